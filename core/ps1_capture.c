@@ -0,0 +1,231 @@
+/*
+ * File:   ps1_capture.c
+ * Author: pyroesp
+ *
+ * Frame parser and queue between the SPI interrupt and the main loop,
+ * see ps1_capture.h
+ */
+
+#include "ps1_capture.h"
+#include "ps1_card.h"
+#include "ps1_stats.h"
+
+/* Transaction length from the ID low byte, in wire order
+ * The low nibble of the ID is the number of half words after 0x5A
+ * (0 means 16, multitap: MTAP_LEN), it ends up reversed in the high nibble
+ * where the capture is MSb first.
+*/
+#define PS1_LEN(n) ((n) ? 3 + 2*(n) : 3 + 2*16)
+#if PS1_BIT_ORDER == PS1_MSB_FIRST
+static const uint8_t ps1_frame_len[16] = {
+    PS1_LEN(0), PS1_LEN(8), PS1_LEN(4), PS1_LEN(12),
+    PS1_LEN(2), PS1_LEN(10), PS1_LEN(6), PS1_LEN(14),
+    PS1_LEN(1), PS1_LEN(9), PS1_LEN(5), PS1_LEN(13),
+    PS1_LEN(3), PS1_LEN(11), PS1_LEN(7), PS1_LEN(15)
+};
+#define PS1_ID_LEN(d) ps1_frame_len[(d) >> 4]
+#else
+#define PS1_ID_LEN(d) PS1_LEN((d) & 0x0F)
+#endif
+
+volatile struct PS1_Capture capture;
+
+/* Empty queue and no card traffic, call before enabling the SPI interrupts */
+void ps1_capture_init(void){
+    uint8_t i;
+    for (i = 0; i < PS1_QUEUE_SIZE; i++){
+        clear_buff((uint8_t*)capture.frame[i].cmd.buff, PS1_CTRL_BUFF_SIZE);
+        clear_buff((uint8_t*)capture.frame[i].data.buff, PS1_CTRL_BUFF_SIZE);
+        capture.frame[i].len = 0;
+        capture.frame[i].pad = 0;
+    }
+    capture.head = 0;
+    capture.tail = 0;
+    capture.cnt = 0;
+    capture.len = 0;
+    capture.ss = 0;
+    capture.port = 0;
+    capture.sel = 0;
+    capture.pad = 0;
+    capture.tap = 0;
+    capture.unsel = 0;
+    capture.stamp = 0;
+    capture.overrun = 0;
+    capture.resync = 0;
+    capture.timing.width = 0;
+    capture.timing.bytes = 0;
+    capture.timing.gap = 0;
+    capture.timing.count = 0;
+    capture.timing.partial = 0;
+    ps1_card_init();
+}
+
+/* ISR: the transaction ends on SS, count it if it's short of what its ID
+ * said. Past the select byte only: an empty port or card slot gives no
+ * /ACK and the PS1 stops there, cnt is 1 or PS1_CNT_CARD. */
+static void ps1_capture_cut(void){
+    if (capture.cnt > 1 && capture.cnt < PS1_CNT_CARD)
+        capture.resync++;
+}
+
+/* ISR: SS falling edge of port (0 or 1), a new transaction starts */
+void ps1_capture_start(uint8_t port, uint16_t stamp){
+    ps1_capture_cut(); // previous transaction ended early
+    capture.cnt = 0;
+    capture.ss = 1;
+    capture.port = port;
+    capture.stamp = stamp;
+}
+
+/* ISR: SS went high, the hardware measured the transaction (HW_TIMING)
+ * width: µs SS was low, bits: CLK edges while it was low
+*/
+void ps1_capture_end(uint16_t width, uint16_t bits){
+    uint16_t busy = bits * PS1_BIT_US;
+
+    ps1_capture_cut(); // shorter than the ID said
+    capture.cnt = PS1_CNT_WAIT; // nothing until the next SS edge
+
+    capture.timing.width = width;
+    capture.timing.bytes = bits >> 3 > 255 ? 255 : bits >> 3;
+    capture.timing.gap = 0;
+    if (capture.timing.bytes && width > busy)
+        capture.timing.gap = (width - busy) / capture.timing.bytes > 255 ?
+            255 : (width - busy) / capture.timing.bytes;
+    if (bits & 7)
+        capture.timing.partial++;
+    capture.timing.count++;
+}
+
+/* ISR: the frame at head is complete, hand it to the main loop */
+static void ps1_capture_queue(void){
+    uint8_t next = (capture.head + 1) & PS1_QUEUE_MASK;
+    if (next == capture.tail)
+        capture.overrun++; // main loop is behind, refill the same frame
+    else{
+        capture.head = next;
+        STAT_INC(frames);
+    }
+}
+
+/* ISR: one byte of CMD (SPI2) and DATA (SPI1), clocked in together */
+void ps1_capture_byte(uint8_t c, uint8_t d){
+    volatile struct PS1_Frame *f;
+    uint8_t i = capture.cnt, k;
+
+    switch(i){
+        case PS1_CNT_WAIT: // rest of a transaction we don't care about
+            return;
+        case PS1_CNT_CARD: // memory card, the tracker counts it through
+            if (!ps1_card_byte(c, d))
+                capture.cnt = capture.ss ? PS1_CNT_WAIT : 0;
+            return;
+        case 0: // select, the device leaves DATA floating high
+            if (capture.ss && capture.unsel != 0xFF)
+                capture.unsel++; // until it turns out to be one
+            if (d != 0xFF)
+                goto reject; // not the start of a transaction
+            switch(c){
+                case W_CMD_SEL_CTRL_1: k = 0; break;
+                case W_CMD_SEL_CTRL_2: k = 1; break;
+                case W_CMD_SEL_CTRL_3: k = 2; break;
+                case W_CMD_SEL_CTRL_4: k = 3; break;
+                case W_CMD_SEL_MEMC_1:
+                case W_CMD_SEL_MEMC_2:
+                case W_CMD_SEL_MEMC_3:
+                case W_CMD_SEL_MEMC_4:
+                    capture.unsel = 0;
+                    ps1_card_start();
+                    capture.cnt = PS1_CNT_CARD;
+                    return;
+                default: goto reject;
+            }
+            capture.unsel = 0;
+            capture.sel = c;
+            capture.pad = capture.port * PS1_SLOTS + k;
+            capture.tap = 0;
+            capture.len = PS1_DECIDE_LEN; // until the ID says otherwise
+            break;
+        case 1: // command, ID low byte
+            switch(c){
+                case W_CMD_READ_SW:
+                    capture.tap = d == (W_ID_MULTITAP & 0xFF);
+                    break;
+                case W_CMD_CONFIG: // DualShock config, same header and length
+                case W_CMD_SET_MODE:
+                case W_CMD_GET_STATUS:
+                case W_CMD_QUERY_ACT:
+                case W_CMD_QUERY_COMB:
+                case W_CMD_QUERY_MODE:
+                case W_CMD_MOTOR_MAP:
+                    break;
+                default:
+                    goto reject;
+            }
+            capture.len = PS1_ID_LEN(d);
+            break;
+        case 2: // ID high byte
+            if (d != REV8(0x5A))
+                goto reject;
+            break;
+    }
+
+    f = &capture.frame[capture.head];
+    if (!capture.tap){
+        if (i < PS1_DECIDE_LEN){
+            f->cmd.buff[i] = c;
+            f->data.buff[i] = d;
+            if (i == PS1_DECIDE_LEN-1){
+                // switches are in, queue the frame, the rest of it isn't needed
+                f->len = PS1_DECIDE_LEN;
+                f->pad = capture.pad;
+                f->stamp = capture.stamp;
+                ps1_capture_queue();
+            }
+        }
+    }else if (i >= 3){
+        // multitap slot k: ID, switches, 4 more bytes
+        k = (i - 3) & (MTAP_SLOT_LEN-1);
+        if (k == 0){
+            f->cmd.buff[0] = capture.sel;
+            f->cmd.buff[1] = W_CMD_READ_SW;
+            f->data.buff[0] = 0xFF;
+            capture.pad = capture.port * PS1_SLOTS + ((i - 3) >> 3);
+        }
+        if (k < PS1_DECIDE_LEN-1){
+            if (k)
+                f->cmd.buff[k+1] = c; // cmd.buff[1] stays the read
+            f->data.buff[k+1] = d;
+            if (k == PS1_DECIDE_LEN-2 && f->data.buff[2] == REV8(0x5A)){
+                // slot switches are in, an empty slot has no 0x5A
+                f->len = PS1_DECIDE_LEN;
+                f->pad = capture.pad;
+                f->stamp = capture.stamp;
+                ps1_capture_queue();
+            }
+        }
+    }
+
+    if (++i >= capture.len)
+        i = capture.ss ? PS1_CNT_WAIT : 0; // transaction done
+    capture.cnt = i;
+    return;
+
+reject:
+    STAT_INC(rejected);
+    capture.cnt = capture.ss ? PS1_CNT_WAIT : 0;
+}
+
+/* Main loop: oldest complete frame, or 0 if there's none */
+struct PS1_Frame *ps1_capture_peek(void){
+    if (capture.tail == capture.head)
+        return 0;
+    return (struct PS1_Frame*)&capture.frame[capture.tail];
+}
+
+/* Main loop: done with the frame from ps1_capture_peek, hand it back
+ * No need to clear it, a frame is only queued once all its bytes are written
+*/
+void ps1_capture_release(void){
+    capture.tail = (capture.tail + 1) & PS1_QUEUE_MASK;
+}
@@ -0,0 +1,104 @@
+/*
+ * File:   ps1_capture.h
+ * Author: pyroesp
+ *
+ * Frame parser and queue between the SPI interrupt and the main loop
+ *
+ * The ISR hands every CMD/DATA byte pair to ps1_capture_byte. The header
+ * is checked as it arrives (0x01 select, 0x42 read or a DualShock config
+ * command, 0xFF then ID then 0x5A from the controller) and anything else
+ * is dropped on the first byte that doesn't fit. Memory card transactions
+ * go to the write tracker instead (ps1_card.h), without a frame. The low
+ * nibble of the ID gives the number of half words that follow, so the
+ * parser knows where the transaction ends instead of waiting for 9 bytes.
+ *
+ * Where the SS falling edge is wired to an interrupt, ps1_capture_start
+ * marks the start of every transaction: the byte index goes back to 0 and
+ * the transaction is timestamped. After a rejected or finished transaction
+ * the parser then ignores the bus until the next edge, so a glitched or
+ * short transaction costs that one transaction only. Without SS edges it
+ * falls back to looking for the next select byte. Transactions that start
+ * on something else are counted in unsel for ps1_guard.h.
+ *
+ * Both ports are captured, ps1_capture_start is told which SEL line
+ * fell. The select byte gives the multitap slot. A multitap in tap mode
+ * (ID 0x5A80) answers for its 4 slots in one 35 byte transaction: the
+ * parser walks the slots from the header and queues one frame per
+ * connected slot, so a frame is always 5 bytes whatever the transaction
+ * length and every pad gets its own combo state (frame.pad).
+ *
+ * Where the chip measures the transaction itself (HW_TIMING in main.c:
+ * CCP1 stamps the SS edge, a timer gated by SS times it, another one
+ * counts CLK edges while it's low), ps1_capture_end gets the numbers when
+ * SS goes high. The transaction ends there and then, whatever the ID
+ * said, and its width, byte count and gap between bytes are kept in
+ * capture.timing, without a cycle spent per byte.
+ *
+ * As soon as the switch bytes have landed the frame is queued: the ISR
+ * moves head on, the main loop decodes frame[tail] and moves tail on.
+ * Each index is written by one side only, so capture never has to be
+ * masked while a frame is being decoded. When the main loop falls behind
+ * the newest frame is dropped and counted in overrun.
+ */
+
+#ifndef PS1_CAPTURE_H
+#define PS1_CAPTURE_H
+
+#include <stdint.h>
+#include "ps1_ctrl.h"
+
+#define PS1_QUEUE_SIZE 8 // frames in the queue, power of 2, a multitap queues 4 at once
+#define PS1_QUEUE_MASK (PS1_QUEUE_SIZE-1)
+
+#define PS1_DECIDE_LEN 5 // 0xFF, ID, switches: all the combo check needs
+#define PS1_CNT_WAIT 0xFF // byte index: ignore the bus until the next SS edge
+#define PS1_CNT_CARD 0xFE // byte index: memory card, see ps1_card_byte
+#define PS1_BIT_US 4 // 250 kHz bus clock, the gap is what's left of the width
+
+/* One poll: what the PS1 sent and what the controller answered */
+struct PS1_Frame{
+    union PS1_Cmd cmd;
+    union PS1_Ctrl_Data data;
+    uint8_t len; // valid bytes in cmd and data
+    uint8_t pad; // port * PS1_SLOTS + multitap slot
+    uint16_t stamp; // timer value at the SS falling edge
+};
+
+/* Last transaction as the hardware measured it, ps1_capture_end */
+struct PS1_Timing{
+    uint16_t width; // µs SS was low
+    uint8_t bytes; // clocked, CLK edges / 8
+    uint8_t gap; // µs between bytes, average
+    uint16_t count; // transactions measured
+    uint16_t partial; // ended in the middle of a byte
+};
+
+struct PS1_Capture{
+    struct PS1_Frame frame[PS1_QUEUE_SIZE];
+    uint8_t head; // frame being filled by the ISR
+    uint8_t tail; // oldest complete frame, owned by the main loop
+    uint8_t cnt; // byte index in the current transaction, 0 = waiting for a select
+    uint8_t len; // length of the current transaction, from the ID
+    uint8_t ss; // 1 once SS edges are seen, transactions end on the next edge
+    uint8_t port; // port of the current transaction, 0 or 1
+    uint8_t sel; // select byte of the current transaction
+    uint8_t pad; // pad of the current transaction or multitap slot
+    uint8_t tap; // current transaction is a multitap, all slots
+    uint8_t unsel; // transactions in a row from an SS edge that didn't start with a select
+    uint16_t stamp; // timer value at the last SS falling edge
+    uint16_t overrun; // frames dropped, queue was full
+    uint16_t resync; // transactions cut short after the ID
+    struct PS1_Timing timing; // HW_TIMING only
+};
+
+extern volatile struct PS1_Capture capture;
+
+/* Function prototype */
+void ps1_capture_init(void);
+void ps1_capture_start(uint8_t port, uint16_t stamp);
+void ps1_capture_end(uint16_t width, uint16_t bits);
+void ps1_capture_byte(uint8_t c, uint8_t d);
+struct PS1_Frame *ps1_capture_peek(void);
+void ps1_capture_release(void);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * File:   ps1_card.c
+ * Author: pyroesp
+ *
+ * Memory card write tracker, see ps1_card.h
+ */
+
+#include "ps1_card.h"
+
+volatile struct PS1_Card card;
+
+/* No card traffic seen, nothing to wait for */
+void ps1_card_init(void){
+    card.cnt = 0;
+    card.cmd = 0;
+    card.idle_ms = CARD_IDLE_MS;
+    card.writes = 0;
+    card.failed = 0;
+}
+
+/* ISR: a card select byte came in, the transaction goes on from byte 1 */
+void ps1_card_start(void){
+    if (card.cmd == W_CMD_MEMC_WRITE)
+        card.failed++; // previous write never got to its end status
+    card.cnt = 1;
+    card.cmd = 0;
+}
+
+/* ISR: next CMD/DATA byte of a card transaction, wire order
+ * Returns 0 once the rest of the transaction can be ignored
+*/
+uint8_t ps1_card_byte(uint8_t c, uint8_t d){
+    uint8_t i = card.cnt++;
+
+    switch(i){
+        case 1: // command
+            card.cmd = c;
+            return c == W_CMD_MEMC_WRITE;
+        case 2: // no card leaves DATA high
+            if (d == REV8(MEMC_ID1))
+                return 1;
+            break;
+        case 3:
+            if (d == REV8(MEMC_ID2)){
+                card.idle_ms = 0; // the card takes the write
+                return 1;
+            }
+            break;
+        case MEMC_WRITE_LEN-1: // end status
+            if (d == REV8(MEMC_GOOD))
+                card.writes++;
+            else
+                card.failed++;
+            card.idle_ms = 0;
+            break;
+        default: // sector number, data, checksum: counted only
+            return 1;
+    }
+    card.cmd = 0;
+    return 0;
+}
+
+/* Timer ISR, every 1 ms
+ * Returns 1 while a save may still be in progress
+*/
+uint8_t ps1_card_tick(void){
+    if (card.idle_ms < CARD_IDLE_MS){
+        card.idle_ms++;
+        return 1;
+    }
+    return 0;
+}
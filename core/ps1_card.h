@@ -0,0 +1,60 @@
+/*
+ * File:   ps1_card.h
+ * Author: pyroesp
+ *
+ * Memory card write tracker, keeps resets away from saves
+ *
+ * Memory card transactions start with 0x81 (0x82 to 0x84 behind a
+ * multitap) where a pad poll starts with 0x01. A sector write is 138
+ * bytes, far more than a frame holds:
+ *   CMD:  81 57 00 00 MSB LSB <128 data bytes> CHK 00 00 00
+ *   DATA: FF 08 5A 5D 00 00 ... 5C 5D <end status>
+ * Nothing of it is buffered. The capture hands every byte of a card
+ * transaction to ps1_card_byte, which counts it and looks at the few
+ * that matter: the command, the card ID and the end status (0x47 'G'
+ * good, 0x4E bad checksum, 0xFF bad sector). Reads and the ID command are
+ * dropped on the command byte, pad polls never come through here.
+ *
+ * A write the card answered restarts the idle count, the 1 ms tick counts
+ * it back up (ps1_card_tick). Until it reaches CARD_IDLE_MS a save may be
+ * going on, the sectors of a save are written a frame or so apart, and
+ * ps1_reset_tick holds a requested reset back.
+ */
+
+#ifndef PS1_CARD_H
+#define PS1_CARD_H
+
+#include <stdint.h>
+#include "ps1_ctrl.h"
+
+/* Memory card commands, second byte */
+#define CMD_MEMC_READ 0x52 // 'R' read sector
+#define CMD_MEMC_WRITE 0x57 // 'W' write sector
+#define CMD_MEMC_ID 0x53 // 'S' get card ID
+
+#define MEMC_ID1 0x5A // card ID, bytes 2 and 3 of every command
+#define MEMC_ID2 0x5D
+#define MEMC_WRITE_LEN 138 // 6 + 128 data + checksum + 3
+#define MEMC_GOOD 0x47 // 'G' end status, sector written
+
+#define CARD_IDLE_MS 1500 // no write for this long, the save is done
+
+#define W_CMD_MEMC_WRITE REV8(CMD_MEMC_WRITE)
+
+struct PS1_Card{
+    uint8_t cnt; // byte index in the current card transaction
+    uint8_t cmd; // command of the current transaction, wire order
+    uint16_t idle_ms; // since the last write, saturates at CARD_IDLE_MS
+    uint16_t writes; // sectors the card reported written
+    uint16_t failed; // writes with a bad end status or cut short
+};
+
+extern volatile struct PS1_Card card;
+
+/* Function prototype */
+void ps1_card_init(void);
+void ps1_card_start(void);
+uint8_t ps1_card_byte(uint8_t c, uint8_t d);
+uint8_t ps1_card_tick(void);
+
+#endif
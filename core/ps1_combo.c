@@ -0,0 +1,223 @@
+/*
+ * File:   ps1_combo.c
+ * Author: pyroesp
+ *
+ * Combo table, see ps1_combo.h
+ */
+
+#include "ps1_combo.h"
+
+struct PS1_Combo_Table combos;
+volatile uint16_t combo_ms; // ms, wraps
+
+/* Built-in combos, used when the EEPROM holds no valid table */
+static const struct PS1_Combo_Def combo_default[] = {
+    {COMBO_CLASS_PAD, (uint16_t)~KEY_COMBO_CTRL, PS1_ACT_SHORT, 0},
+    {COMBO_CLASS_PAD, (uint16_t)~KEY_COMBO_XSTATION, PS1_ACT_LONG, 0},
+    {COMBO_CLASS_GUNCON, (uint16_t)~KEY_COMBO_GUNCON, PS1_ACT_LONG, 0},
+};
+#define COMBO_DEFAULT_COUNT (sizeof(combo_default) / sizeof(combo_default[0]))
+
+static void combo_clear(void){
+    uint8_t b;
+    for (b = 0; b < COMBO_BUCKETS; b++)
+        combos.bucket[b][0] = combos.bucket[b][1] = 0;
+}
+
+/* Bucket of a class and wire order switches
+ * Adds, xors and shifts only, the carry of the add makes the seed matter
+*/
+uint8_t ps1_combo_hash(uint8_t cls, uint16_t sw, uint8_t seed){
+    uint8_t h = (uint8_t)(sw & 0xFF) + seed;
+    h ^= (uint8_t)(sw >> 8) ^ cls;
+    h += seed >> 3;
+    h ^= h >> 5;
+    return h & COMBO_BUCKET_MASK;
+}
+
+/* Fill the table from n combos, trying seeds from seed on until no
+ * bucket gets more than COMBO_WAYS combos
+ * Returns 1 on success, 0 if no seed works (table left empty)
+*/
+uint8_t ps1_combo_compile(const struct PS1_Combo_Def *def, uint8_t n, uint8_t seed){
+    uint8_t i, b, w, tries = 0;
+    struct PS1_Combo *c;
+
+    if (n > COMBO_MAX)
+        n = COMBO_MAX;
+    for (i = 0; i < n; i++){
+        c = &combos.combo[i];
+        c->sw = REV16((uint16_t)~def[i].keys);
+        c->cls = def[i].cls;
+        c->action = def[i].action;
+        c->hold = def[i].hold;
+    }
+    do{
+        combo_clear();
+        for (i = 0; i < n; i++){
+            c = &combos.combo[i];
+            b = ps1_combo_hash(c->cls, c->sw, seed);
+            for (w = 0; w < COMBO_WAYS && combos.bucket[b][w]; w++);
+            if (w == COMBO_WAYS)
+                break; // full, next seed
+            combos.bucket[b][w] = i + 1;
+        }
+        if (i == n){
+            combos.count = n;
+            combos.seed = seed;
+            return 1;
+        }
+        seed++;
+    }while (++tries != 0);
+    combo_clear();
+    combos.count = 0;
+    return 0;
+}
+
+/* Read and compile the EEPROM table, read(addr) returns one byte
+ * Falls back to the built-in combos if read is 0 or the image is bad
+ * Returns COMBO_SRC_x
+*/
+uint8_t ps1_combo_load(uint8_t (*read)(uint8_t addr)){
+    struct PS1_Combo_Def def[COMBO_MAX];
+    uint8_t i, n, seed, sum, a, v;
+
+    if (read && read(0) == 'P' && read(1) == 'C' && read(2) == COMBO_VERSION
+            && (n = read(3)) != 0 && n <= COMBO_MAX){
+        seed = read(4);
+        sum = 'P' + 'C' + COMBO_VERSION + n + seed;
+        for (i = 0, a = COMBO_HDR; i < n; i++){
+            def[i].cls = v = read(a++);
+            sum += v;
+            def[i].keys = v = read(a++);
+            sum += v;
+            v = read(a++);
+            def[i].keys |= (uint16_t)v << 8;
+            sum += v;
+            def[i].action = v = read(a++);
+            sum += v;
+            def[i].hold = v = read(a++);
+            sum += v;
+        }
+        sum += read(a);
+        if (sum == 0 && ps1_combo_compile(def, n, seed)){
+            combos.source = COMBO_SRC_EEPROM;
+            return COMBO_SRC_EEPROM;
+        }
+    }
+    ps1_combo_compile(combo_default, COMBO_DEFAULT_COUNT, 0);
+    combos.source = COMBO_SRC_DEFAULT;
+    return COMBO_SRC_DEFAULT;
+}
+
+/* Host side: compile n combos and write the EEPROM image to img
+ * Returns the image length, 0 if the combos can't be compiled
+*/
+uint8_t ps1_combo_image(uint8_t *img, const struct PS1_Combo_Def *def, uint8_t n){
+    uint8_t i, a = 0, sum = 0;
+
+    if (n == 0 || n > COMBO_MAX || !ps1_combo_compile(def, n, 0))
+        return 0;
+    img[a++] = 'P';
+    img[a++] = 'C';
+    img[a++] = COMBO_VERSION;
+    img[a++] = n;
+    img[a++] = combos.seed;
+    for (i = 0; i < n; i++){
+        img[a++] = def[i].cls;
+        img[a++] = def[i].keys & 0xFF;
+        img[a++] = def[i].keys >> 8;
+        img[a++] = def[i].action;
+        img[a++] = def[i].hold;
+    }
+    for (i = 0; i < a; i++)
+        sum += img[i];
+    img[a] = -sum;
+    return a + 1;
+}
+
+/* Combo for a class and wire order switches, 0 if there's none */
+const struct PS1_Combo *ps1_combo_find(uint8_t cls, uint16_t sw){
+    const uint8_t *b = combos.bucket[ps1_combo_hash(cls, sw, combos.seed)];
+    const struct PS1_Combo *c;
+
+    // COMBO_WAYS is 2, unrolled
+    if (!b[0])
+        return 0;
+    c = &combos.combo[b[0]-1];
+    if (c->sw == sw && c->cls == cls)
+        return c;
+    if (!b[1])
+        return 0;
+    c = &combos.combo[b[1]-1];
+    if (c->sw == sw && c->cls == cls)
+        return c;
+    return 0;
+}
+
+/* Hold time a combo needs, COMBO_HOLD_UNIT_MS units */
+static uint8_t combo_need(const struct PS1_Combo *c){
+    if (c->hold)
+        return c->hold;
+    return c->action == PS1_ACT_LONG ? COMBO_HOLD_LONG : COMBO_HOLD_SHORT;
+}
+
+/* combo_ms, read again if the tick changed it halfway */
+static uint16_t combo_now(void){
+    uint16_t ms;
+    do
+        ms = combo_ms;
+    while (ms != combo_ms);
+    return ms;
+}
+
+/* One frame on a port, c is its combo (0 if none)
+ * Returns the combo action while it's held long enough, PS1_ACT_NONE
+ * otherwise
+*/
+uint8_t ps1_combo_hold(struct PS1_Port *port, const struct PS1_Combo *c, uint16_t stamp){
+    uint16_t dt = stamp - port->stamp;
+    uint16_t ms = combo_now();
+
+    // dt wraps at 65 ms, the ms count doesn't
+    if (c && c == port->combo && dt <= COMBO_HOLD_GAP_US &&
+            (uint16_t)(ms - port->ms) < COMBO_HOLD_WRAP_MS){
+        // still held
+        port->stamp = stamp;
+        port->ms = ms;
+        port->miss = 0;
+        if (port->polls < 255)
+            port->polls++;
+        port->us += dt; // dt <= COMBO_HOLD_GAP_US, no overflow
+        while (port->us >= COMBO_HOLD_UNIT_MS * 1000u){
+            port->us -= COMBO_HOLD_UNIT_MS * 1000u;
+            if (port->held < 255)
+                port->held++;
+        }
+    }else if (c != port->combo && port->combo && port->polls >= 2 && port->miss < COMBO_HOLD_MISS){
+        // one odd frame is forgiven once the combo came twice in a row,
+        // isolated corrupt frames can't chain up that way
+        port->miss++;
+        return PS1_ACT_NONE;
+    }else{
+        // other combo, released, or the bus stopped: start over
+        port->combo = c;
+        port->stamp = stamp;
+        port->ms = ms;
+        port->us = 0;
+        port->held = 0;
+        port->polls = 1;
+        port->miss = 0;
+        if (!c)
+            return PS1_ACT_NONE;
+    }
+
+    if (port->polls < COMBO_HOLD_POLLS || port->held < combo_need(c))
+        return PS1_ACT_NONE;
+    return c->action;
+}
+
+/* Timer ISR, every 1 ms, from ps1_reset_tick */
+void ps1_combo_tick(void){
+    combo_ms++;
+}
@@ -0,0 +1,103 @@
+/*
+ * File:   ps1_combo.h
+ * Author: pyroesp
+ *
+ * Combo table
+ *
+ * The combos live in data EEPROM, so they can be changed without
+ * reflashing the program (host/combo_build.c writes the image). At power
+ * up the table is read, checked and compiled into a small hash: the
+ * controller class and switches of a frame pick one bucket, which holds
+ * at most COMBO_WAYS combos, so a frame costs at most two compares however
+ * many combos there are. The seed that keeps every bucket within
+ * COMBO_WAYS is found by the build tool and stored with the table. A
+ * blank or broken EEPROM falls back to the built-in combos (KEY_COMBO_x).
+ *
+ * A combo only counts once it has been held: ps1_combo_hold keeps the
+ * combo, its hold time (from the frame stamps) and the number of polls
+ * per port, one frame at a time. It needs COMBO_HOLD_POLLS frames and the
+ * combo's hold time (COMBO_HOLD_SHORT / COMBO_HOLD_LONG when the table
+ * says 0), so a corrupted frame or a brushed button doesn't reset. One
+ * odd frame in the middle of a hold is forgiven (COMBO_HOLD_MISS) once the
+ * combo came in two frames in a row, a gap in the polling longer than
+ * COMBO_HOLD_GAP_US starts it over. The frame stamps wrap at 65 ms, so
+ * longer gaps are told by combo_ms, counted by the 1 ms tick
+ * (ps1_combo_tick, from ps1_reset_tick).
+ *
+ * EEPROM image:
+ *   'P' 'C' COMBO_VERSION count seed
+ *   count x {class, keys lo, keys hi, action, hold}
+ *   check: all bytes of the image add up to 0
+ * keys: buttons held down (1 = pressed, PS1 bit order, see Keys), every
+ * other button has to be released. hold: 10 ms units, 0 = default.
+ */
+
+#ifndef PS1_COMBO_H
+#define PS1_COMBO_H
+
+#include <stdint.h>
+#include "ps1_ctrl.h"
+
+#define COMBO_MAX 16 // combos in the table
+#define COMBO_BUCKETS 16 // power of 2
+#define COMBO_WAYS 2 // combos per bucket
+#define COMBO_BUCKET_MASK (COMBO_BUCKETS-1)
+
+#define COMBO_VERSION 1
+#define COMBO_HDR 5 // 'P' 'C' version count seed
+#define COMBO_ENTRY 5 // class keys_lo keys_hi action hold
+#define COMBO_IMAGE_MAX (COMBO_HDR + COMBO_ENTRY*COMBO_MAX + 1)
+
+/* Controller classes, which IDs a combo applies to */
+#define COMBO_CLASS_PAD 1 // digital, analog pad/stick, DualShock 2
+#define COMBO_CLASS_GUNCON 2 // light gun
+
+/* Where the table came from */
+#define COMBO_SRC_DEFAULT 0 // built-in combos
+#define COMBO_SRC_EEPROM 1
+
+#define COMBO_HOLD_UNIT_MS 10 // hold is counted in 10 ms
+#define COMBO_HOLD_SHORT 5 // default hold of a short reset combo, 50 ms
+#define COMBO_HOLD_LONG 5 // default hold of a long reset combo, 50 ms
+#define COMBO_HOLD_POLLS 3 // frames with the combo, at least
+#define COMBO_HOLD_MISS 1 // frames without it forgiven in a row
+#define COMBO_HOLD_GAP_US 50000u // no poll for longer, start over
+#define COMBO_HOLD_WRAP_MS 60 // stamps wrap at 65 ms, combo_ms this far apart is a gap
+
+/* One combo, as written in the image */
+struct PS1_Combo_Def{
+    uint8_t cls; // COMBO_CLASS_x
+    uint16_t keys; // buttons pressed, PS1 bit order
+    uint8_t action; // PS1_ACT_SHORT or PS1_ACT_LONG
+    uint8_t hold; // COMBO_HOLD_UNIT_MS units
+};
+
+/* One combo, compiled */
+struct PS1_Combo{
+    uint16_t sw; // switches as they arrive on the wire
+    uint8_t cls;
+    uint8_t action;
+    uint8_t hold;
+};
+
+struct PS1_Combo_Table{
+    struct PS1_Combo combo[COMBO_MAX];
+    uint8_t bucket[COMBO_BUCKETS][COMBO_WAYS]; // combo index + 1, 0 = empty
+    uint8_t count;
+    uint8_t seed;
+    uint8_t source; // COMBO_SRC_x
+};
+
+extern struct PS1_Combo_Table combos;
+extern volatile uint16_t combo_ms;
+
+/* Function prototype */
+uint8_t ps1_combo_hash(uint8_t cls, uint16_t sw, uint8_t seed);
+uint8_t ps1_combo_compile(const struct PS1_Combo_Def *def, uint8_t n, uint8_t seed);
+uint8_t ps1_combo_load(uint8_t (*read)(uint8_t addr));
+uint8_t ps1_combo_image(uint8_t *img, const struct PS1_Combo_Def *def, uint8_t n);
+const struct PS1_Combo *ps1_combo_find(uint8_t cls, uint16_t sw);
+uint8_t ps1_combo_hold(struct PS1_Port *port, const struct PS1_Combo *c, uint16_t stamp);
+void ps1_combo_tick(void);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * File:   ps1_ctrl.c
+ * Author: pyroesp
+ *
+ * PlayStation 1 controller protocol core, see ps1_ctrl.h
+ */
+
+#include "ps1_ctrl.h"
+#include "ps1_combo.h"
+#include "ps1_stats.h"
+
+/* Reverse byte order 
+ * The playstation send data LSb first,
+ * but the PIC uses a shift left register
+ * so the LSb from the PS1 becomes the MSb of the PIC
+ * Only used for debug output, frames are decoded in wire order
+ * LSb first captures (ps1_target.h) are already in PS1 order
+*/
+void reverse_byte(uint8_t *b) {
+#if PS1_BIT_ORDER == PS1_MSB_FIRST
+   *b = (*b & 0xF0) >> 4 | (*b & 0x0F) << 4;
+   *b = (*b & 0xCC) >> 2 | (*b & 0x33) << 2;
+   *b = (*b & 0xAA) >> 1 | (*b & 0x55) << 1;
+#else
+   (void)b;
+#endif
+}
+
+/* Clear buffer of size s, aka fill with zero */
+void clear_buff(uint8_t *p, uint8_t s){
+    uint8_t i;
+    for (i = 0; i < s; i++)
+        p[i] = 0;
+}
+
+/* Nothing held on the port */
+void ps1_port_init(struct PS1_Port *port){
+    port->combo = 0;
+    port->stamp = 0;
+    port->ms = 0;
+    port->us = 0;
+    port->held = 0;
+    port->polls = 0;
+    port->miss = 0;
+    port->mode = 0;
+    port->seen = 0;
+    port->period = 0;
+}
+
+/* Poll rate of the pad, from the SS edge of every frame
+ * Gaps over 65 ms (loading screens) wrap, the average rides them out
+*/
+static void ps1_poll_rate(struct PS1_Port *port, uint16_t stamp){
+    uint16_t d = stamp - port->seen;
+    if (port->period)
+        port->period += (int16_t)(d - port->period) / 8;
+    else if (port->seen)
+        port->period = d; // second frame
+    port->seen = stamp;
+}
+
+/* Config frame of a DualShock, in wire order: follow the mode
+ * Returns 1 if the frame answers like a read and carries switches
+*/
+static uint8_t ps1_config(struct PS1_Port *port, const union PS1_Cmd *cmd,
+        const union PS1_Ctrl_Data *data){
+    if (data->id != W_ID_CONFIG)
+        return cmd->command == W_CMD_CONFIG; // not in config mode yet
+    port->mode |= PS1_MODE_CONFIG;
+    switch(cmd->command){
+        case W_CMD_CONFIG:
+            if (cmd->buff[3] == 0x00)
+                port->mode &= ~PS1_MODE_CONFIG; // exit, next answer has the new ID
+            break;
+        case W_CMD_SET_MODE:
+            port->mode &= ~(PS1_MODE_ANALOG | PS1_MODE_LOCK);
+            if (cmd->buff[3] == REV8(0x01))
+                port->mode |= PS1_MODE_ANALOG;
+            if (cmd->buff[4] == REV8(0x03))
+                port->mode |= PS1_MODE_LOCK;
+            break;
+    }
+    return 0;
+}
+
+/* Check a complete frame, in wire order, for a key combo
+ * The ID gives the controller class, the combo table does the rest, the
+ * state of the pad decides whether the combo has been held long enough.
+ * Config frames only update the pad mode, the hold goes on past them.
+ * stamp: SS falling edge of the frame, 1 MHz
+ * Returns the reset to do: PS1_ACT_NONE, PS1_ACT_SHORT or PS1_ACT_LONG
+*/
+uint8_t ps1_decode(struct PS1_Port *port, const union PS1_Cmd *cmd,
+        const union PS1_Ctrl_Data *data, uint16_t stamp){
+    const struct PS1_Combo *c = 0;
+    uint8_t cls = 0;
+
+    // Check first command for device selected, any multitap slot
+    switch(cmd->device_select){
+        case W_CMD_SEL_CTRL_1:
+        case W_CMD_SEL_CTRL_2:
+        case W_CMD_SEL_CTRL_3:
+        case W_CMD_SEL_CTRL_4:
+            break;
+        default:
+            return ps1_combo_hold(port, 0, stamp);
+    }
+    ps1_poll_rate(port, stamp);
+    if (cmd->command != W_CMD_READ_SW && !ps1_config(port, cmd, data))
+        return PS1_ACT_NONE; // no switches in it
+    // Check ID
+    switch(data->id){
+        case W_ID_GUNCON_CTRL:
+            cls = COMBO_CLASS_GUNCON;
+            break;
+        case W_ID_DIG_CTRL:
+            port->mode &= ~(PS1_MODE_ANALOG | PS1_MODE_CONFIG);
+            cls = COMBO_CLASS_PAD;
+            break;
+        case W_ID_ANS_CTRL:
+        case W_ID_ANP_CTRL:
+        case W_ID_DS2_CTRL:
+            port->mode = (port->mode | PS1_MODE_ANALOG) & ~PS1_MODE_CONFIG;
+            cls = COMBO_CLASS_PAD;
+            break;
+        case W_ID_CONFIG:
+            port->mode |= PS1_MODE_CONFIG;
+            return PS1_ACT_NONE; // read in config mode, no switches
+        default:
+            STAT_INC(unknown_id);
+            break;
+    }
+
+    // Check switch combo
+    if (cls){
+        c = ps1_combo_find(cls, data->switches);
+        if (c)
+            STAT_INC(combos);
+    }
+    return ps1_combo_hold(port, c, stamp);
+}
@@ -0,0 +1,217 @@
+/*
+ * File:   ps1_ctrl.h
+ * Author: pyroesp
+ *
+ * PlayStation 1 controller protocol core
+ *
+ * Everything the reset mod needs to know about the controller bus that
+ * doesn't touch a register: IDs, commands, key combos, the frame layout
+ * and the combo decision. Builds with XC8 for the PIC and with gcc for
+ * the host tools in ../host.
+ */
+
+#ifndef PS1_CTRL_H
+#define PS1_CTRL_H
+
+#include <stdint.h>
+#include "ps1_target.h"
+
+/* Controller ID */
+#define ID_DIG_CTRL 0x5A41 // digital: SCPH-1080 (EU)
+#define ID_ANP_CTRL 0x5A73 // analog/pad: SCPH-110 (EU)
+#define ID_ANS_CTRL 0x5A53 // analog/stick: SCPH-110 (EU)
+#define ID_DS2_CTRL 0x5A79 // dualshock 2
+#define ID_GUNCON_CTRL 0x5A63 // light gun: NPC-103 (EU)
+#define ID_MULTITAP 0x5A80 // multitap in tap mode: 4 slots follow
+#define ID_CONFIG 0x5AF3 // DualShock in config mode
+
+/* PlayStation Commands
+ * Both ports share CMD, DATA and CLK, the port is picked by its own SEL
+ * line. The select byte addresses the multitap slot: 0x01 is slot A (or
+ * the pad when there's no multitap), 0x02 to 0x04 slots B to D.
+*/
+#define CMD_SEL_CTRL_1 0x01 // select controller 1 / multitap slot A
+#define CMD_SEL_CTRL_4 0x04 // multitap slot D
+#define CMD_SEL_MEMC_1 0x81 // select memory card 1 / multitap slot A
+#define CMD_SEL_MEMC_4 0x84 // memory card in multitap slot D
+#define CMD_READ_SW 0x42 // read switch status from controller
+#define CMD_TAP 0x01 // third byte of a read: ask the multitap for all slots
+
+/* DualShock config commands
+ * 0x43 byte 3 = 0x01 enters config mode, the pad answers 0x5AF3 to
+ * everything until a 0x43 with byte 3 = 0x00. Out of config mode 0x43
+ * answers with the switches like a read. The others only work in config
+ * mode and never carry switches.
+*/
+#define CMD_CONFIG 0x43 // enter/exit config mode, or a read
+#define CMD_SET_MODE 0x44 // byte 3: 0x01 analog, 0x00 digital, byte 4: 0x03 locks it
+#define CMD_GET_STATUS 0x45 // analog LED in data byte 5
+#define CMD_QUERY_ACT 0x46 // actuator info
+#define CMD_QUERY_COMB 0x47
+#define CMD_QUERY_MODE 0x4C
+#define CMD_MOTOR_MAP 0x4D // rumble motor mapping
+
+/* DualShock mode of a pad, PS1_Port.mode */
+#define PS1_MODE_ANALOG 0x01 // analog ID seen or set by 0x44
+#define PS1_MODE_CONFIG 0x02 // answering 0x5AF3
+#define PS1_MODE_LOCK 0x04 // analog button locked by 0x44
+
+/* Pads
+ * A multitap on each port: 2 ports x 4 slots, pad = port * 4 + slot
+*/
+#define PS1_PORTS 2
+#define PS1_SLOTS 4 // multitap slots
+#define PS1_PADS (PS1_PORTS * PS1_SLOTS)
+#define MTAP_SLOT_LEN 8 // ID, switches and 4 analog bytes per slot
+#define MTAP_LEN (3 + PS1_SLOTS * MTAP_SLOT_LEN) // 0xFF 0x80 0x5A, slots
+
+/* PlayStation Communication Buff Size */
+#define PS1_CTRL_BUFF_SIZE 9 // max size of buffer needed for a controller
+
+/* Key Combo */
+#define KEY_COMBO_CTRL 0xFCF6       // select-start-L2-R2   1111 1100 1111 0110
+#define KEY_COMBO_GUNCON 0x9FF7     // A-trigger-B          1001 1111 1111 0111
+#define KEY_COMBO_XSTATION 0xBCFE   // select-cross-L2-R2   1011 1100 1111 1110
+
+/*
+Keys : 
+    SELECT, // 0
+    L3,
+    R3,
+    START, // light gun A
+    UP,
+    RIGHT,
+    DOWN,
+    LEFT,
+    L2,
+    R2,
+    L1,
+    R1,
+    TRIANGLE,
+    CIRCLE, // light gun trigger
+    CROSS, // light gun B
+    SQUARE
+*/
+
+/* Wire order
+ * The PS1 sends LSb first and the MSSP shifts MSb first, so every byte
+ * lands bit reversed in SSPxBUF. Rather than reversing 18 bytes per poll,
+ * the constants are reversed here, at compile time, and frames are
+ * matched as received. reverse_byte is only needed to print a frame.
+ * Where the capture is LSb first (ps1_target.h) wire order is PS1 order
+ * and both do nothing.
+*/
+#if PS1_BIT_ORDER == PS1_MSB_FIRST
+#define REV8(b) ((uint8_t)( \
+    (((b) & 0x01) << 7) | (((b) & 0x02) << 5) | (((b) & 0x04) << 3) | (((b) & 0x08) << 1) | \
+    (((b) & 0x10) >> 1) | (((b) & 0x20) >> 3) | (((b) & 0x40) >> 5) | (((b) & 0x80) >> 7)))
+#else
+#define REV8(b) ((uint8_t)(b))
+#endif
+#define REV16(w) ((uint16_t)(REV8(((w) >> 8) & 0xFF) << 8 | REV8((w) & 0xFF))) // each byte on its own
+
+#define W_ID_DIG_CTRL REV16(ID_DIG_CTRL)
+#define W_ID_ANP_CTRL REV16(ID_ANP_CTRL)
+#define W_ID_ANS_CTRL REV16(ID_ANS_CTRL)
+#define W_ID_DS2_CTRL REV16(ID_DS2_CTRL)
+#define W_ID_GUNCON_CTRL REV16(ID_GUNCON_CTRL)
+#define W_ID_MULTITAP REV16(ID_MULTITAP)
+#define W_ID_CONFIG REV16(ID_CONFIG)
+
+#define W_CMD_SEL_CTRL_1 REV8(CMD_SEL_CTRL_1)
+#define W_CMD_SEL_CTRL_2 REV8(0x02)
+#define W_CMD_SEL_CTRL_3 REV8(0x03)
+#define W_CMD_SEL_CTRL_4 REV8(CMD_SEL_CTRL_4)
+#define W_CMD_SEL_MEMC_1 REV8(CMD_SEL_MEMC_1)
+#define W_CMD_SEL_MEMC_2 REV8(0x82)
+#define W_CMD_SEL_MEMC_3 REV8(0x83)
+#define W_CMD_SEL_MEMC_4 REV8(CMD_SEL_MEMC_4)
+#define W_CMD_READ_SW REV8(CMD_READ_SW)
+#define W_CMD_CONFIG REV8(CMD_CONFIG)
+#define W_CMD_SET_MODE REV8(CMD_SET_MODE)
+#define W_CMD_GET_STATUS REV8(CMD_GET_STATUS)
+#define W_CMD_QUERY_ACT REV8(CMD_QUERY_ACT)
+#define W_CMD_QUERY_COMB REV8(CMD_QUERY_COMB)
+#define W_CMD_QUERY_MODE REV8(CMD_QUERY_MODE)
+#define W_CMD_MOTOR_MAP REV8(CMD_MOTOR_MAP)
+
+#define W_KEY_COMBO_CTRL REV16(KEY_COMBO_CTRL)
+#define W_KEY_COMBO_GUNCON REV16(KEY_COMBO_GUNCON)
+#define W_KEY_COMBO_XSTATION REV16(KEY_COMBO_XSTATION)
+
+/* Reset action decided for a frame */
+#define PS1_ACT_NONE 0 // nothing to do
+#define PS1_ACT_SHORT 1 // short reset pulse (SHORT_DELAY)
+#define PS1_ACT_LONG 2 // long reset pulse (LONG_DELAY), xStation and GUNCON
+
+/* XC8 and avr-gcc never pad, gcc would put id on an even address */
+#if defined(__XC8)
+#define PS1_PACKED
+#else
+#define PS1_PACKED __attribute__((packed))
+#endif
+
+/* PlayStation Controller Command Union */
+union PS1_Cmd{
+    uint8_t buff[PS1_CTRL_BUFF_SIZE];
+    struct{
+        uint8_t device_select; // 0x01 or 0x81
+        uint8_t command; // 0x42 for read switch, 0x43 to 0x4D config
+        uint8_t arg[PS1_CTRL_BUFF_SIZE-2]; // 0 for a read, config arguments
+    };
+};
+
+/* PlayStation Controller Data Union */
+union PS1_Ctrl_Data{
+    uint8_t buff[PS1_CTRL_BUFF_SIZE]; // buffer to read data
+    struct PS1_PACKED{
+        uint8_t unused; // always 0xFF
+        uint16_t id; // 0x5Ayz - y = type; z = # of half word
+        uint16_t switches; // controller switches
+        union{
+            // light gun only (8MHz clock counter since hsync)
+            uint16_t x_pos; // if 0x0001 then error, check y_pos
+            struct{
+                uint8_t adc0; // right joy X
+                uint8_t adc1; // right joy Y
+            };
+        };
+        union{
+            //light gun only (scanlines since vsync)
+            uint16_t y_pos; // if x_pos = 0x0001 && y_pos = 0x000A => not aimed at screen
+            struct{
+                uint8_t adc2; // left joy X
+                uint8_t adc3; // left joy Y
+            };
+        };
+    };
+};
+
+struct PS1_Combo;
+
+/* Rolling state of one pad (port and multitap slot)
+ * A combo has to be held for a while before it counts, see ps1_combo_hold.
+ * Config frames leave the hold alone, so a game switching a DualShock to
+ * analog in the middle of a combo doesn't start it over.
+*/
+struct PS1_Port{
+    const struct PS1_Combo *combo; // combo being held, 0 = none
+    uint16_t stamp; // last frame with it, 1 MHz
+    uint16_t ms; // combo_ms of the last frame with it
+    uint16_t us; // held time not yet in held
+    uint8_t held; // held time, COMBO_HOLD_UNIT_MS units, saturates
+    uint8_t polls; // frames with it, saturates
+    uint8_t miss; // frames in a row without it
+    uint8_t mode; // DualShock mode, PS1_MODE_x
+    uint16_t seen; // SS edge of the last frame, 1 MHz
+    uint16_t period; // µs between polls, averaged over ~8, 0 = not known yet
+};
+
+/* Function prototype */
+void reverse_byte(uint8_t *b);
+void clear_buff(uint8_t *p, uint8_t s);
+void ps1_port_init(struct PS1_Port *port);
+uint8_t ps1_decode(struct PS1_Port *port, const union PS1_Cmd *cmd,
+    const union PS1_Ctrl_Data *data, uint16_t stamp);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * File:   ps1_guard.c
+ * Author: pyroesp
+ *
+ * Capture supervision, see ps1_guard.h
+ */
+
+#include "ps1_guard.h"
+#include "ps1_capture.h"
+
+volatile struct PS1_Guard guard;
+
+/* Nothing seen yet, call with ps1_capture_init */
+void ps1_guard_init(void){
+    clear_buff((uint8_t*)&guard, sizeof(guard));
+}
+
+/* ISR: SPI1 byte interrupt, fault: GUARD_x flags of the MSSPs
+ * Returns 1 if the byte pair can go to ps1_capture_byte
+*/
+uint8_t ps1_guard_spi(uint8_t fault){
+    guard.rx = 1;
+    guard.edges = 0;
+    if (!fault)
+        return 1;
+    if (fault & GUARD_SSPOV)
+        guard.sspov++;
+    if (fault & GUARD_WCOL)
+        guard.wcol++;
+    if (fault & GUARD_PAIR)
+        guard.pair++;
+    guard.restart = 1;
+    return 0;
+}
+
+/* ISR: SS falling edge, before ps1_capture_start sees it */
+void ps1_guard_edge(void){
+    if (++guard.edges > GUARD_SILENT_MAX){
+        // that many edges and no byte in between
+        guard.silent++;
+        guard.restart = 1;
+    }
+    if (capture.unsel >= GUARD_SELECT_MAX){
+        guard.select++;
+        guard.restart = 1;
+    }
+}
+
+/* ISR: 1 ms tick, ss_low: the SS of the MSSPs is low */
+void ps1_guard_tick(uint8_t ss_low){
+    if (!ss_low)
+        guard.low_ms = 0;
+    else if (guard.low_ms < GUARD_SS_MS && ++guard.low_ms == GUARD_SS_MS){
+        guard.stuck++;
+        capture.ss = 0; // look for select bytes, the next SS edge turns it back
+        guard.quiet = 1;
+    }
+    if (guard.quiet && !guard.rx){
+        guard.quiet = 0;
+        guard.restart = 1;
+    }
+    guard.rx = 0;
+}
+
+/* ISR: the MSSPs were restarted for guard.restart, drop the transaction */
+void ps1_guard_restart(void){
+    guard.restart = 0;
+    guard.restarts++;
+    guard.edges = 0;
+    if (guard.failed < 0xFF)
+        guard.failed++;
+    capture.unsel = 0;
+    capture.cnt = capture.ss ? PS1_CNT_WAIT : 0;
+}
+
+/* Main loop: a frame was decoded, the capture works */
+void ps1_guard_frame(void){
+    guard.failed = 0;
+}
+
+/* Main loop: 0 once restarting hasn't helped, stop clearing the watchdog */
+uint8_t ps1_guard_alive(void){
+    return guard.failed < GUARD_FAIL_MAX;
+}
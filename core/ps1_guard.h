@@ -0,0 +1,76 @@
+/*
+ * File:   ps1_guard.h
+ * Author: pyroesp
+ *
+ * Capture supervision: notices when the MSSP pair stops handing over a
+ * usable byte stream and has it restarted, the watchdog is the last resort
+ *
+ * What wedges the capture and how it shows:
+ *   SSPOV   a byte came in before the last one was read (BOEN = 0, the
+ *           overflow is flagged instead of silently overwriting)
+ *   WCOL    SSPxBUF written while a byte was shifting in
+ *   pair    SPI1 has a byte and SPI2 doesn't: they share SS and SCK, so
+ *           they only get out of step when one of them lost clocks
+ *   select  GUARD_SELECT_MAX transactions in a row that didn't start with
+ *           a select byte: the bytes are some bits off
+ *   silent  GUARD_SILENT_MAX SS edges in a row without a byte in between:
+ *           the MSSPs stopped receiving
+ *   stuck   SS low for GUARD_SS_MS: no edges any more, the capture looks
+ *           for select bytes instead (capture.ss = 0) until one comes back
+ * The ISR reports the first three with every byte (ps1_guard_spi), the
+ * others are checked on SS edges (ps1_guard_edge) and on the tick
+ * (ps1_guard_tick). Either way guard.restart is set and at the end of the
+ * ISR both MSSPs are restarted (SSPEN off and on, a few µs) and
+ * ps1_guard_restart drops the transaction, the next SS edge starts clean.
+ * With SS stuck the restart waits for a tick without bytes, so the bit
+ * count starts between transactions.
+ *
+ * Every fault and restart is counted. ps1_guard_frame clears
+ * guard.failed for every good frame, after GUARD_FAIL_MAX restarts with
+ * none ps1_guard_alive returns 0 and the main loop stops clearing the
+ * watchdog: the chip reboots.
+ */
+
+#ifndef PS1_GUARD_H
+#define PS1_GUARD_H
+
+#include <stdint.h>
+
+#define GUARD_SELECT_MAX 4 // transactions in a row not starting with a select
+#define GUARD_SILENT_MAX 8 // SS edges in a row without a byte
+#define GUARD_SS_MS 16 // SS low this long is stuck, a multitap poll takes 2
+#define GUARD_FAIL_MAX 8 // restarts without a good frame, then the watchdog
+
+/* ps1_guard_spi fault, from the MSSP flags */
+#define GUARD_SSPOV 0x01 // receive overflow, either MSSP
+#define GUARD_WCOL 0x02 // write collision, either MSSP
+#define GUARD_PAIR 0x04 // SPI1 byte without an SPI2 byte
+
+struct PS1_Guard{
+    uint16_t sspov; // MSSP receive overflows
+    uint16_t wcol; // MSSP write collisions
+    uint16_t pair; // SPI1 and SPI2 out of step
+    uint16_t select; // restarts for bytes off a select
+    uint16_t silent; // restarts for SS edges without bytes
+    uint16_t stuck; // SS stuck low
+    uint16_t restarts; // MSSP pair restarted
+    uint8_t edges; // SS edges since the last byte
+    uint8_t low_ms; // ms SS has been low
+    uint8_t rx; // a byte came in since the last tick
+    uint8_t quiet; // restart on the next tick without bytes
+    uint8_t failed; // restarts since the last good frame
+    uint8_t restart; // restart the MSSPs, ISR
+};
+
+extern volatile struct PS1_Guard guard;
+
+/* Function prototype */
+void ps1_guard_init(void);
+uint8_t ps1_guard_spi(uint8_t fault);
+void ps1_guard_edge(void);
+void ps1_guard_tick(uint8_t ss_low);
+void ps1_guard_restart(void);
+void ps1_guard_frame(void);
+uint8_t ps1_guard_alive(void);
+
+#endif
@@ -0,0 +1,410 @@
+/*
+ * File:   ps1_journal.c
+ * Author: pyroesp
+ *
+ * Black box journal, see ps1_journal.h
+ */
+
+#include "ps1_journal.h"
+#include "ps1_reset.h"
+#include "ps1_card.h"
+#include "ps1_guard.h"
+
+struct PS1_Journal journal;
+
+#define J_AT(i) journal.buff[(uint8_t)(i) & JOURNAL_MASK]
+
+/* Reset tick ms, read again in case the tick lands in between the bytes */
+static uint16_t ps1_journal_now(void){
+    uint16_t t;
+    do {
+        t = reset.now;
+    } while (t != reset.now);
+    return t;
+}
+
+/* Length of the record at i */
+static uint8_t ps1_journal_len(uint8_t i){
+    uint8_t h = J_AT(i);
+    if (h & J_REPEAT)
+        return 4;
+    if (h & J_EVENT)
+        return (h & J_EV_MASK) == J_EV_STATE ? 6 : 1;
+    return 2 + (h & J_LONG ? 1 : 0) + (h & J_ID ? 2 : 0) + (h & J_SW ? 2 : 0);
+}
+
+/* Bytes to take off from the record at i, of the left ones: a frame
+ * record goes with the repeat after it if that one counts it. A round
+ * doesn't go back past a repeat or an event, so that's the only one. */
+static uint16_t ps1_journal_span(uint8_t i, uint16_t left){
+    uint16_t n = ps1_journal_len(i), k;
+    uint8_t h, frames;
+
+    if (J_AT(i) & (J_REPEAT | J_EVENT))
+        return n;
+    for (k = n, frames = 0; k < left && frames < JOURNAL_CYCLE_MAX; k += ps1_journal_len(i + k)){
+        h = J_AT(i + k);
+        if (h & J_REPEAT)
+            return (J_AT(i + k + 1) & J_CYC_MASK) > frames ? k + 4 : n;
+        if (h & J_EVENT)
+            break;
+        frames++;
+    }
+    return n;
+}
+
+/* What the record at i says about pad, into p */
+static void ps1_journal_state(uint8_t i, uint8_t pad, struct PS1_Journal_Pad *p){
+    uint8_t h = J_AT(i);
+    if ((h & (J_REPEAT | J_EVENT)) || (h & J_PAD_MASK) != pad)
+        return;
+    i += h & J_LONG ? 3 : 2;
+    if (h & J_ID){
+        p->id = J_AT(i) | (uint16_t)J_AT(i+1) << 8;
+        i += 2;
+    }
+    if (h & J_SW)
+        p->sw = J_AT(i) | (uint16_t)J_AT(i+1) << 8;
+}
+
+/* Drop the oldest records into the base state, returns how many */
+static uint8_t ps1_journal_drop(void){
+    uint16_t n = ps1_journal_span(journal.tail, journal.used);
+    uint8_t h, recs = 0;
+
+    if (journal.run == 2 && ((journal.rep - journal.tail) & JOURNAL_MASK) < n){
+        journal.run = 0; // the repeat went with them
+        journal.pend = 0;
+    }
+    journal.used -= n;
+    while (n){
+        h = J_AT(journal.tail);
+        if (!(h & (J_REPEAT | J_EVENT))){
+            ps1_journal_state(journal.tail, h & J_PAD_MASK, &journal.base[h & J_PAD_MASK]);
+            journal.base_known |= 1 << (h & J_PAD_MASK);
+        }
+        h = ps1_journal_len(journal.tail);
+        journal.tail = (journal.tail + h) & JOURNAL_MASK;
+        n -= h;
+        recs++;
+    }
+    return recs;
+}
+
+/* Append one record, dropping the oldest ones to make room: less than
+ * JOURNAL_REC_MAX bytes of them before the last drop, that one a round
+ * and its repeat at most, JOURNAL_DROP_MAX records in all */
+static void ps1_journal_put(const uint8_t *p, uint8_t n){
+    uint8_t i, recs = 0;
+    while (JOURNAL_SIZE - journal.used < n)
+        recs += ps1_journal_drop();
+    if (recs > journal.drop_max)
+        journal.drop_max = recs;
+    for (i = 0; i < n; i++)
+        J_AT(journal.head + i) = p[i];
+    journal.head = (journal.head + n) & JOURNAL_MASK;
+    journal.used += n;
+}
+
+/* Frame record, with what changed since the pad's last one */
+static void ps1_journal_record(uint8_t pad, uint16_t dt, uint16_t id, uint16_t sw){
+    uint8_t p[JOURNAL_REC_MAX], n = 2, h = J_FRAME | pad, bit = 1 << pad;
+    struct PS1_Journal_Pad *last = &journal.last[pad];
+
+    p[1] = dt & 0xFF;
+    if (dt > 0xFF){
+        h |= J_LONG;
+        p[n++] = dt >> 8;
+    }
+    if (!(journal.known & bit) || id != last->id){
+        h |= J_ID;
+        p[n++] = id & 0xFF;
+        p[n++] = id >> 8;
+    }
+    if (!(journal.known & bit) || sw != last->sw){
+        h |= J_SW;
+        p[n++] = sw & 0xFF;
+        p[n++] = sw >> 8;
+    }
+    p[0] = h;
+    ps1_journal_put(p, n);
+    last->id = id;
+    last->sw = sw;
+    journal.known |= bit;
+
+    journal.win_pad[journal.win] = pad;
+    journal.win_dt[journal.win] = dt < 0xFF ? dt : 0xFF;
+    journal.win = (journal.win + 1) & JOURNAL_CYCLE_MASK;
+    if (journal.win_n < JOURNAL_CYCLE_MAX)
+        journal.win_n++;
+}
+
+/* Frames of a round that didn't come round whole, as records after all */
+static void ps1_journal_flush(void){
+    uint8_t pad[JOURNAL_CYCLE_MAX], i, n = journal.pend;
+
+    journal.run = 0;
+    journal.pend = 0;
+    for (i = 0; i < n; i++)
+        pad[i] = journal.win_pad[(journal.cyc + i) & JOURNAL_CYCLE_MASK];
+    for (i = 0; i < n; i++)
+        ps1_journal_record(pad[i], journal.pend_dt[i], journal.last[pad[i]].id, journal.last[pad[i]].sw);
+}
+
+void ps1_journal_init(void){
+    journal.head = 0;
+    journal.tail = 0;
+    journal.used = 0;
+    journal.run = 0;
+    journal.pend = 0;
+    journal.win = 0;
+    journal.win_n = 0;
+    journal.known = 0;
+    journal.base_known = 0;
+    journal.resync = capture.resync;
+    journal.overrun = capture.overrun;
+    journal.restarts = guard.restarts;
+    journal.decided = 0xFFFF;
+    journal.skipped = 0;
+    journal.drop_max = 0;
+    journal.out = 0;
+    journal.last_ms = ps1_journal_now();
+    ps1_journal_event(J_EV_BOOT);
+}
+
+/* Main loop: one record, no payload */
+void ps1_journal_event(uint8_t ev){
+    uint8_t h = J_EVENT | ev;
+    if (journal.out){
+        journal.skipped++;
+        return;
+    }
+    ps1_journal_flush();
+    ps1_journal_put(&h, 1);
+    journal.win_n = 0;
+}
+
+/* Main loop: a decoded frame, before it's released
+ * Capture errors since the last frame go in first, as events
+*/
+void ps1_journal_frame(const struct PS1_Frame *f){
+    uint8_t p[4], resync = capture.resync, overrun = capture.overrun, restarts = guard.restarts;
+    uint8_t pad = f->pad, i, c;
+    struct PS1_Journal_Pad *last = &journal.last[pad];
+    uint16_t now, dt, span, id, sw, prev;
+
+    if (journal.out){
+        journal.skipped++;
+        return;
+    }
+    if (journal.skipped){
+        journal.skipped = 0;
+        ps1_journal_event(J_EV_SKIPPED);
+    }
+    if (resync != journal.resync){
+        journal.resync = resync;
+        ps1_journal_event(J_EV_RESYNC);
+    }
+    if (overrun != journal.overrun){
+        journal.overrun = overrun;
+        ps1_journal_event(J_EV_OVERRUN);
+    }
+    if (restarts != journal.restarts){
+        journal.restarts = restarts;
+        ps1_journal_event(J_EV_RESTART);
+    }
+
+    now = ps1_journal_now();
+    prev = journal.last_ms;
+    dt = now - prev;
+    id = f->data.buff[1] | (uint16_t)f->data.buff[2] << 8;
+    sw = f->data.buff[3] | (uint16_t)f->data.buff[4] << 8;
+    journal.last_ms = now;
+
+    if (!(journal.known >> pad & 1) || id != last->id || sw != last->sw || dt > 0xFF){
+        ps1_journal_flush();
+        ps1_journal_record(pad, dt, id, sw);
+        return;
+    }
+
+    // Unchanged: the next frame of the round going on, or the start of one
+    if (journal.run){
+        i = (journal.cyc + journal.pend) & JOURNAL_CYCLE_MASK;
+        if (journal.win_pad[i] != pad || journal.win_dt[i] == 0xFF ||
+                (uint16_t)(dt - journal.win_dt[i] + JOURNAL_JITTER_MS) > 2*JOURNAL_JITTER_MS)
+            ps1_journal_flush();
+    }
+    if (!journal.run){
+        for (c = 1; c <= journal.win_n; c++){
+            i = (journal.win - c) & JOURNAL_CYCLE_MASK;
+            if (journal.win_pad[i] == pad)
+                break;
+        }
+        if (c > journal.win_n || journal.win_dt[i] == 0xFF ||
+                (uint16_t)(dt - journal.win_dt[i] + JOURNAL_JITTER_MS) > 2*JOURNAL_JITTER_MS){
+            ps1_journal_record(pad, dt, id, sw);
+            return;
+        }
+        journal.run = 1;
+        journal.cyc = i;
+        journal.cyc_len = c;
+        journal.run_ms = prev; // the round ended with the newest record
+    }
+    journal.pend_dt[journal.pend++] = dt;
+    if (journal.pend < journal.cyc_len)
+        return;
+
+    // Came round whole: count it
+    if (journal.run == 1){
+        span = now - journal.run_ms;
+        journal.count = 1;
+        p[0] = J_REPEAT | 1;
+        p[1] = journal.cyc_len;
+        p[2] = span & 0xFF;
+        p[3] = span >> 8;
+        journal.rep = journal.head;
+        journal.pend = 0;
+        ps1_journal_put(p, 4);
+        journal.run = 2;
+        journal.win_n = 0; // the next round doesn't go back past it
+        return;
+    }
+    span = J_AT(journal.rep + 2) | (uint16_t)J_AT(journal.rep + 3) << 8;
+    if (journal.count == JOURNAL_RUN_MAX || span >= JOURNAL_SPAN_MAX){
+        ps1_journal_flush(); // repeat full, the next one counts from these
+        return;
+    }
+    span = now - journal.run_ms;
+    journal.count++;
+    J_AT(journal.rep) = J_REPEAT | (journal.count & J_RUN_MASK);
+    J_AT(journal.rep + 1) = journal.cyc_len | (journal.count >> 7) << 4;
+    J_AT(journal.rep + 2) = span & 0xFF;
+    J_AT(journal.rep + 3) = span >> 8;
+    journal.pend = 0;
+}
+
+/* Main loop: after ps1_decode, the reset it asked for
+ * Journaled when the reset state machine is idle and will take it on the
+ * next tick, once until it has been. Returns 1 for a new decision.
+*/
+uint8_t ps1_journal_action(uint8_t action){
+    uint16_t taken = reset.resets + reset.deferred;
+    uint8_t ev;
+
+    if (action == PS1_ACT_NONE || reset.state != PS1_RST_IDLE || taken == journal.decided)
+        return 0;
+    journal.decided = taken;
+    if (card.idle_ms < CARD_IDLE_MS)
+        ev = J_EV_WAIT;
+    else
+        ev = action == PS1_ACT_LONG ? J_EV_LONG : J_EV_SHORT;
+    ps1_journal_event(ev);
+    return 1;
+}
+
+/* Start a dump of at most limit bytes, header, states and check included:
+ * the newest records that fit. Returns its length, 0 if one is already out
+*/
+uint16_t ps1_journal_open(uint16_t limit){
+    uint8_t cut, seen = journal.base_known, states, h, i;
+    uint16_t left, len, since, n;
+
+    if (journal.out)
+        return 0;
+    ps1_journal_flush(); // held back frames go in the dump
+    cut = journal.tail;
+    left = journal.used;
+    for (;;){
+        for (i = 0, states = 0; i < PS1_PADS; i++)
+            states += seen >> i & 1;
+        if (!left || JOURNAL_HDR + 6*states + left + 1 <= limit)
+            break;
+        for (n = ps1_journal_span(cut, left); n; n -= i){
+            h = J_AT(cut);
+            if (!(h & (J_REPEAT | J_EVENT)))
+                seen |= 1 << (h & J_PAD_MASK);
+            i = ps1_journal_len(cut);
+            cut = (cut + i) & JOURNAL_MASK;
+            left -= i;
+        }
+    }
+
+    len = 6*states + left;
+    since = ps1_journal_now() - journal.last_ms;
+    journal.hdr[0] = 'P';
+    journal.hdr[1] = 'J';
+    journal.hdr[2] = JOURNAL_VERSION;
+    journal.hdr[3] = PS1_BIT_ORDER == PS1_MSB_FIRST ? JOURNAL_WIRE_MSB : 0;
+    journal.hdr[4] = since & 0xFF;
+    journal.hdr[5] = since >> 8;
+    journal.hdr[6] = len & 0xFF;
+    journal.hdr[7] = len >> 8;
+    journal.cut = cut;
+    journal.left = left;
+    journal.dump_known = seen;
+    journal.pad = 0;
+    journal.pos = 0;
+    journal.check = 0;
+    journal.out = J_OUT_HDR;
+    return JOURNAL_HDR + len + 1;
+}
+
+/* State record of pad where the dump starts: the base, then every record
+ * up to the cut */
+static void ps1_journal_cut_state(uint8_t pad){
+    struct PS1_Journal_Pad p = journal.base[pad];
+    uint8_t i = journal.tail;
+
+    while (i != journal.cut){
+        ps1_journal_state(i, pad, &p);
+        i = (i + ps1_journal_len(i)) & JOURNAL_MASK;
+    }
+    journal.state[0] = J_EVENT | J_EV_STATE;
+    journal.state[1] = pad;
+    journal.state[2] = p.id & 0xFF;
+    journal.state[3] = p.id >> 8;
+    journal.state[4] = p.sw & 0xFF;
+    journal.state[5] = p.sw >> 8;
+}
+
+/* Main loop: next byte of the dump, returns 0 when it's all out */
+uint8_t ps1_journal_get(uint8_t *b){
+    uint8_t c;
+
+    if (journal.out == J_OUT_STATE && journal.pos == sizeof(journal.state)){
+        while (journal.pad < PS1_PADS && !(journal.dump_known >> journal.pad & 1))
+            journal.pad++;
+        if (journal.pad < PS1_PADS){
+            ps1_journal_cut_state(journal.pad++);
+            journal.pos = 0;
+        }else
+            journal.out = journal.left ? J_OUT_REC : J_OUT_CHECK;
+    }
+    switch(journal.out){
+        case J_OUT_HDR:
+            c = journal.hdr[journal.pos++];
+            if (journal.pos == JOURNAL_HDR){
+                journal.out = J_OUT_STATE;
+                journal.pos = sizeof(journal.state);
+            }
+            break;
+        case J_OUT_STATE:
+            c = journal.state[journal.pos++];
+            break;
+        case J_OUT_REC:
+            c = J_AT(journal.cut);
+            journal.cut = (journal.cut + 1) & JOURNAL_MASK;
+            if (--journal.left == 0)
+                journal.out = J_OUT_CHECK;
+            break;
+        case J_OUT_CHECK:
+            c = -journal.check;
+            journal.out = 0; // appending again
+            break;
+        default:
+            return 0;
+    }
+    journal.check += c;
+    *b = c;
+    return 1;
+}
@@ -0,0 +1,140 @@
+/*
+ * File:   ps1_journal.h
+ * Author: pyroesp
+ *
+ * Black box journal of the last transactions and reset decisions, in a
+ * ring buffer in RAM. A frame record has the pad, the ms since the poll
+ * before and the ID and switches only when they changed. Rounds of the
+ * same pads coming round unchanged, give or take JOURNAL_JITTER_MS, only
+ * bump a repeat record in place. A full ring drops its oldest records,
+ * at most JOURNAL_DROP_MAX per append, into the per pad base state.
+ *
+ * Records, first byte:
+ *   00LSIppp  frame of pad ppp: dt (L: 2 bytes), I: id lo hi, S: sw lo hi
+ *   01eeeeee  event J_EV_x, J_EV_STATE has 5 more: pad id lo hi sw lo hi
+ *   1nnnnnnn  mmmmcccc span lo hi: the last c frame records, back to the
+ *             repeat or event before, came round mn times more over span ms
+ * Dump (ps1_journal_open, then ps1_journal_get a byte at a time):
+ *   'P' 'J' JOURNAL_VERSION flags since lo hi len lo hi, a J_EV_STATE per
+ *   pad known, the records, a check byte so that all of them add up to 0
+ * host/journal_decode.c prints it.
+ *
+ * Main loop only. ps1_journal_init after ps1_capture_init, ps1_guard_init and
+ * ps1_reset_init, the time comes from the reset tick (reset.now).
+ */
+
+#ifndef PS1_JOURNAL_H
+#define PS1_JOURNAL_H
+
+#include <stdint.h>
+#include "ps1_capture.h"
+
+#ifndef JOURNAL_SIZE
+#define JOURNAL_SIZE 256 // bytes, power of 2 up to 256, 128 leaves room for the DEBUG trace
+#endif
+#define JOURNAL_MASK (JOURNAL_SIZE-1)
+
+#define JOURNAL_VERSION 1
+#define JOURNAL_HDR 8 // 'P' 'J' version flags since lo hi len lo hi
+#define JOURNAL_REC_MAX 7 // longest record
+#define JOURNAL_RUN_MAX 2047 // rounds in one repeat record
+#define JOURNAL_SPAN_MAX 0xF000 // ms, a repeat closes before its span wraps
+#define JOURNAL_CYCLE_MAX 8 // frame records in a round, power of 2, PS1_PADS
+#define JOURNAL_CYCLE_MASK (JOURNAL_CYCLE_MAX-1)
+#define JOURNAL_JITTER_MS 2 // timing change a repeat rides out
+#define JOURNAL_DROP_MAX (JOURNAL_REC_MAX - 1 + JOURNAL_CYCLE_MAX + 1) // records one append drops
+
+#define JOURNAL_WIRE_MSB 0x01 // flags: bytes in MSSP order, bit reversed
+
+/* Dump being sent, journal.out */
+#define J_OUT_HDR 1
+#define J_OUT_STATE 2
+#define J_OUT_REC 3
+#define J_OUT_CHECK 4
+
+/* Data EEPROM after the combo table (COMBO_IMAGE_MAX), JOURNAL_NVM */
+#define JOURNAL_NVM_ADDR 0x60
+#define JOURNAL_NVM_SIZE 160
+
+/* Records */
+#define J_FRAME 0x00
+#define J_ID 0x08 // id follows
+#define J_SW 0x10 // switches follow
+#define J_LONG 0x20 // dt is 2 bytes
+#define J_PAD_MASK 0x07
+#define J_EVENT 0x40
+#define J_EV_MASK 0x3F
+#define J_REPEAT 0x80
+#define J_RUN_MASK 0x7F // low 7 bits of the count, the high 4 top the next byte
+#define J_CYC_MASK 0x0F // frames in the round
+
+/* Events */
+#define J_EV_STATE 0 // pad id lo hi sw lo hi, state where the dump starts
+#define J_EV_BOOT 1 // journal started, power up
+#define J_EV_SHORT 2 // short reset decided
+#define J_EV_LONG 3 // long reset decided
+#define J_EV_WAIT 4 // reset decided, held back for a memory card write
+#define J_EV_RESYNC 5 // capture.resync went up
+#define J_EV_OVERRUN 6 // capture.overrun went up
+#define J_EV_SKIPPED 7 // records not journaled while the last dump went out
+#define J_EV_RESTART 8 // guard.restarts went up, MSSPs restarted
+#define J_EV_WATCHDOG 9 // boot after a watchdog reset
+
+#define J_EV_NAMES "state", "boot", "short reset", "long reset", "reset after save", \
+    "resync", "overrun", "skipped", "MSSP restart", "watchdog reset"
+
+/* Pad state, wire order */
+struct PS1_Journal_Pad{
+    uint16_t id;
+    uint16_t sw;
+};
+
+struct PS1_Journal{
+    uint8_t buff[JOURNAL_SIZE];
+    uint8_t head; // next record goes here
+    uint8_t tail; // oldest record
+    uint16_t used; // bytes in buff
+    uint8_t run; // 0 none, 1 round being matched, 2 and repeat open at rep
+    uint8_t rep; // repeat record being counted
+    uint8_t cyc; // window slot of the first frame of the round
+    uint8_t cyc_len; // frames in the round
+    uint16_t count; // rounds in the open repeat
+    uint8_t pend; // frames of the next round matched, not written yet
+    uint8_t pend_dt[JOURNAL_CYCLE_MAX]; // their ms since the poll before
+    uint16_t run_ms; // when the last frame of the round was written
+    uint16_t last_ms; // when the last poll was
+    uint8_t win; // next window slot
+    uint8_t win_n; // frame records in the window, since the last event
+    uint8_t win_pad[JOURNAL_CYCLE_MAX]; // last frame records written
+    uint8_t win_dt[JOURNAL_CYCLE_MAX]; // their dt, 0xFF too long to repeat
+    uint8_t known; // pads in last, bit per pad
+    struct PS1_Journal_Pad last[PS1_PADS]; // as of the newest record
+    uint8_t base_known; // pads in base
+    struct PS1_Journal_Pad base[PS1_PADS]; // as of the oldest record
+    uint8_t resync, overrun, restarts; // capture and guard counters, low byte, last seen
+    uint16_t decided; // reset.resets + reset.deferred at the last decision
+    uint16_t skipped; // records not journaled while a dump was out
+    uint8_t drop_max; // most records one append dropped, JOURNAL_DROP_MAX
+    // dump, ps1_journal_get
+    uint8_t out; // 0 none, else what's being sent
+    uint8_t pos; // next byte of the header, state or records
+    uint8_t cut; // first record in the dump
+    uint16_t left; // record bytes still to send
+    uint8_t dump_known; // pads with a state record
+    uint8_t pad; // pad of the state record being sent
+    uint8_t state[6]; // the state record
+    uint8_t hdr[JOURNAL_HDR];
+    uint8_t check;
+};
+
+extern struct PS1_Journal journal;
+
+/* Function prototype */
+void ps1_journal_init(void);
+void ps1_journal_frame(const struct PS1_Frame *f);
+void ps1_journal_event(uint8_t ev);
+uint8_t ps1_journal_action(uint8_t action);
+uint16_t ps1_journal_open(uint16_t limit);
+uint8_t ps1_journal_get(uint8_t *b);
+
+#endif
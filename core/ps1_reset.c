@@ -0,0 +1,123 @@
+/*
+ * File:   ps1_reset.c
+ * Author: pyroesp
+ *
+ * Reset pulse and post reset lockout, see ps1_reset.h
+ */
+
+#include "ps1_reset.h"
+#include "ps1_card.h"
+#include "ps1_combo.h"
+
+volatile struct PS1_Reset reset;
+
+/* Enter the lockout, or go straight to idle if there's none */
+static void ps1_reset_lockout(void){
+    reset.ms = reset.lockout_ms;
+    reset.polls = 0;
+    reset.quiet = 255;
+    reset.state = reset.ms ? PS1_RST_LOCKOUT : PS1_RST_IDLE;
+}
+
+/* RESET low for the pulse of action */
+static void ps1_reset_pulse(uint8_t action){
+    reset.action = action;
+    reset.ms = action == PS1_ACT_LONG ? RESET_LONG_MS : RESET_SHORT_MS;
+    reset.quiet = 0; // the poll with the combo
+    reset.state = PS1_RST_PULSE;
+    reset.resets++;
+}
+
+/* Start in lockout, the console is booting when the mod powers up */
+void ps1_reset_init(uint16_t lockout_ms){
+    reset.action = PS1_ACT_NONE;
+    reset.poll = 0;
+    reset.lockout_ms = lockout_ms;
+    reset.release_ms = RESET_QUIET_MS;
+    reset.armed_ms = 0;
+    reset.resets = 0;
+    reset.ignored = 0;
+    reset.deferred = 0;
+    reset.now = 0;
+    ps1_reset_lockout();
+}
+
+/* Main loop: a poll was decoded, action is the reset it asks for (PS1_ACT_x)
+ * Taken on the next tick. With a multitap or both ports several polls
+ * come in per tick, the longest reset asked for wins. The tick clears
+ * reset.poll: where it's an interrupt, mask it around this call
+ * (HAL_TICK_MASK), or a poll taken halfway is posted again.
+*/
+void ps1_reset_poll(uint8_t action){
+    uint8_t req = reset.poll & ~PS1_POLL;
+    if (req > action)
+        action = req;
+    reset.poll = PS1_POLL | action;
+}
+
+/* Timer ISR, every 1 ms
+ * Returns 1 while RESET has to be held low
+*/
+uint8_t ps1_reset_tick(void){
+    uint8_t poll = reset.poll;
+    uint8_t req = poll & ~PS1_POLL;
+    uint8_t busy = ps1_card_tick();
+    ps1_combo_tick();
+    reset.poll = 0;
+    reset.now++;
+
+    switch(reset.state){
+        case PS1_RST_IDLE:
+            if (req == PS1_ACT_SHORT || req == PS1_ACT_LONG){
+                if (busy){
+                    // a save is going on, reset once it's done
+                    reset.action = req;
+                    reset.state = PS1_RST_WAIT;
+                    reset.deferred++;
+                }else
+                    ps1_reset_pulse(req);
+            }
+            break;
+        case PS1_RST_WAIT:
+            if (req == PS1_ACT_LONG)
+                reset.action = PS1_ACT_LONG;
+            if (!busy)
+                ps1_reset_pulse(reset.action);
+            break;
+        case PS1_RST_PULSE:
+            if (req == PS1_ACT_LONG && reset.action == PS1_ACT_SHORT){
+                // other combo while the short pulse is on, make it long
+                reset.action = PS1_ACT_LONG;
+                reset.ms += RESET_LONG_MS - RESET_SHORT_MS;
+            }
+            if (poll)
+                reset.quiet = 0;
+            else if (reset.quiet < 255)
+                reset.quiet++;
+            if (--reset.ms == 0 || (reset.action == PS1_ACT_SHORT &&
+                    reset.release_ms && reset.quiet >= reset.release_ms))
+                ps1_reset_lockout(); // console stopped polling, it's down
+            break;
+        case PS1_RST_LOCKOUT:
+            if (poll){
+                if (req != PS1_ACT_NONE){
+                    reset.ignored++;
+                    reset.polls = 0; // wait for the combo to be released
+                }else if (reset.quiet < ARM_GAP_MS){
+                    if (reset.polls < ARM_POLLS)
+                        reset.polls++;
+                }else
+                    reset.polls = 1; // first poll after a gap
+                reset.quiet = 0;
+            }else if (reset.quiet < 255)
+                reset.quiet++;
+            
+            if (--reset.ms == 0 ||
+                (reset.polls >= ARM_POLLS && reset.lockout_ms - reset.ms >= ARM_MIN_MS)){
+                reset.armed_ms = reset.lockout_ms - reset.ms;
+                reset.state = PS1_RST_IDLE;
+            }
+            break;
+    }
+    return reset.state == PS1_RST_PULSE;
+}
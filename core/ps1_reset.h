@@ -0,0 +1,81 @@
+/*
+ * File:   ps1_reset.h
+ * Author: pyroesp
+ *
+ * Reset pulse and post reset lockout, driven by a 1 ms timer tick
+ *
+ * The main loop reports every decoded poll (ps1_reset_poll), the timer
+ * interrupt does everything else in ps1_reset_tick and tells the caller
+ * whether RESET has to be held low. Nothing blocks, so frames keep being
+ * captured and decoded while the console is held in reset and during the
+ * lockout after it.
+ *
+ *   IDLE --combo--> PULSE --bus quiet or ms--> LOCKOUT --bus up--> IDLE
+ *     \--combo, card written--> WAIT --card idle--/
+ *
+ * A long combo during a short pulse stretches it to a long one, a combo
+ * during the lockout is ignored and counted. A combo while a memory card
+ * is being written (see ps1_card.h) isn't lost: the reset waits until the
+ * card has been idle for CARD_IDLE_MS, a long combo meanwhile makes it a
+ * long one.
+ *
+ * A console held in reset stops polling, so the short pulse ends as soon
+ * as no poll has come for release_ms (RESET_QUIET_MS): the console is
+ * down, holding it longer only delays the boot. A console that keeps
+ * polling (RESET not wired, a poll mailed before the pulse) gets the
+ * whole RESET_SHORT_MS. The long pulse is always RESET_LONG_MS, its
+ * length is what tells the xStation to go back to its menu.
+ *
+ * The lockout ends as soon as the console is clearly up again: at least
+ * ARM_MIN_MS after it started, ARM_POLLS polls in a row without a gap of
+ * ARM_GAP_MS and without a combo (so a combo still held after the reset
+ * doesn't fire again). If the bus never gets there, lockout_ms is the
+ * fallback, like the fixed delay it replaces. Power up starts in lockout.
+ */
+
+#ifndef PS1_RESET_H
+#define PS1_RESET_H
+
+#include <stdint.h>
+#include "ps1_ctrl.h"
+
+#define RESET_SHORT_MS 500 // short pulse, hold reset for 500ms
+#define RESET_LONG_MS 2000 // long pulse (xStation), hold reset for 2s
+#define RESET_QUIET_MS 100 // short pulse: no poll this long, the console is down
+
+#define ARM_MIN_MS 2000 // BIOS boot, don't arm before this
+#define ARM_POLLS 60 // polls in a row to arm, 1 s at 60 Hz
+#define ARM_GAP_MS 100 // longer without a poll and the count starts over
+
+/* Reset state */
+#define PS1_RST_IDLE 0 // armed, waiting for a combo
+#define PS1_RST_PULSE 1 // RESET held low
+#define PS1_RST_LOCKOUT 2 // console booting, combos ignored
+#define PS1_RST_WAIT 3 // reset asked for, waiting for a save to finish
+
+#define PS1_POLL 0x80 // poll mailbox: a poll was decoded, low bits PS1_ACT_x
+
+struct PS1_Reset{
+    uint8_t state; // PS1_RST_x
+    uint8_t action; // pulse in progress, PS1_ACT_SHORT or PS1_ACT_LONG
+    uint8_t poll; // posted by the main loop, taken by the tick
+    uint8_t quiet; // ms since the last poll, saturates at 255
+    uint8_t polls; // polls in a row during the lockout
+    uint8_t release_ms; // short pulse ends this long after the last poll, 0: fixed
+    uint16_t ms; // left in the current state
+    uint16_t now; // ms since power up, wraps
+    uint16_t lockout_ms; // longest lockout after a pulse
+    uint16_t armed_ms; // how long the last lockout took
+    uint16_t resets; // pulses done
+    uint16_t ignored; // combos during the lockout
+    uint16_t deferred; // resets that waited for a memory card write
+};
+
+extern volatile struct PS1_Reset reset;
+
+/* Function prototype */
+void ps1_reset_init(uint16_t lockout_ms);
+void ps1_reset_poll(uint8_t action);
+uint8_t ps1_reset_tick(void);
+
+#endif
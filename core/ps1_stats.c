@@ -0,0 +1,62 @@
+/*
+ * File:   ps1_stats.c
+ * Author: pyroesp
+ *
+ * Hot path counters and timings, see ps1_stats.h
+ */
+
+#include "ps1_stats.h"
+
+#ifdef PS1_STATS
+#include "ps1_capture.h"
+#include "ps1_card.h"
+#include "ps1_reset.h"
+#include "ps1_trace.h"
+#include "ps1_guard.h"
+
+volatile struct PS1_Stats stats;
+
+void ps1_stats_init(void){
+    clear_buff((uint8_t*)&stats, sizeof(stats));
+    stats.isr.min = 0xFFFF;
+    stats.decode.min = 0xFFFF;
+}
+
+/* Keep min and max of a timing */
+void ps1_stats_time(struct PS1_Time *t, uint16_t dt){
+    if (dt < t->min)
+        t->min = dt;
+    if (dt > t->max)
+        t->max = dt;
+}
+
+/* Snapshot every counter into p, STATS_NAMES order
+ * Returns the number of bytes written
+*/
+uint8_t ps1_stats_record(uint8_t *p){
+    uint16_t v[STATS_COUNT];
+    uint8_t i;
+
+    v[0] = stats.frames;
+    v[1] = stats.rejected;
+    v[2] = capture.resync;
+    v[3] = capture.overrun;
+    v[4] = guard.sspov;
+    v[5] = stats.unknown_id;
+    v[6] = stats.combos;
+    v[7] = reset.ignored;
+    v[8] = trace.dropped;
+    v[9] = stats.isr.min;
+    v[10] = stats.isr.max;
+    v[11] = stats.decode.min;
+    v[12] = stats.decode.max;
+    v[13] = card.writes;
+    v[14] = reset.deferred;
+    v[15] = guard.restarts;
+    for (i = 0; i < STATS_COUNT; i++){
+        p[2*i] = v[i] & 0xFF;
+        p[2*i+1] = v[i] >> 8;
+    }
+    return 2 * STATS_COUNT;
+}
+#endif
@@ -0,0 +1,58 @@
+/*
+ * File:   ps1_stats.h
+ * Author: pyroesp
+ *
+ * Hot path counters and timings
+ *
+ * Built in when PS1_STATS is defined for the whole project (-DPS1_STATS),
+ * otherwise every STAT_ macro is empty and costs nothing. Timings are in
+ * ticks of a free running timer (TMR0 at Fosc/4 on the PIC, so 1 tick is
+ * 1 instruction cycle) and keep the min and max seen.
+ *
+ * Counters that already live elsewhere (capture.overrun, capture.resync,
+ * reset.ignored, trace.dropped, card.writes, reset.deferred, guard.sspov,
+ * guard.restarts) are collected into the same record by
+ * ps1_stats_record, in the order of STATS_NAMES.
+ */
+
+#ifndef PS1_STATS_H
+#define PS1_STATS_H
+
+#include <stdint.h>
+
+/* Record layout, little endian uint16_t each */
+#define STATS_NAMES \
+    "frames", "rejected", "resync", "overrun", "sspov", "unknown_id", "combos", \
+    "ignored", "trace_dropped", "isr_min", "isr_max", "decode_min", "decode_max", \
+    "card_writes", "deferred", "spi_restarts"
+#define STATS_COUNT 16
+
+struct PS1_Time{
+    uint16_t min, max;
+};
+
+struct PS1_Stats{
+    uint16_t frames; // controller polls queued
+    uint16_t rejected; // transactions dropped on the header
+    uint16_t unknown_id; // polls from a controller we have no combo for
+    uint16_t combos; // polls that matched a combo
+    struct PS1_Time isr; // SPI interrupt, entry to exit
+    struct PS1_Time decode; // main loop, one frame
+};
+
+#ifdef PS1_STATS
+extern volatile struct PS1_Stats stats;
+
+#define STAT_INC(c) (stats.c++)
+#define STAT_TIME(t, start, now) ps1_stats_time((struct PS1_Time*)&stats.t, (uint16_t)((now) - (start)))
+
+void ps1_stats_init(void);
+void ps1_stats_time(struct PS1_Time *t, uint16_t dt);
+uint8_t ps1_stats_record(uint8_t *p);
+#else
+#define STAT_INC(c) ((void)0)
+#define STAT_TIME(t, start, now) ((void)0)
+#define ps1_stats_init()
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * File:   ps1_target.h
+ * Author: pyroesp
+ *
+ * Platform traits, fixed at compile time
+ *
+ * The core builds for every board from the same source. What it has to
+ * know about the board is set here, from the compiler's part macro or a
+ * PS1_TARGET_x define (-D on the host, the PIC16F18325 when there's none):
+ *   PS1_BIT_ORDER  how a captured byte holds the bits. The PS1 sends LSb
+ *                  first: an MSSP shifts MSb first and gets them reversed
+ *                  (PS1_MSB_FIRST), AVR SPI with DORD set and the AVR
+ *                  sampling loops get them as sent (PS1_LSB_FIRST). The
+ *                  wire order constants (REV8, W_x in ps1_ctrl.h) follow,
+ *                  so nothing is reversed at run time on either.
+ * How the bytes reach ps1_capture_byte (SPI interrupt, clock edge
+ * interrupt, sampling loop) and the clock don't change the core, they
+ * stay with the pins, timers and the reset output in the target's
+ * ps1_hal.h (or at the top of the sketch). host/targets.sh runs ps1_bench
+ * with the traits of every target.
+ */
+
+#ifndef PS1_TARGET_H
+#define PS1_TARGET_H
+
+#define PS1_MSB_FIRST 0
+#define PS1_LSB_FIRST 1
+
+#if !defined(PS1_TARGET_PIC16F18325) && !defined(PS1_TARGET_ATMEGA328PB) && !defined(PS1_TARGET_ATMEGA328P)
+#if defined(__AVR_ATmega328PB__)
+#define PS1_TARGET_ATMEGA328PB
+#elif defined(__AVR_ATmega328P__)
+#define PS1_TARGET_ATMEGA328P
+#else
+#define PS1_TARGET_PIC16F18325
+#endif
+#endif
+
+#if defined(PS1_TARGET_PIC16F18325)
+#define PS1_TARGET_NAME "PIC16F18325"
+#define PS1_BIT_ORDER PS1_MSB_FIRST // MSSP
+
+#elif defined(PS1_TARGET_ATMEGA328PB)
+#define PS1_TARGET_NAME "ATmega328PB"
+#define PS1_BIT_ORDER PS1_LSB_FIRST // SPI0/SPI1, DORD = 1
+
+#elif defined(PS1_TARGET_ATMEGA328P)
+#define PS1_TARGET_NAME "ATmega328P"
+#define PS1_BIT_ORDER PS1_LSB_FIRST // bits shifted in from the top
+#endif
+
+/* A bit (CMD or DATA, 0 or 1) into a byte the way the capture does it */
+#if PS1_BIT_ORDER == PS1_MSB_FIRST
+#define PS1_SHIFT_IN(r, bit) ((uint8_t)((r) << 1 | (bit)))
+#else
+#define PS1_SHIFT_IN(r, bit) ((uint8_t)((r) >> 1 | (bit) << 7))
+#endif
+
+#endif
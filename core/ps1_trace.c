@@ -0,0 +1,94 @@
+/*
+ * File:   ps1_trace.c
+ * Author: pyroesp
+ *
+ * Binary debug trace, see ps1_trace.h
+ */
+
+#include "ps1_trace.h"
+#include "ps1_stats.h"
+#include "ps1_journal.h"
+
+volatile struct PS1_Trace trace;
+
+void ps1_trace_init(void){
+    trace.head = 0;
+    trace.tail = 0;
+    trace.dropped = 0;
+}
+
+/* Queue one record, all or nothing. Returns 0 if it was dropped */
+static uint8_t ps1_trace_put(uint8_t type, const uint8_t *p, uint8_t len){
+    uint8_t h = trace.head, check = type ^ len, i;
+
+    if ((uint8_t)((trace.tail - h - 1) & TRACE_BUFF_MASK) < len + 4){
+        trace.dropped++;
+        return 0;
+    }
+    trace.buff[h] = TRACE_SYNC;
+    h = (h + 1) & TRACE_BUFF_MASK;
+    trace.buff[h] = type;
+    h = (h + 1) & TRACE_BUFF_MASK;
+    trace.buff[h] = len;
+    h = (h + 1) & TRACE_BUFF_MASK;
+    for (i = 0; i < len; i++){
+        trace.buff[h] = p[i];
+        check ^= p[i];
+        h = (h + 1) & TRACE_BUFF_MASK;
+    }
+    trace.buff[h] = check;
+    trace.head = (h + 1) & TRACE_BUFF_MASK; // publish the whole record at once
+    return 1;
+}
+
+/* Main loop: queue a captured frame */
+uint8_t ps1_trace_frame(const struct PS1_Frame *f){
+    uint8_t p[TRACE_MAX_PAYLOAD], i, n = f->len;
+
+    p[0] = f->stamp & 0xFF;
+    p[1] = f->stamp >> 8;
+    p[2] = n | f->pad << 4; // pad in the high nibble
+    for (i = 0; i < n; i++){
+        p[3+i] = f->cmd.buff[i];
+        p[3+n+i] = f->data.buff[i];
+    }
+    return ps1_trace_put(TRACE_FRAME, p, 3 + 2*n);
+}
+
+/* Main loop: queue a message */
+uint8_t ps1_trace_text(const char *s){
+    uint8_t len = 0;
+    while (s[len] != 0 && len < TRACE_BUFF_SIZE - 4)
+        len++;
+    return ps1_trace_put(TRACE_TEXT, (const uint8_t*)s, len);
+}
+
+#ifdef PS1_STATS
+/* Main loop: queue a snapshot of the counters */
+uint8_t ps1_trace_stats(void){
+    uint8_t p[2*STATS_COUNT];
+    return ps1_trace_put(TRACE_STATS, p, ps1_stats_record(p));
+}
+#endif
+
+/* Main loop: queue the next piece of the journal dump being sent, if
+ * there's room for a whole one. Returns 0 if nothing was queued */
+uint8_t ps1_trace_journal(void){
+    uint8_t p[TRACE_JOURNAL_CHUNK], n = 0;
+
+    if ((uint8_t)((trace.tail - trace.head - 1) & TRACE_BUFF_MASK) < TRACE_JOURNAL_CHUNK + 4)
+        return 0; // wait for the UART, don't drop it
+    while (n < TRACE_JOURNAL_CHUNK && ps1_journal_get(&p[n]))
+        n++;
+    return n ? ps1_trace_put(TRACE_JOURNAL, p, n) : 0;
+}
+
+/* UART ISR: next byte to send, returns 0 when there's nothing left */
+uint8_t ps1_trace_get(uint8_t *b){
+    uint8_t t = trace.tail;
+    if (t == trace.head)
+        return 0;
+    *b = trace.buff[t];
+    trace.tail = (t + 1) & TRACE_BUFF_MASK;
+    return 1;
+}
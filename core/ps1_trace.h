@@ -0,0 +1,59 @@
+/*
+ * File:   ps1_trace.h
+ * Author: pyroesp
+ *
+ * Binary debug trace, queued in RAM and sent by the UART interrupt
+ *
+ * The main loop writes whole records into a ring buffer, the UART TX
+ * interrupt sends them a byte at a time, so nothing waits on the UART.
+ * A record that doesn't fit is dropped and counted, never half written.
+ *
+ * Record: SYNC, type, len, payload[len], check
+ *   check = XOR of type, len and payload
+ *   TRACE_FRAME payload: stamp lo, stamp hi, n | pad << 4, cmd[n], data[n]
+ *   (wire order, pad = port * PS1_SLOTS + multitap slot)
+ *   TRACE_TEXT payload: characters, no terminating 0
+ *   TRACE_STATS payload: uint16_t counters, little endian, see ps1_stats.h
+ *   TRACE_JOURNAL payload: the next bytes of a journal dump, see
+ *   ps1_journal.h (host/journal_decode.c puts them back together)
+ *
+ * host/trace_decode.c turns the stream back into readable frames.
+ */
+
+#ifndef PS1_TRACE_H
+#define PS1_TRACE_H
+
+#include <stdint.h>
+#include "ps1_capture.h"
+
+#define TRACE_BUFF_SIZE 128 // bytes, power of 2
+#define TRACE_BUFF_MASK (TRACE_BUFF_SIZE-1)
+
+#define TRACE_SYNC 0xA5 // first byte of every record
+#define TRACE_FRAME 0x01 // captured frame
+#define TRACE_TEXT 0x02 // message
+#define TRACE_STATS 0x03 // counters and timings
+#define TRACE_JOURNAL 0x04 // piece of a journal dump
+
+#define TRACE_JOURNAL_CHUNK 32 // journal bytes per record
+
+#define TRACE_MAX_PAYLOAD (3 + 2*PS1_CTRL_BUFF_SIZE)
+
+struct PS1_Trace{
+    uint8_t buff[TRACE_BUFF_SIZE];
+    uint8_t head; // written by the main loop
+    uint8_t tail; // read by the UART interrupt
+    uint16_t dropped; // records that didn't fit
+};
+
+extern volatile struct PS1_Trace trace;
+
+/* Function prototype */
+void ps1_trace_init(void);
+uint8_t ps1_trace_frame(const struct PS1_Frame *f);
+uint8_t ps1_trace_text(const char *s);
+uint8_t ps1_trace_stats(void);
+uint8_t ps1_trace_journal(void);
+uint8_t ps1_trace_get(uint8_t *b);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * File:   avr_poll.c
+ * Author: pyroesp
+ *
+ * Cycle model of the ATmega328P polling capture
+ *
+ * Runs the edge sampling loop from old/atmega328p/polling/poll_capture.h
+ * (the same string the sketch assembles) instruction by instruction with
+ * AVR cycle timings against a PS1 bus waveform: CLK idle high, data
+ * changes on the falling edge, sampled on the rising one, /ACK gap after
+ * every byte. PINx is read through the input synchronizer, taken as the
+ * worst case 1.5 cycles late.
+ *
+ * Every CPU clock / bus clock pair is run at PHASES start offsets with
+ * random bytes: a multitap poll that fills the buffer, a 9 and a 5 byte
+ * poll that end on SS. The table shows the worst time from CLK rising to
+ * the sample, the worst margin between the CLK low wait starting (as the
+ * synchronizer sees it) and the rising edge it waits for, and whether
+ * every byte came out right. Then a bus that stops mid transaction, SS
+ * stuck low with CLK high or low, has to time out with the bytes so far
+ * within POLL_TIMEOUT turns of the slowest wait.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Wall -I core -I old/atmega328p/polling -o ps1_avrpoll host/avr_poll.c
+ *   ./ps1_avrpoll
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ps1_ctrl.h"
+#include "poll_capture.h"
+
+/* polling.ino pins on PINB */
+#define PIN_CLK 5
+#define PIN_SS 2
+#define PIN_CMD 4
+#define PIN_DATA 3
+
+#define BUFF_SIZE MTAP_LEN // POLL_BUFF_SIZE
+#define SYNC_CY 1.5 // PINx synchronizer, worst case
+#define PHASES 500
+#define PROG_SIZE 256
+
+/**********************************************************/
+/* Assembler for the few instructions the loop uses */
+
+enum{ OP_SBIC, OP_SBIS, OP_RJMP, OP_IN, OP_BST, OP_LSR, OP_BLD, OP_ST, OP_DEC, OP_BREQ,
+    OP_SBIW, OP_LDI, OP_END };
+
+/* Operands */
+enum{ R_C, R_D, R_P, R_N, R_TL, R_TH, R_COUNT };
+#define PTR_X 0
+#define PTR_Z 1
+
+struct Insn{
+    uint8_t op, a, b; // register / bit / pointer
+    int target; // jumps
+    uint8_t wait_high; // first instruction of the CLK low wait
+};
+
+static struct Insn prog[PROG_SIZE];
+static int prog_len;
+
+static int operand(const char *s){
+    static const struct { const char *name; int v; } ops[] = {
+        {"%[pin]", 0}, {"%[ss]", PIN_SS}, {"%[clk]", PIN_CLK}, {"%[cmd]", PIN_CMD}, {"%[dat]", PIN_DATA},
+        {"%[c]", R_C}, {"%[d]", R_D}, {"%[p]", R_P}, {"%[n]", R_N}, {"X+", PTR_X}, {"Z+", PTR_Z},
+        {"%A[t]", R_TL}, {"%B[t]", R_TH},
+        {"lo8(%[to])", POLL_TIMEOUT & 0xFF}, {"hi8(%[to])", POLL_TIMEOUT >> 8},
+    };
+    unsigned i;
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        if (strcmp(s, ops[i].name) == 0)
+            return ops[i].v;
+    return atoi(s); // plain number
+}
+
+/* Local label "3b" / "9f" from instruction i */
+static int label(const char *s, int i, const int *labels, int nlabels, const int *label_at){
+    int n = s[0] - '0', k;
+    if (s[1] == 'b'){
+        for (k = nlabels - 1; k >= 0; k--)
+            if (labels[k] == n && label_at[k] <= i)
+                return label_at[k];
+    }else{
+        for (k = 0; k < nlabels; k++)
+            if (labels[k] == n && label_at[k] > i)
+                return label_at[k];
+    }
+    fprintf(stderr, "label %s not found\n", s);
+    exit(2);
+}
+
+static void assemble(const char *src){
+    static const char *names[] = {"sbic", "sbis", "rjmp", "in", "bst", "lsr", "bld", "st", "dec", "breq",
+        "sbiw", "ldi"};
+    static char line[128], refs[PROG_SIZE][8];
+    int labels[PROG_SIZE], label_at[PROG_SIZE], nlabels = 0, i, op;
+    char mn[16], a[16], b[16], *p;
+    const char *e;
+    size_t len;
+
+    while (*src){
+        e = strchr(src, '\n');
+        len = e ? (size_t)(e - src) : strlen(src);
+        if (len >= sizeof(line))
+            len = sizeof(line) - 1;
+        memcpy(line, src, len);
+        line[len] = 0;
+        src += e ? len + 1 : len;
+        for (p = line; *p; p++)
+            if (*p == ',' || *p == '\t')
+                *p = ' ';
+        p = line;
+        while (*p == ' ')
+            p++;
+        if (p[0] >= '0' && p[0] <= '9' && p[1] == ':'){
+            labels[nlabels] = p[0] - '0';
+            label_at[nlabels++] = prog_len;
+            p += 2;
+        }
+        mn[0] = a[0] = b[0] = 0;
+        if (sscanf(p, "%15s %15s %15s", mn, a, b) < 1)
+            continue;
+        for (op = 0; op < OP_END && strcmp(mn, names[op]) != 0; op++);
+        if (op == OP_END){
+            fprintf(stderr, "can't model '%s'\n", mn);
+            exit(2);
+        }
+        prog[prog_len].op = op;
+        refs[prog_len][0] = 0;
+        switch(op){
+            case OP_RJMP: case OP_BREQ:
+                snprintf(refs[prog_len], sizeof(refs[0]), "%s", a);
+                break;
+            case OP_ST: // st X+, reg
+                prog[prog_len].a = operand(a);
+                prog[prog_len].b = operand(b);
+                break;
+            default:
+                prog[prog_len].a = operand(a);
+                prog[prog_len].b = operand(b);
+                break;
+        }
+        prog_len++;
+    }
+    prog[prog_len].op = OP_END;
+    for (i = 0; i < prog_len; i++){
+        if (refs[i][0])
+            prog[i].target = label(refs[i], i, labels, nlabels, label_at);
+        // "3:", where "sbic pin, clk" skips to, opens the CLK low wait
+        if (i >= 2 && prog[i-2].op == OP_SBIC && prog[i-2].b == PIN_CLK)
+            prog[i].wait_high = 1;
+    }
+}
+
+/**********************************************************/
+/* Bus */
+
+struct Bus{
+    double ss_fall, ss_rise; // ns
+    double clk_low; // SS and CLK stuck low from here on, ns
+    double fall[8*BUFF_SIZE], rise[8*BUFF_SIZE];
+    uint8_t cmd[BUFF_SIZE], dat[BUFF_SIZE];
+    int bits;
+};
+
+static void bus_make(struct Bus *b, double start, double bit_ns, double gap_ns, int bytes){
+    double t = start + bit_ns / 2;
+    int i, k;
+    b->ss_fall = start;
+    b->bits = 8 * bytes;
+    for (i = 0; i < bytes; i++){
+        b->cmd[i] = rand();
+        b->dat[i] = rand();
+        for (k = 0; k < 8; k++){
+            b->fall[i*8 + k] = t;
+            b->rise[i*8 + k] = t + bit_ns / 2;
+            t += bit_ns;
+        }
+        t += gap_ns;
+    }
+    b->ss_rise = t;
+    b->clk_low = 1e30;
+}
+
+/* PINB at time t */
+static uint8_t bus_pin(const struct Bus *b, double t){
+    int lo = 0, hi = b->bits, m;
+    uint8_t v = 1 << PIN_CMD | 1 << PIN_DATA | 1 << PIN_CLK;
+
+    if (t < b->ss_fall || t >= b->ss_rise)
+        return v | 1 << PIN_SS;
+    if (t >= b->clk_low)
+        return 0;
+    // last falling edge before t
+    while (lo < hi){
+        m = (lo + hi) / 2;
+        if (b->fall[m] <= t)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    if (lo == 0)
+        return v;
+    m = lo - 1;
+    v = 0;
+    if (b->cmd[m / 8] >> (m % 8) & 1)
+        v |= 1 << PIN_CMD;
+    if (b->dat[m / 8] >> (m % 8) & 1)
+        v |= 1 << PIN_DATA;
+    if (t >= b->rise[m])
+        v |= 1 << PIN_CLK;
+    return v;
+}
+
+/**********************************************************/
+/* CPU */
+
+struct Run{
+    uint8_t cmd[BUFF_SIZE], dat[BUFF_SIZE];
+    int bytes;
+    int timeout; // left with t at 0
+    double end; // when it left, ns
+    double lat_max; // CLK rising to sample
+    double margin_min; // CLK low wait entered before the rising edge
+};
+
+static void cpu_run(const struct Bus *b, double cy_ns, double t0, struct Run *r){
+    uint8_t reg[R_COUNT] = {0}, t = 0, z = 0, pin;
+    uint16_t w;
+    int pc = 0, ptr[2] = {0, 0}, bit = 0, skip, prev = -1;
+    double now = t0;
+
+    reg[R_N] = BUFF_SIZE;
+    reg[R_TL] = POLL_TIMEOUT & 0xFF;
+    reg[R_TH] = POLL_TIMEOUT >> 8;
+    r->lat_max = 0;
+    r->margin_min = 1e30;
+    while (prog[pc].op != OP_END && now < t0 + 1e9){ // a second, it hangs
+        const struct Insn *in = &prog[pc];
+        pin = bus_pin(b, now - SYNC_CY * cy_ns);
+        // entering the CLK low wait from the CLK high wait
+        if (in->wait_high && prev == pc - 2 && bit < b->bits
+            && b->rise[bit] - (now - SYNC_CY * cy_ns) < r->margin_min)
+            r->margin_min = b->rise[bit] - (now - SYNC_CY * cy_ns);
+        prev = pc;
+        switch(in->op){
+            case OP_SBIC:
+            case OP_SBIS:
+                skip = (pin >> in->b & 1) == (in->op == OP_SBIS);
+                now += (skip ? 2 : 1) * cy_ns;
+                pc += skip ? 2 : 1;
+                continue;
+            case OP_RJMP:
+                now += 2 * cy_ns;
+                pc = in->target;
+                continue;
+            case OP_IN:
+                reg[in->a] = pin;
+                if (bit < b->bits){
+                    if (now - b->rise[bit] > r->lat_max)
+                        r->lat_max = now - b->rise[bit];
+                    bit++;
+                }
+                break;
+            case OP_BST:
+                t = reg[in->a] >> in->b & 1;
+                break;
+            case OP_LSR:
+                reg[in->a] >>= 1;
+                break;
+            case OP_BLD:
+                reg[in->a] = (reg[in->a] & ~(1 << in->b)) | t << in->b;
+                break;
+            case OP_ST:
+                if (ptr[in->a] < BUFF_SIZE)
+                    (in->a == PTR_X ? r->cmd : r->dat)[ptr[in->a]] = reg[in->b];
+                ptr[in->a]++;
+                now += cy_ns; // 2 cycles
+                break;
+            case OP_DEC:
+                z = --reg[in->a] == 0;
+                break;
+            case OP_SBIW: // %A[t], high byte in the next register
+                w = (reg[in->a] | reg[in->a + 1] << 8) - in->b;
+                reg[in->a] = w & 0xFF;
+                reg[in->a + 1] = w >> 8;
+                z = w == 0;
+                now += cy_ns; // 2 cycles
+                break;
+            case OP_LDI:
+                reg[in->a] = in->b;
+                break;
+            case OP_BREQ:
+                if (z){
+                    now += 2 * cy_ns;
+                    pc = in->target;
+                    continue;
+                }
+                break;
+        }
+        now += cy_ns;
+        pc++;
+    }
+    r->bytes = BUFF_SIZE - reg[R_N];
+    r->timeout = reg[R_TL] == 0 && reg[R_TH] == 0;
+    r->end = now;
+}
+
+int main(void){
+    static const double cpu_mhz[] = {8, 16, 20};
+    static const double bus_khz[] = {250, 500, 750, 1000};
+    static const unsigned lens[] = {BUFF_SIZE, 9, 5};
+    struct Bus b;
+    struct Run r;
+    double lat, margin, cy_ns, bit_ns, out;
+    unsigned i, k, ph, bad, len;
+    int err = 0, ok;
+
+    assemble(POLL_CAPTURE_ASM);
+    srand(1);
+    printf("poll_capture.h: %d instructions, %d phases per case, /ACK gap 2.5 bits\n", prog_len, PHASES);
+    printf("%6s %8s %12s %12s %8s\n", "CPU", "bus", "sample lat", "min margin", "result");
+    for (i = 0; i < sizeof(cpu_mhz) / sizeof(cpu_mhz[0]); i++){
+        cy_ns = 1000.0 / cpu_mhz[i];
+        for (k = 0; k < sizeof(bus_khz) / sizeof(bus_khz[0]); k++){
+            bit_ns = 1e6 / bus_khz[k];
+            lat = 0;
+            margin = 1e30;
+            bad = 0;
+            for (ph = 0; ph < PHASES; ph++){
+                // multitap poll, stops on the byte count; 9 and 5 byte polls, stop on SS
+                for (len = 0; len < sizeof(lens) / sizeof(lens[0]); len++){
+                    bus_make(&b, 100 + cy_ns * ph / PHASES, bit_ns, 2.5 * bit_ns, lens[len]);
+                    memset(&r, 0, sizeof(r));
+                    cpu_run(&b, cy_ns, b.ss_fall + 4 * cy_ns, &r); // C loop saw SS low
+                    if (r.bytes != (int)lens[len] || r.timeout ||
+                            memcmp(r.cmd, b.cmd, lens[len]) || memcmp(r.dat, b.dat, lens[len]))
+                        bad++;
+                    if (r.lat_max > lat)
+                        lat = r.lat_max;
+                    if (r.margin_min < margin)
+                        margin = r.margin_min;
+                }
+            }
+            printf("%4.0fMHz %5.0fkHz %9.0f ns %9.0f ns %8s\n", cpu_mhz[i], bus_khz[k], lat, margin,
+                bad ? "FAIL" : "ok");
+            // the PS1 clock is 250 kHz, that has to work at 16 MHz with room to spare
+            if (bad && bus_khz[k] <= 500 && cpu_mhz[i] >= 16)
+                err = 1;
+        }
+    }
+
+    // 3 bytes at 250 kHz, then the bus stops with SS low
+    printf("%6s %26s %26s\n", "CPU", "SS stuck low, CLK high", "SS and CLK stuck low");
+    for (i = 0; i < sizeof(cpu_mhz) / sizeof(cpu_mhz[0]); i++){
+        cy_ns = 1000.0 / cpu_mhz[i];
+        printf("%4.0fMHz", cpu_mhz[i]);
+        for (k = 0; k < 2; k++){
+            bus_make(&b, 100, 4000, 10000, 3);
+            b.clk_low = k ? b.ss_rise : 1e30;
+            b.ss_rise = 1e30;
+            memset(&r, 0, sizeof(r));
+            cpu_run(&b, cy_ns, b.ss_fall + 4 * cy_ns, &r);
+            out = r.end - b.rise[b.bits - 1];
+            // POLL_TIMEOUT turns of the CLK high wait, 8 cycles, and the end of the byte
+            ok = r.timeout && r.bytes == 3 && !memcmp(r.cmd, b.cmd, 3) && !memcmp(r.dat, b.dat, 3) &&
+                out < (POLL_TIMEOUT * 8 + 100) * cy_ns;
+            printf(" %15s %7.0f us %s", "out after", out / 1000, ok ? "ok  " : "FAIL");
+            if (!ok)
+                err = 1;
+        }
+        printf("\n");
+    }
+    return err;
+}
@@ -0,0 +1,2351 @@
+/*
+ * File:   bench.c
+ * Author: pyroesp
+ *
+ * Host benchmark for the protocol core
+ *
+ * Pushes synthetic controller frames through the same steps the PIC does
+ * for every poll (ISR copy of SSPxBUF, combo decision in wire order) and
+ * reports frames/s and the per frame cost. The pre wire order path
+ * (reverse all 18 bytes, decode, clear) is kept as "legacy" to compare.
+ *
+ * A second part replays bus timing (bytes every BYTE_US, polls at 60 Hz
+ * up to back-to-back) against the ISR / main loop frame queue with a
+ * modelled PIC decode time and counts every frame that doesn't make it.
+ *
+ * The reset state machine is run against a simulated 1 ms clock with
+ * polls at 60 Hz to check pulse width, lockout and that capture goes on,
+ * then against boot traces to measure how long it takes to arm, and
+ * against noisy polling (lone combo frames, brushed and corrupted combos)
+ * to check combos have to be held: no false resets, bounded latency.
+ *
+ * The DEBUG trace is drained at the UART baud rate while polls come in,
+ * to see how many records it loses. The sent bytes can be written to a
+ * file and fed to ps1_trace (host/trace_decode.c).
+ *
+ * The combo table lookup is timed with 1 to COMBO_MAX combos, the cost
+ * has to stay flat.
+ *
+ * Faults are injected into a bit level model of the MSSP pair (overflow,
+ * write collision, SPI2 out of step, bits off, no more bytes, SS stuck
+ * low) to time how long ps1_guard takes to get good frames coming again,
+ * and the watchdog when restarting doesn't help.
+ *
+ * The old ATmega328P INT-interrupt ISRs are counted in AVR cycles, from
+ * hand-counted avr-gcc listings, against the 4 us bit at 16 MHz.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_bench host/bench.c core/ps1_*.c
+ *   ./ps1_bench [frames] [trace.bin]
+ * Add -DPS1_STATS to also check the firmware counters (core/ps1_stats.h),
+ * -DPS1_TARGET_ATMEGA328PB or -DPS1_TARGET_ATMEGA328P for the core of
+ * those boards (ps1_target.h), host/targets.sh does all of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_card.h"
+#include "ps1_trace.h"
+#include "ps1_stats.h"
+#include "ps1_combo.h"
+#include "ps1_journal.h"
+#include "ps1_guard.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void){
+    return __rdtsc();
+}
+#else
+#define TICK_UNIT "ns"
+static inline uint64_t bench_ticks(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+#define SET_SIZE 1024 // synthetic frames, replayed in a loop
+#define HIST_SIZE 4096 // per frame cost histogram, in ticks
+#define DEFAULT_FRAMES 10000000ul
+
+/* One poll as seen on the wire, already bit reversed like SSPxBUF */
+struct Bench_Frame{
+    uint8_t cmd[PS1_CTRL_BUFF_SIZE];
+    uint8_t data[PS1_CTRL_BUFF_SIZE];
+    uint8_t expect; // PS1_ACT_x the decoder has to return
+};
+
+static struct Bench_Frame set[SET_SIZE];
+
+/* xorshift32, fixed seed so every run sees the same traffic */
+static uint32_t rng_state = 0x1F2E3D4C;
+static uint32_t rng(void){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t hist[HIST_SIZE];
+
+/* Per frame cost: the host OS preempts us now and then, so the max
+ * alone says little. Keep a histogram and report p99.9 next to it.
+*/
+static void hist_add(uint64_t dt){
+    hist[dt < HIST_SIZE ? dt : HIST_SIZE-1]++;
+}
+
+static uint64_t hist_pct(unsigned long n, double pct){
+    unsigned long sum = 0, lim = (unsigned long)(n * pct);
+    uint32_t i;
+    for (i = 0; i < HIST_SIZE; i++){
+        sum += hist[i];
+        if (sum >= lim)
+            return i;
+    }
+    return HIST_SIZE-1;
+}
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fill a frame in PS1 bit order, then reverse it to what the MSSP holds */
+static void make_frame(struct Bench_Frame *f, uint8_t sel, uint16_t id, uint16_t sw, uint8_t expect){
+    uint8_t i;
+    memset(f, 0, sizeof(*f));
+    f->cmd[0] = sel;
+    f->cmd[1] = CMD_READ_SW;
+    f->data[0] = 0xFF;
+    f->data[1] = id & 0xFF;
+    f->data[2] = id >> 8;
+    f->data[3] = sw & 0xFF;
+    f->data[4] = sw >> 8;
+    for (i = 5; i < PS1_CTRL_BUFF_SIZE; i++)
+        f->data[i] = rng();
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        reverse_byte(&f->cmd[i]);
+        reverse_byte(&f->data[i]);
+    }
+    f->expect = expect;
+}
+
+/* Mostly idle pads, a few memory card accesses and some combos */
+static void make_set(void){
+    static const uint16_t pads[] = {ID_DIG_CTRL, ID_ANP_CTRL, ID_ANS_CTRL, ID_DS2_CTRL};
+    uint16_t i, id, sw;
+    uint32_t r;
+
+    for (i = 0; i < SET_SIZE; i++){
+        r = rng() % 100;
+        id = pads[rng() % 4];
+        sw = 0xFFFF & ~(rng() & rng()); // a couple of keys pressed
+        if (sw == KEY_COMBO_CTRL || sw == KEY_COMBO_XSTATION)
+            sw = 0xFFFF;
+        if (r < 5)
+            make_frame(&set[i], CMD_SEL_MEMC_1, id, sw, PS1_ACT_NONE);
+        else if (r < 10)
+            make_frame(&set[i], CMD_SEL_CTRL_1, id, KEY_COMBO_CTRL, PS1_ACT_SHORT);
+        else if (r < 13)
+            make_frame(&set[i], CMD_SEL_CTRL_1, id, KEY_COMBO_XSTATION, PS1_ACT_LONG);
+        else if (r < 15)
+            make_frame(&set[i], CMD_SEL_CTRL_1, ID_GUNCON_CTRL, KEY_COMBO_GUNCON, PS1_ACT_LONG);
+        else if (r < 20)
+            make_frame(&set[i], CMD_SEL_CTRL_1, ID_GUNCON_CTRL, KEY_COMBO_CTRL, PS1_ACT_NONE);
+        else if (r < 22)
+            make_frame(&set[i], CMD_SEL_CTRL_1, 0x5A12, KEY_COMBO_CTRL, PS1_ACT_NONE); // mouse
+        else if (r < 25){
+            // DualShock config mode status, switch bytes mean nothing there
+            make_frame(&set[i], CMD_SEL_CTRL_1, ID_CONFIG, KEY_COMBO_CTRL, PS1_ACT_NONE);
+            set[i].cmd[1] = W_CMD_GET_STATUS;
+        }else
+            make_frame(&set[i], CMD_SEL_CTRL_1, id, sw, PS1_ACT_NONE);
+    }
+}
+
+static union PS1_Cmd cmd;
+static union PS1_Ctrl_Data data;
+
+/* Decoder as it was before wire order matching, on PS1 bit order frames */
+static uint8_t legacy_decode(const union PS1_Cmd *cmd, const union PS1_Ctrl_Data *data){
+    if (cmd->device_select != CMD_SEL_CTRL_1 || cmd->command != CMD_READ_SW)
+        return PS1_ACT_NONE;
+    switch(data->id){
+        case ID_GUNCON_CTRL:
+            switch(data->switches){
+                case KEY_COMBO_GUNCON:
+                    return PS1_ACT_LONG;
+            }
+            break;
+        case ID_DIG_CTRL:
+        case ID_ANS_CTRL:
+        case ID_ANP_CTRL:
+        case ID_DS2_CTRL:
+            switch(data->switches){
+                case KEY_COMBO_CTRL:
+                    return PS1_ACT_SHORT;
+                case KEY_COMBO_XSTATION:
+                    return PS1_ACT_LONG;
+            }
+            break;
+    }
+    return PS1_ACT_NONE;
+}
+
+/* Old main loop: copy, reverse all 18 bytes, decode, clear */
+static uint8_t legacy_frame(const struct Bench_Frame *f){
+    uint8_t i, act;
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        cmd.buff[i] = f->cmd[i];
+        data.buff[i] = f->data[i];
+    }
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        reverse_byte(&cmd.buff[i]);
+        reverse_byte(&data.buff[i]);
+    }
+    act = legacy_decode(&cmd, &data);
+    clear_buff(data.buff, PS1_CTRL_BUFF_SIZE);
+    clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE);
+    return act;
+}
+
+/* Current main loop: copy, decode in wire order, 60 Hz stamps */
+static struct PS1_Port pads[PS1_PADS];
+static uint16_t stamp;
+
+static void pads_init(void){
+    uint8_t i;
+    for (i = 0; i < PS1_PADS; i++)
+        ps1_port_init(&pads[i]);
+}
+
+static uint8_t wire_frame(const struct Bench_Frame *f){
+    uint8_t i;
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        cmd.buff[i] = f->cmd[i];
+        data.buff[i] = f->data[i];
+    }
+    stamp += 16667;
+    return ps1_decode(&pads[0], &cmd, &data, stamp);
+}
+
+#define HOLD_FRAMES 60 // a combo has to fire when held this long
+
+/* Throughput over n frames, then per frame cost over n/10 frames */
+static int bench_path(const char *name, uint8_t (*path)(const struct Bench_Frame*), unsigned long n){
+    unsigned long i, hits = 0;
+    uint64_t t0, dt, worst = 0, overhead = ~0ull;
+    uint8_t act, k;
+    double s;
+
+    // correctness first, a fast wrong decoder is no use
+    // every frame is held, the legacy decoder fires on the first one
+    for (i = 0; i < SET_SIZE; i++){
+        pads_init();
+        for (k = 0; (act = path(&set[i])) == PS1_ACT_NONE && k < HOLD_FRAMES; k++);
+        if (act != set[i].expect){
+            printf("%s: frame %lu returned wrong action\n", name, i);
+            return 1;
+        }
+    }
+
+    s = now_s();
+    for (i = 0; i < n; i++)
+        hits += path(&set[i & (SET_SIZE-1)]) != PS1_ACT_NONE;
+    s = now_s() - s;
+
+    for (i = 0; i < 1000; i++){
+        t0 = bench_ticks();
+        dt = bench_ticks() - t0;
+        if (dt < overhead)
+            overhead = dt;
+    }
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < n / 10; i++){
+        t0 = bench_ticks();
+        path(&set[i & (SET_SIZE-1)]);
+        dt = bench_ticks() - t0 - overhead;
+        hist_add(dt);
+        if (dt > worst)
+            worst = dt;
+    }
+
+    printf("%s: %lu frames in %.3f s, %.1f Mframes/s, %.1f ns/frame, %lu resets\n",
+        name, n, s, n / s / 1e6, s * 1e9 / n, hits);
+    printf("%s: per frame p50 %llu, p99.9 %llu, worst %llu %s\n", name,
+        (unsigned long long)hist_pct(n / 10, 0.5),
+        (unsigned long long)hist_pct(n / 10, 0.999),
+        (unsigned long long)worst, TICK_UNIT);
+    return 0;
+}
+
+/**********************************************************/
+/* Combo table: lookup cost against the number of combos */
+
+#define COMBO_LOOKUPS 2000000ul
+
+static int bench_combo(void){
+    static const uint8_t sizes[] = {1, 2, 4, 8, COMBO_MAX};
+    static struct PS1_Combo_Def def[COMBO_MAX];
+    static uint16_t sw[1024];
+    static uint8_t cl[1024];
+    double best[sizeof(sizes)], s, lo = 1e30, hi = 0;
+    unsigned long i, found;
+    uint8_t k, j, r, cls;
+    int err = 0;
+
+    printf("combo table: %lu lookups, one bucket per frame\n", COMBO_LOOKUPS);
+    printf("  %6s %6s %10s %10s\n", "combos", "seed", "ns/lookup", "hits");
+    for (k = 0; k < sizeof(sizes); k++){
+        // random distinct combos of 2 to 5 buttons
+        for (j = 0; j < sizes[k]; j++){
+            def[j].cls = j & 1 ? COMBO_CLASS_GUNCON : COMBO_CLASS_PAD;
+            do{
+                def[j].keys = 0;
+                for (r = 2 + rng() % 4; r; r--)
+                    def[j].keys |= 1 << (rng() % 16);
+                for (r = 0; r < j && (def[r].keys != def[j].keys || def[r].cls != def[j].cls); r++);
+            }while (r < j);
+            def[j].action = PS1_ACT_SHORT + (j & 1);
+            def[j].hold = 0;
+        }
+        if (!ps1_combo_compile(def, sizes[k], 0)){
+            printf("  %u combos: no seed found\n", sizes[k]);
+            err = 1;
+            continue;
+        }
+        // every combo must be found, in its own class only
+        for (j = 0; j < sizes[k]; j++){
+            cls = def[j].cls;
+            if (!ps1_combo_find(cls, REV16((uint16_t)~def[j].keys)))
+                err = 1;
+        }
+        // idle pads, random presses and one frame in 8 on a combo, every
+        // combo in turn, each looked up in its own class
+        for (i = 0; i < 1024; i++){
+            if (i % 8 == 0){
+                sw[i] = REV16((uint16_t)~def[i / 8 % sizes[k]].keys);
+                cl[i] = def[i / 8 % sizes[k]].cls;
+            }else{
+                sw[i] = i % 2 ? 0xFFFF : (uint16_t)rng();
+                cl[i] = i % 4 < 2 ? COMBO_CLASS_PAD : COMBO_CLASS_GUNCON;
+            }
+        }
+        best[k] = 1e30;
+        for (r = 0; r < 5; r++){
+            found = 0;
+            s = now_s();
+            for (i = 0; i < COMBO_LOOKUPS; i++)
+                found += ps1_combo_find(cl[i & 1023], sw[i & 1023]) != 0;
+            s = now_s() - s;
+            if (s < best[k])
+                best[k] = s;
+        }
+        best[k] = best[k] * 1e9 / COMBO_LOOKUPS;
+        if (best[k] < lo)
+            lo = best[k];
+        if (best[k] > hi)
+            hi = best[k];
+        if (found != COMBO_LOOKUPS / 8)
+            err = 1; // missed or false hits
+        printf("  %6u %6u %10.2f %10lu\n", sizes[k], combos.seed, best[k], found);
+    }
+    // flat: a lookup is one bucket, at most COMBO_WAYS compares whatever the size
+    if (hi > lo * COMBO_WAYS + 0.5){
+        printf("  lookup cost grows with the table\n");
+        err = 1;
+    }
+    if (err)
+        printf("  combo table check failed\n");
+    ps1_combo_load(0); // back to the built-in combos
+    return err;
+}
+
+/**********************************************************/
+/* Capture path timing model */
+
+#define BYTE_US 40 // 8 bits at 250kHz + /ACK gap
+#define DECODE_US 100 // main loop time per frame on the PIC
+#define SIM_FRAMES 100000ul
+#define SIM_MAX_LEN 140 // memory card read
+
+#define MIX_ANALOG 0 // analog pads only
+#define MIX_CARD 1 // digital pad, analog pad, memory card read or write
+#define MIX_MTAP 2 // multitap with 4 analog pads, ports 1 and 2 in turn
+
+struct Sim_Case{
+    const char *name;
+    uint32_t period_us; // time between bursts of transactions
+    uint8_t burst; // transactions sent back-to-back, 2 for both ports
+    uint8_t mix; // MIX_x
+    uint32_t decode_us; // main loop time per frame
+    uint8_t ss; // SS falling edge calls ps1_capture_start
+    uint8_t glitch; // every glitch-th transaction is damaged, 0 = none
+};
+
+/* Damage a transaction: a byte lost, a spurious byte, SS released early */
+static uint8_t sim_glitch(uint8_t *cb, uint8_t *db, uint8_t len){
+    switch(rng() % 3){
+        case 0: // byte 1 never clocked in
+            memmove(cb+1, cb+2, len-2);
+            memmove(db+1, db+2, len-2);
+            return len-1;
+        case 1: // noise on SCK, one extra byte after the select
+            memmove(cb+2, cb+1, len-1);
+            memmove(db+2, db+1, len-1);
+            cb[1] = 0x00;
+            db[1] = 0xFF;
+            return len+1;
+        default: // cut short after 3 bytes
+            return 3;
+    }
+}
+
+/* Transaction k as it reaches SSPxBUF, wire order. Pads carry the poll
+ * number in their switches. Returns the length, *pad = the number of
+ * pad polls in it: 0 for the card, 4 for a multitap.
+*/
+static uint8_t sim_frame(const struct Sim_Case *c, uint32_t k, uint16_t seq,
+        uint8_t *cb, uint8_t *db, uint8_t *pad){
+    uint8_t i, len;
+    uint16_t id = ID_ANP_CTRL;
+
+    memset(cb, 0, SIM_MAX_LEN);
+    memset(db, 0, SIM_MAX_LEN);
+    *pad = 1;
+    if (c->mix == MIX_CARD && k % 3 == 2){
+        // read sector 0x0142: 81 52 00 00 01 42 00 ...
+        // or write it: 81 57 00 00 01 42 <data> ..., 5C 5D 47 back
+        len = k % 6 == 2 ? SIM_MAX_LEN : MEMC_WRITE_LEN;
+        cb[0] = CMD_SEL_MEMC_1;
+        cb[1] = len == SIM_MAX_LEN ? CMD_MEMC_READ : CMD_MEMC_WRITE;
+        cb[4] = 0x01;
+        cb[5] = 0x42;
+        db[0] = 0xFF;
+        db[1] = 0x08;
+        db[2] = MEMC_ID1;
+        db[3] = MEMC_ID2;
+        for (i = 10; i < len; i++)
+            (len == SIM_MAX_LEN ? db : cb)[i] = rng();
+        if (len == MEMC_WRITE_LEN){
+            db[len-3] = 0x5C;
+            db[len-2] = 0x5D;
+            db[len-1] = MEMC_GOOD;
+        }
+        *pad = 0;
+    }else if (c->mix == MIX_MTAP){
+        // 01 42 01 00 ..., FF 80 5A then ID, switches, sticks for slots A to D
+        len = MTAP_LEN;
+        cb[0] = CMD_SEL_CTRL_1;
+        cb[1] = CMD_READ_SW;
+        cb[2] = CMD_TAP;
+        db[0] = 0xFF;
+        db[1] = ID_MULTITAP & 0xFF;
+        db[2] = ID_MULTITAP >> 8;
+        for (i = 0; i < PS1_SLOTS; i++){
+            db[3 + MTAP_SLOT_LEN*i] = id & 0xFF;
+            db[4 + MTAP_SLOT_LEN*i] = id >> 8;
+            db[5 + MTAP_SLOT_LEN*i] = (seq + i) & 0xFF;
+            db[6 + MTAP_SLOT_LEN*i] = (seq + i) >> 8;
+            memset(&db[7 + MTAP_SLOT_LEN*i], 0x80, 4);
+        }
+        *pad = PS1_SLOTS;
+    }else{
+        if (c->mix == MIX_CARD && k % 3 == 0)
+            id = ID_DIG_CTRL;
+        len = id == ID_DIG_CTRL ? 5 : 9;
+        cb[0] = CMD_SEL_CTRL_1;
+        cb[1] = CMD_READ_SW;
+        db[0] = 0xFF;
+        db[1] = id & 0xFF;
+        db[2] = id >> 8;
+        db[3] = seq & 0xFF;
+        db[4] = seq >> 8;
+        for (i = 5; i < len; i++)
+            db[i] = 0x80; // sticks centered
+    }
+    for (i = 0; i < len; i++){
+        reverse_byte(&cb[i]);
+        reverse_byte(&db[i]);
+    }
+    return len;
+}
+
+/* Header of a queued frame is a pad poll, *seq = its poll number */
+static int sim_check(const uint8_t *c, const uint8_t *d, uint16_t *seq){
+    uint8_t cc[PS1_DECIDE_LEN], dd[PS1_DECIDE_LEN], i;
+    uint16_t id;
+    for (i = 0; i < PS1_DECIDE_LEN; i++){
+        cc[i] = c[i];
+        dd[i] = d[i];
+        reverse_byte(&cc[i]);
+        reverse_byte(&dd[i]);
+    }
+    id = dd[1] | dd[2] << 8;
+    *seq = dd[3] | dd[4] << 8;
+    return cc[0] == CMD_SEL_CTRL_1 && cc[1] == CMD_READ_SW && dd[0] == 0xFF &&
+        (id == ID_DIG_CTRL || id == ID_ANP_CTRL);
+}
+
+/* Count a poll once, in order, and the longest run of polls lost before it */
+static int sim_new(uint16_t seq, uint16_t *last, unsigned long *run){
+    uint16_t d = seq - *last;
+    if (d == 0 || d >= 0x8000)
+        return 0;
+    if (run && d - 1u > *run)
+        *run = d - 1u;
+    *last = seq;
+    return 1;
+}
+
+/* Start of transaction k, right after the previous one within a burst */
+static uint64_t sim_start(const struct Sim_Case *c, uint32_t k, uint64_t prev_end){
+    uint64_t t = prev_end + BYTE_US;
+    uint64_t burst = (uint64_t)(k / c->burst) * c->period_us;
+    if (k % c->burst == 0 && burst > t)
+        t = burst;
+    return t;
+}
+
+/* Queued capture: ISR runs on every byte, main loop takes decode_us per frame */
+static unsigned long sim_queue(const struct Sim_Case *c, unsigned long n,
+        unsigned long *polls, unsigned long *run){
+    static uint8_t cb[SIM_MAX_LEN+1], db[SIM_MAX_LEN+1];
+    uint64_t avail[PS1_QUEUE_SIZE], main_t = 0, t = 0, t0, start;
+    unsigned long good = 0;
+    uint32_t k;
+    uint16_t seq, last = 0xFFFF, pads = 0;
+    uint8_t j, len, pad, head, port = 0;
+    struct PS1_Frame *f;
+
+    *polls = 0;
+    *run = 0;
+    ps1_capture_init();
+    for (k = 0; k <= n; k++){
+        len = sim_frame(c, k, pads, cb, db, &pad);
+        if (c->glitch && k % c->glitch == c->glitch-1u)
+            len = sim_glitch(cb, db, len);
+        pads += pad;
+        *polls += k < n ? pad : 0;
+        t0 = sim_start(c, k, t);
+        if (c->mix == MIX_MTAP)
+            port = k % PS1_PORTS;
+        if (c->ss && k < n)
+            ps1_capture_start(port, t0);
+        for (j = 0; j < len; j++){
+            t = k < n ? t0 + (j + 1) * BYTE_US : ~0ull;
+            // main loop: decode whatever it can finish before this byte
+            while ((f = ps1_capture_peek()) != 0){
+                start = main_t > avail[capture.tail] ? main_t : avail[capture.tail];
+                if (start + c->decode_us > t)
+                    break;
+                // multitap slots of both ports take turns: pad = seq % 8
+                if (sim_check(f->cmd.buff, f->data.buff, &seq) &&
+                        f->pad == (c->mix == MIX_MTAP ? seq % PS1_PADS : 0) &&
+                        sim_new(seq, &last, run))
+                    good++;
+                ps1_capture_release();
+                main_t = start + c->decode_us;
+            }
+            if (k == n){
+                seq = *polls;
+                sim_new(seq, &last, run); // polls lost at the very end
+                return good;
+            }
+            // ISR
+            head = capture.head;
+            ps1_capture_byte(cb[j], db[j]);
+            if (capture.head != head)
+                avail[head] = t;
+        }
+    }
+    return good;
+}
+
+/* Original main.c: count to 9 bytes, peripheral interrupts off while decoding */
+static unsigned long sim_masked(const struct Sim_Case *c, unsigned long n){
+    static uint8_t cb[SIM_MAX_LEN+1], db[SIM_MAX_LEN+1];
+    uint64_t masked = 0, t = 0, t0;
+    unsigned long good = 0;
+    uint32_t k;
+    uint16_t seq, last = 0xFFFF, pads = 0;
+    uint8_t j, len, pad, cnt = 0;
+    uint8_t cmd_buff[PS1_CTRL_BUFF_SIZE], data_buff[PS1_CTRL_BUFF_SIZE];
+
+    for (k = 0; k < n; k++){
+        len = sim_frame(c, k, pads, cb, db, &pad);
+        if (c->glitch && k % c->glitch == c->glitch-1u)
+            len = sim_glitch(cb, db, len);
+        pads += pad;
+        t0 = sim_start(c, k, t);
+        for (j = 0; j < len; j++){
+            t = t0 + (j + 1) * BYTE_US;
+            if (t < masked)
+                continue; // PEIE = 0, byte is lost
+            cmd_buff[cnt] = cb[j];
+            data_buff[cnt] = db[j];
+            if (++cnt >= PS1_CTRL_BUFF_SIZE){
+                if (sim_check(cmd_buff, data_buff, &seq))
+                    good += sim_new(seq, &last, 0);
+                masked = t + c->decode_us;
+                cnt = 0;
+            }
+        }
+    }
+    return good;
+}
+
+static int bench_capture(void){
+    static const struct Sim_Case cases[] = {
+        {"60 Hz, 1 pad", 16667, 1, MIX_ANALOG, DECODE_US, 1, 0},
+        {"60 Hz, 2 multitaps", 16667, 2, MIX_MTAP, DECODE_US, 1, 0},
+        {"back-to-back multitaps", 0, 1, MIX_MTAP, DECODE_US, 1, 0},
+        {"back-to-back polls", 0, 1, MIX_ANALOG, DECODE_US, 1, 0},
+        {"60 Hz, pads + card", 16667, 3, MIX_CARD, DECODE_US, 1, 0},
+        {"back-to-back pads + card", 0, 1, MIX_CARD, DECODE_US, 1, 0},
+        {"glitches, no SS edge", 0, 1, MIX_CARD, DECODE_US, 0, 7},
+        {"glitches, SS edge", 0, 1, MIX_CARD, DECODE_US, 1, 7},
+    };
+    unsigned long q, m, polls, run;
+    uint8_t i;
+    int err = 0;
+
+    printf("capture: %u us/byte, %u us decode, %lu transactions per case\n", BYTE_US, DECODE_US, SIM_FRAMES);
+    printf("  %-26s %8s %10s %8s %8s %8s %8s %10s\n", "case", "polls", "queued ok", "dropped",
+        "max run", "overrun", "resync", "masked ok");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        q = sim_queue(&cases[i], SIM_FRAMES, &polls, &run);
+        m = sim_masked(&cases[i], SIM_FRAMES);
+        printf("  %-26s %8lu %10lu %8lu %8lu %8u %8u %10lu\n", cases[i].name, polls, q, polls - q,
+            run, capture.overrun, capture.resync, m);
+        // a glitch may cost its own poll, never the one after it
+        if (cases[i].glitch ? (cases[i].ss && run > 1) : q != polls)
+            err = 1;
+    }
+    return err;
+}
+
+/**********************************************************/
+/* Reset state machine on a simulated 1 ms clock */
+
+#define POLL_MS 17 // ~60 Hz
+
+/* Put one poll with these switches through the ISR, wire order */
+static void poll_pad(uint16_t id, uint16_t sw, uint16_t stamp){
+    uint8_t c[PS1_CTRL_BUFF_SIZE] = {CMD_SEL_CTRL_1, CMD_READ_SW};
+    uint8_t d[PS1_CTRL_BUFF_SIZE] = {0xFF, id & 0xFF, id >> 8, sw & 0xFF, sw >> 8, 0x80, 0x80, 0x80, 0x80};
+    uint8_t i, len = id == ID_DIG_CTRL ? 5 : 9;
+    ps1_capture_start(0, stamp);
+    for (i = 0; i < len; i++){
+        reverse_byte(&c[i]);
+        reverse_byte(&d[i]);
+        ps1_capture_byte(c[i], d[i]);
+    }
+}
+
+/* Main loop: decode everything queued */
+static unsigned long main_loop(void){
+    struct PS1_Frame *f;
+    unsigned long n = 0;
+    while ((f = ps1_capture_peek()) != 0){
+        ps1_reset_poll(ps1_decode(&pads[f->pad], &f->cmd, &f->data, f->stamp));
+        ps1_capture_release();
+        n++;
+    }
+    return n;
+}
+
+struct Reset_Case{
+    const char *name;
+    uint32_t combo_ms, combo_len_ms; // first combo held
+    uint16_t combo;
+    uint32_t combo2_ms; // second combo, 0 = none
+    uint16_t combo2;
+    uint32_t pulse_ms; // expected pulse width
+};
+
+static int bench_reset(void){
+    static const struct Reset_Case cases[] = {
+        {"short combo", 1000, 300, KEY_COMBO_CTRL, 0, 0, RESET_SHORT_MS},
+        {"xStation combo", 1000, 300, KEY_COMBO_XSTATION, 0, 0, RESET_LONG_MS},
+        {"short, then xStation", 1000, 100, KEY_COMBO_CTRL, 1200, KEY_COMBO_XSTATION, RESET_LONG_MS},
+        {"held through lockout", 1000, 5000, KEY_COMBO_CTRL, 0, 0, RESET_SHORT_MS},
+    };
+    uint32_t t, first, pulse_on, pulse_len, lock_end;
+    unsigned long frames, frames_pulse;
+    uint16_t sw;
+    uint8_t i, pin;
+    int err = 0, ok;
+
+    printf("reset: 1 ms tick, polls every %u ms through the pulse, lockout 5000 ms at most\n", POLL_MS);
+    printf("  %-24s %10s %8s %10s %12s %8s\n", "case", "latency", "pulse", "lockout", "polls during", "ignored");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Reset_Case *c = &cases[i];
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0); // armed from the start
+        reset.lockout_ms = 5000;
+        first = pulse_on = pulse_len = lock_end = 0;
+        frames = frames_pulse = 0;
+        for (t = 1; t < 12000; t++){
+            if (t % POLL_MS == 0){
+                sw = 0xFFFF;
+                if (t >= c->combo_ms && t < c->combo_ms + c->combo_len_ms)
+                    sw = c->combo;
+                if (c->combo2_ms && t >= c->combo2_ms && t < c->combo2_ms + 100)
+                    sw = c->combo2;
+                if (sw != 0xFFFF && !first)
+                    first = t;
+                poll_pad(ID_ANP_CTRL, sw, t * 1000);
+            }
+            frames = main_loop();
+            if (reset.state == PS1_RST_PULSE)
+                frames_pulse += frames; // capture still running
+            pin = ps1_reset_tick();
+            if (pin){
+                if (!pulse_on)
+                    pulse_on = t;
+                pulse_len++;
+            }else if (pulse_on && !lock_end && reset.state == PS1_RST_IDLE)
+                lock_end = t;
+        }
+        ok = pulse_len == c->pulse_ms && reset.resets == 1 && frames_pulse > 0 &&
+            lock_end - (pulse_on + pulse_len) == reset.armed_ms;
+        printf("  %-24s %7lu ms %5lu ms %7lu ms %12lu %8u %s\n", c->name,
+            (unsigned long)(pulse_on - first), (unsigned long)pulse_len,
+            (unsigned long)(lock_end - pulse_on - pulse_len), frames_pulse,
+            reset.ignored, ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/* Noisy polling: every PRESS_EVERY_MS the combo is held for PRESS_MS
+ * with every 7th poll of it corrupted, in between isolated frames that
+ * look like a combo and short brushes over it, at least 3 polls apart */
+#define HOLD_RUN_MS 100000
+#define PRESS_EVERY_MS 5000
+#define PRESS_MS 300
+
+struct Hold_Case{
+    const char *name;
+    uint16_t every_ms; // poll period
+    uint16_t combo; // held for the presses
+    uint8_t glitch; // 1 in glitch polls between presses is a lone combo frame, 0 = none
+    uint16_t brush_ms; // combo brushed for up to this long, ~5 a second, 0 = none
+};
+
+static int bench_hold(void){
+    static const struct Hold_Case cases[] = {
+        {"60 Hz, clean", 17, KEY_COMBO_CTRL, 0, 0},
+        {"60 Hz, lone combo frames", 17, KEY_COMBO_CTRL, 8, 0},
+        {"60 Hz, brushed combos", 17, KEY_COMBO_XSTATION, 0, 40},
+        {"50 Hz, frames + brushes", 20, KEY_COMBO_CTRL, 8, 40},
+        {"30 Hz, frames + brushes", 33, KEY_COMBO_XSTATION, 8, 40},
+        {"250 Hz, frames + brushes", 4, KEY_COMBO_CTRL, 8, 40},
+    };
+    uint32_t t, press, bound, lat, lat_max, brush_t, brush_end, last_noise;
+    unsigned long presses, hits, wrong, pressed, noise;
+    uint16_t sw, hold_ms;
+    uint8_t i, pin, was = 0;
+    int err = 0;
+
+    hold_ms = COMBO_HOLD_SHORT > COMBO_HOLD_LONG ? COMBO_HOLD_SHORT : COMBO_HOLD_LONG;
+    hold_ms *= COMBO_HOLD_UNIT_MS;
+    printf("hold: %u polls and %u ms, %u ms presses every %u ms for %u s\n", COMBO_HOLD_POLLS,
+        hold_ms, PRESS_MS, PRESS_EVERY_MS, HOLD_RUN_MS / 1000);
+    printf("  %-26s %8s %8s %8s %8s %10s %10s\n", "trace", "noise", "presses", "resets", "false",
+        "max lat", "bound");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Hold_Case *c = &cases[i];
+        // first poll of the press, hold time, one forgiven poll, the tick
+        bound = hold_ms + 2 * c->every_ms + 1;
+        if ((COMBO_HOLD_POLLS + 1u) * c->every_ms + 1 > bound)
+            bound = (COMBO_HOLD_POLLS + 1) * c->every_ms + 1;
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        reset.lockout_ms = 500; // a press held on doesn't fire again
+        presses = hits = wrong = pressed = noise = 0;
+        lat_max = 0;
+        brush_t = brush_end = 0;
+        last_noise = 0;
+        press = 0;
+        for (t = 1; t < HOLD_RUN_MS; t++){
+            if (t % PRESS_EVERY_MS == PRESS_EVERY_MS / 2){
+                press = t;
+                presses++;
+                pressed = 0;
+            }
+            if (t % c->every_ms == 0){
+                sw = 0xFFFF & ~(rng() & 0x00F0); // d-pad noise
+                if (press && t < press + PRESS_MS){
+                    sw = c->combo;
+                    if (++pressed % 7 == 0)
+                        sw ^= 1 << (rng() % 16); // corrupt frame
+                }else if (press && t < press + RESET_LONG_MS + 500)
+                    ; // pulse and lockout
+                else{
+                    if (brush_t && t < brush_end){
+                        sw = c->combo;
+                        last_noise = t;
+                    }else if (t - last_noise > 3u * c->every_ms){
+                        brush_t = 0;
+                        if (c->brush_ms && rng() % 200 < c->every_ms){
+                            brush_t = last_noise = t;
+                            noise++;
+                            brush_end = t + 1 + rng() % c->brush_ms;
+                            sw = c->combo;
+                        }else if (c->glitch && rng() % c->glitch == 0){
+                            last_noise = t; // lone frame
+                            noise++;
+                            sw = rng() & 1 ? KEY_COMBO_CTRL : KEY_COMBO_XSTATION;
+                        }
+                    }
+                }
+                poll_pad(ID_ANP_CTRL, sw, t * 1000);
+            }
+            main_loop();
+            pin = ps1_reset_tick();
+            if (pin && !was){
+                lat = t - press;
+                if (press && lat <= bound){
+                    hits++;
+                    if (lat > lat_max)
+                        lat_max = lat;
+                }else
+                    wrong++;
+            }
+            was = pin;
+        }
+        printf("  %-26s %8lu %8lu %8u %8lu %7u ms %7u ms %s\n", c->name, noise, presses, reset.resets, wrong,
+            lat_max, bound, hits == presses && !wrong ? "" : "FAIL");
+        if (hits != presses || wrong)
+            err = 1;
+    }
+
+    // a gap in the polling starts the hold over, also one the 16 bit
+    // stamps see as a short one (70 ms is 4.5 ms to them)
+    for (i = 0; i < 4; i++){
+        static const uint16_t gaps[] = {40, 70, 200, 1000};
+        uint32_t back = 2 * POLL_MS + gaps[i], fired = 0;
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        for (t = 1; t < back + 1000 && !fired; t++){
+            if (t <= 2 * POLL_MS ? t % POLL_MS == 0 : t >= back && (t - back) % POLL_MS == 0)
+                poll_pad(ID_ANP_CTRL, KEY_COMBO_CTRL, t * 1000);
+            main_loop();
+            if (ps1_reset_tick())
+                fired = t;
+        }
+        // held on across the gap: fires before hold_ms of polls after it
+        was = gaps[i] * 1000ul <= COMBO_HOLD_GAP_US ? fired && fired < back + hold_ms :
+            fired >= back + hold_ms;
+        printf("  gap of %4u ms in the hold   reset %3lu ms after the polls came back %s\n",
+            gaps[i], (unsigned long)(fired - back), was ? "" : "FAIL");
+        if (!was)
+            err = 1;
+    }
+    return err;
+}
+
+/* One multitap transaction in tap mode on port, slot switches sw[],
+ * 0 = nothing in the slot */
+static void poll_tap(uint8_t port, const uint16_t *sw, uint16_t stamp){
+    uint8_t c[MTAP_LEN] = {CMD_SEL_CTRL_1, CMD_READ_SW, CMD_TAP};
+    uint8_t d[MTAP_LEN] = {0xFF, ID_MULTITAP & 0xFF, ID_MULTITAP >> 8};
+    uint8_t i, *p;
+    for (i = 0; i < PS1_SLOTS; i++){
+        p = &d[3 + MTAP_SLOT_LEN*i];
+        memset(p, sw[i] ? 0x80 : 0xFF, MTAP_SLOT_LEN);
+        if (sw[i]){
+            p[0] = ID_ANP_CTRL & 0xFF;
+            p[1] = ID_ANP_CTRL >> 8;
+            p[2] = sw[i] & 0xFF;
+            p[3] = sw[i] >> 8;
+        }
+    }
+    ps1_capture_start(port, stamp);
+    for (i = 0; i < MTAP_LEN; i++){
+        reverse_byte(&c[i]);
+        reverse_byte(&d[i]);
+        ps1_capture_byte(c[i], d[i]);
+    }
+}
+
+/* A multitap on each port, every slot keeps its own combo state */
+struct Mtap_Case{
+    const char *name;
+    uint8_t port; // port the combo slots are on
+    uint16_t sw[PS1_SLOTS]; // held from 500 to 800 ms, 0 = empty slot
+    uint8_t resets; // expected
+};
+
+static int bench_mtap(void){
+    static const struct Mtap_Case cases[] = {
+        {"port 1 slot A", 0, {KEY_COMBO_CTRL, 0xFFFF, 0xFFFF, 0xFFFF}, 1},
+        {"port 2 slot C", 1, {0xFFFF, 0xFFFF, KEY_COMBO_XSTATION, 0xFFFF}, 1},
+        {"port 2 slot D, B C empty", 1, {0xFFFF, 0, 0, KEY_COMBO_CTRL}, 1},
+        {"same combo on 2 slots", 0, {KEY_COMBO_CTRL, KEY_COMBO_CTRL, 0xFFFF, 0xFFFF}, 1},
+        {"combo split over 2 slots", 0, {KEY_COMBO_CTRL | 0x0300, 0xFCFF, 0xFFFF, 0xFFFF}, 0},
+    };
+    static const uint16_t idle[PS1_SLOTS] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+    const uint16_t *sw;
+    uint32_t t, first;
+    unsigned long frames, expect;
+    uint8_t i, j, port;
+    int err = 0, ok;
+
+    printf("multitap: %u pads, polls every %u ms on both ports\n", PS1_PADS, POLL_MS);
+    printf("  %-26s %8s %8s %10s\n", "case", "frames", "resets", "latency");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Mtap_Case *c = &cases[i];
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        reset.lockout_ms = 500;
+        frames = expect = first = 0;
+        for (t = 1; t < 3000; t++){
+            if (t % POLL_MS == 0){
+                for (port = 0; port < PS1_PORTS; port++){
+                    sw = port == c->port && t >= 500 && t < 800 ? c->sw : idle;
+                    poll_tap(port, sw, t * 1000 + port * 1500);
+                    for (j = 0; j < PS1_SLOTS; j++)
+                        expect += sw[j] != 0;
+                    frames += main_loop();
+                }
+            }
+            if (ps1_reset_tick() && !first)
+                first = t;
+        }
+        // an empty slot queues no frame
+        ok = reset.resets == c->resets && frames == expect;
+        printf("  %-26s %8lu %8u %7lu ms %s\n", c->name, frames, reset.resets,
+            first ? (unsigned long)(first - 500) : 0ul, ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/* One sector write through the ISR: the first len bytes of it, the card
+ * answers status at the end */
+static void card_write(uint16_t sector, uint8_t status, uint8_t len, uint16_t stamp){
+    uint8_t c[MEMC_WRITE_LEN], d[MEMC_WRITE_LEN];
+    uint8_t i;
+
+    memset(c, 0, sizeof(c));
+    memset(d, 0, sizeof(d));
+    c[0] = CMD_SEL_MEMC_1;
+    c[1] = CMD_MEMC_WRITE;
+    c[4] = sector >> 8;
+    c[5] = sector & 0xFF;
+    for (i = 6; i < 6 + 128; i++)
+        c[i] = rng();
+    d[0] = 0xFF;
+    d[1] = 0x08;
+    d[2] = MEMC_ID1;
+    d[3] = MEMC_ID2;
+    d[MEMC_WRITE_LEN-3] = 0x5C;
+    d[MEMC_WRITE_LEN-2] = 0x5D;
+    d[MEMC_WRITE_LEN-1] = status;
+    ps1_capture_start(0, stamp);
+    for (i = 0; i < len; i++){
+        reverse_byte(&c[i]);
+        reverse_byte(&d[i]);
+        ps1_capture_byte(c[i], d[i]);
+    }
+}
+
+/* A save between the pad polls: one sector every gap_ms from 2 s on,
+ * the combo held for 300 ms from press_ms */
+#define SAVE_MS 2000
+
+struct Card_Case{
+    const char *name;
+    uint16_t sectors; // written, 0 = no save
+    uint16_t gap_ms; // between sectors
+    uint32_t press_ms;
+    uint16_t combo;
+    uint8_t bad; // every bad-th sector fails: odd ones bad checksum, even ones cut short
+    uint8_t deferred; // expected
+};
+
+static int bench_card(void){
+    static const struct Card_Case cases[] = {
+        {"no save", 0, 17, 3000, KEY_COMBO_CTRL, 0, 0},
+        {"combo before the save", 64, 17, 1000, KEY_COMBO_CTRL, 0, 0},
+        {"combo during 1 block", 64, 17, 2500, KEY_COMBO_CTRL, 0, 1},
+        {"xStation during 1 block", 64, 17, 2500, KEY_COMBO_XSTATION, 0, 1},
+        {"3 blocks, 1 per frame", 192, 17, 3000, KEY_COMBO_CTRL, 0, 1},
+        {"slow save, 1 s pauses", 8, 1000, 2200, KEY_COMBO_CTRL, 0, 1},
+        {"failed writes", 64, 17, 2500, KEY_COMBO_CTRL, 5, 1},
+        {"combo right after save", 32, 17, 2000 + 32 * 17 + 100, KEY_COMBO_CTRL, 0, 1},
+    };
+    uint32_t t, pulse_on, last_write;
+    unsigned long sent, frames, during;
+    uint16_t sw, k, good, failed;
+    uint8_t i, pin, st, len;
+    int err = 0, ok;
+
+    printf("memory card: sector writes between %u ms polls, resets wait %u ms after the last one\n",
+        POLL_MS, CARD_IDLE_MS);
+    printf("  %-26s %8s %8s %8s %8s %10s %10s\n", "case", "writes", "failed", "polls", "deferred",
+        "last write", "RESET low");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Card_Case *c = &cases[i];
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        reset.lockout_ms = 500;
+        pulse_on = last_write = 0;
+        sent = frames = during = 0;
+        k = good = failed = 0;
+        for (t = 1; t < SAVE_MS + (uint32_t)c->sectors * c->gap_ms + 5000; t++){
+            if (t % POLL_MS == 0){
+                sw = t >= c->press_ms && t < c->press_ms + 300 ? c->combo : 0xFFFF;
+                poll_pad(ID_ANP_CTRL, sw, t * 1000);
+                sent++;
+            }
+            if (k < c->sectors && t >= SAVE_MS && (t - SAVE_MS) % c->gap_ms == 5){
+                // sector k, a few ms after the poll like a game does it
+                st = MEMC_GOOD;
+                len = MEMC_WRITE_LEN;
+                if (c->bad && k % c->bad == c->bad - 1){
+                    if (k / c->bad & 1)
+                        len = 70; // SS released in the middle of the data
+                    else
+                        st = 0x4E; // bad checksum
+                    failed++;
+                }else
+                    good++;
+                card_write(k++, st, len, t * 1000);
+                last_write = t;
+                if (reset.state == PS1_RST_PULSE)
+                    during++; // reset in the middle of a save
+            }
+            frames += main_loop();
+            pin = ps1_reset_tick();
+            if (pin && !pulse_on)
+                pulse_on = t;
+        }
+        // the last cut short write is only seen when the next one starts
+        if (c->bad && (k - 1u) % c->bad == c->bad - 1u && ((k - 1u) / c->bad & 1))
+            failed--;
+        ok = reset.resets == 1 && reset.deferred == c->deferred && !during && frames == sent &&
+            card.writes == good && card.failed == failed &&
+            reset.action == (c->combo == KEY_COMBO_XSTATION ? PS1_ACT_LONG : PS1_ACT_SHORT);
+        if (c->deferred)
+            ok = ok && pulse_on == last_write + CARD_IDLE_MS;
+        printf("  %-26s %8u %8u %8lu %8u %7lu ms %7lu ms %s\n", c->name, card.writes, card.failed,
+            frames, reset.deferred, (unsigned long)last_write, (unsigned long)pulse_on, ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/* DualShock transaction through the ISR: command with arguments 3 and 4,
+ * the pad answers id and sw (bytes 3 and 4) */
+static void poll_ds(uint8_t command, uint8_t a3, uint8_t a4, uint16_t id, uint16_t sw, uint16_t stamp){
+    uint8_t c[PS1_CTRL_BUFF_SIZE] = {CMD_SEL_CTRL_1, command, 0x00, a3, a4};
+    uint8_t d[PS1_CTRL_BUFF_SIZE] = {0xFF, id & 0xFF, id >> 8, sw & 0xFF, sw >> 8, 0x80, 0x80, 0x80, 0x80};
+    uint8_t i, len = id == ID_DIG_CTRL ? 5 : 9;
+    ps1_capture_start(0, stamp);
+    for (i = 0; i < len; i++){
+        reverse_byte(&c[i]);
+        reverse_byte(&d[i]);
+        ps1_capture_byte(c[i], d[i]);
+    }
+}
+
+/* What games send to switch a DualShock to analog (or back) and set up rumble */
+struct Ds_Step{
+    uint8_t command, a3, a4;
+};
+
+static const struct Ds_Step ds_to_analog[] = {
+    {CMD_CONFIG, 0x01, 0x00}, {CMD_SET_MODE, 0x01, 0x03}, {CMD_MOTOR_MAP, 0x00, 0x01},
+    {CMD_GET_STATUS, 0x00, 0x00}, {CMD_QUERY_ACT, 0x00, 0x00}, {CMD_QUERY_ACT, 0x01, 0x00},
+    {CMD_QUERY_COMB, 0x00, 0x00}, {CMD_QUERY_MODE, 0x00, 0x00}, {CMD_QUERY_MODE, 0x01, 0x00},
+    {CMD_CONFIG, 0x00, 0x00},
+};
+static const struct Ds_Step ds_to_digital[] = {
+    {CMD_CONFIG, 0x01, 0x00}, {CMD_SET_MODE, 0x00, 0x02}, {CMD_CONFIG, 0x00, 0x00},
+};
+
+#define DS_STEPS (sizeof(ds_to_analog) / sizeof(ds_to_analog[0]))
+
+struct Ds_Case{
+    const char *name;
+    uint8_t read; // command the game polls with, 0x42 or 0x43
+    uint8_t analog; // pad starts in analog mode
+    uint32_t config_ms; // config sequence starts, 0 = none
+    uint8_t step_ms; // between its commands, 0 = none
+    uint8_t to_analog; // ds_to_analog or ds_to_digital
+    uint32_t press_ms; // combo held for 300 ms, 0 = none
+    uint16_t config_sw; // what the pad answers in config mode
+    uint8_t resets, mode; // expected
+};
+
+/* Mode the DualShock is in after the steps */
+static void ds_step(const struct Ds_Step *st, uint8_t *analog, uint8_t *config){
+    if (st->command == CMD_CONFIG)
+        *config = st->a3;
+    else if (st->command == CMD_SET_MODE && *config)
+        *analog = st->a3;
+}
+
+static int bench_config(void){
+    static const struct Ds_Case cases[] = {
+        {"polled with 0x43", CMD_CONFIG, 0, 0, 0, 0, 1000, 0xFFFF, 1, 0},
+        {"analog switch, 1 ms steps", CMD_READ_SW, 0, 1100, 1, 1, 1000, 0xFFFF, 1,
+            PS1_MODE_ANALOG | PS1_MODE_LOCK},
+        {"analog switch, 1 per frame", CMD_READ_SW, 0, 1050, POLL_MS, 1, 1000, 0xFFFF, 1,
+            PS1_MODE_ANALOG | PS1_MODE_LOCK},
+        {"back to digital in a hold", CMD_CONFIG, 1, 1080, 1, 0, 1000, 0xFFFF, 1, 0},
+        {"config answers = combo", CMD_READ_SW, 0, 1000, 20, 1, 0, KEY_COMBO_CTRL, 0,
+            PS1_MODE_ANALOG | PS1_MODE_LOCK},
+        {"config with no combo", CMD_READ_SW, 1, 1000, 1, 0, 0, 0xFFFF, 0, 0},
+    };
+    static struct Bench_Frame mix[SET_SIZE];
+    uint32_t t, next, first, k;
+    unsigned long sent, frames;
+    uint64_t t0, dt[2];
+    uint8_t i, j, analog, config, step, pin, act;
+    uint16_t sw;
+    int err = 0, ok;
+
+    printf("DualShock: config sequences of %u commands while polling every %u ms\n",
+        (unsigned)DS_STEPS, POLL_MS);
+    printf("  %-28s %8s %8s %8s %10s %6s\n", "case", "sent", "decoded", "resets", "latency", "mode");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Ds_Case *c = &cases[i];
+        const struct Ds_Step *seq = c->to_analog ? ds_to_analog : ds_to_digital;
+        uint8_t steps = c->to_analog ? DS_STEPS : sizeof(ds_to_digital) / sizeof(ds_to_digital[0]);
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        reset.lockout_ms = 500;
+        analog = c->analog;
+        config = 0;
+        step = 0;
+        next = c->config_ms;
+        sent = frames = first = 0;
+        for (t = 1; t < 4000; t++){
+            if (c->step_ms && step < steps && t >= next && t % POLL_MS != 0){
+                // config command, the pad answers F3 once in config mode
+                ds_step(&seq[step], &analog, &config);
+                poll_ds(seq[step].command, seq[step].a3, seq[step].a4,
+                    seq[step].command == CMD_CONFIG && seq[step].a3 ? (analog ? ID_ANP_CTRL : ID_DIG_CTRL) : ID_CONFIG,
+                    c->config_sw, t * 1000);
+                sent++;
+                step++;
+                next = t + c->step_ms;
+            }
+            if (t % POLL_MS == 0){
+                sw = c->press_ms && t >= c->press_ms && t < c->press_ms + 300 ? KEY_COMBO_CTRL : 0xFFFF;
+                if (config)
+                    poll_ds(CMD_READ_SW, 0, 0, ID_CONFIG, c->config_sw, t * 1000);
+                else
+                    poll_ds(c->read, 0, 0, analog ? ID_ANP_CTRL : ID_DIG_CTRL, sw, t * 1000);
+                sent++;
+            }
+            frames += main_loop();
+            pin = ps1_reset_tick();
+            if (pin && !first)
+                first = t;
+        }
+        ok = reset.resets == c->resets && frames == sent && pads[0].mode == c->mode;
+        printf("  %-28s %8lu %8lu %8u %7lu ms %6s %s\n", c->name, sent, frames, reset.resets,
+            first ? (unsigned long)(first - c->press_ms) : 0ul,
+            pads[0].mode & PS1_MODE_ANALOG ? (pads[0].mode & PS1_MODE_LOCK ? "A lock" : "analog") : "dig",
+            ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+
+    // decode rate: reads only against a game running config sequences
+    for (j = 0; j < 2; j++){
+        for (k = 0; k < SET_SIZE; k++){
+            if (j && k % 16 < DS_STEPS){
+                // pad answers F3 to all but the enter command
+                make_frame(&mix[k], CMD_SEL_CTRL_1, k % 16 ? ID_CONFIG : ID_ANP_CTRL, 0xFFFF, PS1_ACT_NONE);
+                mix[k].cmd[1] = ds_to_analog[k % 16].command;
+                reverse_byte(&mix[k].cmd[1]);
+                mix[k].cmd[3] = ds_to_analog[k % 16].a3;
+                reverse_byte(&mix[k].cmd[3]);
+            }else
+                make_frame(&mix[k], CMD_SEL_CTRL_1, ID_ANP_CTRL, 0xFFFF, PS1_ACT_NONE);
+        }
+        pads_init();
+        act = 0;
+        t0 = bench_ticks();
+        for (k = 0; k < 100 * SET_SIZE; k++){
+            memcpy(cmd.buff, mix[k % SET_SIZE].cmd, PS1_CTRL_BUFF_SIZE);
+            memcpy(data.buff, mix[k % SET_SIZE].data, PS1_CTRL_BUFF_SIZE);
+            act |= ps1_decode(&pads[0], &cmd, &data, k * 16667);
+        }
+        dt[j] = bench_ticks() - t0;
+        if (act)
+            err = 1;
+    }
+    printf("  decode: reads %.1f " TICK_UNIT "/frame, with config sequences %.1f " TICK_UNIT "/frame\n",
+        (double)dt[0] / (100 * SET_SIZE), (double)dt[1] / (100 * SET_SIZE));
+    return err;
+}
+
+/* Boot trace: polling segments after power up or a reset */
+struct Boot_Seg{
+    uint32_t from_ms, to_ms;
+    uint16_t every_ms; // poll period
+    uint16_t sw; // switches
+};
+
+struct Boot_Trace{
+    const char *name;
+    struct Boot_Seg seg[3];
+    uint8_t nseg;
+};
+
+#define BOOT_LOCKOUT_MS 20000 // REBOOT_DELAY
+
+static int bench_boot(void){
+    static const struct Boot_Trace traces[] = {
+        {"menu polls from 1.5 s", {{1500, 30000, POLL_MS, 0xFFFF}}, 1},
+        {"BIOS blip, game at 5 s", {{600, 900, POLL_MS, 0xFFFF}, {5000, 30000, POLL_MS, 0xFFFF}}, 2},
+        {"combo held until 4 s", {{1000, 4000, POLL_MS, KEY_COMBO_CTRL}, {4000, 30000, POLL_MS, 0xFFFF}}, 2},
+        {"15 Hz polling from 1 s", {{1000, 30000, 67, 0xFFFF}}, 1},
+        {"no controller", {{0, 0, 1, 0xFFFF}}, 0},
+    };
+    uint32_t t, armed;
+    uint8_t i, j;
+    int err = 0;
+
+    printf("boot: lockout %u ms at most, arm after %u ms and %u polls in a row\n",
+        BOOT_LOCKOUT_MS, ARM_MIN_MS, ARM_POLLS);
+    printf("  %-26s %10s %8s %8s\n", "trace", "armed at", "resets", "ignored");
+    for (i = 0; i < sizeof(traces) / sizeof(traces[0]); i++){
+        const struct Boot_Trace *b = &traces[i];
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(BOOT_LOCKOUT_MS);
+        armed = 0;
+        for (t = 1; t < 30000 && !armed; t++){
+            for (j = 0; j < b->nseg; j++){
+                if (t >= b->seg[j].from_ms && t < b->seg[j].to_ms &&
+                        (t - b->seg[j].from_ms) % b->seg[j].every_ms == 0)
+                    poll_pad(ID_DIG_CTRL, b->seg[j].sw, t * 1000);
+            }
+            main_loop();
+            ps1_reset_tick();
+            if (reset.state == PS1_RST_IDLE)
+                armed = t;
+        }
+        printf("  %-26s %7lu ms %8u %8u\n", b->name, (unsigned long)armed, reset.resets, reset.ignored);
+        if (!armed || reset.resets)
+            err = 1;
+    }
+    return err;
+}
+
+/* Console model: polls every POLL_MS until RESET goes low, nothing while
+ * it's held (if it's wired), then boots and polls as seg says, from the
+ * release. The combo is pressed at CONSOLE_COMBO_MS. Every case runs with
+ * the short pulse ending on a quiet bus and with the fixed one. */
+#define CONSOLE_COMBO_MS 1000
+
+struct Console_Case{
+    const char *name;
+    uint16_t combo;
+    uint32_t combo_len_ms; // held this long, polls after the boot see it too
+    uint8_t wired; // RESET stops the console
+    struct Boot_Seg seg[2]; // from the release
+    uint8_t nseg;
+};
+
+struct Console_Run{
+    uint32_t first, pulse_on, pulse_len, up, armed; // ms, up: first poll after the release
+};
+
+static void console_run(const struct Console_Case *c, uint8_t release_ms, struct Console_Run *r){
+    uint32_t t, release = 0;
+    uint16_t sw;
+    uint8_t j, pin = 0, poll;
+
+    ps1_capture_init();
+    pads_init();
+    ps1_reset_init(0); // armed from the start
+    reset.lockout_ms = BOOT_LOCKOUT_MS;
+    reset.release_ms = release_ms;
+    memset(r, 0, sizeof(*r));
+    for (t = 1; t < 40000 && !r->armed; t++){
+        sw = t >= CONSOLE_COMBO_MS && t < CONSOLE_COMBO_MS + c->combo_len_ms ? c->combo : 0xFFFF;
+        if (!r->pulse_on || !c->wired)
+            poll = t % POLL_MS == 0; // up, or RESET goes nowhere
+        else if (pin)
+            poll = 0; // held in reset
+        else{
+            poll = 0; // booting
+            for (j = 0; j < c->nseg; j++){
+                if (t - release >= c->seg[j].from_ms && t - release < c->seg[j].to_ms &&
+                        (t - release - c->seg[j].from_ms) % c->seg[j].every_ms == 0)
+                    poll = 1;
+            }
+            if (poll && !r->up)
+                r->up = t;
+        }
+        if (poll){
+            if (sw != 0xFFFF && !r->first)
+                r->first = t;
+            poll_pad(ID_DIG_CTRL, sw, t * 1000);
+        }
+        main_loop();
+        pin = ps1_reset_tick();
+        if (pin){
+            if (!r->pulse_on)
+                r->pulse_on = t;
+            r->pulse_len++;
+            release = t + 1;
+        }else if (r->pulse_on && reset.state == PS1_RST_IDLE)
+            r->armed = t;
+    }
+    if (!c->wired)
+        r->up = release; // never went down
+}
+
+static int bench_console(void){
+    static const struct Console_Case cases[] = {
+        {"menu polls from 1.5 s", KEY_COMBO_CTRL, 300, 1, {{1500, 30000, POLL_MS, 0xFFFF}}, 1},
+        {"BIOS blip, game at 5 s", KEY_COMBO_CTRL, 300, 1, {{600, 900, POLL_MS, 0xFFFF}, {5000, 30000, POLL_MS, 0xFFFF}}, 2},
+        {"combo held for 4 s", KEY_COMBO_CTRL, 4000, 1, {{1500, 30000, POLL_MS, 0xFFFF}}, 1},
+        {"xStation combo", KEY_COMBO_XSTATION, 300, 1, {{1500, 30000, POLL_MS, 0xFFFF}}, 1},
+        {"RESET not wired", KEY_COMBO_CTRL, 300, 0, {{0, 0, 1, 0xFFFF}}, 0},
+    };
+    struct Console_Run q, f;
+    uint8_t i, ok;
+    int err = 0;
+
+    printf("console: RESET stops the polls, short pulse ends after %u ms without one, fixed %u ms\n",
+        RESET_QUIET_MS, RESET_SHORT_MS);
+    printf("  %-24s %16s %18s %18s\n", "", "pulse", "console up", "armed");
+    printf("  %-24s %8s %7s %9s %8s %9s %8s\n", "case", "quiet", "fixed", "quiet", "fixed", "quiet", "fixed");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Console_Case *c = &cases[i];
+        console_run(c, RESET_QUIET_MS, &q);
+        console_run(c, 0, &f);
+        ok = q.armed && f.armed && reset.resets == 1 &&
+            f.pulse_len == (c->combo == KEY_COMBO_XSTATION ? RESET_LONG_MS : RESET_SHORT_MS) &&
+            q.pulse_on - q.first == f.pulse_on - f.first &&
+            // the console boots the same from the release, a held combo can keep the lockout on
+            q.up - (q.pulse_on + q.pulse_len) == f.up - (f.pulse_on + f.pulse_len) &&
+            q.armed - (q.pulse_on + q.pulse_len) >= f.armed - (f.pulse_on + f.pulse_len) && q.armed <= f.armed;
+        if (c->wired && c->combo != KEY_COMBO_XSTATION)
+            ok = ok && q.pulse_len >= RESET_QUIET_MS && q.pulse_len <= RESET_QUIET_MS + POLL_MS;
+        else
+            ok = ok && q.pulse_len == f.pulse_len;
+        printf("  %-24s %5lu ms %4lu ms %6lu ms %5lu ms %6lu ms %5lu ms %s\n", c->name,
+            (unsigned long)q.pulse_len, (unsigned long)f.pulse_len,
+            (unsigned long)(q.up - q.first), (unsigned long)(f.up - f.first),
+            (unsigned long)(q.armed - q.first), (unsigned long)(f.armed - f.first), ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/**********************************************************/
+/* HW_TIMING: ps1_capture_end and the poll period of every pad */
+
+#define GAP_US 10 // /ACK and the PS1 between two bytes
+#define JITTER_US 64u // SS edge to SS edge, vsync and game loop
+
+struct Timing_Case{
+    const char *name;
+    uint8_t sel; // select byte
+    uint16_t id;
+    uint8_t len; // bytes clocked
+    uint8_t bits; // extra bits, SS high in the middle of a byte
+    uint8_t resync, partial; // expected
+};
+
+/* The first len bytes of a poll, then SS high with what the timers saw,
+ * or without HW_TIMING nothing until the next SS edge (end = 0) */
+static void timing_tx(const struct Timing_Case *c, uint8_t end){
+    uint8_t cb[PS1_CTRL_BUFF_SIZE] = {c->sel, CMD_READ_SW};
+    uint8_t db[PS1_CTRL_BUFF_SIZE] = {0xFF, c->id & 0xFF, c->id >> 8, 0xFF, 0xFF, 0x80, 0x80, 0x80, 0x80};
+    uint16_t bits = c->len * 8 + c->bits;
+    uint8_t i;
+    ps1_capture_start(0, 0);
+    for (i = 0; i < c->len; i++){
+        reverse_byte(&cb[i]);
+        reverse_byte(&db[i]);
+        ps1_capture_byte(cb[i], db[i]);
+    }
+    if (end)
+        ps1_capture_end(bits * PS1_BIT_US + c->len * GAP_US, bits);
+}
+
+struct Rate_Case{
+    const char *name;
+    uint32_t period_us;
+    uint8_t tap; // multitap on port 1, 4 pads
+};
+
+static int bench_timing(void){
+    static const struct Timing_Case cases[] = {
+        {"digital poll", CMD_SEL_CTRL_1, ID_DIG_CTRL, 5, 0, 0, 0},
+        {"analog poll", CMD_SEL_CTRL_1, ID_ANP_CTRL, 9, 0, 0, 0},
+        {"analog, SS high at byte 6", CMD_SEL_CTRL_1, ID_ANP_CTRL, 6, 0, 1, 0},
+        {"analog, SS high at bit 51", CMD_SEL_CTRL_1, ID_ANP_CTRL, 6, 3, 1, 1},
+        {"analog, SS high after ID", CMD_SEL_CTRL_1, ID_ANP_CTRL, 2, 0, 1, 0},
+        {"no controller", CMD_SEL_CTRL_1, 0xFFFF, 3, 0, 0, 0},
+        {"empty port, no /ACK", CMD_SEL_CTRL_1, 0xFFFF, 1, 0, 0, 0},
+        {"empty card slot, no /ACK", CMD_SEL_MEMC_1, 0xFFFF, 1, 0, 0, 0},
+    };
+    static const struct Rate_Case rates[] = {
+        {"60 Hz NTSC", 16683, 0},
+        {"50 Hz PAL", 20000, 0},
+        {"60 Hz, multitap", 16683, 1},
+        {"30 Hz", 33367, 0},
+    };
+    static const uint16_t idle[PS1_SLOTS] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+    uint16_t resync;
+    uint32_t t, stamp;
+    uint8_t i, j, n;
+    int err = 0, ok;
+
+    printf("HW timing: %u us per bit, %u us between bytes\n", PS1_BIT_US, GAP_US);
+    printf("  %-26s %8s %8s %8s %8s %8s\n", "transaction", "width", "bytes", "gap", "resync", "partial");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Timing_Case *c = &cases[i];
+        // without HW_TIMING the next SS edge counts it
+        ps1_capture_init();
+        timing_tx(c, 0);
+        ps1_capture_start(0, 0);
+        resync = capture.resync;
+        ps1_capture_init();
+        timing_tx(c, 1);
+        ok = capture.resync == c->resync && resync == c->resync;
+        ps1_capture_start(0, 0); // next SS edge, counted once already
+        ok = ok && capture.resync == c->resync &&
+            capture.timing.partial == c->partial && capture.timing.bytes == c->len &&
+            capture.timing.gap == GAP_US && capture.timing.count == 1;
+        printf("  %-26s %5u us %8u %5u us %8u %8u %s\n", c->name, capture.timing.width,
+            capture.timing.bytes, capture.timing.gap, capture.resync, capture.timing.partial, ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+
+    printf("  %-26s %10s %10s\n", "poll rate", "period", "measured");
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        const struct Rate_Case *r = &rates[i];
+        n = r->tap ? PS1_SLOTS : 1;
+        ps1_capture_init();
+        pads_init();
+        // 10 s of polls, the stamp wraps every 65.5 ms
+        for (t = 1; t * r->period_us < 10000000; t++){
+            stamp = t * r->period_us + rng() % JITTER_US;
+            if (r->tap)
+                poll_tap(0, idle, stamp);
+            else
+                poll_pad(ID_ANP_CTRL, 0xFFFF, stamp);
+            main_loop();
+        }
+        for (j = 0, ok = 1; j < n; j++)
+            ok = ok && pads[j].period + JITTER_US >= r->period_us && pads[j].period <= r->period_us + JITTER_US;
+        printf("  %-26s %7lu us %7u us %s\n", r->name, (unsigned long)r->period_us, pads[0].period,
+            ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/**********************************************************/
+/* Journal: what a dump holds against what was polled */
+
+#define JPOLL_MAX 32768
+#define JDUMP_MAX 2048
+#define NVM_BYTE_MS 4 // data EEPROM write cycle
+
+struct J_Poll{
+    uint8_t pad;
+    uint16_t sw; // PS1 order
+    uint32_t t; // ms before the dump
+};
+
+static struct J_Poll fed[JPOLL_MAX], got[JPOLL_MAX];
+
+/* Polls in a dump, the way ps1_journal reads it: repeats spread evenly
+ * over their span. Returns how many, -1 if the dump is broken */
+static long journal_parse(const uint8_t *p, unsigned n, unsigned *events){
+    uint16_t sw[PS1_PADS], span, dt[JOURNAL_CYCLE_MAX], off;
+    uint32_t t = 0, end;
+    unsigned len, i, r, k, m, e, cnt, c;
+    uint8_t sum = 0, h, pad = 0, lo, hi, msb, win[JOURNAL_CYCLE_MAX], w = 0, wn = 0;
+    long np = 0;
+
+    if (n < JOURNAL_HDR + 1 || p[0] != 'P' || p[1] != 'J' || p[2] != JOURNAL_VERSION)
+        return -1;
+    msb = p[3] & JOURNAL_WIRE_MSB;
+    len = p[6] | p[7] << 8;
+    if (n != JOURNAL_HDR + len + 1)
+        return -1;
+    for (i = 0; i < n; i++)
+        sum += p[i];
+    if (sum)
+        return -1;
+    p += JOURNAL_HDR;
+    for (i = 0; i < len; i += r){
+        h = p[i];
+        r = h & J_REPEAT ? 4 : h & J_EVENT ? ((h & J_EV_MASK) == J_EV_STATE ? 6 : 1) :
+            2 + (h & J_LONG ? 1 : 0) + (h & J_ID ? 2 : 0) + (h & J_SW ? 2 : 0);
+        if (i + r > len)
+            return -1;
+        if (r >= 4 && !(h & J_REPEAT)){
+            // switches, last in a state or frame record that has them
+            lo = p[i+r-2];
+            hi = p[i+r-1];
+            if (msb){
+                reverse_byte(&lo);
+                reverse_byte(&hi);
+            }
+        }
+        if (h & J_REPEAT){
+            // the last c frame records, cnt more rounds ending at even steps
+            cnt = (h & J_RUN_MASK) | (p[i+1] >> 4) << 7;
+            c = p[i+1] & J_CYC_MASK;
+            span = p[i+2] | p[i+3] << 8;
+            if (!cnt || !c || c > wn)
+                return -1;
+            for (k = 1; k <= cnt; k++){
+                for (m = 0; m < c; m++){
+                    for (off = 0, e = m + 1; e < c; e++)
+                        off += dt[(w - c + e) & JOURNAL_CYCLE_MASK];
+                    pad = win[(w - c + m) & JOURNAL_CYCLE_MASK];
+                    if (np < JPOLL_MAX){
+                        got[np].pad = pad;
+                        got[np].sw = sw[pad];
+                        got[np++].t = t + (span * k + cnt / 2) / cnt - off;
+                    }
+                }
+            }
+            t += span;
+        }else if (h & J_EVENT){
+            events[h & J_EV_MASK]++;
+            if ((h & J_EV_MASK) == J_EV_STATE)
+                sw[p[i+1] & J_PAD_MASK] = lo | hi << 8;
+            wn = 0;
+        }else{
+            pad = h & J_PAD_MASK;
+            t += h & J_LONG ? p[i+1] | p[i+2] << 8 : p[i+1];
+            if (h & J_SW)
+                sw[pad] = lo | hi << 8;
+            win[w] = pad;
+            dt[w] = h & J_LONG ? p[i+1] | p[i+2] << 8 : p[i+1];
+            w = (w + 1) & JOURNAL_CYCLE_MASK;
+            if (wn < JOURNAL_CYCLE_MAX)
+                wn++;
+            if (np < JPOLL_MAX){
+                got[np].pad = pad;
+                got[np].sw = sw[pad];
+                got[np++].t = t;
+            }
+        }
+    }
+    // count back from the dump
+    end = t + (p[-4] | p[-3] << 8);
+    for (i = 0; i < np; i++)
+        got[i].t = end - got[i].t;
+    return np;
+}
+
+struct Journal_Case{
+    const char *name;
+    uint8_t tap; // multitaps, port 1 then 2, 0 one pad
+    uint8_t change; // 1 poll in change gets new buttons, 0 never
+    uint8_t combo; // hold the combo for 0.5 s every combo s, 0 never
+    uint16_t limit; // dump size
+    uint32_t ms; // of polling
+    unsigned min_polls; // the dump has to reach back this far
+};
+
+/* Main loop with the journal: JOURNAL in main.c */
+static void journal_loop(unsigned long *nfed, unsigned *decided){
+    struct PS1_Frame *f;
+    uint8_t action;
+    while ((f = ps1_capture_peek()) != 0){
+        if (!journal.out && *nfed < JPOLL_MAX){
+            fed[*nfed].pad = f->pad;
+            fed[*nfed].sw = f->data.buff[3] | f->data.buff[4] << 8;
+            fed[(*nfed)++].t = reset.now;
+        }
+        ps1_journal_frame(f);
+        action = ps1_decode(&pads[f->pad], &f->cmd, &f->data, f->stamp);
+        ps1_capture_release();
+        *decided += ps1_journal_action(action);
+        ps1_reset_poll(action);
+    }
+}
+
+static int bench_journal(void){
+    static const struct Journal_Case cases[] = {
+        {"idle pad, 60 s", 0, 0, 0, 0xFFFF, 60000, 3500},
+        {"new buttons every poll", 0, 1, 0, 0xFFFF, 10000, 50},
+        {"two multitaps idle, 60 s", 2, 0, 0, 0xFFFF, 60000, 28000},
+        {"multitap, 1 in 8 new", 1, 8, 0, 0xFFFF, 10000, 100},
+        {"multitap, EEPROM size", 1, 8, 0, JOURNAL_NVM_SIZE, 10000, 40},
+        {"combo every 10 s, saved", 0, 16, 10, JOURNAL_NVM_SIZE, 60000, 100},
+    };
+    static uint8_t dump[JDUMP_MAX];
+    unsigned events[J_EV_MASK + 1], decided, dn, dumps, bad;
+    unsigned long nfed, j, next_us, k;
+    uint64_t t0, dt, worst = 0, sum = 0, calls = 0;
+    uint16_t sw[PS1_SLOTS], sw_w;
+    uint32_t t;
+    uint8_t i, slot, b, lo, hi, drops = 0;
+    long ngot;
+    int err = 0, ok;
+
+    printf("journal: %u byte ring, repeats up to %u rounds, EEPROM dump %u bytes\n",
+        JOURNAL_SIZE, JOURNAL_RUN_MAX, JOURNAL_NVM_SIZE);
+    printf("  %-26s %8s %8s %8s %10s %8s %8s\n", "case", "polled", "dumped", "bytes",
+        "bytes/poll", "resets", "dumps");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Journal_Case *c = &cases[i];
+        ps1_capture_init();
+        pads_init();
+        ps1_reset_init(0);
+        ps1_journal_init();
+        memset(events, 0, sizeof(events));
+        nfed = 0;
+        decided = dumps = bad = dn = 0;
+        next_us = 16683;
+        for (slot = 0; slot < PS1_SLOTS; slot++)
+            sw[slot] = 0xFFFF;
+        for (t = 1; t <= c->ms; t++){
+            ps1_reset_tick(); // reset.now
+            if (t * 1000ul >= next_us){
+                for (slot = 0; slot < (c->tap ? PS1_SLOTS : 1); slot++){
+                    if (c->change && rng() % c->change == 0)
+                        sw[slot] = ~(rng() & 0xF0F0); // face buttons and d-pad, never a combo
+                    if (c->combo && t % (c->combo * 1000ul) >= 5000 && t % (c->combo * 1000ul) < 5500)
+                        sw[slot] = KEY_COMBO_CTRL;
+                    else if (sw[slot] == KEY_COMBO_CTRL)
+                        sw[slot] = 0xFFFF;
+                }
+                if (c->tap){
+                    poll_tap(0, sw, next_us);
+                    if (c->tap > 1){
+                        journal_loop(&nfed, &decided); // ports are polled ~1 ms apart
+                        poll_tap(1, sw, next_us);
+                    }
+                }
+                else
+                    poll_pad(ID_ANP_CTRL, sw[0], next_us);
+                t0 = bench_ticks();
+                k = decided;
+                journal_loop(&nfed, &decided);
+                dt = bench_ticks() - t0;
+                sum += dt;
+                calls++;
+                if (dt > worst)
+                    worst = dt;
+                if (decided != k && ps1_journal_open(c->limit))
+                    dn = 0; // saved at the decision, EEPROM pace
+                next_us += 16683;
+            }
+            // a dump going out: one byte per EEPROM write
+            if (journal.out && t % NVM_BYTE_MS == 0 && ps1_journal_get(&b) && dn < JDUMP_MAX){
+                dump[dn++] = b;
+                if (!journal.out){
+                    dumps++;
+                    if (journal_parse(dump, dn, events) < 0 || dn > c->limit)
+                        bad++;
+                }
+            }
+        }
+        // what's in it now, all of it or as much as the EEPROM holds
+        while (journal.out)
+            ps1_journal_get(&b);
+        t = reset.now;
+        dn = 0;
+        ps1_journal_open(c->limit);
+        while (dn < JDUMP_MAX && ps1_journal_get(&dump[dn]))
+            dn++;
+        memset(events, 0, sizeof(events));
+        ngot = journal_parse(dump, dn, events);
+
+        // the newest polls, same pad, buttons and time
+        ok = ngot >= (long)c->min_polls && ngot <= (long)nfed && !bad && dn <= c->limit &&
+            decided == reset.resets && (!c->combo || dumps == decided);
+        for (j = 0; ok && j < (unsigned long)ngot; j++){
+            k = nfed - ngot + j;
+            lo = fed[k].sw & 0xFF;
+            hi = fed[k].sw >> 8;
+            reverse_byte(&lo);
+            reverse_byte(&hi);
+            sw_w = lo | hi << 8;
+            dt = t - fed[k].t;
+            if (got[j].pad != fed[k].pad || got[j].sw != sw_w || got[j].t + 2 < dt || got[j].t > dt + 2)
+                ok = 0;
+        }
+        printf("  %-26s %8lu %8ld %8u %10.3f %8u %8u %s\n", c->name, nfed, ngot, dn,
+            ngot > 0 ? (double)dn / ngot : 0, reset.resets, dumps, ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+        if (journal.drop_max > drops)
+            drops = journal.drop_max;
+    }
+    printf("  main loop per transaction, decode and journal: avg %llu, worst %llu %s\n",
+        (unsigned long long)(sum / calls), (unsigned long long)worst, TICK_UNIT);
+    printf("  most records dropped by one append: %u, JOURNAL_DROP_MAX %u %s\n",
+        drops, JOURNAL_DROP_MAX, drops <= JOURNAL_DROP_MAX ? "" : "FAIL");
+    if (drops > JOURNAL_DROP_MAX)
+        err = 1;
+    return err;
+}
+
+/**********************************************************/
+/* Capture supervision, faults injected into a modelled MSSP pair */
+
+#define GUARD_POLL_MS 17 // ~60 Hz
+#define GUARD_FAULT_MS 1000 // when the fault goes in
+#define GUARD_WDT_MS 64 // HAL_WDT_START
+
+/* Faults, what the MSSPs do from GUARD_FAULT_MS on */
+#define FAULT_NONE 0
+#define FAULT_SSPOV 1 // one overflow, SSPOV stays set
+#define FAULT_WCOL 2 // one write collision, WCOL stays set
+#define FAULT_PAIR 3 // SPI2 a byte behind SPI1
+#define FAULT_SLIP 4 // bit count 3 off, SS no longer clears it
+#define FAULT_STALL 5 // no more bytes
+#define FAULT_STUCK 6 // SS stuck low, no more edges
+#define FAULT_DEAD 7 // no more bytes, not even after a restart
+
+/* Both MSSPs as the ISR sees them */
+struct Mssp_Model{
+    uint8_t c, d; // shift registers, PS1_SHIFT_IN
+    uint8_t bits; // bit count
+    uint8_t sspov, wcol, pair; // flags, until restarted
+    uint8_t slip; // SS edges don't clear the bit count
+    uint8_t stall; // no byte interrupts, 2: for good
+    uint8_t stuck; // SS held low
+};
+
+static struct Mssp_Model mssp;
+
+/* HAL_SPI_RESTART on the model */
+static void mssp_restart(void){
+    mssp.bits = 0;
+    mssp.sspov = mssp.wcol = mssp.pair = 0;
+    mssp.slip = 0;
+    if (mssp.stall == 1)
+        mssp.stall = 0;
+}
+
+/* End of _spi_int */
+static void guard_isr_end(void){
+    if (guard.restart){
+        mssp_restart();
+        ps1_guard_restart();
+    }
+}
+
+/* _spi_int: SPI1 flag, both bytes read */
+static void guard_isr_byte(void){
+    uint8_t fault;
+    if (mssp.stall)
+        return; // no interrupt
+    fault = (mssp.sspov ? GUARD_SSPOV : 0) | (mssp.wcol ? GUARD_WCOL : 0) | (mssp.pair ? GUARD_PAIR : 0);
+    if (ps1_guard_spi(fault))
+        ps1_capture_byte(mssp.c, mssp.d);
+    guard_isr_end();
+}
+
+/* One transaction on the bus, PS1 order bytes, LSb first on the wire */
+static void guard_bus(const uint8_t *cmd, const uint8_t *dat, uint8_t len, uint16_t stamp){
+    uint8_t i, b;
+    if (!mssp.stuck){
+        ps1_guard_edge();
+        ps1_capture_start(0, stamp);
+        guard_isr_end();
+    }
+    for (i = 0; i < len; i++){
+        for (b = 0; b < 8; b++){
+            mssp.c = PS1_SHIFT_IN(mssp.c, cmd[i] >> b & 1);
+            mssp.d = PS1_SHIFT_IN(mssp.d, dat[i] >> b & 1);
+            if (++mssp.bits == 8){
+                mssp.bits = 0;
+                guard_isr_byte();
+            }
+        }
+    }
+    if (!mssp.stuck && !mssp.slip)
+        mssp.bits = 0; // SS high
+}
+
+static void guard_fault(uint8_t fault){
+    switch(fault){
+        case FAULT_SSPOV: mssp.sspov = 1; break;
+        case FAULT_WCOL: mssp.wcol = 1; break;
+        case FAULT_PAIR: mssp.pair = 1; break;
+        case FAULT_SLIP: mssp.slip = 1; mssp.bits = 3; break;
+        case FAULT_STALL: mssp.stall = 1; break;
+        case FAULT_STUCK: mssp.stuck = 1; break;
+        case FAULT_DEAD: mssp.stall = 2; break;
+    }
+}
+
+struct Guard_Case{
+    const char *name;
+    uint8_t fault;
+    uint8_t glitch; // SS pulse without bytes after every poll
+    uint16_t recover_ms; // good frames again within, 0 none lost
+    uint8_t watchdog; // the watchdog has to fire
+};
+
+static int bench_guard(void){
+    static const struct Guard_Case cases[] = {
+        {"no fault, pad + card", FAULT_NONE, 0, 0, 0},
+        {"no fault, SS glitches", FAULT_NONE, 1, 0, 0},
+        {"SSPOV", FAULT_SSPOV, 0, 2*GUARD_POLL_MS, 0},
+        {"WCOL", FAULT_WCOL, 0, 2*GUARD_POLL_MS, 0},
+        {"SPI2 a byte behind", FAULT_PAIR, 0, 2*GUARD_POLL_MS, 0},
+        {"bits off, SS can't clear", FAULT_SLIP, 0, (GUARD_SELECT_MAX + 2) * GUARD_POLL_MS, 0},
+        {"no more bytes", FAULT_STALL, 0, (GUARD_SILENT_MAX + 3) * GUARD_POLL_MS, 0},
+        {"SS stuck low", FAULT_STUCK, 0, GUARD_SS_MS + 2*GUARD_POLL_MS, 0},
+        {"MSSPs dead for good", FAULT_DEAD, 0, 0, 1},
+    };
+    static const uint8_t c_card[] = {CMD_SEL_MEMC_1, CMD_MEMC_READ, 0, 0, 0, 0, 0};
+    static const uint8_t d_card[] = {0xFF, 0x08, MEMC_ID1, MEMC_ID2, 0x00, 0x00, 0x00};
+    uint8_t c_pad[9] = {CMD_SEL_CTRL_1, CMD_READ_SW}, d_pad[9];
+    struct PS1_Frame *f;
+    uint32_t t, good_ms, wdt_ms, fired;
+    unsigned long lost, bad;
+    uint16_t sw, w;
+    uint8_t i, lo, hi;
+    int err = 0, ok;
+
+    printf("guard: polls every %u ms, fault at %u ms, watchdog %u ms\n", GUARD_POLL_MS, GUARD_FAULT_MS, GUARD_WDT_MS);
+    printf("  %-26s %8s %8s %8s %8s %8s %8s %10s %10s\n", "case", "restarts", "sspov", "pair",
+        "select", "silent", "stuck", "recovered", "watchdog");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        const struct Guard_Case *c = &cases[i];
+        ps1_capture_init();
+        ps1_guard_init();
+        pads_init();
+        ps1_reset_init(0);
+        memset(&mssp, 0, sizeof(mssp));
+        good_ms = wdt_ms = fired = 0;
+        lost = bad = 0;
+        sw = 0xFFFF;
+        for (t = 1; t <= 5000 && !fired; t++){
+            // TMR2
+            ps1_reset_tick();
+            ps1_guard_tick(mssp.stuck);
+            guard_isr_end();
+            if (t == GUARD_FAULT_MS)
+                guard_fault(c->fault);
+            if (t % GUARD_POLL_MS == 0){
+                sw = ~(rng() & 0xF0F0); // face buttons and d-pad, a new poll every time
+                memset(d_pad, 0x80, sizeof(d_pad));
+                d_pad[0] = 0xFF;
+                d_pad[1] = ID_ANP_CTRL & 0xFF;
+                d_pad[2] = ID_ANP_CTRL >> 8;
+                d_pad[3] = sw & 0xFF;
+                d_pad[4] = sw >> 8;
+                guard_bus(c_pad, d_pad, sizeof(d_pad), t * 1000);
+                if (t % (8*GUARD_POLL_MS) == 0)
+                    guard_bus(c_card, d_card, sizeof(d_card), t * 1000 + 500);
+                if (c->glitch)
+                    guard_bus(c_pad, d_pad, 0, t * 1000 + 900);
+            }
+            // main loop
+            while ((f = ps1_capture_peek()) != 0){
+                lo = f->data.buff[3];
+                hi = f->data.buff[4];
+                reverse_byte(&lo);
+                reverse_byte(&hi);
+                w = lo | hi << 8;
+                ps1_decode(&pads[f->pad], &f->cmd, &f->data, f->stamp);
+                ps1_capture_release();
+                ps1_guard_frame();
+                if (w != sw)
+                    bad++; // garbage made it through
+                else if (t >= GUARD_FAULT_MS && !good_ms)
+                    good_ms = t;
+            }
+            if (t % GUARD_POLL_MS == 0 && t >= GUARD_FAULT_MS && !good_ms)
+                lost++;
+            if (ps1_guard_alive())
+                wdt_ms = 0;
+            else if (++wdt_ms >= GUARD_WDT_MS)
+                fired = t;
+        }
+        if (c->watchdog)
+            ok = fired && !bad;
+        else if (c->recover_ms)
+            ok = !fired && !bad && good_ms && good_ms - GUARD_FAULT_MS <= c->recover_ms && guard.restarts;
+        else
+            ok = !fired && !bad && !lost && guard.restarts == 0;
+        printf("  %-26s %8u %8u %8u %8u %8u %8u ", c->name, guard.restarts, guard.sspov + guard.wcol,
+            guard.pair, guard.select, guard.silent, guard.stuck);
+        if (c->fault && good_ms)
+            printf("%7lu ms ", (unsigned long)(good_ms - GUARD_FAULT_MS));
+        else
+            printf("%10s ", "-");
+        if (fired)
+            printf("%7lu ms", (unsigned long)(fired - GUARD_FAULT_MS));
+        else
+            printf("%10s", "-");
+        printf(" %s\n", ok ? "" : "FAIL");
+        if (!ok)
+            err = 1;
+    }
+    return err;
+}
+
+/**********************************************************/
+/* DEBUG trace drained by the UART interrupt */
+
+#define UART_BAUD 500000
+#define OLD_BAUD 9615 // blocking UART_print/UART_printHex
+#define OLD_CHARS 120 // characters printed per frame by the old DEBUG loop
+
+struct Trace_Case{
+    const char *name;
+    uint32_t period_us; // between polls
+    uint8_t id_len; // 5 digital, 9 analog
+};
+
+static int bench_trace(const char *out){
+    static const struct Trace_Case cases[] = {
+        {"60 Hz digital", 16667, 5},
+        {"60 Hz analog", 16667, 9},
+        {"multitap rate (4x 60 Hz)", 4167, 9},
+        {"back-to-back analog", 400, 9},
+    };
+    const uint32_t byte_ns = 10 * 1000000000ull / UART_BAUD; // start + 8 + stop
+    FILE *f = out ? fopen(out, "wb") : 0;
+    uint64_t t, uart_t;
+    uint32_t k, polls = 2000, sent;
+    uint8_t i, b;
+    struct PS1_Frame fr;
+
+    printf("trace: %u baud, %u byte ring, %u polls per case; old DEBUG loop blocked %.1f ms per frame\n",
+        UART_BAUD, TRACE_BUFF_SIZE, polls, OLD_CHARS * 10 * 1000.0 / OLD_BAUD);
+    printf("  %-26s %8s %8s %10s\n", "case", "records", "dropped", "bytes/s");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        ps1_trace_init();
+        if (f && i == 0)
+            ps1_trace_text("bench trace");
+        uart_t = 0;
+        sent = 0;
+        for (k = 0; k < polls; k++){
+            t = (uint64_t)k * cases[i].period_us * 1000;
+            // UART interrupt: drain what the line had time for
+            while (uart_t <= t && ps1_trace_get(&b)){
+                if (f && i == 0)
+                    fputc(b, f);
+                uart_t += byte_ns;
+                sent++;
+            }
+            if (uart_t < t)
+                uart_t = t;
+            memset(&fr, 0, sizeof(fr));
+            fr.cmd.buff[0] = W_CMD_SEL_CTRL_1;
+            fr.cmd.buff[1] = W_CMD_READ_SW;
+            fr.data.buff[0] = 0xFF;
+            fr.data.buff[1] = cases[i].id_len == 5 ? REV8(ID_DIG_CTRL & 0xFF) : REV8(ID_ANP_CTRL & 0xFF);
+            fr.data.buff[2] = REV8(0x5A);
+            fr.data.buff[3] = k & 0x10 ? REV8(0xF6) : 0xFF; // select + start now and then
+            fr.data.buff[4] = 0xFF;
+            fr.len = cases[i].id_len;
+            fr.stamp = t / 1000;
+            ps1_trace_frame(&fr);
+        }
+        while (ps1_trace_get(&b)){
+            if (f && i == 0)
+                fputc(b, f);
+            sent++;
+        }
+        printf("  %-26s %8u %8u %10.0f\n", cases[i].name, polls - trace.dropped, trace.dropped,
+            sent * 1e6 / ((double)polls * cases[i].period_us));
+    }
+    if (f)
+        fclose(f);
+    return 0;
+}
+
+/**********************************************************/
+/* old/atmega328p/INT-interrupt: INT0 in AVR cycles against the bit period
+ *
+ * The ISRs as avr-gcc -Os builds them, counted by hand (there is no AVR
+ * toolchain here): one line per instruction with its cycles and where it
+ * runs. sbrc + ori is 2 cycles whether it skips or not. An interrupt takes
+ * 4 cycles to the vector and 3 for its jmp, up to 3 more to finish the
+ * instruction it came in on. */
+
+#define AVR_CMD 4 // PIND bits, as in the sketch
+#define AVR_DATA 5
+#define AVR_BITS (8 * PS1_CTRL_BUFF_SIZE)
+#define AVR_MHZ 16
+#define AVR_BIT_CY (AVR_MHZ * 4) // 250 kHz clock
+#define AVR_VECTOR_CY 7 // response and jmp
+#define AVR_LATE_CY 3 // the instruction the interrupt came in on
+
+#define AVR_ALL 0 // every bit
+#define AVR_PRO 1 // prologue and epilogue, every bit
+#define AVR_SAMPLE 2 // reads PIND; EE_READY: interrupts back on after it
+#define AVR_BIT 3 // bits 1 to 7
+#define AVR_BYTE 4 // 8th bit
+
+struct Avr_Insn{
+    const char *text;
+    uint8_t cy;
+    uint8_t path; // AVR_x
+};
+
+/* Before: store PIND, transpose in loop() */
+static const struct Avr_Insn avr_port_isr[] = {
+    {"push r1", 2, AVR_PRO}, {"push r0", 2, AVR_PRO}, {"in r0, SREG", 1, AVR_PRO},
+    {"push r0", 2, AVR_PRO}, {"clr r1", 1, AVR_PRO}, {"push r24", 2, AVR_PRO},
+    {"push r30", 2, AVR_PRO}, {"push r31", 2, AVR_PRO},
+    {"lds r30, bit_cnt", 2, AVR_ALL}, {"ldi r31, 0", 1, AVR_ALL},
+    {"in r24, PIND", 1, AVR_SAMPLE},
+    {"subi r30, lo8(-(port))", 1, AVR_ALL}, {"sbci r31, hi8(-(port))", 1, AVR_ALL},
+    {"st Z, r24", 2, AVR_ALL},
+    {"lds r24, bit_cnt", 2, AVR_ALL}, {"subi r24, 0xFF", 1, AVR_ALL}, {"sts bit_cnt, r24", 2, AVR_ALL},
+    {"pop r31", 2, AVR_PRO}, {"pop r30", 2, AVR_PRO}, {"pop r24", 2, AVR_PRO},
+    {"pop r0", 2, AVR_PRO}, {"out SREG, r0", 1, AVR_PRO}, {"pop r0", 2, AVR_PRO},
+    {"pop r1", 2, AVR_PRO}, {"reti", 4, AVR_PRO},
+};
+
+/* Shift registers in RAM, ps1_capture_byte called on the 8th bit: the call
+ * makes the prologue save every call-used register on every bit */
+static const struct Avr_Insn avr_call_isr[] = {
+    {"push r1", 2, AVR_PRO}, {"push r0", 2, AVR_PRO}, {"in r0, SREG", 1, AVR_PRO},
+    {"push r0", 2, AVR_PRO}, {"clr r1", 1, AVR_PRO},
+    {"push r18..r27, r30, r31", 24, AVR_PRO}, {"push r28", 2, AVR_PRO},
+    {"in r24, PIND", 1, AVR_SAMPLE},
+    {"lds r25, cmd_sr", 2, AVR_ALL}, {"lsr r25", 1, AVR_ALL}, {"sbrc r24, 4 / ori r25, 0x80", 2, AVR_ALL},
+    {"lds r22, data_sr", 2, AVR_ALL}, {"lsr r22", 1, AVR_ALL}, {"sbrc r24, 5 / ori r22, 0x80", 2, AVR_ALL},
+    {"lds r28, bit_cnt", 2, AVR_ALL}, {"subi r28, 0xFF", 1, AVR_ALL},
+    {"sts cmd_sr, r25", 2, AVR_ALL}, {"sts data_sr, r22", 2, AVR_ALL},
+    {"mov r24, r28", 1, AVR_ALL}, {"andi r24, 7", 1, AVR_ALL},
+    {"brne 1f", 2, AVR_BIT}, {"brne 1f", 1, AVR_BYTE},
+    {"mov r24, r25", 1, AVR_BYTE}, {"call ps1_capture_byte, ret", 8, AVR_BYTE},
+    {"lds r24, capture+cnt", 2, AVR_BYTE}, {"cpi r24, PS1_CNT_WAIT", 1, AVR_BYTE},
+    {"brne 1f", 1, AVR_BYTE}, {"cbi EIMSK, INT0", 2, AVR_BYTE},
+    {"1: sts bit_cnt, r28", 2, AVR_ALL},
+    {"pop r28", 2, AVR_PRO}, {"pop r31, r30, r27..r18", 24, AVR_PRO},
+    {"pop r0", 2, AVR_PRO}, {"out SREG, r0", 1, AVR_PRO}, {"pop r0", 2, AVR_PRO},
+    {"pop r1", 2, AVR_PRO}, {"reti", 4, AVR_PRO},
+};
+
+/* Now: shift registers and bit count in GPIOR1, GPIOR2, GPIOR0, nothing
+ * called, the 8th bit sets EERIE (or EE_LOST while EE_BUSY, a cycle less) */
+static const struct Avr_Insn avr_gpior_isr[] = {
+    {"push r1", 2, AVR_PRO}, {"push r0", 2, AVR_PRO}, {"in r0, SREG", 1, AVR_PRO},
+    {"push r0", 2, AVR_PRO}, {"clr r1", 1, AVR_PRO}, {"push r24", 2, AVR_PRO},
+    {"push r25", 2, AVR_PRO},
+    {"in r24, PIND", 1, AVR_SAMPLE},
+    {"in r25, GPIOR1", 1, AVR_ALL}, {"lsr r25", 1, AVR_ALL}, {"sbrc r24, 4 / ori r25, 0x80", 2, AVR_ALL},
+    {"out GPIOR1, r25", 1, AVR_ALL},
+    {"in r25, GPIOR2", 1, AVR_ALL}, {"lsr r25", 1, AVR_ALL}, {"sbrc r24, 5 / ori r25, 0x80", 2, AVR_ALL},
+    {"out GPIOR2, r25", 1, AVR_ALL},
+    {"in r25, GPIOR0", 1, AVR_ALL}, {"subi r25, 0xFF", 1, AVR_ALL}, {"andi r25, 0xC7", 1, AVR_ALL},
+    {"out GPIOR0, r25", 1, AVR_ALL}, {"andi r25, 7", 1, AVR_ALL},
+    {"brne 1f", 2, AVR_BIT}, {"brne 1f", 1, AVR_BYTE},
+    {"sbic GPIOR0, 6 (skips)", 2, AVR_BYTE}, {"sbi EECR, EERIE", 2, AVR_BYTE}, {"rjmp 1f", 2, AVR_BYTE},
+    {"1: pop r25", 2, AVR_PRO}, {"pop r24", 2, AVR_PRO},
+    {"pop r0", 2, AVR_PRO}, {"out SREG, r0", 1, AVR_PRO}, {"pop r0", 2, AVR_PRO},
+    {"pop r1", 2, AVR_PRO}, {"reti", 4, AVR_PRO},
+};
+
+/* EE_READY, once a byte, up to sei and the call: INT0 waits for that. The
+ * rest runs with interrupts on and depends on what ps1_capture_byte does
+ * with the byte (end of frame, queue, card tracker), the sketch's DEBUG
+ * build times all of it on the chip */
+static const struct Avr_Insn avr_byte_isr[] = {
+    {"push r1", 2, AVR_PRO}, {"push r0", 2, AVR_PRO}, {"in r0, SREG", 1, AVR_PRO},
+    {"push r0", 2, AVR_PRO}, {"clr r1", 1, AVR_PRO},
+    {"push r18..r27, r30, r31", 24, AVR_PRO},
+    {"in r24, GPIOR1", 1, AVR_ALL}, {"in r22, GPIOR2", 1, AVR_ALL},
+    {"cbi EECR, EERIE", 2, AVR_ALL}, {"sbi GPIOR0, 6", 2, AVR_ALL}, {"sei", 1, AVR_ALL},
+    {"call ps1_capture_byte", 4, AVR_SAMPLE}, // one more instruction after sei
+};
+
+struct Avr_Cost{
+    uint16_t sample; // clock edge to PIND read, worst
+    uint16_t bit, byte; // clock edge to reti, bits 1 to 7 and the 8th
+};
+
+static void avr_count(const struct Avr_Insn *p, uint8_t n, struct Avr_Cost *c){
+    uint8_t i, sampled = 0;
+    c->sample = AVR_VECTOR_CY + AVR_LATE_CY;
+    c->bit = c->byte = AVR_VECTOR_CY;
+    for (i = 0; i < n; i++){
+        if (!sampled)
+            c->sample += p[i].cy;
+        if (p[i].path == AVR_SAMPLE)
+            sampled = 1;
+        if (p[i].path != AVR_BYTE)
+            c->bit += p[i].cy;
+        if (p[i].path != AVR_BIT)
+            c->byte += p[i].cy;
+    }
+}
+
+/* What INT0 and EE_READY do, in C, to check the bytes come out right and
+ * that a byte ending while EE_READY is still busy is lost, not nested */
+#define AVR_BUSY 0x40 // EE_BUSY
+#define AVR_LOST 0x80 // EE_LOST
+static uint8_t avr_cnt, avr_cmd_sr, avr_data_sr, avr_eerie, avr_bytes, avr_lost;
+static uint8_t avr_cmd[PS1_CTRL_BUFF_SIZE], avr_data[PS1_CTRL_BUFF_SIZE];
+
+static void avr_isr(uint8_t pind){
+    avr_cmd_sr = PS1_SHIFT_IN(avr_cmd_sr, pind >> AVR_CMD & 1);
+    avr_data_sr = PS1_SHIFT_IN(avr_data_sr, pind >> AVR_DATA & 1);
+    avr_cnt = (avr_cnt + 1) & (AVR_BUSY | AVR_LOST | 7);
+    if ((avr_cnt & 7) == 0){
+        if (avr_cnt & AVR_BUSY)
+            avr_cnt |= AVR_LOST;
+        else
+            avr_eerie = 1;
+    }
+}
+
+/* EE_READY up to the call, the byte goes to the capture */
+static void avr_ee_enter(void){
+    avr_eerie = 0;
+    avr_cnt |= AVR_BUSY;
+    avr_cmd[avr_bytes] = avr_cmd_sr;
+    avr_data[avr_bytes++] = avr_data_sr;
+}
+
+/* EE_READY once the call is back, returns 0 if the transaction is dropped */
+static uint8_t avr_ee_leave(void){
+    uint8_t ok = !(avr_cnt & AVR_LOST);
+    if (!ok)
+        avr_lost++;
+    avr_cnt &= ~(AVR_BUSY | AVR_LOST);
+    return ok;
+}
+
+/* One poll, LSb first on the wire as PIND would read it. EE_READY for
+ * byte slow takes 12 bits, the others are over before the next edge. */
+static void avr_poll(const struct Bench_Frame *f, uint8_t slow){
+    uint8_t i, b, cmd, data, busy = 0;
+    avr_cnt = avr_eerie = avr_bytes = avr_lost = 0;
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        cmd = f->cmd[i];
+        data = f->data[i];
+        reverse_byte(&cmd); // set[] holds wire order (MSSP), back to PS1 order
+        reverse_byte(&data);
+        for (b = 0; b < 8; b++){
+            avr_isr((cmd >> b & 1) << AVR_CMD | (data >> b & 1) << AVR_DATA);
+            if (busy && --busy == 0 && !avr_ee_leave())
+                return; // INT0 off until the next SS edge
+            if (avr_eerie){
+                avr_ee_enter();
+                if (i == slow)
+                    busy = 12;
+                else
+                    avr_ee_leave();
+            }
+        }
+    }
+}
+
+static int bench_avr_int(void){
+    static const struct{
+        const char *name;
+        const struct Avr_Insn *isr;
+        uint8_t n;
+        uint8_t shipped;
+    } isrs[] = {
+        {"port[] + transpose", avr_port_isr, sizeof(avr_port_isr) / sizeof(avr_port_isr[0]), 0},
+        {"shift, call on 8th bit", avr_call_isr, sizeof(avr_call_isr) / sizeof(avr_call_isr[0]), 0},
+        {"GPIOR shift, EE_READY", avr_gpior_isr, sizeof(avr_gpior_isr) / sizeof(avr_gpior_isr[0]), 1},
+    };
+    const struct Bench_Frame *f = &set[0];
+    struct Avr_Cost c, e;
+    uint16_t gap_cy = (BYTE_US - 8 * 4) * AVR_MHZ, left;
+    uint8_t i, cmd, data, ok;
+    int err = 0;
+
+    printf("328p INT: AVR cycles at %u MHz, a bit is %u, PIND read before the falling edge (%u)\n",
+        AVR_MHZ, AVR_BIT_CY, AVR_BIT_CY / 2);
+    printf("  %-24s %8s %8s %10s\n", "INT0", "sample", "bit", "8th bit");
+    for (i = 0; i < sizeof(isrs) / sizeof(isrs[0]); i++){
+        avr_count(isrs[i].isr, isrs[i].n, &c);
+        ok = c.sample <= AVR_BIT_CY / 2 && c.bit <= AVR_BIT_CY && c.byte <= AVR_BIT_CY;
+        printf("  %-24s %5u cy %5u cy %7u cy %s\n", isrs[i].name, c.sample, c.bit, c.byte,
+            ok ? "" : isrs[i].shipped ? "FAIL" : "too slow");
+        if (isrs[i].shipped && !ok)
+            err = 1;
+    }
+
+    // EE_READY runs after the 8th bit, INT0 waits for it until its sei:
+    // that has to be over before the next byte's first clock edge
+    avr_count(avr_gpior_isr, sizeof(avr_gpior_isr) / sizeof(avr_gpior_isr[0]), &c);
+    avr_count(avr_byte_isr, sizeof(avr_byte_isr) / sizeof(avr_byte_isr[0]), &e);
+    ok = c.byte + e.sample <= gap_cy + AVR_BIT_CY;
+    printf("  EE_READY: INT0 held off %u cy after the 8th bit (next edge at %u) %s\n",
+        c.byte + e.sample, gap_cy + AVR_BIT_CY, ok ? "" : "FAIL");
+    if (!ok)
+        err = 1;
+    // the rest of it, INT0 and millis() included, until the next byte is in
+    left = BYTE_US * AVR_MHZ - c.byte;
+    printf("  EE_READY has %u cy (%u us) until the next byte is lost, the DEBUG build prints its longest\n",
+        left, left / AVR_MHZ);
+
+    // one analog poll, then one where EE_READY is still busy a byte later
+    avr_poll(f, 3);
+    ok = avr_lost == 1 && avr_bytes == 4;
+    printf("  EE_READY past the next byte: %u lost, %u of %u bytes, transaction dropped %s\n",
+        avr_lost, avr_bytes, PS1_CTRL_BUFF_SIZE, ok ? "" : "FAIL");
+    if (!ok)
+        err = 1;
+    avr_poll(f, 0xFF);
+    err |= avr_lost || avr_bytes != PS1_CTRL_BUFF_SIZE;
+    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
+        cmd = f->cmd[i];
+        data = f->data[i];
+        // as ps1_capture_byte gets them on this target
+        if (PS1_BIT_ORDER == PS1_LSB_FIRST){
+            reverse_byte(&cmd);
+            reverse_byte(&data);
+        }
+        err |= avr_cmd[i] != cmd || avr_data[i] != data;
+    }
+    if (err)
+        printf("  328p INT check failed\n");
+    return err;
+}
+
+#ifdef PS1_STATS
+/**********************************************************/
+/* PS1_STATS counters against known traffic */
+
+/* One transaction through the ISR, PS1 bit order in, wire order on the bus */
+static void poll_raw(const uint8_t *cmd, const uint8_t *dat, uint8_t len, uint16_t stamp){
+    uint8_t i, c, d;
+    uint64_t t0;
+    ps1_capture_start(0, stamp);
+    for (i = 0; i < len; i++){
+        c = cmd[i];
+        d = dat[i];
+        reverse_byte(&c);
+        reverse_byte(&d);
+        t0 = bench_ticks();
+        ps1_capture_byte(c, d);
+        STAT_TIME(isr, t0, bench_ticks());
+    }
+}
+
+static int bench_stats(const char *out){
+    static const uint8_t c_pad[] = {CMD_SEL_CTRL_1, CMD_READ_SW, 0, 0, 0, 0, 0};
+    static const uint8_t c_card[] = {CMD_SEL_MEMC_1, CMD_MEMC_READ, 0, 0, 0, 0, 0};
+    static const uint8_t d_pad[] = {0xFF, ID_DIG_CTRL & 0xFF, ID_DIG_CTRL >> 8, 0xFF, 0xFF};
+    static const uint8_t d_combo[] = {0xFF, ID_DIG_CTRL & 0xFF, ID_DIG_CTRL >> 8,
+        KEY_COMBO_CTRL & 0xFF, KEY_COMBO_CTRL >> 8};
+    static const uint8_t d_mouse[] = {0xFF, 0x12, 0x5A, 0xFF, 0xFF, 0x00, 0x00};
+    static const uint8_t d_card[] = {0xFF, 0x08, 0x5A, 0x5D, 0x00, 0x00, 0x00};
+    const uint16_t n = 1000;
+    struct PS1_Frame *f;
+    uint64_t t0;
+    uint16_t k, frames = 0;
+    uint8_t rec[2*STATS_COUNT], b;
+    FILE *fo;
+    int err = 0;
+
+    ps1_capture_init();
+    ps1_stats_init();
+    for (k = 0; k < n; k++){
+        // pad, pad with combo, mouse (no combo for it), memory card read and write
+        poll_raw(c_pad, d_pad, sizeof(d_pad), k);
+        poll_raw(c_pad, d_combo, sizeof(d_combo), k);
+        poll_raw(c_pad, d_mouse, sizeof(d_mouse), k);
+        poll_raw(c_card, d_card, sizeof(d_card), k);
+        card_write(k, MEMC_GOOD, MEMC_WRITE_LEN, k);
+        while ((f = ps1_capture_peek()) != 0){
+            t0 = bench_ticks();
+            ps1_decode(&pads[f->pad], &f->cmd, &f->data, f->stamp);
+            ps1_capture_release();
+            STAT_TIME(decode, t0, bench_ticks());
+            frames++;
+        }
+    }
+    ps1_stats_record(rec);
+    printf("stats: %u of each transaction, isr %u..%u ticks, decode %u..%u ticks\n",
+        n, stats.isr.min, stats.isr.max, stats.decode.min, stats.decode.max);
+    printf("  frames %u rejected %u unknown_id %u combos %u overrun %u card_writes %u\n",
+        stats.frames, stats.rejected, stats.unknown_id, stats.combos, capture.overrun, card.writes);
+    // card transactions go to the write tracker, not counted as rejected
+    if (stats.frames != 3*n || frames != 3*n || stats.rejected != 0 || card.writes != n
+        || stats.unknown_id != n || stats.combos != n || capture.overrun != 0){
+        printf("  counters don't match the traffic\n");
+        err = 1;
+    }
+
+    // append a stats record to the sample trace
+    if (out && (fo = fopen(out, "ab")) != 0){
+        ps1_trace_init();
+        ps1_trace_stats();
+        while (ps1_trace_get(&b))
+            fputc(b, fo);
+        fclose(fo);
+    }
+    return err;
+}
+#endif
+
+int main(int argc, char **argv){
+    unsigned long n = DEFAULT_FRAMES;
+    int err = 0;
+
+    if (argc > 1)
+        n = strtoul(argv[1], NULL, 0);
+
+    printf("core built for %s: %s first capture\n", PS1_TARGET_NAME,
+        PS1_BIT_ORDER == PS1_MSB_FIRST ? "MSb" : "LSb");
+    ps1_combo_load(0);
+    make_set();
+    err |= bench_path("legacy", legacy_frame, n);
+    err |= bench_path("decode", wire_frame, n);
+    err |= bench_combo();
+    err |= bench_capture();
+    err |= bench_reset();
+    err |= bench_hold();
+    err |= bench_mtap();
+    err |= bench_card();
+    err |= bench_config();
+    err |= bench_boot();
+    err |= bench_console();
+    err |= bench_timing();
+    err |= bench_journal();
+    err |= bench_guard();
+    err |= bench_trace(argc > 2 ? argv[2] : 0);
+    err |= bench_avr_int();
+#ifdef PS1_STATS
+    err |= bench_stats(argc > 2 ? argv[2] : 0);
+#endif
+    return err;
+}
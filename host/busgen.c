@@ -0,0 +1,622 @@
+/*
+ * File:   busgen.c
+ * Author: pyroesp
+ *
+ * Controller bus traffic generator and CPU budget benchmark
+ *
+ * Generates port 1 traffic the way the PS1 clocks it: SS low, bytes at
+ * 250 kHz LSb first, an /ACK gap after every byte the device answers,
+ * SS high. Every ID the firmware knows is plugged in turn (digital, analog
+ * pad, analog stick, DualShock 2 with its 21 byte pressure frame, GunCon,
+ * the next one every COMBO_EVERY_MS) and polled at 50 Hz up to
+ * back-to-back, optionally with memory card sector reads in between. The
+ * combo is pressed and held every COMBO_EVERY_MS. With multitaps on both
+ * ports (-t) the two are polled one after the other every period, 35
+ * bytes each, and the combo moves to the next of the 8 pads every press.
+ * With saves (-w) a sector is written to the memory card after every poll
+ * from SAVE_BEFORE_MS before the press to SAVE_AFTER_MS after it, so the
+ * reset has to wait for the card (see ps1_card.h).
+ *
+ * The bytes are pushed through the core the way the PIC would get them
+ * at a given clock: the MSSP buffer holds one byte and is overwritten by
+ * the next one if the interrupt hasn't read it yet (BOEN = 1), the ISR
+ * costs cycles per flag it handles, the main loop decodes frames in the
+ * time left over and the 1 ms tick runs the reset state machine. The
+ * table shows polls lost or corrupted, MSSP overflows and the time from
+ * the SS edge of the first poll with the combo to RESET going low.
+ *
+ * The cycle costs are estimates for XC8 on the PIC16F18325, build the
+ * firmware with PS1_STATS to measure them and pass them with -i and -d.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_busgen host/busgen.c core/ps1_*.c
+ *   ./ps1_busgen [-i spi_cycles] [-d decode_cycles] [-s seconds]
+ *   ./ps1_busgen -v bus.vcd [-p poll_hz] [-m | -t | -w] [-s seconds]
+ * The second form writes the traffic as a VCD for ps1_replay instead,
+ * port 2 SEL is the ss2 signal.
+ *   ./ps1_busgen -l [-p poll_hz] [-i spi_cycles] [-d decode_cycles] [-s seconds]
+ * models LOW_POWER instead: the main loop goes to IDLE when the queue is
+ * empty and every interrupt that finds it there costs CY_WAKE more, see
+ * duty_table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_combo.h"
+#include "ps1_card.h"
+
+/* Bus timing, ns */
+#define BIT_NS 4000 // 250 kHz clock
+#define SS_SETUP_NS 2000 // SS low to first clock
+#define ACK_GAP_NS 12000 // last clock to next byte, /ACK from the device
+#define CARD_GAP_NS 14000 // memory cards answer a bit slower
+#define SS_HOLD_NS 4000 // last clock to SS high
+
+#define GEN_MAX_LEN 140 // memory card sector read
+#define CARD_EVERY 4 // a sector read after every 4th poll with MIX_CARD
+
+#define COMBO_EVERY_MS 5000 // press the combo this often
+#define COMBO_HOLD_MS 300 // and hold it this long
+#define SAVE_BEFORE_MS 500 // MIX_SAVE: sectors written from this long before the press
+#define SAVE_AFTER_MS 1000 // to this long after it
+
+/* CPU cost, instruction cycles (Fosc/4) */
+#define CY_ENTRY 8 // interrupt latency, flag tests, retfie
+#define CY_SPI 45 // SPI1 flag: both SSPxBUF and ps1_capture_byte
+#define CY_SS 25 // IOC flag: TMR1 read and ps1_capture_start
+#define CY_TICK 40 // TMR2 flag: ps1_reset_tick and RESET pin
+#define CY_DECODE 60 // main loop: peek, ps1_decode, release, poll
+#define CY_WAKE 4 // LOW_POWER: out of IDLE, GIE back on
+#define CY_IDLE 20 // LOW_POWER: main loop finds nothing, GIE off, peek, SLEEP
+
+#define MIX_PADS 0
+#define MIX_CARD 1
+#define MIX_MTAP 2 // a multitap on each port, 4 analog pads each
+#define MIX_SAVE 3 // pads, sector writes around the combo
+
+#define MS 1000000ull
+
+/* Controllers, PS1 bit order */
+struct Gen_Pad{
+    uint16_t id;
+    uint8_t len; // bytes in the poll
+    uint16_t combo;
+};
+
+static const struct Gen_Pad pads[] = {
+    {ID_DIG_CTRL, 5, KEY_COMBO_CTRL},
+    {ID_ANP_CTRL, 9, KEY_COMBO_CTRL},
+    {ID_ANS_CTRL, 9, KEY_COMBO_CTRL},
+    {ID_DS2_CTRL, 21, KEY_COMBO_XSTATION},
+    {ID_GUNCON_CTRL, 9, KEY_COMBO_GUNCON},
+};
+#define PAD_COUNT (sizeof(pads) / sizeof(pads[0]))
+
+/* One transaction, PS1 bit order */
+struct Gen_Tx{
+    uint64_t t; // SS falling edge
+    uint64_t gap; // between bytes
+    uint8_t cmd[GEN_MAX_LEN], dat[GEN_MAX_LEN];
+    uint8_t n;
+    uint8_t port; // SEL line, 0 or 1
+    uint8_t pad; // controller polls in it: 0 card, 1 pad, 4 multitap
+    uint16_t id[PS1_SLOTS], sw[PS1_SLOTS];
+};
+
+struct Gen{
+    uint64_t period; // between polls
+    uint8_t mix;
+    uint32_t k; // polls so far
+    uint8_t card; // next transaction is a card read, 2 a write
+    uint8_t port; // next multitap is on port 2
+    uint64_t t; // next transaction start
+    uint64_t t0; // start of the period, MIX_MTAP
+};
+
+static uint64_t tx_end(const struct Gen_Tx *tx){
+    return tx->t + SS_SETUP_NS + tx->n * (8 * BIT_NS + tx->gap) - tx->gap + SS_HOLD_NS;
+}
+
+/* Byte j is in the MSSP buffer at this time */
+static uint64_t tx_byte(const struct Gen_Tx *tx, uint8_t j){
+    return tx->t + SS_SETUP_NS + j * (8 * BIT_NS + tx->gap) + 8 * BIT_NS;
+}
+
+static void gen_init(struct Gen *g, uint32_t poll_hz, uint8_t mix){
+    memset(g, 0, sizeof(*g));
+    g->period = 1000000000ull / poll_hz;
+    g->mix = mix;
+    g->t = MS + 370000; // out of phase with the 1 ms tick
+}
+
+static void gen_next(struct Gen *g, struct Gen_Tx *tx){
+    const struct Gen_Pad *p;
+    uint32_t ms;
+    uint8_t i, press;
+
+    memset(tx, 0, sizeof(*tx));
+    tx->t = g->t;
+    if (g->card == 2){
+        // sector write: 0x81 'W', sector, data out, 'G' back at the end
+        g->card = 0;
+        tx->n = MEMC_WRITE_LEN;
+        tx->gap = CARD_GAP_NS;
+        tx->cmd[0] = CMD_SEL_MEMC_1;
+        tx->cmd[1] = CMD_MEMC_WRITE;
+        tx->cmd[5] = g->k;
+        for (i = 6; i < MEMC_WRITE_LEN - 3; i++)
+            tx->cmd[i] = i * 37;
+        tx->dat[0] = 0xFF;
+        tx->dat[1] = 0x08;
+        tx->dat[2] = MEMC_ID1;
+        tx->dat[3] = MEMC_ID2;
+        tx->dat[MEMC_WRITE_LEN-3] = 0x5C;
+        tx->dat[MEMC_WRITE_LEN-2] = 0x5D;
+        tx->dat[MEMC_WRITE_LEN-1] = MEMC_GOOD;
+        g->t = tx_end(tx) + 100000; // the next poll waits for its slot
+        g->t += g->period - g->t % g->period;
+        return;
+    }
+    if (g->card){
+        // sector read: 0x81 'R', then mostly zeroes out and data back
+        g->card = 0;
+        tx->n = GEN_MAX_LEN;
+        tx->gap = CARD_GAP_NS;
+        tx->cmd[0] = CMD_SEL_MEMC_1;
+        tx->cmd[1] = CMD_MEMC_READ;
+        tx->dat[0] = 0xFF;
+        tx->dat[1] = 0x08;
+        tx->dat[2] = MEMC_ID1;
+        tx->dat[3] = MEMC_ID2;
+        for (i = 4; i < GEN_MAX_LEN; i++)
+            tx->dat[i] = i * 37;
+        g->t = tx_end(tx) + 100000; // the next poll waits for its slot
+        g->t += g->period - g->t % g->period;
+        return;
+    }
+    press = (g->t / MS) % COMBO_EVERY_MS < COMBO_HOLD_MS && g->t / MS >= COMBO_EVERY_MS;
+    if (g->mix == MIX_MTAP){
+        // 01 42 01 00 ..., FF 80 5A then ID, switches, sticks for slots A to D
+        press = press ? (g->t / MS / COMBO_EVERY_MS) % PS1_PADS : 0xFF; // pad holding the combo
+        tx->n = MTAP_LEN;
+        tx->gap = ACK_GAP_NS;
+        tx->port = g->port;
+        tx->pad = PS1_SLOTS;
+        tx->cmd[0] = CMD_SEL_CTRL_1;
+        tx->cmd[1] = CMD_READ_SW;
+        tx->cmd[2] = CMD_TAP;
+        tx->dat[0] = 0xFF;
+        tx->dat[1] = ID_MULTITAP & 0xFF;
+        tx->dat[2] = ID_MULTITAP >> 8;
+        for (i = 0; i < PS1_SLOTS; i++){
+            tx->id[i] = ID_ANP_CTRL;
+            tx->sw[i] = press == g->port * PS1_SLOTS + i ? KEY_COMBO_CTRL : 0xFFFF;
+            tx->dat[3 + MTAP_SLOT_LEN*i] = ID_ANP_CTRL & 0xFF;
+            tx->dat[4 + MTAP_SLOT_LEN*i] = ID_ANP_CTRL >> 8;
+            tx->dat[5 + MTAP_SLOT_LEN*i] = tx->sw[i] & 0xFF;
+            tx->dat[6 + MTAP_SLOT_LEN*i] = tx->sw[i] >> 8;
+            memset(&tx->dat[7 + MTAP_SLOT_LEN*i], 0x80, 4);
+        }
+        g->k++;
+        if (g->port == 0){
+            g->port = 1; // port 2 right after port 1
+            g->t0 = g->t;
+            g->t = tx_end(tx) + 20000;
+        }else{
+            g->port = 0;
+            g->t = g->t0 + g->period;
+            if (g->t < tx_end(tx) + 20000)
+                g->t = tx_end(tx) + 20000; // back-to-back
+        }
+        return;
+    }
+    p = &pads[(g->t / MS / COMBO_EVERY_MS) % PAD_COUNT]; // next pad every combo period
+    tx->n = p->len;
+    tx->gap = ACK_GAP_NS;
+    tx->pad = 1;
+    tx->id[0] = p->id;
+    tx->sw[0] = press ? p->combo : 0xFFFF;
+    tx->cmd[0] = CMD_SEL_CTRL_1;
+    tx->cmd[1] = CMD_READ_SW;
+    tx->dat[0] = 0xFF;
+    tx->dat[1] = p->id & 0xFF;
+    tx->dat[2] = p->id >> 8;
+    tx->dat[3] = tx->sw[0] & 0xFF;
+    tx->dat[4] = tx->sw[0] >> 8;
+    for (i = 5; i < tx->n; i++)
+        tx->dat[i] = 0x80;
+    g->k++;
+    ms = (g->t / MS + SAVE_BEFORE_MS) % COMBO_EVERY_MS; // from the start of the save
+    if (g->mix == MIX_CARD && g->k % CARD_EVERY == 0){
+        g->card = 1;
+        g->t = tx_end(tx) + 50000;
+    }else if (g->mix == MIX_SAVE && g->t / MS + SAVE_BEFORE_MS >= COMBO_EVERY_MS &&
+            ms < SAVE_BEFORE_MS + SAVE_AFTER_MS){
+        g->card = 2;
+        g->t = tx_end(tx) + 50000;
+    }else{
+        g->t += g->period;
+        if (g->t < tx_end(tx) + 20000)
+            g->t = tx_end(tx) + 20000; // back-to-back
+    }
+}
+
+/**********************************************************/
+/* PIC model */
+
+/* Polls sent, matched in order against what the main loop decodes */
+#define EXPECT_SIZE 64
+#define EXPECT_LOOK 8 // polls a frame may be behind before it's corrupt
+
+struct Sim_Result{
+    unsigned long polls, decoded, dropped, corrupt, sspov;
+    unsigned long combos, resets; // combo presses, pulses
+    uint64_t lat_sum, lat_max; // SS edge of the first combo poll to RESET low
+    unsigned long wakes; // LOW_POWER: interrupts that woke the core from IDLE
+    uint64_t work; // ns the core ran ISR and main loop code, the rest is spin or IDLE
+};
+
+struct Sim{
+    uint64_t cy; // instruction cycle, ps
+    uint32_t cy_spi; // ISR cost of a byte
+    uint64_t t; // ns
+    uint8_t isr; // 0 idle, 1 entering, 2 running
+    uint64_t isr_at; // read point or end
+    uint8_t f_spi, f_ss, f_tick;
+    uint8_t ss_port; // SEL line of the pending SS edge
+    uint8_t buf_c, buf_d, buf_full;
+    uint8_t main; // 1 decoding, 2 LOW_POWER: on the way to IDLE
+    uint64_t main_left; // ns of CPU still needed
+    uint8_t low_power; // main loop idles when the queue is empty
+    uint8_t asleep; // in IDLE, the next interrupt wakes the core
+    uint8_t isr_wake; // CY_WAKE if the ISR woke the core
+    uint64_t tick_t;
+    uint8_t rst;
+    uint64_t combo_t; // first poll with the combo, 0 = none pending
+    struct PS1_Port pads[PS1_PADS]; // combo hold, per port and multitap slot
+    uint16_t exp_id[EXPECT_SIZE], exp_sw[EXPECT_SIZE];
+    uint32_t exp_head, exp_tail;
+};
+
+static uint64_t cycles_ns(const struct Sim *s, uint32_t cy){
+    return (cy * s->cy + 999) / 1000;
+}
+
+/* Main loop finished a frame, match it with the polls that were sent */
+static void sim_decoded(struct Sim *s, struct Sim_Result *r, const struct PS1_Frame *f){
+    uint8_t id_lo = f->data.buff[1], id_hi = f->data.buff[2], sw_lo = f->data.buff[3], sw_hi = f->data.buff[4];
+    uint16_t id, sw;
+    uint32_t i;
+
+    reverse_byte(&id_lo);
+    reverse_byte(&id_hi);
+    reverse_byte(&sw_lo);
+    reverse_byte(&sw_hi);
+    id = id_lo | id_hi << 8;
+    sw = sw_lo | sw_hi << 8;
+    for (i = s->exp_tail; i != s->exp_head && i - s->exp_tail < EXPECT_LOOK; i++){
+        if (s->exp_id[i % EXPECT_SIZE] == id && s->exp_sw[i % EXPECT_SIZE] == sw){
+            r->dropped += i - s->exp_tail;
+            s->exp_tail = i + 1;
+            r->decoded++;
+            return;
+        }
+    }
+    r->corrupt++;
+}
+
+/* ISR at its read point: SPI, SS, tick in the order of _spi_int */
+static void sim_isr(struct Sim *s, struct Sim_Result *r, uint64_t start){
+    uint32_t cy = CY_ENTRY + s->isr_wake;
+    uint8_t rst;
+
+    if (s->f_spi){
+        s->f_spi = 0;
+        s->buf_full = 0;
+        ps1_capture_byte(s->buf_c, s->buf_d);
+        cy += s->cy_spi;
+    }
+    if (s->f_ss){
+        s->f_ss = 0;
+        ps1_capture_start(s->ss_port, (uint16_t)(s->t / 1000));
+        cy += CY_SS;
+    }
+    if (s->f_tick){
+        s->f_tick = 0;
+        rst = ps1_reset_tick();
+        if (rst && !s->rst){
+            r->resets++;
+            if (s->combo_t){
+                if (s->t - s->combo_t > r->lat_max)
+                    r->lat_max = s->t - s->combo_t;
+                r->lat_sum += s->t - s->combo_t;
+                s->combo_t = 0;
+            }
+        }
+        s->rst = rst;
+        cy += CY_TICK;
+    }
+    s->isr = 2;
+    s->isr_at = start + cycles_ns(s, cy);
+    r->work += s->isr_at - start;
+}
+
+static void sim_run(uint32_t fosc_khz, uint32_t poll_hz, uint8_t mix, uint32_t seconds,
+        uint32_t cy_spi, uint32_t cy_decode, uint8_t low_power, struct Sim_Result *r){
+    static struct Sim s;
+    struct Gen g;
+    struct Gen_Tx tx;
+    struct PS1_Frame *f;
+    uint64_t end = seconds * 1000 * MS, bus_t, t_next, isr_start = 0, combo_press = 0;
+    uint8_t j = 0, k, ss_pending;
+    uint8_t c, d;
+
+    memset(&s, 0, sizeof(s));
+    memset(r, 0, sizeof(*r));
+    s.cy = 4000000000ull / fosc_khz; // 4 clocks per instruction, ps
+    s.cy_spi = cy_spi;
+    s.low_power = low_power;
+    s.tick_t = MS;
+    ps1_capture_init();
+    for (k = 0; k < PS1_PADS; k++)
+        ps1_port_init(&s.pads[k]);
+    ps1_reset_init(0); // console is up, armed from the start
+
+    gen_init(&g, poll_hz, mix);
+    gen_next(&g, &tx);
+    ss_pending = 1; // SS edge of tx, then its bytes
+    while (s.t < end){
+        bus_t = ss_pending ? tx.t : tx_byte(&tx, j);
+        t_next = bus_t < s.tick_t ? bus_t : s.tick_t;
+        if (s.isr && s.isr_at < t_next)
+            t_next = s.isr_at;
+        if (!s.isr && s.main && s.t + s.main_left < t_next)
+            t_next = s.t + s.main_left;
+        if (t_next >= end)
+            break;
+        if (!s.isr && s.main)
+            s.main_left -= t_next - s.t;
+        s.t = t_next;
+
+        if (s.isr == 1 && s.t == s.isr_at)
+            sim_isr(&s, r, isr_start);
+        else if (s.isr == 2 && s.t == s.isr_at)
+            s.isr = 0;
+        if (!s.isr && s.main == 1 && s.main_left == 0){
+            f = ps1_capture_peek();
+            sim_decoded(&s, r, f);
+            ps1_reset_poll(ps1_decode(&s.pads[f->pad], &f->cmd, &f->data, f->stamp));
+            ps1_capture_release();
+            s.main = 0;
+        }else if (!s.isr && s.main == 2 && s.main_left == 0){
+            s.main = 0;
+            s.asleep = !ps1_capture_peek(); // second peek with GIE off
+        }
+        if (s.t == bus_t){
+            if (ss_pending){
+                ss_pending = 0;
+                s.f_ss = 1;
+                s.ss_port = tx.port;
+                for (k = 0; k < tx.pad; k++){
+                    r->polls++;
+                    s.exp_id[s.exp_head % EXPECT_SIZE] = tx.id[k];
+                    s.exp_sw[s.exp_head % EXPECT_SIZE] = tx.sw[k];
+                    s.exp_head++;
+                    if (s.exp_head - s.exp_tail > EXPECT_SIZE){
+                        s.exp_tail++; // never decoded
+                        r->dropped++;
+                    }
+                    if (tx.sw[k] != 0xFFFF && combo_press != tx.t / MS / COMBO_EVERY_MS){
+                        combo_press = tx.t / MS / COMBO_EVERY_MS;
+                        r->combos++;
+                        s.combo_t = tx.t;
+                    }
+                }
+            }else{
+                // MSSP: BOEN = 1, a byte that wasn't read is overwritten
+                if (s.buf_full)
+                    r->sspov++;
+                c = tx.cmd[j];
+                d = tx.dat[j];
+                reverse_byte(&c);
+                reverse_byte(&d);
+                s.buf_c = c;
+                s.buf_d = d;
+                s.buf_full = 1;
+                s.f_spi = 1;
+                if (++j == tx.n){
+                    j = 0;
+                    gen_next(&g, &tx);
+                    ss_pending = 1;
+                }
+            }
+        }
+        if (s.t == s.tick_t){
+            s.f_tick = 1;
+            s.tick_t += MS;
+        }
+        if (!s.isr && (s.f_spi || s.f_ss || s.f_tick)){
+            s.isr = 1;
+            isr_start = s.t;
+            s.isr_wake = s.asleep ? CY_WAKE : 0;
+            s.isr_at = s.t + cycles_ns(&s, CY_ENTRY + s.isr_wake);
+            r->wakes += s.asleep;
+            s.asleep = 0;
+        }
+        if (!s.isr && !s.main && ps1_capture_peek()){
+            s.main = 1;
+            s.main_left = cycles_ns(&s, cy_decode);
+            r->work += s.main_left;
+        }else if (!s.isr && !s.main && s.low_power && !s.asleep){
+            s.main = 2;
+            s.main_left = cycles_ns(&s, CY_IDLE);
+            r->work += s.main_left;
+        }
+    }
+    k = mix == MIX_MTAP ? PS1_SLOTS : 1; // last transaction may be in flight
+    r->dropped += s.exp_head - s.exp_tail > k ? s.exp_head - s.exp_tail - k : 0;
+}
+
+/**********************************************************/
+/* VCD for ps1_replay */
+
+static void vcd_write(FILE *f, uint32_t poll_hz, uint8_t mix, uint32_t seconds){
+    struct Gen g;
+    struct Gen_Tx tx;
+    uint64_t end = seconds * 1000 * MS, t;
+    uint8_t j, b, cmd = 1, dat = 1;
+    char ss;
+
+    fprintf(f, "$timescale 1ns $end\n$scope module ps1 $end\n"
+        "$var wire 1 ! ss $end\n$var wire 1 \" clk $end\n"
+        "$var wire 1 # cmd $end\n$var wire 1 $ data $end\n"
+        "$var wire 1 %% ss2 $end\n"
+        "$upscope $end\n$enddefinitions $end\n"
+        "#0\n$dumpvars\n1!\n1\"\n1#\n1$\n1%%\n$end\n");
+    gen_init(&g, poll_hz, mix);
+    for (gen_next(&g, &tx); tx.t < end; gen_next(&g, &tx)){
+        ss = tx.port ? '%' : '!';
+        fprintf(f, "#%llu\n0%c\n", (unsigned long long)tx.t, ss);
+        for (j = 0; j < tx.n; j++){
+            t = tx_byte(&tx, j) - 8 * BIT_NS;
+            for (b = 0; b < 8; b++, t += BIT_NS){
+                // data changes on the falling edge, sampled on the rising one
+                fprintf(f, "#%llu\n0\"\n", (unsigned long long)t);
+                if ((tx.cmd[j] >> b & 1) != cmd)
+                    fprintf(f, "%u#\n", cmd ^= 1);
+                if ((tx.dat[j] >> b & 1) != dat)
+                    fprintf(f, "%u$\n", dat ^= 1);
+                fprintf(f, "#%llu\n1\"\n", (unsigned long long)(t + BIT_NS / 2));
+            }
+        }
+        fprintf(f, "#%llu\n1%c\n", (unsigned long long)tx_end(&tx), ss);
+        if (!cmd)
+            fprintf(f, "1#\n");
+        if (!dat)
+            fprintf(f, "1$\n");
+        cmd = dat = 1;
+    }
+}
+
+/**********************************************************/
+/* LOW_POWER duty cycle */
+
+/* Cycles per 60 Hz frame the core runs code against what it spends in
+ * IDLE, at the clocks main.c can be built for (FOSC_MHZ). Without
+ * LOW_POWER the main loop spins through the idle part instead.
+ * Returns 1 if a clock loses polls with LOW_POWER and not without it */
+static int duty_table(uint32_t poll_hz, uint32_t seconds, uint32_t cy_spi, uint32_t cy_decode){
+    static const uint32_t fosc[] = {8000, 16000, 32000};
+    static const char *mix_name[] = {"pads", "pads+card", "multitaps", "pads+save"};
+    struct Sim_Result r, spin;
+    uint64_t frame_cy;
+    double frames = seconds * 60.0, work, awake;
+    unsigned i;
+    uint8_t m;
+    int err = 0, ok;
+
+    printf("%u s per case, polled at %u Hz, wake %u cycles, back to IDLE %u cycles\n",
+        seconds, poll_hz, CY_WAKE, CY_IDLE);
+    printf("%6s %-10s %10s %10s %10s %7s %7s %7s %7s\n", "Fosc", "traffic", "cy/frame",
+        "spin work", "idle awake", "idle %", "wakes", "lost %", "sspov");
+    for (i = 0; i < sizeof(fosc) / sizeof(fosc[0]); i++){
+        frame_cy = fosc[i] * 1000ull / 4 / 60;
+        for (m = MIX_PADS; m <= MIX_SAVE; m++){
+            sim_run(fosc[i], poll_hz, m, seconds, cy_spi, cy_decode, 0, &spin);
+            sim_run(fosc[i], poll_hz, m, seconds, cy_spi, cy_decode, 1, &r);
+            work = spin.work / 1e9 * fosc[i] * 250 / frames; // ns to cycles at Fosc/4
+            awake = r.work / 1e9 * fosc[i] * 250 / frames;
+            ok = r.dropped + r.corrupt + r.sspov <= spin.dropped + spin.corrupt + spin.sspov;
+            printf("%4uMHz %-10s %10llu %10.0f %10.0f %7.2f %7.1f %7.3f %7lu%s\n", fosc[i] / 1000,
+                mix_name[m], (unsigned long long)frame_cy, work, awake, 100.0 - 100.0 * awake / frame_cy,
+                r.wakes / frames, r.polls ? 100.0 * r.dropped / r.polls : 0, r.sspov, ok ? "" : " FAIL");
+            if (!ok)
+                err = 1;
+        }
+    }
+    return err;
+}
+
+/**********************************************************/
+
+int main(int argc, char **argv){
+    static const uint32_t fosc[] = {1000, 2000, 4000, 8000, 16000, 32000};
+    static const uint32_t rate[] = {50, 60, 240, 1000, 5000};
+    static const char *mix_name[] = {"pads", "pads+card", "multitaps", "pads+save"};
+    uint32_t cy_spi = CY_SPI, cy_decode = CY_DECODE, seconds = 30, poll_hz = 60;
+    const char *vcd = 0;
+    uint8_t mix = MIX_PADS, m, duty = 0;
+    struct Sim_Result r;
+    unsigned i, k;
+    FILE *f;
+
+    for (i = 1; i < (unsigned)argc; i++){
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < (unsigned)argc)
+            cy_spi = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < (unsigned)argc)
+            cy_decode = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < (unsigned)argc)
+            seconds = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < (unsigned)argc)
+            poll_hz = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < (unsigned)argc)
+            vcd = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0)
+            mix = MIX_CARD;
+        else if (strcmp(argv[i], "-t") == 0)
+            mix = MIX_MTAP;
+        else if (strcmp(argv[i], "-w") == 0)
+            mix = MIX_SAVE;
+        else if (strcmp(argv[i], "-l") == 0)
+            duty = 1;
+        else{
+            fprintf(stderr, "usage: ps1_busgen [-i spi_cycles] [-d decode_cycles] [-s seconds]\n"
+                "       ps1_busgen -l [-p poll_hz] [-i spi_cycles] [-d decode_cycles] [-s seconds]\n"
+                "       ps1_busgen -v bus.vcd [-p poll_hz] [-m | -t | -w] [-s seconds]\n");
+            return 2;
+        }
+    }
+    if (!seconds || !poll_hz)
+        return 2;
+    ps1_combo_load(0);
+
+    if (vcd){
+        f = fopen(vcd, "w");
+        if (!f){
+            perror(vcd);
+            return 2;
+        }
+        vcd_write(f, poll_hz, mix, seconds);
+        fclose(f);
+        return 0;
+    }
+
+    if (duty)
+        return duty_table(poll_hz, seconds, cy_spi, cy_decode);
+
+    printf("%u s per case, ISR %u+%u cycles per byte, decode %u cycles, combo every %u ms\n",
+        seconds, CY_ENTRY, cy_spi, cy_decode, COMBO_EVERY_MS);
+    printf("%6s %6s %-10s %7s %8s %7s %7s %7s %12s %12s\n", "Fosc", "poll", "traffic",
+        "polls", "lost %", "corrupt", "sspov", "resets", "latency avg", "latency max");
+    for (i = 0; i < sizeof(fosc) / sizeof(fosc[0]); i++){
+        for (k = 0; k < sizeof(rate) / sizeof(rate[0]); k++){
+            for (m = MIX_PADS; m <= MIX_SAVE; m++){
+                sim_run(fosc[i], rate[k], m, seconds, cy_spi, cy_decode, 0, &r);
+                printf("%4uMHz %5uHz %-10s %7lu %8.3f %7lu %7lu %3lu/%-3lu", fosc[i] / 1000, rate[k],
+                    mix_name[m], r.polls, r.polls ? 100.0 * r.dropped / r.polls : 0, r.corrupt, r.sspov,
+                    r.resets, r.combos);
+                if (r.resets)
+                    printf(" %9.2f ms %9.2f ms\n", r.lat_sum / 1e6 / r.resets, r.lat_max / 1e6);
+                else
+                    printf(" %12s %12s\n", "-", "-");
+            }
+        }
+    }
+    return 0;
+}
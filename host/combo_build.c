@@ -0,0 +1,227 @@
+/*
+ * File:   combo_build.c
+ * Author: pyroesp
+ *
+ * Builds the EEPROM combo table (see core/ps1_combo.h) from a text file
+ *
+ * One combo per line, '#' starts a comment:
+ *   <pad|guncon> <button>... <short|long> [hold ms]
+ *   pad select start l2 r2 short
+ *   pad select cross l2 r2 long
+ *   guncon a trigger b long
+ *   pad l1 r1 triangle short 2000
+ * Buttons: select l3 r3 start up right down left l2 r2 l1 r1 triangle
+ * circle cross square, GunCon names a (start), trigger (circle), b (cross).
+ * The listed buttons are held, every other one released. The hold time
+ * defaults to COMBO_HOLD_SHORT / COMBO_HOLD_LONG.
+ *
+ * Writes the raw image (.bin, for ps1_replay -t) and an Intel HEX of the
+ * PIC16F18325 data EEPROM (0xF000, byte address 0x1E000) to load with the
+ * programmer. With -d it prints an existing .bin instead.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_combos host/combo_build.c core/ps1_combo.c core/ps1_ctrl.c
+ * Run:
+ *   ./ps1_combos combos.txt combos.bin combos.hex
+ *   ./ps1_combos -d combos.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_combo.h"
+
+#define EEPROM_HEX_ADDR 0x1E000ul // word 0xF000, one EEPROM byte per word
+
+static const char *key_names[16] = {
+    "select", "l3", "r3", "start", "up", "right", "down", "left",
+    "l2", "r2", "l1", "r1", "triangle", "circle", "cross", "square"
+};
+
+static const struct { const char *name; uint8_t key; } gun_names[] = {
+    {"a", 3}, {"trigger", 13}, {"b", 14}, // start, circle, cross
+};
+
+static int key_find(const char *s){
+    unsigned i;
+    for (i = 0; i < 16; i++)
+        if (strcasecmp(s, key_names[i]) == 0)
+            return i;
+    for (i = 0; i < sizeof(gun_names) / sizeof(gun_names[0]); i++)
+        if (strcasecmp(s, gun_names[i].name) == 0)
+            return gun_names[i].key;
+    return -1;
+}
+
+/* Text table to combos, returns the count or -1 */
+static int parse(FILE *f, const char *fname, struct PS1_Combo_Def *def){
+    char line[256], *tok, *end;
+    int n = 0, ln = 0, k;
+    unsigned long ms;
+
+    while (fgets(line, sizeof(line), f)){
+        ln++;
+        if ((tok = strchr(line, '#')) != NULL)
+            *tok = 0;
+        if ((tok = strtok(line, " \t\r\n")) == NULL)
+            continue;
+        if (n == COMBO_MAX){
+            fprintf(stderr, "%s:%d: more than %d combos\n", fname, ln, COMBO_MAX);
+            return -1;
+        }
+        memset(&def[n], 0, sizeof(def[n]));
+        if (strcasecmp(tok, "pad") == 0)
+            def[n].cls = COMBO_CLASS_PAD;
+        else if (strcasecmp(tok, "guncon") == 0)
+            def[n].cls = COMBO_CLASS_GUNCON;
+        else{
+            fprintf(stderr, "%s:%d: unknown class '%s'\n", fname, ln, tok);
+            return -1;
+        }
+        while ((tok = strtok(NULL, " \t\r\n")) != NULL){
+            if (strcasecmp(tok, "short") == 0)
+                def[n].action = PS1_ACT_SHORT;
+            else if (strcasecmp(tok, "long") == 0)
+                def[n].action = PS1_ACT_LONG;
+            else if (def[n].action){
+                ms = strtoul(tok, &end, 0);
+                if (*end || ms / COMBO_HOLD_UNIT_MS > 255){
+                    fprintf(stderr, "%s:%d: hold '%s' not 0 to %d ms\n", fname, ln, tok,
+                        255 * COMBO_HOLD_UNIT_MS);
+                    return -1;
+                }
+                def[n].hold = ms / COMBO_HOLD_UNIT_MS;
+            }else if ((k = key_find(tok)) >= 0)
+                def[n].keys |= 1 << k;
+            else{
+                fprintf(stderr, "%s:%d: unknown button '%s'\n", fname, ln, tok);
+                return -1;
+            }
+        }
+        if (!def[n].keys || !def[n].action){
+            fprintf(stderr, "%s:%d: needs buttons and short/long\n", fname, ln);
+            return -1;
+        }
+        for (k = 0; k < n; k++){
+            if (def[k].cls == def[n].cls && def[k].keys == def[n].keys){
+                fprintf(stderr, "%s:%d: same buttons as combo %d\n", fname, ln, k + 1);
+                return -1;
+            }
+        }
+        n++;
+    }
+    return n;
+}
+
+static void dump(const struct PS1_Combo_Def *def, int n){
+    int i, k;
+    printf("%d combos, seed %u, %u bytes\n", n, combos.seed, COMBO_HDR + COMBO_ENTRY*n + 1);
+    for (i = 0; i < n; i++){
+        printf("  %-6s %-5s %5u ms ", def[i].cls == COMBO_CLASS_GUNCON ? "guncon" : "pad",
+            def[i].action == PS1_ACT_LONG ? "long" : "short", def[i].hold * COMBO_HOLD_UNIT_MS);
+        for (k = 0; k < 16; k++)
+            if (def[i].keys >> k & 1)
+                printf(" %s", key_names[k]);
+        printf("\n");
+    }
+}
+
+static void hex_line(FILE *f, uint8_t type, uint16_t addr, const uint8_t *p, uint8_t len){
+    uint8_t sum = len + (addr >> 8) + addr + type, i;
+    fprintf(f, ":%02X%04X%02X", len, addr, type);
+    for (i = 0; i < len; i++){
+        fprintf(f, "%02X", p[i]);
+        sum += p[i];
+    }
+    fprintf(f, "%02X\n", (uint8_t)-sum);
+}
+
+/* EEPROM bytes as program words: data, 0x00 */
+static void write_hex(FILE *f, const uint8_t *img, int len){
+    uint8_t rec[16], ext[2] = {EEPROM_HEX_ADDR >> 24, EEPROM_HEX_ADDR >> 16};
+    int i, k;
+
+    hex_line(f, 4, 0, ext, 2);
+    for (i = 0; i < len; i += 8){
+        for (k = 0; k < 8 && i + k < len; k++){
+            rec[2*k] = img[i+k];
+            rec[2*k+1] = 0;
+        }
+        hex_line(f, 0, (uint16_t)(EEPROM_HEX_ADDR + 2*i), rec, 2*k);
+    }
+    hex_line(f, 1, 0, NULL, 0);
+}
+
+/* ps1_combo_load reads through this */
+static uint8_t img[256];
+static uint8_t img_read(uint8_t a){
+    return img[a];
+}
+
+int main(int argc, char *argv[]){
+    struct PS1_Combo_Def def[COMBO_MAX];
+    FILE *f;
+    int n, len, i;
+
+    if (argc == 3 && strcmp(argv[1], "-d") == 0){
+        memset(img, 0xFF, sizeof(img));
+        if ((f = fopen(argv[2], "rb")) == NULL){
+            perror(argv[2]);
+            return 1;
+        }
+        len = fread(img, 1, sizeof(img), f);
+        fclose(f);
+        if (ps1_combo_load(img_read) != COMBO_SRC_EEPROM){
+            fprintf(stderr, "%s: not a valid combo table (%d bytes)\n", argv[2], len);
+            return 1;
+        }
+        n = img[3];
+        for (i = 0; i < n; i++){
+            def[i].cls = img[COMBO_HDR + COMBO_ENTRY*i];
+            def[i].keys = img[COMBO_HDR + COMBO_ENTRY*i + 1] | img[COMBO_HDR + COMBO_ENTRY*i + 2] << 8;
+            def[i].action = img[COMBO_HDR + COMBO_ENTRY*i + 3];
+            def[i].hold = img[COMBO_HDR + COMBO_ENTRY*i + 4];
+        }
+        dump(def, n);
+        return 0;
+    }
+    if (argc < 3 || argc > 4){
+        fprintf(stderr, "usage: %s combos.txt combos.bin [combos.hex]\n"
+            "       %s -d combos.bin\n", argv[0], argv[0]);
+        return 2;
+    }
+    if ((f = fopen(argv[1], "r")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    n = parse(f, argv[1], def);
+    fclose(f);
+    if (n <= 0){
+        if (n == 0)
+            fprintf(stderr, "%s: no combos\n", argv[1]);
+        return 1;
+    }
+    if ((len = ps1_combo_image(img, def, n)) == 0){
+        fprintf(stderr, "no hash seed fits these combos\n");
+        return 1;
+    }
+    dump(def, n);
+    if ((f = fopen(argv[2], "wb")) == NULL || fwrite(img, 1, len, f) != (size_t)len){
+        perror(argv[2]);
+        return 1;
+    }
+    fclose(f);
+    if (argc == 4){
+        if ((f = fopen(argv[3], "w")) == NULL){
+            perror(argv[3]);
+            return 1;
+        }
+        write_hex(f, img, len);
+        fclose(f);
+    }
+    return 0;
+}
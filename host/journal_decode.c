@@ -0,0 +1,309 @@
+/*
+ * File:   journal_decode.c
+ * Author: pyroesp
+ *
+ * Decoder for journal dumps (see core/ps1_journal.h)
+ *
+ * Takes the dump the way it comes off the mod:
+ *   DEBUG UART trace: the TRACE_JOURNAL records are put back together,
+ *                     everything else in the stream is skipped
+ *   Intel HEX: the data EEPROM read back with the programmer, JOURNAL_NVM
+ *              saved the dump at JOURNAL_NVM_ADDR
+ *   raw: the dump itself, starting with 'P' 'J'
+ * and prints one line per record, times in ms before the dump was taken,
+ * buttons pressed by name. Exits with 1 if a dump is broken.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_journal host/journal_decode.c
+ * Run:
+ *   stty -F /dev/ttyUSB0 500000 raw && ./ps1_journal /dev/ttyUSB0
+ *   ./ps1_journal eeprom.hex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_trace.h"
+#include "ps1_journal.h"
+
+#define EEPROM_HEX_ADDR 0x1E000ul // word 0xF000, one EEPROM byte per word
+#define EEPROM_SIZE 256
+#define INPUT_MAX (1 << 20)
+
+static const char *key_names[16] = {
+    "SELECT", "L3", "R3", "START", "UP", "RIGHT", "DOWN", "LEFT",
+    "L2", "R2", "L1", "R1", "TRIANGLE", "CIRCLE", "CROSS", "SQUARE"
+};
+
+static const char *ev_names[] = { J_EV_NAMES };
+
+static const char *id_name(uint16_t id){
+    switch(id){
+        case ID_DIG_CTRL: return "digital";
+        case ID_ANP_CTRL: return "analog pad";
+        case ID_ANS_CTRL: return "analog stick";
+        case ID_DS2_CTRL: return "dualshock 2";
+        case ID_GUNCON_CTRL: return "guncon";
+        case ID_MULTITAP: return "multitap";
+        case ID_CONFIG: return "config mode";
+    }
+    return "unknown";
+}
+
+static uint8_t msb; // dump in MSSP order
+static unsigned long polls;
+
+static uint8_t rev(uint8_t b){
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+}
+
+/* Wire order pair of bytes to PS1 order */
+static uint16_t ps1_word(uint8_t lo, uint8_t hi){
+    return msb ? rev(lo) | rev(hi) << 8 : lo | hi << 8;
+}
+
+static void print_at(uint32_t t, uint32_t end){
+    printf("%10.3f s  ", -(double)(end - t) / 1000);
+}
+
+static void print_pad(uint8_t pad, const uint16_t *id, const uint16_t *sw, uint8_t known){
+    uint8_t i;
+    printf("%u%c  ", pad / PS1_SLOTS + 1, 'A' + pad % PS1_SLOTS);
+    if (!(known >> pad & 1)){
+        printf("?\n");
+        return;
+    }
+    printf("%s", id_name(id[pad]));
+    for (i = 0; i < 16; i++)
+        if (!(sw[pad] & (1 << i)))
+            printf(" %s", key_names[i]);
+    printf("\n");
+}
+
+/* Length of the record at p, 0 if it doesn't fit in n */
+static unsigned rec_len(const uint8_t *p, unsigned n){
+    unsigned len;
+    if (p[0] & J_REPEAT)
+        len = 4;
+    else if (p[0] & J_EVENT)
+        len = (p[0] & J_EV_MASK) == J_EV_STATE ? 6 : 1;
+    else
+        len = 2 + (p[0] & J_LONG ? 1 : 0) + (p[0] & J_ID ? 2 : 0) + (p[0] & J_SW ? 2 : 0);
+    return len <= n ? len : 0;
+}
+
+/* One dump, returns its length or -1 if it's broken */
+static long decode(const uint8_t *p, size_t n){
+    uint16_t id[PS1_PADS], sw[PS1_PADS], span;
+    uint32_t t, end, since;
+    unsigned len, i, k, r, cnt;
+    uint8_t known = 0, sum = 0, h, pad = 0, frames, c;
+
+    if (n < JOURNAL_HDR + 1 || p[0] != 'P' || p[1] != 'J')
+        return -1;
+    if (p[2] != JOURNAL_VERSION){
+        fprintf(stderr, "journal version %u, this decoder reads %u\n", p[2], JOURNAL_VERSION);
+        return -1;
+    }
+    msb = p[3] & JOURNAL_WIRE_MSB;
+    since = p[4] | p[5] << 8;
+    len = p[6] | p[7] << 8;
+    if (n < JOURNAL_HDR + len + 1u){
+        fprintf(stderr, "journal dump cut short, %lu of %u bytes\n",
+            (unsigned long)n, JOURNAL_HDR + len + 1);
+        return -1;
+    }
+    for (i = 0; i < JOURNAL_HDR + len + 1; i++)
+        sum += p[i];
+    if (sum){
+        fprintf(stderr, "journal dump check failed\n");
+        return -1;
+    }
+
+    // time runs forward from the first record, the dump is since after the last
+    for (i = 0, t = 0; i < len; i += r){
+        const uint8_t *q = &p[JOURNAL_HDR + i];
+        if (!(r = rec_len(q, len - i)))
+            return -1;
+        if (q[0] & J_REPEAT)
+            t += q[2] | q[3] << 8;
+        else if (!(q[0] & J_EVENT))
+            t += q[0] & J_LONG ? q[1] | q[2] << 8 : q[1];
+    }
+    end = t + since;
+    printf("journal: %u bytes, %.3f s of records, last one %.3f s before the dump\n",
+        len, t / 1000.0, since / 1000.0);
+
+    for (i = 0, t = 0, frames = 0; i < len; i += r){
+        const uint8_t *q = &p[JOURNAL_HDR + i];
+        r = rec_len(q, len - i);
+        h = q[0];
+        if (h & J_REPEAT){
+            cnt = (h & J_RUN_MASK) | (q[1] >> 4) << 7;
+            c = q[1] & J_CYC_MASK;
+            span = q[2] | q[3] << 8;
+            if (!cnt || !c || c > frames)
+                return -1; // repeat of records that aren't there
+            polls += cnt * c;
+            t += span;
+            print_at(t, end);
+            if (c == 1)
+                printf("    same poll %u more times over %u ms, every %.1f ms\n",
+                    cnt, span, (double)span / cnt);
+            else
+                printf("    same %u polls %u more times over %u ms, every %.1f ms\n",
+                    c, cnt, span, (double)span / cnt);
+        }else if (h & J_EVENT){
+            if ((h & J_EV_MASK) == J_EV_STATE){
+                pad = q[1] & J_PAD_MASK;
+                id[pad] = ps1_word(q[2], q[3]);
+                sw[pad] = ps1_word(q[4], q[5]);
+                known |= 1 << pad;
+                printf("%12s  state ", "");
+                print_pad(pad, id, sw, known);
+            }else{
+                print_at(t, end);
+                k = h & J_EV_MASK;
+                printf("-- %s\n", k < sizeof(ev_names) / sizeof(ev_names[0]) ? ev_names[k] : "unknown event");
+            }
+            frames = 0; // rounds don't go past events
+        }else{
+            pad = h & J_PAD_MASK;
+            k = 1;
+            t += h & J_LONG ? q[k] | q[k+1] << 8 : q[k];
+            k += h & J_LONG ? 2 : 1;
+            if (h & J_ID){
+                id[pad] = ps1_word(q[k], q[k+1]);
+                k += 2;
+            }
+            if (h & J_SW)
+                sw[pad] = ps1_word(q[k], q[k+1]);
+            if ((h & (J_ID | J_SW)) == (J_ID | J_SW))
+                known |= 1 << pad;
+            if (frames < JOURNAL_CYCLE_MAX)
+                frames++;
+            polls++;
+            print_at(t, end);
+            print_pad(pad, id, sw, known);
+        }
+    }
+    return JOURNAL_HDR + len + 1;
+}
+
+/* Intel HEX of the data EEPROM, the dump at JOURNAL_NVM_ADDR */
+static int hex_eeprom(const char *s, uint8_t *img){
+    unsigned len, addr, type, b, i;
+    unsigned long base = 0, a;
+    const char *line;
+
+    memset(img, 0xFF, EEPROM_SIZE);
+    for (line = s; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : 0){
+        if (*line != ':')
+            continue;
+        if (sscanf(line + 1, "%2x%4x%2x", &len, &addr, &type) != 3)
+            return -1;
+        if (type == 4 && sscanf(line + 9, "%4lx", &base) == 1)
+            base <<= 16;
+        if (type != 0)
+            continue;
+        for (i = 0; i < len; i++){
+            if (sscanf(line + 9 + 2*i, "%2x", &b) != 1)
+                return -1;
+            a = base + addr + i;
+            // one EEPROM byte in the low byte of each word
+            if (a >= EEPROM_HEX_ADDR && a < EEPROM_HEX_ADDR + 2*EEPROM_SIZE && !(a & 1))
+                img[(a - EEPROM_HEX_ADDR) / 2] = b;
+        }
+    }
+    return 0;
+}
+
+/* TRACE_JOURNAL payloads of a DEBUG trace, back to back into out */
+static size_t trace_journal(const uint8_t *p, size_t n, uint8_t *out){
+    size_t i = 0, len, o = 0, k;
+    uint8_t check;
+
+    while (i + 3 < n){
+        if (p[i] != TRACE_SYNC){
+            i++;
+            continue;
+        }
+        len = p[i+2];
+        if (i + 4 + len > n)
+            break;
+        check = p[i+1] ^ p[i+2];
+        for (k = 0; k < len; k++)
+            check ^= p[i+3+k];
+        if (check != p[i+3+len]){
+            i++; // not a record, resync
+            continue;
+        }
+        if (p[i+1] == TRACE_JOURNAL){
+            memcpy(&out[o], &p[i+3], len);
+            o += len;
+        }
+        i += 4 + len;
+    }
+    return o;
+}
+
+int main(int argc, char **argv){
+    static uint8_t in[INPUT_MAX + 1], buf[INPUT_MAX];
+    const uint8_t *p = in;
+    FILE *f = stdin;
+    size_t n, i;
+    long len;
+    int dumps = 0, err = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0){
+        f = fopen(argv[1], "rb");
+        if (!f){
+            perror(argv[1]);
+            return 2;
+        }
+    }
+    n = fread(in, 1, INPUT_MAX, f);
+    in[n] = 0;
+
+    if (n >= 2 && in[0] == 'P' && in[1] == 'J')
+        p = in;
+    else if (n && in[0] == ':'){
+        if (hex_eeprom((const char*)in, buf)){
+            fprintf(stderr, "bad Intel HEX\n");
+            return 2;
+        }
+        p = buf + JOURNAL_NVM_ADDR;
+        n = JOURNAL_NVM_SIZE;
+    }else{
+        n = trace_journal(in, n, buf);
+        p = buf;
+    }
+
+    // every dump in it, in order
+    for (i = 0; i + JOURNAL_HDR < n; ){
+        if (p[i] != 'P' || p[i+1] != 'J'){
+            i++;
+            continue;
+        }
+        if (dumps++)
+            printf("\n");
+        len = decode(&p[i], n - i);
+        if (len < 0){
+            err = 1;
+            i++;
+            continue;
+        }
+        i += len;
+    }
+    if (!dumps){
+        fprintf(stderr, "no journal dump found\n");
+        return 1;
+    }
+    fprintf(stderr, "%d dumps, %lu polls\n", dumps, polls);
+    return err;
+}
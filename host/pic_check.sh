@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# File:   pic_check.sh
+# Author: pyroesp
+#
+# Builds pic16f18325/main.c for the host (host/xc/xc.h, host/pic_sim.c)
+# with each set of build options and runs it on ps1_busgen traffic next to
+# ps1_replay: transactions, polls decoded, reset pulses and the memory card
+# line have to be the same, with no capture errors. The DEBUG trace and
+# the JOURNAL_NVM EEPROM have to decode, and a bus the MSSPs get nothing
+# from, or MSSPs that get nothing off a busy bus (ps1_pic -d), have to end
+# in watchdog resets.
+# Exits with an error on the first one that doesn't.
+#
+# Run from the repository root:
+#   sh host/pic_check.sh [seconds]
+
+seconds=${1:-12}
+dir=${TMPDIR:-/tmp}/ps1_pic_check
+mkdir -p "$dir" || exit 1
+
+gcc -O2 -Wall -I core -o "$dir/busgen" host/busgen.c core/ps1_*.c || exit 1
+gcc -O2 -Wall -I core -o "$dir/replay" host/replay.c core/ps1_*.c || exit 1
+gcc -O2 -Wall -DPS1_STATS -I core -o "$dir/trace" host/trace_decode.c core/ps1_*.c || exit 1
+gcc -O2 -Wall -I core -o "$dir/journal" host/journal_decode.c || exit 1
+
+# Traffic, and what ps1_replay makes of it with main.c's 20 s lockout
+for mix in pads -m -w -t; do
+    opt=$mix
+    [ "$mix" = pads ] && opt=
+    "$dir/busgen" -v "$dir/$mix.vcd" $opt -s "$seconds" > /dev/null || exit 1
+    "$dir/replay" -q -l 20000 "$dir/$mix.vcd" 2> /dev/null |
+        sed -n 's/^[0-9.]* s of bus, //; s/ [0-9]* combo hits,//p; /^memory card/p' > "$dir/$mix.want"
+done
+
+# SS pulses at 60 Hz and nothing else
+{
+    printf '$timescale 1ns $end\n$scope module ps1 $end\n'
+    printf '$var wire 1 ! ss $end\n$var wire 1 " clk $end\n$var wire 1 # cmd $end\n$var wire 1 $ data $end\n'
+    printf '$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n1!\n1"\n1#\n1$\n$end\n'
+    i=1
+    while [ $i -le 300 ]; do
+        printf '#%d\n0!\n#%d\n1!\n' $((i * 16666667)) $((i * 16666667 + 300000))
+        i=$((i + 1))
+    done
+} > "$dir/dead.vcd"
+
+for opts in "" -DLOW_POWER -DHW_TIMING -DPORT2 "-DPORT2 -DHW_TIMING -DLOW_POWER" \
+    "-DDEBUG -DJOURNAL -DPS1_STATS" "-DJOURNAL -DJOURNAL_NVM"; do
+    echo "== main.c $opts"
+    # warning-clean in every build, unused DEBUG macros included
+    gcc -O2 -Wall -Wextra -Werror -Wno-unknown-pragmas -finstrument-functions $opts -I host/xc -I core -I pic16f18325 \
+        -o "$dir/pic" host/pic_sim.c pic16f18325/main.c core/ps1_*.c || exit 1
+    for mix in pads -m -w -t; do
+        # port 2 traffic, only PORT2 sees all of it
+        [ "$mix" = -t ] && [ "${opts#*PORT2}" = "$opts" ] && continue
+        rm -f "$dir/uart.bin" "$dir/eeprom.hex"
+        "$dir/pic" -q -u "$dir/uart.bin" -e "$dir/eeprom.hex" "$dir/$mix.vcd" > "$dir/out.txt" ||
+            { cat "$dir/out.txt"; echo "main.c $opts, $mix: FAIL, capture errors"; exit 1; }
+        sed -n '1s/^[0-9.]* s of bus, //p; /^memory card/p' "$dir/out.txt" > "$dir/got"
+        cmp -s "$dir/got" "$dir/$mix.want" ||
+            { diff "$dir/$mix.want" "$dir/got"; echo "main.c $opts, $mix: FAIL, not what ps1_replay saw"; exit 1; }
+        echo "  $mix: $(head -1 "$dir/got")"
+        echo "    $(grep '^CPU' "$dir/out.txt")"
+        case "$opts" in *DEBUG*)
+            "$dir/trace" "$dir/uart.bin" 2>&1 > /dev/null | grep -q ' 0 bad records' ||
+                { echo "main.c $opts, $mix: FAIL, DEBUG trace"; exit 1; }
+        esac
+        # saved when a reset is decided, there's none in less than 5 s
+        case "$mix$opts" in -w*JOURNAL_NVM*)
+            grep -q ' [1-9][0-9]* reset pulses' "$dir/got" || continue
+            "$dir/journal" "$dir/eeprom.hex" > /dev/null 2>&1 ||
+                { echo "main.c $opts, $mix: FAIL, no journal in the EEPROM"; exit 1; }
+        esac
+    done
+    "$dir/pic" -q "$dir/dead.vcd" > "$dir/out.txt"
+    grep -q ' [1-9][0-9]* watchdog resets' "$dir/out.txt" ||
+        { cat "$dir/out.txt"; echo "main.c $opts: FAIL, no watchdog reset on a dead bus"; exit 1; }
+    echo "  dead bus: $(grep -o '[0-9]* watchdog resets' "$dir/out.txt")"
+    # polls on the bus, MSSPs that get nothing: restarting them doesn't
+    # help, the watchdog has to, IDLE or not
+    "$dir/pic" -q -d "$dir/pads.vcd" > "$dir/out.txt"
+    grep -q ' [1-9][0-9]* watchdog resets' "$dir/out.txt" ||
+        { cat "$dir/out.txt"; echo "main.c $opts: FAIL, no watchdog reset with dead MSSPs"; exit 1; }
+    echo "  dead MSSPs: $(grep -o '[0-9]* watchdog resets' "$dir/out.txt")"
+done
+rm -rf "$dir"
+echo "main.c passes on the simulated PIC"
@@ -0,0 +1,888 @@
+/*
+ * File:   pic_sim.c
+ * Author: pyroesp
+ *
+ * Runs pic16f18325/main.c as it ships on a simulated PIC16F18325, with a
+ * logic analyzer capture of the controller bus on its pins
+ *
+ * main.c is built against host/xc/xc.h instead of XC8's: the SFRs are
+ * bytes in here and the peripherals main.c sets up are modelled on them,
+ * as far as it uses them:
+ *   pins       PORTA/PORTC from the bus, TRIS, LAT and ANSEL (an analog
+ *              input reads 0), RA5 driven by CLC1 when RA5PPS picks it
+ *   PPS        every peripheral input reads the pin its xxxPPS selects
+ *   MSSP1/2    SPI slave, SS enabled: SS high clears the bit count,
+ *              bits sampled on the CKP edge, MSb first, one byte buffer
+ *              with BF, SSPOV (BOEN = 0) or overwrite (BOEN = 1), SSPxIF
+ *   CLC1       4 input AND from CLCIN0-3, gate and output polarity
+ *   IOC        IOCAN/IOCAP edges on port A set IOCAF
+ *   TMR0/1/2   Fosc/4 with prescalers, TMR2IF every period (PR2, T2OUTPS)
+ *   CCP1       captures TMR1 on the falling edge of CCP1PPS
+ *   TMR3/5     gated by their xGPPS pin in single pulse mode, TMR3 on
+ *              Fosc/4, TMR5 on T5CKI edges, TMR3GIF at the end of the gate
+ *   EUSART TX  TX1REG and the shift register at the SP1BRG baud rate,
+ *              every byte sent goes to the -u file
+ *   data EEPROM read, and write with WR taking 4 ms, -e saves it as HEX
+ *   watchdog   SWDTEN and WDTPS on the 31 kHz LFINTOSC, reboots main,
+ *              SLEEP clears it
+ *   IDLE       SLEEP with IDLEN: time runs until an enabled interrupt
+ *              flag is set, or the watchdog runs out: that only wakes
+ *              the core
+ * Fosc is the 32 MHz HFINTOSC divided by OSCCON1bits.NDIV.
+ *
+ * The firmware and core are built with -finstrument-functions: every
+ * function they enter runs the chip for call_cycles (-c) instruction
+ * cycles, the only cost model there is. The bus is played in meanwhile
+ * and when an enabled interrupt is pending with GIE set the main loop is
+ * interrupted there and _spi_int runs, costing ISR_CYCLES for the entry
+ * and the functions it calls. Nothing nests, like on the PIC. CLRWDT and
+ * SLEEP run the chip too. A watchdog reset runs main from the top with
+ * PCON0bits.nRWDT clear, the RAM isn't cleared.
+ *
+ * RESET (RC5) low and released are printed with their time like
+ * ps1_replay does, then a summary with the polls decoded (ps1_decode
+ * calls), the capture errors and where the CPU time went. Exits with 1 if
+ * the capture had any error.
+ *
+ * Build from the repository root, main.c options with -D:
+ *   gcc -O2 -Wall -Wno-unknown-pragmas -finstrument-functions -I host/xc -I core \
+ *       -I pic16f18325 -o ps1_pic host/pic_sim.c pic16f18325/main.c core/ps1_*.c
+ * Run:
+ *   ./ps1_pic [-q] [-d] [-c call_cycles] [-n ss,clk,cmd,data] [-u uart.bin] [-e eeprom.hex] session.vcd
+ * VCD signals as ps1_replay takes them, ss2 (port 2 SEL) on RA4. -d
+ * leaves the MSSPs dead, they never get a bit off the bus.
+ * host/pic_check.sh runs every build on ps1_busgen traffic against
+ * ps1_replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+#include "xc.h"
+#include "ps1_ctrl.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_card.h"
+#include "ps1_guard.h"
+
+#undef main
+
+#define CALL_CYCLES 24 // per function entered, a call and a few statements
+#define ISR_CYCLES 10 // interrupt entry and return, context saved in hardware
+#define HFINTOSC_HZ 32000000ull
+#define LFINTOSC_HZ 31000ull
+#define NVM_WRITE_PS (4 * PS_PER_MS)
+#define TAIL_PS PS_PER_MS // run on after the last bus change
+
+#define PS_PER_S 1000000000000ull
+#define PS_PER_MS 1000000000ull
+
+/* Bus signals, bit in Sim.bus */
+#define SIG_SS 0
+#define SIG_CLK 1
+#define SIG_CMD 2
+#define SIG_DATA 3
+#define SIG_SS2 4
+#define SIG_COUNT 5
+
+/* Pins they're wired to, main.c header */
+#define PIN_SS 2 // RA2
+#define PIN_SS2 4 // RA4
+#define PIN_CLK 0 // RC0
+#define PIN_DATA 1 // RC1
+#define PIN_CMD 2 // RC2
+#define PIN_RESET 5 // RC5
+
+/* SFRs */
+volatile PORTAbits_t PORTAbits;
+volatile PORTCbits_t PORTCbits;
+volatile TRISAbits_t TRISAbits;
+volatile TRISCbits_t TRISCbits;
+volatile LATAbits_t LATAbits;
+volatile LATCbits_t LATCbits;
+volatile ANSELAbits_t ANSELAbits;
+volatile ANSELCbits_t ANSELCbits;
+volatile INTCONbits_t INTCONbits;
+volatile PIR0bits_t PIR0bits;
+volatile PIR1bits_t PIR1bits;
+volatile PIR2bits_t PIR2bits;
+volatile PIR5bits_t PIR5bits;
+volatile PIE0bits_t PIE0bits;
+volatile PIE1bits_t PIE1bits;
+volatile PIE2bits_t PIE2bits;
+volatile PIE5bits_t PIE5bits;
+volatile IOCAPbits_t IOCAPbits;
+volatile IOCANbits_t IOCANbits;
+volatile IOCAFbits_t IOCAFbits;
+volatile OSCCON1bits_t OSCCON1bits;
+volatile OSCCON3bits_t OSCCON3bits;
+volatile WDTCONbits_t WDTCONbits;
+volatile PCON0bits_t PCON0bits;
+volatile CPUDOZEbits_t CPUDOZEbits;
+volatile SSP1STATbits_t SSP1STATbits;
+volatile SSP1CON1bits_t SSP1CON1bits;
+volatile SSP1CON3bits_t SSP1CON3bits;
+volatile SSP2STATbits_t SSP2STATbits;
+volatile SSP2CON1bits_t SSP2CON1bits;
+volatile SSP2CON3bits_t SSP2CON3bits;
+volatile SSP1SSPPSbits_t SSP1SSPPSbits;
+volatile SSP2SSPPSbits_t SSP2SSPPSbits;
+volatile SSP1CLKPPSbits_t SSP1CLKPPSbits;
+volatile SSP2CLKPPSbits_t SSP2CLKPPSbits;
+volatile SSP1DATPPSbits_t SSP1DATPPSbits;
+volatile SSP2DATPPSbits_t SSP2DATPPSbits;
+volatile CLCIN0PPSbits_t CLCIN0PPSbits;
+volatile CLCIN1PPSbits_t CLCIN1PPSbits;
+volatile RXPPSbits_t RXPPSbits;
+volatile RA5PPSbits_t RA5PPSbits;
+volatile RC3PPSbits_t RC3PPSbits;
+volatile uint8_t CCP1PPS, T3GPPS, T5GPPS, T5CKIPPS;
+volatile CLC1CONbits_t CLC1CONbits;
+volatile CLC1SEL0bits_t CLC1SEL0bits;
+volatile CLC1SEL1bits_t CLC1SEL1bits;
+volatile CLC1SEL2bits_t CLC1SEL2bits;
+volatile CLC1SEL3bits_t CLC1SEL3bits;
+volatile uint8_t CLC1GLS0, CLC1GLS1, CLC1GLS2, CLC1GLS3, CLC1POL;
+volatile T0CON0bits_t T0CON0bits;
+volatile T0CON1bits_t T0CON1bits;
+volatile T1CONbits_t T1CONbits;
+volatile T2CONbits_t T2CONbits;
+volatile T3CONbits_t T3CONbits;
+volatile T3GCONbits_t T3GCONbits;
+volatile T5CONbits_t T5CONbits;
+volatile T5GCONbits_t T5GCONbits;
+volatile CCP1CONbits_t CCP1CONbits;
+volatile CCPTMRSbits_t CCPTMRSbits;
+volatile uint8_t PR2, TMR0H, TMR3H, TMR3L, TMR5H, TMR5L, CCPR1H, CCPR1L;
+volatile NVMCON1bits_t NVMCON1bits;
+volatile uint8_t NVMADRL, NVMADRH, NVMCON2;
+volatile TX1STAbits_t TX1STAbits;
+volatile RC1STAbits_t RC1STAbits;
+volatile BAUD1CONbits_t BAUD1CONbits;
+volatile CLKRCONbits_t CLKRCONbits;
+volatile uint8_t SP1BRGL, SP1BRGH;
+
+/* The firmware */
+void pic_main(void);
+void _spi_int(void);
+
+/* One MSSP */
+struct Sim_Mssp{
+    volatile SSP1STATbits_t *stat;
+    volatile SSP1CON1bits_t *con1;
+    volatile SSP1CON3bits_t *con3;
+    volatile uint8_t *ssppps, *clkpps, *datpps;
+    uint8_t sr, bits; // shift register, bit count
+    uint8_t buf; // SSPxBUF
+    uint8_t ss, sck; // last levels seen
+};
+
+struct Sim{
+    uint64_t t; // ps since power up
+    uint64_t end; // last bus change + TAIL_PS, 0 until the VCD is read out
+    uint8_t isr; // running _spi_int
+    uint32_t call_cycles;
+    // bus
+    FILE *vcd;
+    uint64_t vcd_mul; // ps per VCD time unit
+    uint64_t bus_t; // time of the next bus change
+    uint8_t bus, bus_next; // levels now and after it, bit SIG_x
+    uint8_t bus_more; // bus_next is valid
+    char ids[SIG_COUNT][64]; // VCD identifiers
+    // pins and peripherals
+    uint8_t pin_a, pin_c; // levels as the peripherals see them
+    uint8_t clc; // CLC1 output
+    struct Sim_Mssp ssp[2];
+    uint8_t ccp_pin, t3_pin, t5_pin, t5_ck; // last levels
+    uint8_t t3_run, t5_run; // gate open, counting
+    uint64_t t3_start;
+    uint64_t t0_start, t1_start; // TMR0/TMR1 went on
+    uint8_t t0_on, t1_on;
+    uint64_t tmr2_next; // next TMR2IF, 0 off
+    uint64_t wdt_t; // watchdog last cleared
+    uint8_t tx_reg, tx_sr; // TX1REG, shift register
+    uint8_t tx_wrote, tx_full; // TX1REG written, TX1REG waiting for the shift register
+    uint64_t tx_done; // shift register empty, 0 idle
+    uint8_t rc_reg;
+    uint8_t nvm_dat;
+    uint64_t nvm_done; // write finishes, 0 idle
+    uint8_t eeprom[256];
+    unsigned nvm_writes;
+    uint8_t reset_low;
+    uint64_t reset_t;
+    jmp_buf stop; // end of the bus or watchdog
+    uint8_t done;
+    uint8_t dead; // -d: the MSSPs never get a bit
+    // results
+    FILE *uart;
+    int quiet;
+    unsigned long uart_bytes, transactions, polls, pulses, wdt_resets, wdt_wakes, isr_runs, wakes;
+    uint64_t isr_ps, isr_max_ps, idle_ps;
+};
+
+static struct Sim sim;
+static const char *sig_names[SIG_COUNT] = {"ss", "clk", "cmd", "data", "ss2"};
+
+static void sim_run(uint64_t ps) XC_SIM;
+static void sim_sync(void) XC_SIM;
+
+static XC_SIM void print_time(uint64_t t){
+    printf("%12.6f s  ", t / 1e12);
+}
+
+/**********************************************************/
+/* Clocks */
+
+/* Instruction cycle, ps */
+static XC_SIM uint64_t tcy(void){
+    return 4 * PS_PER_S / (HFINTOSC_HZ >> OSCCON1bits.NDIV);
+}
+
+static XC_SIM uint64_t tmr2_period(void){
+    return tcy() * (1u << 2 * T2CONbits.T2CKPS) * (PR2 + 1u) * (T2CONbits.T2OUTPS + 1u);
+}
+
+static XC_SIM uint64_t wdt_period(void){
+    return (1ull << (WDTCONbits.WDTPS + 5)) * PS_PER_S / LFINTOSC_HZ;
+}
+
+/* One UART frame, start + 8 + stop */
+static XC_SIM uint64_t uart_byte(void){
+    uint32_t div = BAUD1CONbits.BRG16 && TX1STAbits.BRGH ? 4 : BAUD1CONbits.BRG16 || TX1STAbits.BRGH ? 16 : 64;
+    uint32_t brg = BAUD1CONbits.BRG16 ? (SP1BRGH << 8 | SP1BRGL) : SP1BRGL;
+    return 10 * tcy() / 4 * div * (brg + 1);
+}
+
+/**********************************************************/
+/* Accessors, see xc.h */
+
+volatile uint8_t *xc_sspbuf(uint8_t n){
+    struct Sim_Mssp *m = &sim.ssp[n];
+    if (!m->con1->SSPEN){
+        m->bits = 0; // SSPEN off resets the MSSP
+        m->sr = 0;
+    }
+    m->stat->BF = 0;
+    return &m->buf;
+}
+
+volatile uint8_t *xc_tmr1(uint8_t high){
+    static volatile uint8_t b[2];
+    uint16_t v = sim.t1_on ? (uint16_t)((sim.t - sim.t1_start) / (tcy() << T1CONbits.T1CKPS)) : 0;
+    b[0] = v & 0xFF;
+    b[1] = v >> 8;
+    return &b[high];
+}
+
+volatile uint8_t *xc_tmr0l(void){
+    static volatile uint8_t l;
+    uint16_t v = sim.t0_on ? (uint16_t)((sim.t - sim.t0_start) / (tcy() << T0CON1bits.T0CKPS)) : 0;
+    l = v & 0xFF;
+    TMR0H = v >> 8; // latched by the read of TMR0L
+    return &l;
+}
+
+volatile uint8_t *xc_nvmdatl(void){
+    if (NVMCON1bits.RD){
+        NVMCON1bits.RD = 0;
+        sim.nvm_dat = NVMCON1bits.NVMREGS && NVMADRH == 0xF0 ? sim.eeprom[NVMADRL] : 0xFF;
+    }
+    return (volatile uint8_t*)&sim.nvm_dat;
+}
+
+volatile uint8_t *xc_txreg(void){
+    sim.tx_wrote = 1;
+    PIR1bits.TXIF = 0;
+    return (volatile uint8_t*)&sim.tx_reg;
+}
+
+volatile uint8_t *xc_rcreg(void){
+    PIR1bits.RCIF = 0;
+    return (volatile uint8_t*)&sim.rc_reg;
+}
+
+/**********************************************************/
+/* Pins and peripherals */
+
+/* PPS input selection: 0x00-0x05 RA0-RA5, 0x10-0x15 RC0-RC5 */
+static XC_SIM uint8_t pps_in(uint8_t code){
+    if (code < 0x08)
+        return sim.pin_a >> code & 1;
+    if (code >= 0x10 && code < 0x18)
+        return sim.pin_c >> (code & 7) & 1;
+    return 0;
+}
+
+/* CLC1, 4 input AND only (LC1MODE 2) */
+static XC_SIM uint8_t clc1(void){
+    uint8_t d[4], gls[4] = {CLC1GLS0, CLC1GLS1, CLC1GLS2, CLC1GLS3};
+    uint8_t sel[4] = {CLC1SEL0bits.LC1D1S, CLC1SEL1bits.LC1D2S, CLC1SEL2bits.LC1D3S, CLC1SEL3bits.LC1D4S};
+    uint8_t in[2] = {pps_in(CLCIN0PPSbits.CLCIN0PPS), pps_in(CLCIN1PPSbits.CLCIN1PPS)};
+    uint8_t g, k, gate, out = 1;
+
+    if (!CLC1CONbits.LC1EN || CLC1CONbits.LC1MODE != 2)
+        return 0;
+    for (k = 0; k < 4; k++)
+        d[k] = sel[k] < 2 ? in[sel[k]] : 0;
+    for (g = 0; g < 4; g++){
+        gate = 0;
+        for (k = 0; k < 4; k++)
+            gate |= (gls[g] >> (2*k + 1) & d[k]) | (gls[g] >> (2*k) & !d[k]);
+        out &= gate ^ (CLC1POL >> g & 1);
+    }
+    return out ^ (CLC1POL >> 7 & 1);
+}
+
+/* Level of a port pin: the outside world on inputs (ANSEL reads 0), the
+ * latch or a PPS output on outputs */
+static XC_SIM uint8_t port_pins(uint8_t ext, uint8_t tris, uint8_t lat, uint8_t ansel, uint8_t out, uint8_t out_mask){
+    uint8_t in = ext & ~ansel;
+    lat = (lat & ~out_mask) | (out & out_mask);
+    return ((in & tris) | (lat & ~tris)) & 0x3F;
+}
+
+/* Port levels from the bus and the registers */
+static XC_SIM void pins(void){
+    uint8_t ext_a = 0x3F, ext_c = 0x3F, ra5 = RA5PPSbits.RA5PPS == 0x04 ? 1 << 5 : 0;
+    // RA5 open, RC5 pulled up by the console
+    ext_a &= ~(1 << PIN_SS | 1 << PIN_SS2);
+    ext_a |= (sim.bus >> SIG_SS & 1) << PIN_SS | (sim.bus >> SIG_SS2 & 1) << PIN_SS2;
+    ext_c &= ~(1 << PIN_CLK | 1 << PIN_DATA | 1 << PIN_CMD);
+    ext_c |= (sim.bus >> SIG_CLK & 1) << PIN_CLK | (sim.bus >> SIG_DATA & 1) << PIN_DATA |
+        (sim.bus >> SIG_CMD & 1) << PIN_CMD;
+    sim.pin_c = port_pins(ext_c, TRISC, LATC, ANSELC, 0, 0);
+    sim.pin_a = port_pins(ext_a, TRISA, LATA, ANSELA, sim.clc << 5, ra5);
+    sim.clc = clc1(); // from RA2 and RA4, its output on RA5
+    sim.pin_a = port_pins(ext_a, TRISA, LATA, ANSELA, sim.clc << 5, ra5);
+    PORTAbits.reg = sim.pin_a;
+    PORTCbits.reg = sim.pin_c;
+}
+
+/* A clock edge or SS on one MSSP */
+static XC_SIM void mssp(struct Sim_Mssp *m, volatile uint8_t *pir, uint8_t flag){
+    uint8_t ss = pps_in(*m->ssppps), sck = pps_in(*m->clkpps), edge;
+
+    edge = m->con1->CKP ? (!m->sck && sck) : (m->sck && !sck); // CKE = 0: sampled going idle
+    m->sck = sck;
+    m->ss = ss;
+    if (sim.dead)
+        return;
+    if (!m->con1->SSPEN || (m->con1->SSPM != 4 && m->con1->SSPM != 5))
+        return;
+    if (m->con1->SSPM == 4 && ss){
+        m->bits = 0; // not selected
+        return;
+    }
+    if (!edge)
+        return;
+    m->sr = m->sr << 1 | pps_in(*m->datpps);
+    if (++m->bits < 8)
+        return;
+    m->bits = 0;
+    if (!m->stat->BF){
+        m->buf = m->sr;
+        m->stat->BF = 1;
+    }else if (m->con3->BOEN)
+        m->buf = m->sr;
+    else
+        m->con1->SSPOV = 1;
+    *pir |= flag;
+}
+
+/* Pins changed or registers written: edges to the peripherals */
+static XC_SIM void update(void){
+    uint8_t a = sim.pin_a, v;
+
+    pins();
+    // interrupt on change, port A
+    IOCAFbits.reg |= (a & ~sim.pin_a & IOCANbits.reg) | (~a & sim.pin_a & IOCAPbits.reg);
+    PIR0bits.IOCIF = IOCAFbits.reg != 0;
+    mssp(&sim.ssp[0], &PIR1bits.reg, 1 << 3); // SSP1IF
+    mssp(&sim.ssp[1], &PIR2bits.reg, 1 << 4); // SSP2IF
+    // CCP1 capture of TMR1, every falling edge
+    v = pps_in(CCP1PPS);
+    if (sim.ccp_pin && !v && CCP1CONbits.CCP1EN && CCP1CONbits.CCP1MODE == 4 && CCPTMRSbits.C1TSEL == 1){
+        CCPR1L = *xc_tmr1(0);
+        CCPR1H = *xc_tmr1(1);
+    }
+    sim.ccp_pin = v;
+    // TMR3 gate, single pulse, counts Fosc/4 while open
+    v = pps_in(T3GPPS) ^ !T3GCONbits.T3GPOL; // 1: gate open
+    if (T3CONbits.TMR3ON && T3GCONbits.TMR3GE){
+        if (!sim.t3_pin && v && T3GCONbits.T3GGO && !sim.t3_run){
+            sim.t3_run = 1;
+            sim.t3_start = sim.t;
+        }else if (sim.t3_pin && !v && sim.t3_run){
+            uint16_t n = (TMR3H << 8 | TMR3L) + (sim.t - sim.t3_start) / (tcy() << T3CONbits.T3CKPS);
+            TMR3H = n >> 8;
+            TMR3L = n & 0xFF;
+            sim.t3_run = 0;
+            T3GCONbits.T3GGO = 0;
+            PIR5bits.TMR3GIF = 1;
+        }
+    }
+    sim.t3_pin = v;
+    // TMR5 gate, single pulse, counts T5CKI rising edges while open
+    v = pps_in(T5GPPS) ^ !T5GCONbits.T5GPOL;
+    if (T5CONbits.TMR5ON && T5GCONbits.TMR5GE){
+        uint8_t ck = pps_in(T5CKIPPS);
+        if (!sim.t5_pin && v && T5GCONbits.T5GGO)
+            sim.t5_run = 1;
+        if (sim.t5_run && v && !sim.t5_ck && ck && T5CONbits.TMR5CS == 2){
+            uint16_t n = (TMR5H << 8 | TMR5L) + 1;
+            TMR5H = n >> 8;
+            TMR5L = n & 0xFF;
+        }
+        if (sim.t5_pin && !v && sim.t5_run){
+            sim.t5_run = 0;
+            T5GCONbits.T5GGO = 0;
+            PIR5bits.TMR5GIF = 1;
+        }
+        sim.t5_ck = ck;
+    }
+    sim.t5_pin = v;
+}
+
+/* Register writes since the last time: pins, timers, UART, EEPROM */
+static XC_SIM void sim_sync(void){
+    uint8_t low;
+
+    update();
+    low = !(TRISC >> PIN_RESET & 1) && !(LATC >> PIN_RESET & 1); // open drain, the console pulls it up
+    if (low != sim.reset_low){
+        sim.reset_low = low;
+        if (low){
+            sim.reset_t = sim.t;
+            sim.pulses++;
+        }
+        if (!sim.quiet){
+            print_time(sim.t);
+            if (low)
+                printf("RESET low\n");
+            else
+                printf("RESET released after %llu ms\n",
+                    (unsigned long long)((sim.t - sim.reset_t) / PS_PER_MS));
+        }
+    }
+    if (T0CON0bits.T0EN != sim.t0_on){
+        sim.t0_on = T0CON0bits.T0EN;
+        sim.t0_start = sim.t;
+    }
+    if (T1CONbits.TMR1ON != sim.t1_on){
+        sim.t1_on = T1CONbits.TMR1ON;
+        sim.t1_start = sim.t;
+    }
+    if (!T2CONbits.TMR2ON)
+        sim.tmr2_next = 0;
+    else if (!sim.tmr2_next)
+        sim.tmr2_next = sim.t + tmr2_period();
+    if (!WDTCONbits.SWDTEN)
+        sim.wdt_t = sim.t;
+    if (NVMCON1bits.WR && !sim.nvm_done){
+        if (NVMCON1bits.NVMREGS && NVMADRH == 0xF0){
+            sim.eeprom[NVMADRL] = sim.nvm_dat;
+            sim.nvm_writes++;
+        }
+        sim.nvm_done = sim.t + NVM_WRITE_PS;
+    }
+    if (sim.tx_wrote){
+        sim.tx_wrote = 0;
+        if (!sim.tx_done){
+            sim.tx_sr = sim.tx_reg;
+            sim.tx_done = sim.t + uart_byte();
+            PIR1bits.TXIF = 1;
+        }else
+            sim.tx_full = 1;
+    }
+}
+
+/**********************************************************/
+/* Bus, VCD */
+
+/* Next time stamp with changes on the signals into bus_t and bus_next,
+ * 0 at the end of the file */
+static XC_SIM int vcd_next(void){
+    char tok[256], id[sizeof(sim.ids[0])], name[64];
+    uint64_t t = sim.bus_t;
+    uint8_t v = sim.bus_next, changed = 0, k;
+    unsigned n, size;
+
+    while (fscanf(sim.vcd, " %255s", tok) == 1){
+        if (tok[0] == '#'){
+            if (changed){
+                // the next time stamp, put it back
+                fseek(sim.vcd, -(long)strlen(tok), SEEK_CUR);
+                break;
+            }
+            t = strtoull(tok + 1, 0, 10) * sim.vcd_mul;
+        }else if (strcmp(tok, "$timescale") == 0){
+            // 1, 10 or 100 of ps to s, "1ns" or "1 ns"
+            if (fscanf(sim.vcd, " %u %63s", &n, name) == 2){
+                sim.vcd_mul = name[0] == 'p' ? 1 : name[0] == 'n' ? 1000 : name[0] == 'u' ? 1000000 :
+                    name[0] == 'm' ? PS_PER_MS : PS_PER_S;
+                sim.vcd_mul *= n;
+                if (strcmp(name, "$end") == 0)
+                    continue;
+            }
+            while (fscanf(sim.vcd, " %255s", tok) == 1 && strcmp(tok, "$end"));
+        }else if (strcmp(tok, "$var") == 0){
+            if (fscanf(sim.vcd, " %*s %u %63s %63s", &size, id, name) == 3 && size == 1)
+                for (k = 0; k < SIG_COUNT; k++)
+                    if (strcasecmp(name, sig_names[k]) == 0)
+                        snprintf(sim.ids[k], sizeof(sim.ids[k]), "%s", id);
+            while (fscanf(sim.vcd, " %255s", tok) == 1 && strcmp(tok, "$end"));
+        }else if (tok[0] == '$'){
+            // $dumpvars and its $end carry values, the others are skipped
+            if (strcmp(tok, "$dumpvars") && strcmp(tok, "$dumpall") && strcmp(tok, "$dumpon") &&
+                strcmp(tok, "$dumpoff") && strcmp(tok, "$end"))
+                while (fscanf(sim.vcd, " %255s", tok) == 1 && strcmp(tok, "$end"));
+        }else if (tok[0] == 'b' || tok[0] == 'B' || tok[0] == 'r' || tok[0] == 'R'){
+            if (fscanf(sim.vcd, " %255s", tok) != 1) // vector, not ours
+                break;
+        }else if (strchr("01xXzZ", tok[0])){
+            for (k = 0; k < SIG_COUNT; k++)
+                if (sim.ids[k][0] && strcmp(tok + 1, sim.ids[k]) == 0){
+                    v = (v & ~(1 << k)) | (tok[0] == '0' ? 0 : 1 << k);
+                    changed = 1;
+                }
+        }
+    }
+    sim.bus_t = t;
+    sim.bus_next = v;
+    return changed;
+}
+
+/**********************************************************/
+/* Scheduler */
+
+/* An enabled interrupt flag is set, GIE aside: wakes IDLE */
+static XC_SIM int wake_pending(void){
+    if (PIE0bits.IOCIE && IOCAFbits.reg)
+        return 1;
+    return INTCONbits.PEIE && ((PIE1bits.reg & PIR1bits.reg) || (PIE2bits.reg & PIR2bits.reg) ||
+        (PIE5bits.reg & PIR5bits.reg));
+}
+
+/* Earliest thing that happens on its own */
+static XC_SIM uint64_t next_event(void){
+    uint64_t n = sim.bus_more ? sim.bus_t : sim.end;
+    if (sim.tmr2_next && sim.tmr2_next < n)
+        n = sim.tmr2_next;
+    if (sim.tx_done && sim.tx_done < n)
+        n = sim.tx_done;
+    if (sim.nvm_done && sim.nvm_done < n)
+        n = sim.nvm_done;
+    if (WDTCONbits.SWDTEN && sim.wdt_t + wdt_period() < n)
+        n = sim.wdt_t + wdt_period();
+    return n;
+}
+
+/* Everything due at sim.t */
+static XC_SIM void events(void){
+    uint8_t fell;
+
+    while (sim.bus_more && sim.bus_t <= sim.t){
+        fell = sim.bus & ~sim.bus_next;
+        if (fell & (1 << SIG_SS | 1 << SIG_SS2))
+            sim.transactions++;
+        sim.bus = sim.bus_next;
+        update();
+        sim.bus_more = vcd_next();
+        if (!sim.bus_more)
+            sim.end = sim.t + TAIL_PS;
+    }
+    if (sim.tmr2_next && sim.tmr2_next <= sim.t){
+        PIR1bits.TMR2IF = 1;
+        sim.tmr2_next += tmr2_period();
+    }
+    if (sim.tx_done && sim.tx_done <= sim.t){
+        if (sim.uart)
+            fputc(sim.tx_sr, sim.uart);
+        sim.uart_bytes++;
+        if (sim.tx_full){
+            sim.tx_full = 0;
+            sim.tx_sr = sim.tx_reg;
+            sim.tx_done = sim.t + uart_byte();
+            PIR1bits.TXIF = 1;
+        }else
+            sim.tx_done = 0;
+    }
+    if (sim.nvm_done && sim.nvm_done <= sim.t){
+        sim.nvm_done = 0;
+        NVMCON1bits.WR = 0;
+    }
+    if (WDTCONbits.SWDTEN && sim.t >= sim.wdt_t + wdt_period()){
+        sim.wdt_resets++;
+        if (!sim.quiet){
+            print_time(sim.t);
+            printf("watchdog reset\n");
+        }
+        longjmp(sim.stop, 1);
+    }
+    if (!sim.bus_more && sim.t >= sim.end){
+        sim.done = 1;
+        longjmp(sim.stop, 1);
+    }
+}
+
+/* Run the ISR for as long as an enabled flag is set, like the PIC
+ * going back into it after RETFIE */
+static XC_SIM void interrupts(void){
+    uint64_t t0;
+    while (!sim.isr && INTCONbits.GIE && wake_pending()){
+        sim.isr = 1;
+        t0 = sim.t;
+        sim_run(ISR_CYCLES * tcy());
+        _spi_int();
+        sim_sync();
+        sim.isr = 0;
+        sim.isr_runs++;
+        sim.isr_ps += sim.t - t0;
+        if (sim.t - t0 > sim.isr_max_ps)
+            sim.isr_max_ps = sim.t - t0;
+    }
+}
+
+/* Let ps go by on the CPU, taking interrupts on the way outside the ISR */
+static XC_SIM void sim_run(uint64_t ps){
+    uint64_t n;
+    while (ps){
+        n = next_event();
+        if (sim.t + ps < n){
+            sim.t += ps;
+            return;
+        }
+        ps -= n - sim.t;
+        sim.t = n;
+        events();
+        interrupts();
+    }
+}
+
+/* Every function the firmware and core enter */
+XC_SIM void __cyg_profile_func_enter(void *fn, void *site){
+    (void)site;
+    if (fn == (void*)ps1_decode)
+        sim.polls++;
+    sim_sync();
+    interrupts();
+    sim_run(sim.call_cycles * tcy());
+}
+
+XC_SIM void __cyg_profile_func_exit(void *fn, void *site){
+    (void)fn;
+    (void)site;
+}
+
+void xc_clrwdt(void){
+    sim_sync();
+    sim.wdt_t = sim.t;
+    interrupts();
+    sim_run(tcy());
+}
+
+void xc_sleep(void){
+    uint64_t n;
+    sim_sync();
+    sim.wdt_t = sim.t; // SLEEP clears the watchdog
+    if (!wake_pending())
+        sim.wakes++;
+    while (!wake_pending()){
+        n = next_event();
+        sim.idle_ps += n - sim.t;
+        sim.t = n;
+        if (WDTCONbits.SWDTEN && sim.t >= sim.wdt_t + wdt_period()){
+            // running out asleep wakes the core, it doesn't reset it
+            sim.wdt_t = sim.t;
+            sim.wdt_wakes++;
+            events();
+            break;
+        }
+        events();
+    }
+    sim_run(tcy());
+}
+
+void xc_delay_us(uint32_t us){
+    sim_sync();
+    sim_run(us * 1000000ull);
+}
+
+/**********************************************************/
+
+/* Registers as after a reset, the ones main.c relies on */
+static XC_SIM void por(uint8_t wdt){
+    uint8_t n;
+    static volatile uint8_t *regs[] = {
+        &INTCONbits.reg, &PIR0bits.reg, &PIR1bits.reg, &PIR2bits.reg, &PIR5bits.reg,
+        &PIE0bits.reg, &PIE1bits.reg, &PIE2bits.reg, &PIE5bits.reg,
+        &IOCAPbits.reg, &IOCANbits.reg, &IOCAFbits.reg, &OSCCON1bits.reg, &WDTCONbits.reg,
+        &CPUDOZEbits.reg, &SSP1STATbits.reg, &SSP1CON1bits.reg, &SSP1CON3bits.reg,
+        &SSP2STATbits.reg, &SSP2CON1bits.reg, &SSP2CON3bits.reg, &CLC1CONbits.reg,
+        &T0CON0bits.reg, &T0CON1bits.reg, &T1CONbits.reg, &T2CONbits.reg, &T3CONbits.reg,
+        &T3GCONbits.reg, &T5CONbits.reg, &T5GCONbits.reg, &CCP1CONbits.reg, &NVMCON1bits.reg,
+        &TX1STAbits.reg, &RC1STAbits.reg, &BAUD1CONbits.reg, &CLKRCONbits.reg, &RA5PPSbits.reg,
+        &RC3PPSbits.reg,
+    };
+    for (n = 0; n < sizeof(regs) / sizeof(regs[0]); n++)
+        *regs[n] = 0;
+    TRISA = TRISC = 0x3F; // inputs
+    ANSELA = 0x37; // analog, RA3 has none
+    ANSELC = 0x3F;
+    SSP1CON3bits.BOEN = 1;
+    SSP2CON3bits.BOEN = 1;
+    OSCCON1bits.NDIV = 0; // RSTOSC = HFINT32
+    OSCCON3bits.ORDY = 1;
+    PIR1bits.TXIF = 1;
+    PCON0bits.reg = 0x3F;
+    PCON0bits.nRWDT = !wdt;
+    // PPS inputs default to the pins the datasheet gives them
+    SSP1SSPPSbits.SSP1SSPPS = 0x03;
+    SSP1CLKPPSbits.SSP1CLKPPS = 0x10;
+    SSP1DATPPSbits.SSP1DATPPS = 0x11;
+    SSP2SSPPSbits.SSP2SSPPS = 0x03;
+    SSP2CLKPPSbits.SSP2CLKPPS = 0x10;
+    SSP2DATPPSbits.SSP2DATPPS = 0x11;
+    memset(sim.ssp, 0, sizeof(sim.ssp));
+    sim.ssp[0] = (struct Sim_Mssp){&SSP1STATbits, &SSP1CON1bits, &SSP1CON3bits,
+        &SSP1SSPPSbits.reg, &SSP1CLKPPSbits.reg, &SSP1DATPPSbits.reg, 0, 0, 0, 1, 1};
+    sim.ssp[1] = (struct Sim_Mssp){&SSP2STATbits, &SSP2CON1bits, &SSP2CON3bits,
+        &SSP2SSPPSbits.reg, &SSP2CLKPPSbits.reg, &SSP2DATPPSbits.reg, 0, 0, 0, 1, 1};
+    sim.isr = 0;
+    sim.t0_on = sim.t1_on = 0;
+    sim.t3_run = sim.t5_run = 0;
+    sim.tmr2_next = 0;
+    sim.tx_wrote = sim.tx_full = 0;
+    sim.tx_done = 0;
+    sim.nvm_done = 0;
+    sim.wdt_t = sim.t;
+    pins();
+}
+
+/* Power up, and again after every watchdog reset, until the bus ends */
+static XC_SIM void power(void){
+    while (!sim.done){
+        por(sim.wdt_resets != 0);
+        if (!setjmp(sim.stop))
+            pic_main();
+    }
+}
+
+/* Data EEPROM as Intel HEX, one byte per word at 0xF000 like the
+ * programmer reads it back */
+static XC_SIM void save_hex(FILE *f){
+    unsigned a, i;
+    uint8_t sum;
+    fprintf(f, ":020000040001F9\n"); // 0x10000
+    for (a = 0; a < sizeof(sim.eeprom); a += 8){
+        uint16_t addr = 0xE000 + 2*a;
+        sum = 16 + (addr >> 8) + (addr & 0xFF);
+        fprintf(f, ":10%04X00", addr);
+        for (i = 0; i < 8; i++){
+            fprintf(f, "%02X00", sim.eeprom[a + i]);
+            sum += sim.eeprom[a + i];
+        }
+        fprintf(f, "%02X\n", (uint8_t)-sum);
+    }
+    fprintf(f, ":00000001FF\n");
+}
+
+XC_SIM int main(int argc, char **argv){
+    const char *path = 0, *uart = 0, *hex = 0, *names = 0;
+    uint64_t busy;
+    double span;
+    int i, k, err;
+
+    sim.call_cycles = CALL_CYCLES;
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-q") == 0)
+            sim.quiet = 1;
+        else if (strcmp(argv[i], "-d") == 0)
+            sim.dead = 1;
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            sim.call_cycles = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            names = argv[++i];
+        else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+            uart = argv[++i];
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            hex = argv[++i];
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else{
+            fprintf(stderr, "usage: ps1_pic [-q] [-d] [-c call_cycles] [-n ss,clk,cmd,data] [-u uart.bin] [-e eeprom.hex] session.vcd\n");
+            return 2;
+        }
+    }
+    if (!path){
+        fprintf(stderr, "usage: ps1_pic [-q] [-d] [-c call_cycles] [-n ss,clk,cmd,data] [-u uart.bin] [-e eeprom.hex] session.vcd\n");
+        return 2;
+    }
+    sim.vcd = fopen(path, "rb");
+    if (!sim.vcd){
+        perror(path);
+        return 2;
+    }
+    if (uart && !(sim.uart = fopen(uart, "wb"))){
+        perror(uart);
+        return 2;
+    }
+
+    // idle bus, signals renamed with -n as in ps1_replay
+    sim.vcd_mul = 1000;
+    sim.bus = sim.bus_next = 1 << SIG_SS | 1 << SIG_CLK | 1 << SIG_CMD | 1 << SIG_DATA | 1 << SIG_SS2;
+    if (names){
+        static char buf[256];
+        char *p, *q;
+        snprintf(buf, sizeof(buf), "%s", names);
+        for (k = 0, p = strtok_r(buf, ",", &q); p && k < SIG_SS2; k++, p = strtok_r(0, ",", &q))
+            sig_names[k] = p;
+    }
+    sim.bus_more = vcd_next();
+    if (!sim.ids[SIG_SS][0] || !sim.ids[SIG_CLK][0] || !sim.ids[SIG_CMD][0] || !sim.ids[SIG_DATA][0]){
+        fprintf(stderr, "%s: no ss, clk, cmd and data signals\n", path);
+        return 2;
+    }
+    memset(sim.eeprom, 0xFF, sizeof(sim.eeprom));
+
+    power();
+    fclose(sim.vcd);
+    if (sim.uart)
+        fclose(sim.uart);
+    if (hex){
+        FILE *f = fopen(hex, "w");
+        if (!f){
+            perror(hex);
+            return 2;
+        }
+        save_hex(f);
+        fclose(f);
+    }
+
+    span = sim.t / 1e12;
+    busy = sim.t - sim.idle_ps;
+    printf("%.3f s of bus, %lu transactions, %lu polls decoded, %lu reset pulses\n",
+        span, sim.transactions, sim.polls, sim.pulses);
+    printf("memory card: %u sectors written, %u failed, %u resets waited for it\n",
+        card.writes, card.failed, reset.deferred);
+    printf("errors: %u MSSP overflows, %u resync, %u overrun, %u MSSP restarts, %lu watchdog resets\n",
+        guard.sspov, capture.resync, capture.overrun, guard.restarts, sim.wdt_resets);
+    printf("CPU at %llu MHz, %u cycles a call: ISR %.2f%% (%lu runs, longest %llu cycles), main loop %.2f%%, IDLE %.2f%% (%lu wakes, %lu by the watchdog)\n",
+        (unsigned long long)(HFINTOSC_HZ >> OSCCON1bits.NDIV) / 1000000, sim.call_cycles,
+        100.0 * sim.isr_ps / sim.t, sim.isr_runs, (unsigned long long)(sim.isr_max_ps / tcy()),
+        100.0 * (busy - sim.isr_ps) / sim.t, 100.0 * sim.idle_ps / sim.t, sim.wakes, sim.wdt_wakes);
+    if (capture.timing.count)
+        printf("HW timing: %u transactions, last %u us, %u bytes, %u us between bytes, %u partial\n",
+            capture.timing.count, capture.timing.width, capture.timing.bytes,
+            capture.timing.gap, capture.timing.partial);
+    if (sim.uart_bytes)
+        printf("UART: %lu bytes sent\n", sim.uart_bytes);
+    if (sim.nvm_writes)
+        printf("data EEPROM: %u bytes written\n", sim.nvm_writes);
+    err = guard.sspov || capture.resync || capture.overrun || guard.restarts || sim.wdt_resets;
+    return err ? 1 : 0;
+}
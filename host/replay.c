@@ -0,0 +1,675 @@
+/*
+ * File:   replay.c
+ * Author: pyroesp
+ *
+ * Replays logic analyzer captures of the controller bus through the core
+ *
+ * SS, CLK, CMD and DATA are turned back into bytes the way the MSSP sees
+ * them: bits sampled on the CLK rising edge while SS is low, shifted in
+ * MSb first so every byte comes out bit reversed, bit counter cleared
+ * when SS goes high. Each byte pair goes to ps1_capture_byte like
+ * _spi_int does, SS falling edges to ps1_capture_start with a 1 MHz
+ * stamp, and queued frames through ps1_decode and the reset state machine
+ * on a 1 ms tick like the main loop and TMR2 do.
+ *
+ * Prints every combo hit (held long enough), reset pulse and frame error with its time in
+ * the capture, then a summary with the memory card writes and the resets
+ * that waited for them. Exits with 1 if there was any frame error.
+ *
+ * Input is memory mapped and read once front to back, memory use doesn't
+ * depend on the capture size:
+ *   VCD: 1 bit signals named ss, clk, cmd and data (case doesn't matter,
+ *        -n to use other names), ss2 for the SEL of port 2 if it was
+ *        probed. The MSSPs are selected while either SEL is low.
+ *   raw: sigrok binary output, one sample per unit (1 byte up to 8
+ *        channels), -r sample rate and -c channel numbers, e.g.
+ *        sigrok-cli -i session.sr -O binary -o session.bin
+ *
+ * Build from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_replay host/replay.c core/ps1_*.c
+ * Run:
+ *   ./ps1_replay [-q] [-l lockout_ms] [-n ss,clk,cmd,data] session.vcd
+ *   ./ps1_replay [-q] [-l lockout_ms] -r 24000000 [-c 0,1,2,3] [-u unitsize] session.bin
+ * -t combos.bin replays with a combo table from ps1_combos instead of the
+ * built-in one. -H replays the HW_TIMING build: CCP1 stamps the SS edge,
+ * TMR3 times the selection and TMR5 counts its CLK rising edges, handed
+ * to ps1_capture_end when SS goes high; the summary adds what they saw
+ * and the poll period of every pad. -j journal.bin keeps the JOURNAL
+ * build's journal and writes a dump of it at every reset decision and at
+ * the end, for ps1_journal.
+ *
+ * ps1_guard watches the byte stream like it does in the ISR, a restart
+ * of the MSSPs clears the bit counter and counts as an error.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_combo.h"
+#include "ps1_card.h"
+#include "ps1_journal.h"
+#include "ps1_guard.h"
+
+/* Signals, bit in Bus.v */
+#define SIG_SS 0
+#define SIG_CLK 1
+#define SIG_CMD 2
+#define SIG_DATA 3
+#define SIG_COUNT 4
+#define SIG_SS2 4 // optional, port 2 SEL
+
+/* Either port selected, SS of the MSSPs */
+#define BUS_SEL(v) ((~(v) & (1 << SIG_SS | 1 << SIG_SS2)) != 0)
+
+#define PS_PER_US 1000000ull
+#define PS_PER_MS 1000000000ull
+
+static const char *sig_names[SIG_COUNT] = {"ss", "clk", "cmd", "data"};
+
+/* MSSP and main loop state */
+struct Bus{
+    uint8_t v; // level of each signal, bit SIG_x
+    uint8_t bits; // bits shifted into the current byte
+    uint8_t c, d; // MSSP shift registers
+    uint8_t bytes; // bytes in the current transaction
+    uint8_t sel; // first CMD byte of the transaction, wire order
+    uint8_t poll; // 0x01 0x42 with ID and 0x5A back: a controller answered
+    uint8_t queued; // a frame was queued during this transaction
+    uint8_t action[PS1_PADS]; // last decoded action, report combos once per press
+    struct PS1_Port pads[PS1_PADS]; // combo hold, per port and multitap slot
+    uint16_t clk; // TMR5: CLK rising edges while selected
+    uint64_t sel_ps; // TMR3 gate opened
+    uint8_t rst; // RESET held low
+    uint64_t ms; // tick count
+    uint64_t rst_ps; // when RESET went low
+};
+
+static struct Bus bus;
+static int quiet, hw;
+static FILE *journal_file;
+static unsigned long transactions, polls, hits, pulses;
+static unsigned long partial, lost, overrun, resync, restarts;
+
+static void print_time(uint64_t t){
+    printf("%12.6f s  ", t / 1e12);
+}
+
+/* Journal dump into the -j file, all of it */
+static void bus_journal(void){
+    uint8_t b;
+    if (!journal_file || !ps1_journal_open(0xFFFF))
+        return;
+    while (ps1_journal_get(&b))
+        fputc(b, journal_file);
+}
+
+/* Main loop: decode everything queued */
+static void bus_main(uint64_t t){
+    struct PS1_Frame *f;
+    uint8_t action, mode, id_lo, id_hi, sw_lo, sw_hi;
+
+    while ((f = ps1_capture_peek()) != 0){
+        mode = bus.pads[f->pad].mode;
+        if (journal_file)
+            ps1_journal_frame(f);
+        action = ps1_decode(&bus.pads[f->pad], &f->cmd, &f->data, f->stamp);
+        if (!quiet && (mode ^ bus.pads[f->pad].mode) & (PS1_MODE_ANALOG | PS1_MODE_CONFIG)){
+            mode = bus.pads[f->pad].mode;
+            print_time(t);
+            printf("pad %u%c  %s\n", f->pad / PS1_SLOTS + 1, 'A' + f->pad % PS1_SLOTS,
+                mode & PS1_MODE_CONFIG ? "config mode" :
+                mode & PS1_MODE_ANALOG ? (mode & PS1_MODE_LOCK ? "analog, locked" : "analog") : "digital");
+        }
+        if (action != PS1_ACT_NONE && action != bus.action[f->pad]){
+            hits++;
+            if (!quiet){
+                id_lo = f->data.buff[1];
+                id_hi = f->data.buff[2];
+                sw_lo = f->data.buff[3];
+                sw_hi = f->data.buff[4];
+                reverse_byte(&id_lo);
+                reverse_byte(&id_hi);
+                reverse_byte(&sw_lo);
+                reverse_byte(&sw_hi);
+                print_time(t);
+                printf("combo %s  pad %u%c  ID %02X%02X  switches %02X%02X%s\n",
+                    action == PS1_ACT_SHORT ? "short" : "long", f->pad / PS1_SLOTS + 1,
+                    'A' + f->pad % PS1_SLOTS, id_hi, id_lo, sw_hi, sw_lo,
+                    reset.state == PS1_RST_WAIT ? "  (waiting for the memory card)" :
+                    reset.state != PS1_RST_IDLE ? "  (ignored, not armed)" :
+                    card.idle_ms < CARD_IDLE_MS ? "  (memory card written, reset waits)" : "");
+            }
+        }
+        bus.action[f->pad] = action;
+        ps1_capture_release();
+        ps1_guard_frame();
+        if (journal_file && ps1_journal_action(action))
+            bus_journal();
+        ps1_reset_poll(action);
+        polls++;
+    }
+}
+
+static void bus_error(uint64_t t, const char *what){
+    if (quiet)
+        return;
+    print_time(t);
+    printf("error: %s\n", what);
+}
+
+/* End of the ISR: HAL_SPI_RESTART if the guard asked for it */
+static void bus_guard(uint64_t t){
+    if (!guard.restart)
+        return;
+    bus.bits = 0;
+    ps1_guard_restart();
+    restarts++;
+    bus_error(t, "MSSPs restarted");
+}
+
+/* TMR2: run the 1 ms ticks up to t */
+static void bus_tick(uint64_t t){
+    uint64_t ms = t / PS_PER_MS;
+    uint8_t r;
+
+    while (bus.ms < ms){
+        bus.ms++;
+        ps1_guard_tick(BUS_SEL(bus.v));
+        bus_guard(bus.ms * PS_PER_MS);
+        r = ps1_reset_tick();
+        if (r == bus.rst)
+            continue;
+        bus.rst = r;
+        if (r){
+            bus.rst_ps = bus.ms * PS_PER_MS;
+            pulses++;
+        }
+        if (!quiet){
+            print_time(bus.ms * PS_PER_MS);
+            if (r)
+                printf("RESET low\n");
+            else
+                printf("RESET released after %llu ms\n",
+                    (unsigned long long)((bus.ms * PS_PER_MS - bus.rst_ps) / PS_PER_MS));
+        }
+    }
+}
+
+/* SS high, close the transaction */
+static void bus_end(uint64_t t){
+    if (bus.bits){
+        partial++;
+        bus_error(t, "SS went high in the middle of a byte");
+    }
+    if (bus.poll && bus.bytes >= PS1_DECIDE_LEN && !bus.queued){
+        lost++;
+        bus_error(t, "controller transaction not queued");
+    }
+    if (hw){
+        uint16_t n = capture.resync;
+        ps1_capture_end((uint16_t)((t - bus.sel_ps) / PS_PER_US), bus.clk);
+        if (capture.resync != n){
+            resync++;
+            bus_error(t, "transaction shorter than its ID");
+        }
+    }
+    bus.bits = 0;
+}
+
+/* New level on one or more signals at time t */
+static void bus_edge(uint64_t t, uint8_t v){
+    uint8_t ch = v ^ bus.v, fell = ch & ~v, was = BUS_SEL(bus.v), head;
+    uint16_t n;
+
+    bus_tick(t); // the ticks before t saw the old levels
+    bus.v = v;
+    if (was && !BUS_SEL(v))
+        bus_end(t);
+    if (!was && BUS_SEL(v)){
+        bus.sel_ps = t;
+        bus.clk = 0;
+    }
+    if (fell & (1 << SIG_SS | 1 << SIG_SS2)){
+        n = capture.resync;
+        ps1_guard_edge();
+        ps1_capture_start(fell & 1 << SIG_SS ? 0 : 1, (uint16_t)(t / PS_PER_US));
+        if (capture.resync != n){
+            resync++;
+            bus_error(t, "transaction cut short by the next SS edge");
+        }
+        transactions++;
+        bus.bits = 0;
+        bus.bytes = 0;
+        bus.poll = 0;
+        bus.queued = 0;
+        bus_guard(t);
+    }
+    if ((ch & 1 << SIG_CLK) && (v & 1 << SIG_CLK) && BUS_SEL(v)){
+        bus.clk++;
+        bus.c = PS1_SHIFT_IN(bus.c, v >> SIG_CMD & 1);
+        bus.d = PS1_SHIFT_IN(bus.d, v >> SIG_DATA & 1);
+        if (++bus.bits == 8){
+            bus.bits = 0;
+            if (bus.bytes == 0)
+                bus.sel = bus.c;
+            else if (bus.bytes == 1)
+                bus.poll = (bus.sel == W_CMD_SEL_CTRL_1 || bus.sel == W_CMD_SEL_CTRL_2 ||
+                    bus.sel == W_CMD_SEL_CTRL_3 || bus.sel == W_CMD_SEL_CTRL_4) && bus.c == W_CMD_READ_SW;
+            else if (bus.bytes == 2)
+                bus.poll = bus.poll && bus.d == REV8(0x5A);
+            if (bus.bytes < 0xFF)
+                bus.bytes++;
+            head = capture.head;
+            n = capture.overrun;
+            if (ps1_guard_spi(0))
+                ps1_capture_byte(bus.c, bus.d);
+            bus_guard(t);
+            if (capture.head != head || capture.overrun != n)
+                bus.queued = 1;
+            if (capture.overrun != n){
+                overrun++;
+                bus_error(t, "frame queue overrun");
+            }
+            bus_main(t);
+        }
+    }
+}
+
+/**********************************************************/
+/* VCD */
+
+struct Vcd_Id{
+    const char *s;
+    size_t len;
+};
+
+static int vcd_space(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Next whitespace separated token, 0 at the end of the input */
+static const char *vcd_token(const char **p, const char *end, size_t *len){
+    const char *s = *p;
+    while (s < end && vcd_space(*s))
+        s++;
+    if (s == end)
+        return 0;
+    *p = s;
+    while (*p < end && !vcd_space(**p))
+        (*p)++;
+    *len = *p - s;
+    return s;
+}
+
+static int vcd_is(const char *s, size_t len, const char *word){
+    return len == strlen(word) && memcmp(s, word, len) == 0;
+}
+
+/* Skip up to and including the next $end */
+static void vcd_skip(const char **p, const char *end){
+    const char *s;
+    size_t len;
+    while ((s = vcd_token(p, end, &len)) != 0 && !vcd_is(s, len, "$end"));
+}
+
+/* "1 ns", "10ps"... as a fraction of a picosecond */
+static int vcd_timescale(const char **p, const char *end, uint64_t *mul, uint64_t *div){
+    static const struct { const char *unit; uint64_t mul, div; } units[] = {
+        {"s", 1000000000000ull, 1}, {"ms", 1000000000ull, 1}, {"us", 1000000ull, 1},
+        {"ns", 1000, 1}, {"ps", 1, 1}, {"fs", 1, 1000},
+    };
+    char buf[32];
+    size_t n = 0, len, i;
+    const char *s, *u;
+    unsigned long v;
+
+    while ((s = vcd_token(p, end, &len)) != 0 && !vcd_is(s, len, "$end"))
+        for (i = 0; i < len && n < sizeof(buf) - 1; i++)
+            buf[n++] = s[i];
+    buf[n] = 0;
+    v = strtoul(buf, (char**)&u, 10);
+    for (i = 0; i < sizeof(units) / sizeof(units[0]); i++){
+        if (strcmp(u, units[i].unit) == 0){
+            *mul = v * units[i].mul;
+            *div = units[i].div;
+            return 0;
+        }
+    }
+    fprintf(stderr, "timescale '%s' not understood\n", buf);
+    return -1;
+}
+
+static int vcd_replay(const char *p, const char *end, const char **names){
+    struct Vcd_Id id[SIG_COUNT+1] = {{0}}; // and ss2
+    uint64_t mul = 1000, div = 1, t = 0; // VCD default is 1 ns
+    uint8_t v = bus.v, lvl;
+    const char *s, *ref, *code;
+    size_t len, ref_len, code_len;
+    int i, started = 0;
+
+    // header: timescale and the four signals
+    while ((s = vcd_token(&p, end, &len)) != 0){
+        if (vcd_is(s, len, "$timescale")){
+            if (vcd_timescale(&p, end, &mul, &div))
+                return -1;
+        }else if (vcd_is(s, len, "$var")){
+            vcd_token(&p, end, &len); // type
+            s = vcd_token(&p, end, &len); // size
+            code = vcd_token(&p, end, &code_len);
+            ref = vcd_token(&p, end, &ref_len);
+            if (!ref)
+                break;
+            for (i = 0; i <= SIG_SS2; i++)
+                if (s[0] == '1' && len == 1 && ref_len == strlen(names[i])
+                    && strncasecmp(ref, names[i], ref_len) == 0){
+                    id[i].s = code;
+                    id[i].len = code_len;
+                }
+            vcd_skip(&p, end);
+        }else if (vcd_is(s, len, "$enddefinitions")){
+            vcd_skip(&p, end);
+            break;
+        }else if (s[0] == '$' && !vcd_is(s, len, "$end"))
+            vcd_skip(&p, end); // $date, $version, $scope...
+    }
+    for (i = 0; i < SIG_COUNT; i++){
+        if (!id[i].s){
+            fprintf(stderr, "no 1 bit signal named '%s' in the VCD\n", names[i]);
+            return -1;
+        }
+    }
+
+    // value changes, everything at one timestamp is applied at once
+    while ((s = vcd_token(&p, end, &len)) != 0){
+        switch(s[0]){
+            case '#':
+                if (started && v != bus.v)
+                    bus_edge(t * mul / div, v);
+                t = strtoull(s + 1, 0, 10);
+                if (!started){
+                    bus.ms = t * mul / div / PS_PER_MS;
+                    started = 1;
+                }
+                continue;
+            case '0': case '1': case 'x': case 'X': case 'z': case 'Z':
+                lvl = s[0] == '0' ? 0 : 1; // bus lines are pulled up, x and z read high
+                code = s + 1;
+                code_len = len - 1;
+                break;
+            case 'b': case 'B':
+                lvl = s[len-1] == '0' ? 0 : 1; // LSb of a vector
+                code = vcd_token(&p, end, &code_len);
+                break;
+            case 'r': case 'R':
+                vcd_token(&p, end, &code_len); // real, none of ours
+                continue;
+            case '$':
+                if (vcd_is(s, len, "$comment"))
+                    vcd_skip(&p, end);
+                continue; // $dumpvars, $end...
+            default:
+                continue;
+        }
+        if (!code)
+            break;
+        for (i = 0; i <= SIG_SS2; i++){
+            if (id[i].s && id[i].len == code_len && memcmp(id[i].s, code, code_len) == 0){
+                if (lvl)
+                    v |= 1 << i;
+                else
+                    v &= ~(1 << i);
+            }
+        }
+    }
+    if (started && v != bus.v)
+        bus_edge(t * mul / div, v);
+    bus_tick(t * mul / div);
+    return 0;
+}
+
+/**********************************************************/
+/* sigrok binary */
+
+static uint64_t raw_time(uint64_t i, uint64_t rate){
+    return (unsigned __int128)i * 1000000000000ull / rate;
+}
+
+static int raw_replay(const uint8_t *p, const uint8_t *end, uint64_t rate,
+        const int *ch, unsigned unit){
+    uint8_t lut[256], v, prev;
+    uint64_t i, n = (end - p) / unit, w, rep;
+    uint32_t s;
+    unsigned j;
+    int k;
+
+    if (unit == 1){
+        // one byte per sample: level of each signal by lookup, skip repeats
+        for (j = 0; j < 256; j++){
+            lut[j] = 1 << SIG_SS2; // port 2 SEL isn't in raw captures
+            for (k = 0; k < SIG_COUNT; k++)
+                lut[j] |= (j >> ch[k] & 1) << k;
+        }
+        if (n)
+            bus.v = lut[p[0]];
+        prev = p[0];
+        rep = prev * 0x0101010101010101ull;
+        for (i = 1; i < n; i++){
+            // the bus is idle most of the time, skip 8 unchanged samples at once
+            while (i + 8 <= n){
+                memcpy(&w, p + i, 8);
+                if (w != rep)
+                    break;
+                i += 8;
+            }
+            if (i >= n)
+                break;
+            if (p[i] == prev)
+                continue;
+            prev = p[i];
+            rep = prev * 0x0101010101010101ull;
+            v = lut[prev];
+            if (v != bus.v)
+                bus_edge(raw_time(i, rate), v);
+        }
+    }else{
+        for (i = 0; i < n; i++){
+            s = 0;
+            for (j = 0; j < unit && j < 4; j++)
+                s |= (uint32_t)p[i*unit + j] << 8*j;
+            v = 1 << SIG_SS2;
+            for (k = 0; k < SIG_COUNT; k++)
+                v |= (s >> ch[k] & 1) << k;
+            if (i == 0)
+                bus.v = v;
+            else if (v != bus.v)
+                bus_edge(raw_time(i, rate), v);
+        }
+    }
+    bus_tick(raw_time(n, rate));
+    return 0;
+}
+
+/**********************************************************/
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* "a,b,c,d" into four strings, in place */
+static int split4(char *s, char **out){
+    int i;
+    for (i = 0; i < SIG_COUNT; i++){
+        out[i] = s;
+        s = strchr(s, ',');
+        if (!s)
+            break;
+        *s++ = 0;
+    }
+    return i == SIG_COUNT - 1 ? 0 : -1;
+}
+
+/* Combo table image from a file, as the EEPROM would hold it */
+static uint8_t table[256];
+static uint8_t table_read(uint8_t addr){
+    return table[addr];
+}
+
+static int table_load(const char *path){
+    FILE *f = fopen(path, "rb");
+    if (!f){
+        perror(path);
+        return -1;
+    }
+    memset(table, 0xFF, sizeof(table)); // blank EEPROM
+    if (fread(table, 1, sizeof(table), f) == 0){
+        fclose(f);
+        fprintf(stderr, "%s is empty\n", path);
+        return -1;
+    }
+    fclose(f);
+    if (ps1_combo_load(table_read) != COMBO_SRC_EEPROM){
+        fprintf(stderr, "%s isn't a valid combo table\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(void){
+    fprintf(stderr,
+        "usage: ps1_replay [-q] [-H] [-j journal.bin] [-l lockout_ms] [-t combos.bin] [-n ss,clk,cmd,data] capture.vcd\n"
+        "       ps1_replay [-q] [-H] [-j journal.bin] [-l lockout_ms] [-t combos.bin] -r rate [-c ss,clk,cmd,data] [-u unitsize] capture.bin\n");
+}
+
+int main(int argc, char **argv){
+    const char *names[SIG_COUNT+1] = {sig_names[0], sig_names[1], sig_names[2], sig_names[3], "ss2"};
+    char *arg[SIG_COUNT];
+    int ch[SIG_COUNT] = {0, 1, 2, 3};
+    uint64_t rate = 0;
+    unsigned unit = 1, lockout = 0;
+    const char *path = 0;
+    const uint8_t *map;
+    struct stat st;
+    double t0, wall, span;
+    int i, fd, err;
+
+    ps1_combo_load(0); // built-in combos unless -t
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-q") == 0)
+            quiet = 1;
+        else if (strcmp(argv[i], "-H") == 0)
+            hw = 1;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            if (!(journal_file = fopen(argv[++i], "wb"))){
+                perror(argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc){
+            if (table_load(argv[++i]))
+                return 2;
+        }else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            lockout = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rate = strtoull(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+            unit = strtoul(argv[++i], 0, 0);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            if (split4(argv[++i], arg))
+                return usage(), 2;
+            for (fd = 0; fd < SIG_COUNT; fd++)
+                names[fd] = arg[fd];
+        }else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+            if (split4(argv[++i], arg))
+                return usage(), 2;
+            for (fd = 0; fd < SIG_COUNT; fd++)
+                ch[fd] = atoi(arg[fd]);
+        }else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+            return usage(), 2;
+    }
+    if (!path || unit < 1 || unit > 4 || lockout > 0xFFFF)
+        return usage(), 2;
+    for (i = 0; i < SIG_COUNT; i++){
+        if (ch[i] < 0 || ch[i] >= 8 * (int)unit){
+            fprintf(stderr, "channel %d doesn't fit in %u byte samples\n", ch[i], unit);
+            return 2;
+        }
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0){
+        perror(path);
+        return 2;
+    }
+    map = st.st_size ? mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : 0;
+    if (map == MAP_FAILED){
+        perror(path);
+        return 2;
+    }
+    if (map)
+        madvise((void*)map, st.st_size, MADV_SEQUENTIAL);
+
+    // idle bus: SS and CLK high, RESET released
+    bus.v = 1 << SIG_SS | 1 << SIG_CLK | 1 << SIG_CMD | 1 << SIG_DATA | 1 << SIG_SS2;
+    ps1_capture_init();
+    ps1_guard_init();
+    for (i = 0; i < PS1_PADS; i++)
+        ps1_port_init(&bus.pads[i]);
+    ps1_reset_init(lockout); // 0: capture starts with the console already up
+    ps1_journal_init();
+
+    t0 = now_s();
+    for (i = 0; i < st.st_size && (map[i] == ' ' || map[i] == '\n' || map[i] == '\r' || map[i] == '\t'); i++);
+    if (i < st.st_size && map[i] == '$')
+        err = vcd_replay((const char*)map, (const char*)map + st.st_size, names);
+    else if (rate)
+        err = raw_replay(map, map + st.st_size, rate, ch, unit);
+    else{
+        fprintf(stderr, "%s isn't a VCD, give the sample rate (-r) to read it as sigrok binary\n", path);
+        err = -1;
+    }
+    wall = now_s() - t0;
+    if (map)
+        munmap((void*)map, st.st_size);
+    close(fd);
+    if (journal_file){
+        bus_journal();
+        fclose(journal_file);
+    }
+    if (err)
+        return 2;
+
+    span = bus.ms / 1000.0;
+    printf("%.3f s of bus, %lu transactions, %lu polls decoded, %lu combo hits, %lu reset pulses\n",
+        span, transactions, polls, hits, pulses);
+    printf("memory card: %u sectors written, %u failed, %u resets waited for it\n",
+        card.writes, card.failed, reset.deferred);
+    printf("errors: %lu partial bytes, %lu polls lost, %lu resync, %lu overrun, %lu MSSP restarts\n",
+        partial, lost, resync, overrun, restarts);
+    if (hw){
+        printf("HW timing: %u transactions, last %u us, %u bytes, %u us between bytes, %u partial\n",
+            capture.timing.count, capture.timing.width, capture.timing.bytes,
+            capture.timing.gap, capture.timing.partial);
+        for (i = 0; i < PS1_PADS; i++)
+            if (bus.pads[i].period)
+                printf("pad %u%c polled every %u us, %.2f Hz\n", i / PS1_SLOTS + 1, 'A' + i % PS1_SLOTS,
+                    bus.pads[i].period, 1e6 / bus.pads[i].period);
+    }
+    fprintf(stderr, "%.0f MB in %.2f s, %.0f MB/s, %.0fx real time\n", st.st_size / 1e6, wall,
+        st.st_size / 1e6 / wall, wall > 0 ? span / wall : 0);
+    return partial || lost || resync || overrun || restarts ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# File:   targets.sh
+# Author: pyroesp
+#
+# Builds ps1_bench with the platform traits of every target the core
+# supports (core/ps1_target.h), with and without PS1_STATS, and runs it.
+# Exits with an error on the first target that doesn't build or pass.
+#
+# Run from the repository root:
+#   sh host/targets.sh [frames]
+
+frames=${1:-100000}
+out=${TMPDIR:-/tmp}/ps1_bench_target
+
+for target in PIC16F18325 ATMEGA328PB ATMEGA328P; do
+    for stats in "" -DPS1_STATS; do
+        echo "== $target $stats"
+        gcc -O2 -Wall -Wextra -DPS1_TARGET_$target $stats -I core -o "$out" host/bench.c core/ps1_*.c || exit 1
+        "$out" "$frames" > "$out.txt" || { cat "$out.txt"; echo "$target $stats: FAIL"; exit 1; }
+        head -1 "$out.txt"
+    done
+done
+rm -f "$out" "$out.txt"
+echo "all targets pass"
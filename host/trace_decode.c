@@ -0,0 +1,152 @@
+/*
+ * File:   trace_decode.c
+ * Author: pyroesp
+ *
+ * Decoder for the DEBUG UART trace (see core/ps1_trace.h)
+ *
+ * Reads the binary stream from a file, a serial port or stdin and prints
+ * one line per record, bytes in PS1 bit order. Journal dumps in it are
+ * only counted, ps1_journal decodes them from the same stream.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -Wall -I core -o ps1_trace host/trace_decode.c core/ps1_*.c
+ * Run:
+ *   stty -F /dev/ttyUSB0 500000 raw && ./ps1_trace /dev/ttyUSB0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ps1_ctrl.h"
+#include "ps1_trace.h"
+#include "ps1_stats.h"
+
+static const char *key_names[16] = {
+    "SELECT", "L3", "R3", "START", "UP", "RIGHT", "DOWN", "LEFT",
+    "L2", "R2", "L1", "R1", "TRIANGLE", "CIRCLE", "CROSS", "SQUARE"
+};
+
+static const char *id_name(uint16_t id){
+    switch(id){
+        case ID_DIG_CTRL: return "digital";
+        case ID_ANP_CTRL: return "analog pad";
+        case ID_ANS_CTRL: return "analog stick";
+        case ID_DS2_CTRL: return "dualshock 2";
+        case ID_GUNCON_CTRL: return "guncon";
+        case ID_MULTITAP: return "multitap";
+        case ID_CONFIG: return "config mode";
+    }
+    return "unknown";
+}
+
+static uint32_t now_us; // 16 bit stamps unwrapped
+static uint16_t last_stamp;
+static unsigned long frames, texts, bad, journal_bytes;
+
+static void print_frame(const uint8_t *p, uint8_t len){
+    uint8_t n = p[2] & 0x0F, pad = p[2] >> 4, c[PS1_CTRL_BUFF_SIZE], d[PS1_CTRL_BUFF_SIZE], i;
+    uint16_t stamp = p[0] | p[1] << 8, id, sw;
+
+    if (n > PS1_CTRL_BUFF_SIZE || len != 3 + 2*n){
+        bad++;
+        return;
+    }
+    for (i = 0; i < n; i++){
+        c[i] = p[3+i];
+        d[i] = p[3+n+i];
+        reverse_byte(&c[i]);
+        reverse_byte(&d[i]);
+    }
+    now_us += (uint16_t)(stamp - last_stamp);
+    last_stamp = stamp;
+    frames++;
+
+    // port 1/2, multitap slot A to D
+    printf("%10lu us  %u%c  CMD:", (unsigned long)now_us, pad / PS1_SLOTS + 1, 'A' + pad % PS1_SLOTS);
+    for (i = 0; i < n; i++)
+        printf(" %02X", c[i]);
+    printf("  DATA:");
+    for (i = 0; i < n; i++)
+        printf(" %02X", d[i]);
+    if (n >= 5){
+        id = d[1] | d[2] << 8;
+        sw = d[3] | d[4] << 8;
+        printf("  %s", id_name(id));
+        for (i = 0; i < 16; i++)
+            if (!(sw & (1 << i)))
+                printf(" %s", key_names[i]);
+    }
+    printf("\n");
+}
+
+/* PS1_STATS snapshot, one name=value per counter */
+static void print_stats(const uint8_t *p, int len){
+    static const char *names[STATS_COUNT] = { STATS_NAMES };
+    int i;
+
+    printf("# stats:");
+    for (i = 0; i < STATS_COUNT && 2*i + 1 < len; i++)
+        printf(" %s=%u", names[i], p[2*i] | p[2*i+1] << 8);
+    printf("\n");
+}
+
+int main(int argc, char **argv){
+    FILE *in = stdin;
+    uint8_t rec[2 + 255], check;
+    int ch, i, len;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0){
+        in = fopen(argv[1], "rb");
+        if (!in){
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    // SYNC type len payload check, resync on the next SYNC if anything is off
+    while ((ch = fgetc(in)) != EOF){
+        if (ch != TRACE_SYNC)
+            continue;
+        if ((ch = fgetc(in)) == EOF)
+            break;
+        rec[0] = ch;
+        if ((len = fgetc(in)) == EOF)
+            break;
+        rec[1] = len;
+        check = rec[0] ^ rec[1];
+        for (i = 0; i < len && (ch = fgetc(in)) != EOF; i++){
+            rec[2+i] = ch;
+            check ^= ch;
+        }
+        if (i < len || (ch = fgetc(in)) == EOF)
+            break;
+        if (ch != check){
+            bad++;
+            continue;
+        }
+        switch(rec[0]){
+            case TRACE_FRAME:
+                print_frame(&rec[2], len);
+                break;
+            case TRACE_TEXT:
+                printf("# %.*s\n", len, (const char*)&rec[2]);
+                texts++;
+                break;
+            case TRACE_STATS:
+                print_stats(&rec[2], len);
+                break;
+            case TRACE_JOURNAL:
+                if (len >= 2 && rec[2] == 'P' && rec[3] == 'J')
+                    printf("# journal dump, decode with ps1_journal\n");
+                journal_bytes += len;
+                break;
+            default:
+                bad++;
+                break;
+        }
+    }
+    fprintf(stderr, "%lu frames, %lu messages, %lu journal bytes, %lu bad records\n",
+        frames, texts, journal_bytes, bad);
+    return 0;
+}
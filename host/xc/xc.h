@@ -0,0 +1,182 @@
+/*
+ * File:   xc.h
+ * Author: pyroesp
+ *
+ * Stand-in for XC8's <xc.h> so pic16f18325/main.c builds unmodified on the
+ * host, see host/pic_sim.c for the chip behind it
+ *
+ * Only the SFRs and bits main.c and ps1_hal.h use are here. Each register
+ * is a byte with its bits on top (PIR1bits.SSP1IF, PIR1), bit positions
+ * as in the datasheet. Registers that do something when they're read or
+ * written are accessors into the model instead of plain bytes:
+ *   SSPxBUF    read clears BF, with SSPEN off the bit count is cleared
+ *   TMR1H/L    TMR1 counting from the simulated clock
+ *   TMR0L      TMR1 the same, the read latches TMR0H
+ *   NVMDATL    with RD set: the data EEPROM byte at NVMADRL
+ *   TX1REG     written: the byte goes out on the UART
+ *   RC1REG     read clears RCIF
+ * NVMCON1bits.WR and the rest are picked up by the model the next time it
+ * runs, which is at every function entry (-finstrument-functions), CLRWDT
+ * and SLEEP. main() is renamed pic_main, __interrupt() is dropped and
+ * host/pic_sim.c calls _spi_int itself.
+ */
+
+#ifndef XC_H
+#define XC_H
+
+#include <stdint.h>
+
+#define XC_SIM __attribute__((no_instrument_function))
+
+/* One byte SFR with named bits, name##bits and name */
+#define XC_SFR(name, ...) \
+    typedef union { struct { __VA_ARGS__ }; uint8_t reg; } name##bits_t; \
+    extern volatile name##bits_t name##bits
+#define XC_BYTE(name) extern volatile uint8_t name
+
+/* Ports */
+XC_SFR(PORTA, unsigned RA0:1, RA1:1, RA2:1, RA3:1, RA4:1, RA5:1, :2;);
+XC_SFR(PORTC, unsigned RC0:1, RC1:1, RC2:1, RC3:1, RC4:1, RC5:1, :2;);
+XC_SFR(TRISA, unsigned TRISA0:1, TRISA1:1, TRISA2:1, :1, TRISA4:1, TRISA5:1, :2;);
+XC_SFR(TRISC, unsigned TRISC0:1, TRISC1:1, TRISC2:1, TRISC3:1, TRISC4:1, TRISC5:1, :2;);
+XC_SFR(LATA, unsigned LATA0:1, LATA1:1, LATA2:1, :1, LATA4:1, LATA5:1, :2;);
+XC_SFR(LATC, unsigned LATC0:1, LATC1:1, LATC2:1, LATC3:1, LATC4:1, LATC5:1, :2;);
+XC_SFR(ANSELA, unsigned ANSA0:1, ANSA1:1, ANSA2:1, :1, ANSA4:1, ANSA5:1, :2;);
+XC_SFR(ANSELC, unsigned ANSC0:1, ANSC1:1, ANSC2:1, ANSC3:1, ANSC4:1, ANSC5:1, :2;);
+#define PORTA PORTAbits.reg
+#define PORTC PORTCbits.reg
+#define TRISA TRISAbits.reg
+#define TRISC TRISCbits.reg
+#define LATA LATAbits.reg
+#define LATC LATCbits.reg
+#define ANSELA ANSELAbits.reg
+#define ANSELC ANSELCbits.reg
+
+/* Interrupts */
+XC_SFR(INTCON, unsigned INTEDG:1, :5, PEIE:1, GIE:1;);
+XC_SFR(PIR0, unsigned INTF:1, :3, IOCIF:1, TMR0IF:1, :2;);
+XC_SFR(PIR1, unsigned TMR1IF:1, TMR2IF:1, BCL1IF:1, SSP1IF:1, TXIF:1, RCIF:1, ADIF:1, TMR1GIF:1;);
+XC_SFR(PIR2, unsigned CCP2IF:1, TMR4IF:1, TMR6IF:1, BCL2IF:1, SSP2IF:1, NVMIF:1, C1IF:1, C2IF:1;);
+XC_SFR(PIR5, unsigned TMR3IF:1, TMR3GIF:1, TMR5IF:1, TMR5GIF:1, CLC1IF:1, :3;);
+XC_SFR(PIE0, unsigned INTE:1, :3, IOCIE:1, TMR0IE:1, :2;);
+XC_SFR(PIE1, unsigned TMR1IE:1, TMR2IE:1, BCL1IE:1, SSP1IE:1, TXIE:1, RCIE:1, ADIE:1, TMR1GIE:1;);
+XC_SFR(PIE2, unsigned CCP2IE:1, TMR4IE:1, TMR6IE:1, BCL2IE:1, SSP2IE:1, NVMIE:1, C1IE:1, C2IE:1;);
+XC_SFR(PIE5, unsigned TMR3IE:1, TMR3GIE:1, TMR5IE:1, TMR5GIE:1, CLC1IE:1, :3;);
+XC_SFR(IOCAP, unsigned IOCAP0:1, IOCAP1:1, IOCAP2:1, IOCAP3:1, IOCAP4:1, IOCAP5:1, :2;);
+XC_SFR(IOCAN, unsigned IOCAN0:1, IOCAN1:1, IOCAN2:1, IOCAN3:1, IOCAN4:1, IOCAN5:1, :2;);
+XC_SFR(IOCAF, unsigned IOCAF0:1, IOCAF1:1, IOCAF2:1, IOCAF3:1, IOCAF4:1, IOCAF5:1, :2;);
+#define INTCON INTCONbits.reg
+#define PIR1 PIR1bits.reg
+#define PIE1 PIE1bits.reg
+#define IOCAF IOCAFbits.reg
+
+/* Clock, watchdog, reset, power */
+XC_SFR(OSCCON1, unsigned NDIV:4, NOSC:3, :1;);
+XC_SFR(OSCCON3, unsigned :4, ORDY:1, NOSCR:1, SOSCPWR:1, CSWHOLD:1;);
+XC_SFR(WDTCON, unsigned SWDTEN:1, WDTPS:5, :2;);
+XC_SFR(PCON0, unsigned nBOR:1, nPOR:1, nRI:1, nRMCLR:1, nRWDT:1, :1, STKUNF:1, STKOVF:1;);
+XC_SFR(CPUDOZE, unsigned DOZE:3, :1, DOE:1, ROI:1, DOZEN:1, IDLEN:1;);
+
+/* MSSP */
+XC_SFR(SSP1STAT, unsigned BF:1, UA:1, R_nW:1, S:1, P:1, D_nA:1, CKE:1, SMP:1;);
+XC_SFR(SSP1CON1, unsigned SSPM:4, CKP:1, SSPEN:1, SSPOV:1, WCOL:1;);
+XC_SFR(SSP1CON3, unsigned DHEN:1, AHEN:1, SBCDE:1, SDAHT:1, BOEN:1, SCIE:1, PCIE:1, ACKTIM:1;);
+typedef SSP1STATbits_t SSP2STATbits_t; // MSSP2 is laid out as MSSP1
+typedef SSP1CON1bits_t SSP2CON1bits_t;
+typedef SSP1CON3bits_t SSP2CON3bits_t;
+extern volatile SSP2STATbits_t SSP2STATbits;
+extern volatile SSP2CON1bits_t SSP2CON1bits;
+extern volatile SSP2CON3bits_t SSP2CON3bits;
+volatile uint8_t *xc_sspbuf(uint8_t n) XC_SIM;
+#define SSP1BUF (*xc_sspbuf(0))
+#define SSP2BUF (*xc_sspbuf(1))
+
+/* PPS, inputs 0x00-0x05 RA0-RA5, 0x10-0x15 RC0-RC5 */
+XC_SFR(SSP1SSPPS, unsigned SSP1SSPPS:5, :3;);
+XC_SFR(SSP2SSPPS, unsigned SSP2SSPPS:5, :3;);
+XC_SFR(SSP1CLKPPS, unsigned SSP1CLKPPS:5, :3;);
+XC_SFR(SSP2CLKPPS, unsigned SSP2CLKPPS:5, :3;);
+XC_SFR(SSP1DATPPS, unsigned SSP1DATPPS:5, :3;);
+XC_SFR(SSP2DATPPS, unsigned SSP2DATPPS:5, :3;);
+XC_SFR(CLCIN0PPS, unsigned CLCIN0PPS:5, :3;);
+XC_SFR(CLCIN1PPS, unsigned CLCIN1PPS:5, :3;);
+XC_SFR(RXPPS, unsigned RXPPS:5, :3;);
+XC_SFR(RA5PPS, unsigned RA5PPS:5, :3;); // outputs: 0x04 CLC1OUT
+XC_SFR(RC3PPS, unsigned RC3PPS:5, :3;); // 0x14 TX
+XC_BYTE(CCP1PPS);
+XC_BYTE(T3GPPS);
+XC_BYTE(T5GPPS);
+XC_BYTE(T5CKIPPS);
+
+/* CLC1 */
+XC_SFR(CLC1CON, unsigned LC1MODE:3, LC1INTN:1, LC1INTP:1, LC1OUT:1, :1, LC1EN:1;);
+XC_SFR(CLC1SEL0, unsigned LC1D1S:6, :2;);
+XC_SFR(CLC1SEL1, unsigned LC1D2S:6, :2;);
+XC_SFR(CLC1SEL2, unsigned LC1D3S:6, :2;);
+XC_SFR(CLC1SEL3, unsigned LC1D4S:6, :2;);
+XC_BYTE(CLC1GLS0);
+XC_BYTE(CLC1GLS1);
+XC_BYTE(CLC1GLS2);
+XC_BYTE(CLC1GLS3);
+XC_BYTE(CLC1POL);
+
+/* Timers and CCP1 */
+XC_SFR(T0CON0, unsigned T0OUTPS:4, T016BIT:1, T0OUT:1, :1, T0EN:1;);
+XC_SFR(T0CON1, unsigned T0CKPS:4, T0ASYNC:1, T0CS:3;);
+XC_SFR(T1CON, unsigned TMR1ON:1, :1, nT1SYNC:1, T1SOSC:1, T1CKPS:2, TMR1CS:2;);
+XC_SFR(T2CON, unsigned T2CKPS:2, TMR2ON:1, T2OUTPS:4, :1;);
+XC_SFR(T3CON, unsigned TMR3ON:1, :1, nT3SYNC:1, T3SOSC:1, T3CKPS:2, TMR3CS:2;);
+XC_SFR(T3GCON, unsigned T3GSS:2, T3GVAL:1, T3GGO:1, T3GSPM:1, T3GTM:1, T3GPOL:1, TMR3GE:1;);
+XC_SFR(T5CON, unsigned TMR5ON:1, :1, nT5SYNC:1, T5SOSC:1, T5CKPS:2, TMR5CS:2;);
+XC_SFR(T5GCON, unsigned T5GSS:2, T5GVAL:1, T5GGO:1, T5GSPM:1, T5GTM:1, T5GPOL:1, TMR5GE:1;);
+XC_SFR(CCP1CON, unsigned CCP1MODE:4, CCP1FMT:1, CCP1OUT:1, :1, CCP1EN:1;);
+XC_SFR(CCPTMRS, unsigned C1TSEL:2, C2TSEL:2, C3TSEL:2, C4TSEL:2;);
+XC_BYTE(PR2);
+XC_BYTE(TMR0H);
+XC_BYTE(TMR3H);
+XC_BYTE(TMR3L);
+XC_BYTE(TMR5H);
+XC_BYTE(TMR5L);
+XC_BYTE(CCPR1H);
+XC_BYTE(CCPR1L);
+volatile uint8_t *xc_tmr1(uint8_t high) XC_SIM;
+volatile uint8_t *xc_tmr0l(void) XC_SIM;
+#define TMR1H (*xc_tmr1(1))
+#define TMR1L (*xc_tmr1(0))
+#define TMR0L (*xc_tmr0l())
+
+/* Data EEPROM */
+XC_SFR(NVMCON1, unsigned RD:1, WR:1, WREN:1, WRERR:1, FREE:1, LWLO:1, NVMREGS:1, :1;);
+XC_BYTE(NVMADRL);
+XC_BYTE(NVMADRH);
+XC_BYTE(NVMCON2);
+volatile uint8_t *xc_nvmdatl(void) XC_SIM;
+#define NVMDATL (*xc_nvmdatl())
+
+/* EUSART and reference clock */
+XC_SFR(TX1STA, unsigned TX9D:1, TRMT:1, BRGH:1, SENDB:1, SYNC:1, TXEN:1, TX9:1, CSRC:1;);
+XC_SFR(RC1STA, unsigned RX9D:1, OERR:1, FERR:1, ADDEN:1, CREN:1, SREN:1, RX9:1, SPEN:1;);
+XC_SFR(BAUD1CON, unsigned ABDEN:1, WUE:1, :1, BRG16:1, SCKP:1, :1, RCIDL:1, ABDOVF:1;);
+XC_SFR(CLKRCON, unsigned CLKRDIV:3, CLKRDC:2, :2, CLKREN:1;);
+XC_BYTE(SP1BRGL);
+XC_BYTE(SP1BRGH);
+volatile uint8_t *xc_txreg(void) XC_SIM;
+volatile uint8_t *xc_rcreg(void) XC_SIM;
+#define TX1REG (*xc_txreg())
+#define RC1REG (*xc_rcreg())
+
+/* Intrinsics */
+void xc_clrwdt(void) XC_SIM;
+void xc_sleep(void) XC_SIM;
+void xc_delay_us(uint32_t us) XC_SIM;
+#define CLRWDT() xc_clrwdt()
+#define SLEEP() xc_sleep()
+#define NOP() ((void)0)
+#define __delay_us(x) xc_delay_us(x)
+#define __delay_ms(x) xc_delay_us((x) * 1000ul)
+#define __interrupt(...)
+
+/* host/pic_sim.c has the main(), the firmware's is called from it */
+#define main pic_main
+
+#endif
@@ -1,24 +1,28 @@
 /*
  * Arduino nano reset combo mod POC v2
  * -----------------------------------
- * 
- * IO are setup on PORTB, but can be modified. See PS1_X_IO defines.
- * PB5 - SCK (input, connect to PS1 clock)
- * PB4 - CMD (input, connect to PS1 TX)
- * PB3 - DATA (input, connect to PS1 RX)
- * PB2 - /SS (input, connect to controller 1 select)
- * PB1 - playstation reset (output, connect to reset of parallel port (pin 2))
- * 
+ *
+ * IO are setup on PORTD, but can be modified. See PS1_X_IO defines.
+ * PD2 - SCK (input, connect to PS1 clock, INT0)
+ * PD3 - /SS (input, connect to controller 1 select, INT1)
+ * PD4 - CMD (input, connect to PS1 TX)
+ * PD5 - DATA (input, connect to PS1 RX)
+ * PD6 - playstation reset (output, connect to reset of parallel port (pin 2))
+ *
+ * Same protocol core as the PIC (../../../core, built by ps1_core.c): the
+ * clock interrupt shifts the bits in, EE_READY hands every byte to the
+ * capture in the /ACK gap before the next one, the loop decodes what it
+ * queued and millis() runs the 1 ms reset tick.
  */
 
 // #define DEBUG
 
 #if defined(DEBUG)
-  #define REBOOT_DELAY 30000
+  #define REBOOT_DELAY 1000
 #else
-  #define REBOOT_DELAY 1
+  #define REBOOT_DELAY 30000
 #endif
- 
+
 #define PS1_PIN_IO PIND // IO pin reg used for SS, CMD, DATA and RESET
 #define PS1_PORT_IO PORTD // IO port reg used for SS, CMD, DATA and RESET
 #define PS1_DIR_IO DDRD // IO dir reg used for SS, CMD, DATA and RESET
@@ -28,110 +32,41 @@
 #define DATA 5
 #define RESET 6 // Only IO that outputs a logic 0
 
- /* Controller ID */
-#define ID_DIG_CTRL 0x5A41 // digital
-#define ID_ANP_CTRL 0x5A73 // analog/pad
-#define ID_GUNCON_CTRL 0x5A63 // light gun
-
-/* PlayStation Commands */
-#define CMD_SEL_CTRL_1 0x01 // select controller 1
-#define CMD_SEL_MEMC_1 0x81 // select memory card 1
-#define CMD_READ_SW 0x42 // read switch status from controller
-
-/* PlayStation Buff Size */
-#define PS1_CTRL_BUFF_SIZE 9 // max size of buffer needed for a controller
-#define PORT_BUFF_SIZE 72 // (8 * PS1_CTRL_BUFF_SIZE)
-
-/* Key Combo */
-#define KEY_COMBO_CTRL 0xFCF6 // select-start-L2-R2 1111 1100 1111 0110
-#define KEY_COMBO_GUNCON 0x9FF7 // A-trigger-B 1001 1111 1111 0111 
-
-/* Key stuff */
-#define KEY_PRESSED 0
-#define KEY_RELEASED 1
-
-enum Keys{
-  SELECT, // 0
-  L3,
-  R3,
-  START, // light gun A
-  UP,
-  RIGHT,
-  DOWN,
-  LEFT,
-  L2,
-  R2,
-  L1,
-  R1,
-  TRIANGLE,
-  CIRCLE, // light gun trigger
-  CROSS, // light gun B
-  SQUARE
-};
-
-/* PlayStation Controller Command Union */
-union PS1_Cmd{
-  uint8_t buff[PS1_CTRL_BUFF_SIZE];
-  struct{
-    uint8_t device_select; // 0x01 or 0x81
-    uint8_t command; // 0x42 for read switch
-    uint8_t unused[PS1_CTRL_BUFF_SIZE-2]; // always 0 for controller
-  };
-};
-
-/* PlayStation Controller Data Union */
-union PS1_Ctrl_Data{
-  uint8_t buff[PS1_CTRL_BUFF_SIZE]; // buffer to read data
-  struct{
-    uint8_t unused; // always 0xFF
-    uint16_t id; // 0x5Ayz - y = type; z = # of half word
-    uint16_t switches; // controller switches
-    union{
-      // light gun only (8MHz clock counter since hsync)
-      uint16_t x_pos; // if 0x0001 then error, check y_pos
-      struct{
-        uint8_t adc0; // right joy X
-        uint8_t adc1; // right joy Y
-      };
-    };
-    union{
-      //light gun only (scanlines since vsync
-      uint16_t y_pos; // if x_pos = 0x0001 && y_pos = 0x000A => not aimed at screen
-      struct{
-        uint8_t adc2; // left joy X
-        uint8_t adc3; // left joy Y
-      };
-    };
-  };
-};
-
-void clear_buff(uint8_t *p, uint8_t s){
-  uint8_t i;
-  for (i = 0; i < s; i++)
-    p[i] = 0;
-}
-
-// read 8 bytes -> 1 byte corresponding to bit b
-uint8_t convert_buff_to_byte(uint8_t *p, uint8_t b){
-  uint8_t i, retval;
-  for (i = 0, retval = 0; i < 8; i++){
-    if (p[i] & b)
-      retval |= _BV(i);
-  }
-  return retval;
+extern "C" {
+#include "../../../core/ps1_ctrl.h"
+#include "../../../core/ps1_combo.h"
+#include "../../../core/ps1_capture.h"
+#include "../../../core/ps1_reset.h"
 }
 
-uint8_t port[PORT_BUFF_SIZE]; // port buffer
-uint8_t bit_cnt; // bit counter
-
-union PS1_Ctrl_Data data;
-union PS1_Cmd cmd;
+// INT0 state in the general purpose I/O registers, in/out take 1 cycle
+// where lds/sts take 2, sbi/sbic/cbi work on GPIOR0
+#define bit_cnt GPIOR0 // bit counter in the low 3 bits, EE_x flags
+#define EE_BUSY _BV(6) // EE_READY is in ps1_capture_byte
+#define EE_LOST _BV(7) // a byte ended meanwhile, its bits are gone
+#define cmd_sr GPIOR1 // CMD and DATA shift registers, bits come in LSb first
+#define data_sr GPIOR2
+
+struct PS1_Port pads[PS1_PADS]; // combo held, per multitap slot
+uint16_t tick_ms; // last millis() the reset tick ran for
+uint8_t lost; // bytes INT0 finished while EE_READY still had the last one
+#if defined(DEBUG)
+uint8_t ee_max; // longest EE_READY, TMR2 ticks of 0.5 us
+#endif
 
 void setup() {
+  uint8_t i;
   // Set PORT to inputs and no pull-ups
   PS1_PORT_IO = 0;
   PS1_DIR_IO = 0;
 
+  ps1_capture_init();
+  for (i = 0; i < PS1_PADS; i++)
+    ps1_port_init(&pads[i]);
+  ps1_combo_load(0); // built-in combos
+  ps1_reset_init(REBOOT_DELAY); // armed once the bus is up
+  bit_cnt = 0;
+
   // ISR setup stuff
 
   EICRA |= 0x03; // ISC01-ISC00: The rising edge of INT0 generates an interrupt request. -> CLK
@@ -140,38 +75,79 @@ void setup() {
   // Select timer1 normal mode (timer overflow)
   TCCR1A = 0;
   TCCR1B = 2;
-  
+#if defined(DEBUG)
+  // timer2 free running at 2 MHz, times EE_READY
+  TCCR2A = 0;
+  TCCR2B = 2;
+#endif
+
   SREG |= 0x80; //  I: Global Interrupt Enable
 
   // -------
-  
+
   DDRB |= _BV(5);
   PORTB |= _BV(5);
   delay(1000); // LED on for 1000ms
   PORTB &= ~_BV(5);
-  
-  delay(REBOOT_DELAY); // wait 30 seconds after power up
+
 #if defined(DEBUG)
   Serial.begin(115200);
   Serial.println("PlayStation reset mod");
 #endif
-
-  // Clear buffer
-  clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE);
-  clear_buff(data.buff, PS1_CTRL_BUFF_SIZE);
-  clear_buff(port, PORT_BUFF_SIZE);
-  // Clear vars
-  bit_cnt = 0;
+  tick_ms = millis();
 }
 
 
 // ISR read on rising edge of PD2 using INT0
+// CMD and DATA are shifted straight into bytes. It calls nothing, so it
+// only saves the registers it uses and fits in a 4 us bit at 16 MHz
+// (host/bench.c counts it), the 8th bit hands the byte to EE_READY
 ISR(INT0_vect){
-  port[bit_cnt] = PS1_PIN_IO; // read port
-  bit_cnt++;
+  uint8_t p = PS1_PIN_IO; // read port once, CMD and DATA from the same edge
+
+  cmd_sr = PS1_SHIFT_IN(cmd_sr, p >> CMD & 1);
+  data_sr = PS1_SHIFT_IN(data_sr, p >> DATA & 1);
+  bit_cnt = (bit_cnt + 1) & (EE_BUSY | EE_LOST | 7); // flags stay, the count wraps at 8
+  if ((bit_cnt & 7) == 0){
+    // 8th bit, byte done: EE_READY runs once this returns. ps1_capture_byte
+    // isn't reentrant, if it's still on the last byte this one is lost
+    if (bit_cnt & EE_BUSY)
+      bit_cnt |= EE_LOST;
+    else
+      EECR |= _BV(EERIE);
+  }
+}
+
+// Byte done, raised by INT0: EE_READY fires while EERIE is set and no
+// EEPROM write is going on, there is none. Interrupts go back on once the
+// byte is read, the next byte's clock edges don't wait for the capture.
+// It has a byte to finish (40 us at 250 kHz), DEBUG prints the longest.
+ISR(EE_READY_vect){
+  uint8_t c = cmd_sr, d = data_sr;
+#if defined(DEBUG)
+  uint8_t t = TCNT2;
+#endif
+
+  EECR &= ~_BV(EERIE);
+  bit_cnt |= EE_BUSY;
+  sei();
+  ps1_capture_byte(c, d);
+  cli();
+  if (bit_cnt & EE_LOST){
+    lost++;
+    capture.cnt = PS1_CNT_WAIT; // a byte short, drop the transaction
+  }
+  bit_cnt &= ~(EE_BUSY | EE_LOST);
+  if (capture.cnt == PS1_CNT_WAIT)
+    EIMSK &= ~_BV(INT0); // rest of the transaction isn't needed, stop counting clocks
+#if defined(DEBUG)
+  t = TCNT2 - t;
+  if (t > ee_max)
+    ee_max = t;
+#endif
 }
 
-// ISR read on rising edge of PD3 using INT1
+// ISR read on falling edge of PD3 using INT1
 ISR(INT1_vect){
   TCNT1 = 65495; // OVF at 65536 (41 clock / 8 cycles)
   TIMSK1 |= _BV(TOIE1);
@@ -180,102 +156,54 @@ ISR(INT1_vect){
 // TMR1 interrupt is triggered when TMR1 overflows
 // Check if SS is low for long enough to start reading data, see extra SS pulse after controller data transfer
 ISR(TIMER1_OVF_vect){
+  if (bit_cnt & EE_BUSY){
+    TCNT1 = 65528; // EE_READY is in the capture, try again in 4 us
+    return;
+  }
+  TIMSK1 &= ~_BV(TOIE1); // disable timer interrupt
   if (!(PS1_PIN_IO & _BV(SS))){ // check if SS is still low
-    TIMSK1 &= ~_BV(TOIE1); // disable timer interrupt
+    bit_cnt = 0;
+    ps1_capture_start(0, (uint16_t)micros());
+    EIFR = _BV(INTF0); // forget clock edges of port 2 transactions
     EIMSK |= _BV(INT0); // enables external interrupt INT0
   }
 }
 
-void loop(){
-  if (bit_cnt >= PORT_BUFF_SIZE){
-    EIMSK &= ~_BV(INT0); // disable clk interrupt
-    EIMSK &= ~_BV(INT1); // disable ss interrupt
-
-    bit_cnt = 0;
-
-    // Convert PORT data to bytes
-    uint8_t i;
-    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-      cmd.buff[i] = convert_buff_to_byte(&port[i*8], _BV(CMD));
-      data.buff[i] = convert_buff_to_byte(&port[i*8], _BV(DATA));
-    }
+// Reset pulse and lockout, once for every ms gone by
+void tick(void){
+  uint16_t now = millis();
+  while (tick_ms != now){
+    tick_ms++;
+    if (ps1_reset_tick())
+      PS1_DIR_IO |= _BV(RESET); // output, logic low (PORT is already 0)
+    else
+      PS1_DIR_IO &= ~_BV(RESET); // back to input
+  }
+}
 
-#if defined(DEBUG)
-    Serial.print("PORT BUFF: ");
-    for (i = 0; i < PORT_BUFF_SIZE; i++){
-      Serial.print("0x");
-      Serial.print(port[i], HEX);
-      Serial.print(", ");
-    }
-    Serial.print("\nCMD: ");
-    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-      Serial.print(cmd.buff[i], HEX);
-      Serial.print(" ");
-    }
-    Serial.println("");
-      Serial.print("DATA: ");
-    for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-      Serial.print(data.buff[i], HEX);
-      Serial.print(" ");
-    }
-    Serial.println("");
-    Serial.println("Data done converting");
-#endif
+void loop(){
+  uint8_t action;
+  struct PS1_Frame *frame;
 
-    uint16_t key_combo = 0;
-    // Check first command for device selected
-    if (cmd.device_select == CMD_SEL_CTRL_1 && cmd.command == CMD_READ_SW){
-      // Check ID
-      switch(data.id){
-        case ID_GUNCON_CTRL:
-#if defined(DEBUG)
-          Serial.println("GUNCON found");
-          Serial.print("Switches = 0x");
-          Serial.println(data.switches, HEX);
-#endif
-          key_combo = KEY_COMBO_GUNCON;
-          break;
-        case ID_DIG_CTRL:
-        case ID_ANP_CTRL:
-#if defined(DEBUG)
-          Serial.println("Controller found");
-          Serial.print("Switches = 0x");
-          Serial.println(data.switches, HEX);
-#endif
-          key_combo = KEY_COMBO_CTRL;
-          break;
-        default:
+  tick();
+  while ((frame = ps1_capture_peek()) != 0){
+    action = ps1_decode(&pads[frame->pad], &frame->cmd, &frame->data, frame->stamp);
+    ps1_capture_release();
 #if defined(DEBUG)
-          Serial.print("Wrong data or unsupported device: ");
-          Serial.println(data.id, HEX);
+    if (action != PS1_ACT_NONE && reset.state == PS1_RST_IDLE)
+      Serial.println(action == PS1_ACT_SHORT ? "Short Reset" : "Long Reset");
 #endif
-          key_combo = 0;
-          break;
-      }
-  
-      // Check switch combo
-      if (key_combo != 0 && 0 == (data.switches ^ key_combo)){
-        // change RESET from input to output, logic low (PORT is already 0)
-        PS1_DIR_IO |= _BV(RESET);
-        DDRB |= _BV(5);
-        PORTB |= _BV(5);
+    ps1_reset_poll(action);
+  }
 #if defined(DEBUG)
-        Serial.println("PlayStation Resetting");
+  static uint8_t ee_shown, lost_shown;
+  if (ee_max != ee_shown || lost != lost_shown){
+    ee_shown = ee_max;
+    lost_shown = lost;
+    Serial.print("EE_READY max ");
+    Serial.print(ee_shown / 2);
+    Serial.print(" us, bytes lost ");
+    Serial.println(lost_shown);
+  }
 #endif
-        delay(1000); // hold reset for 100ms
-        // change RESET back to input
-        PS1_DIR_IO &= ~_BV(RESET);
-        PORTB &= ~_BV(5);
-        delay(REBOOT_DELAY); // wait 30 sec before next reset, this is to prevent multiple reset one after the other
-      }
-    }
-
-    clear_buff(data.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-    clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-    clear_buff(port, PORT_BUFF_SIZE); // clear PORT to remove all previous data and not get stuck in a reset loop if the controller is disconnected after a reset
-    
-    delay(50);
-
-    EIMSK |= _BV(INT1); // enable ss interrupt
-  } 
 }
@@ -0,0 +1,15 @@
+/*
+ * File:   ps1_core.c
+ * Author: pyroesp
+ *
+ * The protocol core for the sketch, built as C. The Arduino IDE only
+ * compiles what's in the sketch folder, so the sources are pulled in from
+ * ../../../core here. ps1_target.h picks the ATmega328P traits from the
+ * compiler's part macro.
+ */
+
+#include "../../../core/ps1_ctrl.c"
+#include "../../../core/ps1_combo.c"
+#include "../../../core/ps1_capture.c"
+#include "../../../core/ps1_card.c"
+#include "../../../core/ps1_reset.c"
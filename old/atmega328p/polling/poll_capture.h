@@ -0,0 +1,68 @@
+/*
+ * File:   poll_capture.h
+ * Author: pyroesp
+ *
+ * Edge sampling loop for the polling capture, AVR assembly
+ *
+ * Every bit is the same straight line code (the 8 bits of a byte are
+ * unrolled), so the cycle count doesn't depend on the compiler:
+ *   CLK high: sbic SS, sbiw, breq, sbic CLK, rjmp  8 cycles per turn,
+ *             leave on SS high
+ *   CLK low:  sbiw, breq, sbis CLK, rjmp           6 cycles per turn
+ *   rising:   in, 2x (bst, lsr, bld)   2 (skip) + 7 cycles
+ *   byte:     st X+, st Z+, 2x ldi, dec, breq, rjmp  10 cycles, in the /ACK gap
+ * CMD and DATA come in LSb first and are shifted in from the top, so the
+ * bytes are stored in PS1 bit order.
+ *
+ * Interrupts are off around it, so every wait counts down t, reloaded with
+ * POLL_TIMEOUT turns each byte: a bus stuck mid transaction (SS held low,
+ * CLK not toggling) leaves with t at 0 instead of hanging.
+ *
+ * host/avr_poll.c runs this string against the bus waveform with AVR
+ * cycle timings to check which bus clocks it keeps up with.
+ *
+ * Operands: %[pin] PINx, %[ss] %[clk] %[cmd] %[dat] bit numbers,
+ * %[c] %[d] %[p] scratch, %[n] bytes left, X cmd buffer, Z data buffer,
+ * %[t] turns left (16 bit, upper register pair), %[to] POLL_TIMEOUT.
+ */
+
+#ifndef POLL_CAPTURE_H
+#define POLL_CAPTURE_H
+
+#ifndef POLL_TIMEOUT
+#define POLL_TIMEOUT 4000 // wait turns per byte, 1.5 to 2 ms at 16 MHz, a byte and its /ACK are ~50 us
+#endif
+
+#define POLL_BIT \
+    "2:  sbic %[pin], %[ss]\n\t"   /* SS high, transaction over */ \
+    "    rjmp 9f\n\t" \
+    "    sbiw %A[t], 1\n\t"        /* timed out, t = 0 */ \
+    "    breq 9f\n\t" \
+    "    sbic %[pin], %[clk]\n\t"  /* wait for CLK low */ \
+    "    rjmp 2b\n\t" \
+    "3:  sbiw %A[t], 1\n\t" \
+    "    breq 9f\n\t" \
+    "    sbis %[pin], %[clk]\n\t"  /* wait for CLK high */ \
+    "    rjmp 3b\n\t" \
+    "    in   %[p], %[pin]\n\t"    /* rising edge, sample */ \
+    "    bst  %[p], %[cmd]\n\t" \
+    "    lsr  %[c]\n\t" \
+    "    bld  %[c], 7\n\t" \
+    "    bst  %[p], %[dat]\n\t" \
+    "    lsr  %[d]\n\t" \
+    "    bld  %[d], 7\n\t"
+
+#define POLL_CAPTURE_ASM \
+    "1:\n\t" \
+    POLL_BIT POLL_BIT POLL_BIT POLL_BIT \
+    POLL_BIT POLL_BIT POLL_BIT POLL_BIT \
+    "    st   X+, %[c]\n\t" \
+    "    st   Z+, %[d]\n\t" \
+    "    ldi  %A[t], lo8(%[to])\n\t" \
+    "    ldi  %B[t], hi8(%[to])\n\t" \
+    "    dec  %[n]\n\t" \
+    "    breq 9f\n\t" \
+    "    rjmp 1b\n\t" \
+    "9:\n\t"
+
+#endif
@@ -1,25 +1,36 @@
 /*
  * Arduino nano reset combo mod POC
  * --------------------------------
- * 
+ *
  * IO are setup on PORTB, but can be modified. See PS1_X_IO defines.
  * PB5 - SCK (input, connect to PS1 clock)
  * PB4 - CMD (input, connect to PS1 TX)
  * PB3 - DATA (input, connect to PS1 RX)
  * PB2 - /SS (input, connect to controller 1 select)
  * PB1 - playstation reset (output, connect to reset of parallel port (pin 2))
- * 
+ *
+ * Same protocol core as the PIC (../../../core, built by ps1_core.c): the
+ * loop samples every transaction up to a multitap poll, hands the bytes to
+ * the capture and decodes what it queued, millis() runs the 1 ms reset tick.
  */
 
 //#define DEBUG
 
+/* Capture backend
+ * POLL_ASM: hand written edge sampling loop (poll_capture.h), fixed cycle
+ *           count per bit, keeps up with a 750 kHz bus at 16 MHz
+ *           (host/avr_poll.c), the PS1 runs it at 250 kHz
+ * otherwise: plain C loop, for MCUs the assembly doesn't fit
+*/
+#define POLL_ASM
+
 #if defined(DEBUG)
   #define REBOOT_DELAY 1000
 #else
   #define REBOOT_DELAY 30000
 #endif
 
- 
+
 #define PS1_PIN_IO PINB // IO pin reg used for SS, CMD, DATA and RESET
 #define PS1_PORT_IO PORTB // IO port reg used for SS, CMD, DATA and RESET
 #define PS1_DIR_IO DDRB // IO dir reg used for SS, CMD, DATA and RESET
@@ -29,198 +40,129 @@
 #define DATA 3
 #define RESET 1
 
- /* Controller ID */
-#define ID_DIG_CTRL 0x5A41 // digital
-#define ID_ANP_CTRL 0x5A73 // analog/pad
-#define ID_ANS_CTRL 0x5A53 // analog/stick
-#define ID_GUNCON_CTRL 0x5A63 // light gun
-
-/* PlayStation Commands */
-#define CMD_SEL_CTRL_1 0x01 // select controller 1
-#define CMD_SEL_MEMC_1 0x81 // select memory card 1
-#define CMD_READ_SW 0x42 // read switch status from controller
-
-#define PS1_CTRL_BUFF_SIZE 9 // max size of buffer needed for a controller
-
-/* Key Combo */
-#define KEY_COMBO_CTRL 0xFCF6 // select-start-L2-R2 1111 1100 1111 0110
-#define KEY_COMBO_GUNCON 0x9FF7 // A-trigger-B 1001 1111 1111 0111 
-
-/* Key stuff */
-#define KEY_PRESSED 0
-#define KEY_RELEASED 1
-enum Keys{
-  SELECT,
-  L3,
-  R3,
-  START, // light gun A
-  UP,
-  RIGHT,
-  DOWN,
-  LEFT,
-  L2,
-  R2,
-  L1,
-  R1,
-  TRIANGLE,
-  CIRCLE, // light gun trigger
-  CROSS, // light gun B
-  SQUARE
-};
-
-/* PlayStation Controller Command Union */
-union PS1_Cmd{
-  uint8_t buff[PS1_CTRL_BUFF_SIZE];
-  struct{
-    uint8_t device_select; // 0x01 or 0x81
-    uint8_t command; // 0x42 for read switch
-    uint8_t unused[PS1_CTRL_BUFF_SIZE-2]; // always 0 for controller
-  };
-};
-
-/* PlayStation Controller Data Union */
-union PS1_Ctrl_Data{
-  uint8_t buff[PS1_CTRL_BUFF_SIZE]; // buffer to read data
-  struct{
-    uint8_t unused; // always 0xFF
-    uint16_t id; // 0x5Ayz - y = type; z = # of half word
-    uint16_t switches; // controller switches
-    union{
-      // light gun only (8MHz clock counter since hsync)
-      uint16_t x_pos; // if 0x0001 then error, check y_pos
-      struct{
-        uint8_t adc0; // right joy X
-        uint8_t adc1; // right joy Y
-      };
-    };
-    union{
-      //light gun only (scanlines since vsync
-      uint16_t y_pos; // if x_pos = 0x0001 && y_pos = 0x000A => not aimed at screen
-      struct{
-        uint8_t adc2; // left joy X
-        uint8_t adc3; // left joy Y
-      };
-    };
-  };
-};
-
-
-void clear_buff(uint8_t *p, uint8_t s){
-  uint8_t i;
-  for (i = 0; i < s; i++)
-    p[i] = 0;
+extern "C" {
+#include "../../../core/ps1_ctrl.h"
+#include "../../../core/ps1_combo.h"
+#include "../../../core/ps1_capture.h"
+#include "../../../core/ps1_reset.h"
 }
 
-uint8_t convert_buff_to_byte(uint8_t *p, uint8_t b){
-  uint8_t i, retval;
-  for (i = 0, retval = 0; i < 8; i++){
-    if (p[i] & b)
-      retval |= _BV(i);
+#include "poll_capture.h"
+
+// Longest frame the core takes, a multitap poll: 4 slots of ID, switches and
+// analog. Only memory card transactions are longer, the card tracker needs
+// their first 4 bytes (a write's end status is cut off, card.failed counts it)
+#define POLL_BUFF_SIZE MTAP_LEN
+
+uint8_t cmd_buf[POLL_BUFF_SIZE], data_buf[POLL_BUFF_SIZE];
+struct PS1_Port pads[PS1_PADS]; // combo held, per multitap slot
+uint16_t tick_ms; // last millis() the reset tick ran for
+uint16_t stuck; // transactions the capture timed out of, SS low and no clock
+
+// Sample one transaction into cmd_buf and data_buf, call with SS just gone low
+// Returns the number of complete bytes, stops at POLL_BUFF_SIZE, SS high or
+// POLL_TIMEOUT turns without a clock edge
+// A multitap poll keeps interrupts off ~1.5 ms, millis() can lose a ms to it
+uint8_t sample(void){
+  uint8_t n = POLL_BUFF_SIZE;
+  uint16_t t = POLL_TIMEOUT;
+  uint8_t sreg = SREG;
+  cli(); // no timer interrupt in the middle of a bit
+#if defined(POLL_ASM)
+  uint8_t c, d, p;
+  uint8_t *pc = cmd_buf, *pd = data_buf;
+  asm volatile(POLL_CAPTURE_ASM
+    : [c] "=&r" (c), [d] "=&r" (d), [p] "=&r" (p), [n] "+r" (n), [t] "+w" (t), "+x" (pc), "+z" (pd)
+    : [pin] "I" (_SFR_IO_ADDR(PS1_PIN_IO)), [ss] "I" (SS), [clk] "I" (CLK),
+      [cmd] "I" (CMD), [dat] "I" (DATA), [to] "n" (POLL_TIMEOUT)
+    : "memory");
+#else
+  uint8_t i, b, c, d, p;
+  for (i = 0; i < POLL_BUFF_SIZE; i++, n--){
+    for (b = 0; b < 8; b++){
+      do{
+        if (PS1_PIN_IO & _BV(SS) || !--t) // transaction over, or stuck
+          goto done;
+      }while (PS1_PIN_IO & _BV(CLK)); // wait for CLK low
+      while (!((p = PS1_PIN_IO) & _BV(CLK))) // wait for CLK high
+        if (!--t)
+          goto done;
+      c = (c >> 1) | (p & _BV(CMD) ? 0x80 : 0); // LSb first
+      d = (d >> 1) | (p & _BV(DATA) ? 0x80 : 0);
+    }
+    cmd_buf[i] = c;
+    data_buf[i] = d;
+    t = POLL_TIMEOUT;
   }
-  return retval;
+done:
+#endif
+  SREG = sreg;
+  if (!t)
+    stuck++; // the bytes so far still go in, the next select counts the cut
+  return POLL_BUFF_SIZE - n;
 }
 
-#define PORT_BUFF_SIZE 72 // (8 * PS1_CTRL_BUFF_SIZE)
-uint8_t port[PORT_BUFF_SIZE]; // port buffer
-uint8_t bit_cnt; // bit counter
-
-union PS1_Ctrl_Data data;
-union PS1_Cmd cmd;
+// Reset pulse and lockout, once for every ms gone by
+void tick(void){
+  uint16_t now = millis();
+  while (tick_ms != now){
+    tick_ms++;
+    if (ps1_reset_tick())
+      PS1_DIR_IO |= _BV(RESET); // output, logic low (PORT is already 0)
+    else
+      PS1_DIR_IO &= ~_BV(RESET); // back to input
+  }
+}
 
 void setup() {
+  uint8_t i;
   // Set PORT to inputs and no pull-ups
   PS1_PORT_IO = 0;
   PS1_DIR_IO = 0;
-  
-  delay(REBOOT_DELAY); // wait 30 seconds after power up
+
 #if defined(DEBUG)
   Serial.begin(115200);
   Serial.println("PlayStation reset mod");
 #endif
 
-  // Clear buffer
-  clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE);
-  clear_buff(data.buff, PS1_CTRL_BUFF_SIZE);
-  clear_buff(port, PORT_BUFF_SIZE);
-  // Clear vars
-  bit_cnt = 0;
+  ps1_capture_init();
+  for (i = 0; i < PS1_PADS; i++)
+    ps1_port_init(&pads[i]);
+  ps1_combo_load(0); // built-in combos
+  ps1_reset_init(REBOOT_DELAY); // armed once the bus is up
+  tick_ms = millis();
 }
 
 void loop() {
-  delay(50); // delay so you're not constantly reading data
-  while (!(PS1_PIN_IO & _BV(SS))); // if data is currently being sent, wait for it to finish
-  
-  bit_cnt = 0;
-  while (PS1_PIN_IO & _BV(SS)); // wait while there's no data incoming
-
-  uint8_t clk, prev_clk;
-  clk = PS1_PIN_IO & _BV(CLK);
-  prev_clk = clk;
-  while (!(PS1_PIN_IO & _BV(SS))){ // loop while SS is low
-    clk = PS1_PIN_IO & _BV(CLK); // read clock input
-    if (!prev_clk && clk){ // check for rising edge
-      port[bit_cnt] = PS1_PIN_IO; // read port
-      ++bit_cnt;
-      if (bit_cnt >= PORT_BUFF_SIZE) // if all bits read, exit loop
-        break;
-    }
-    prev_clk = clk;
-  }
-  
-  // convert port buffer bits to byte
-  uint8_t i, j;
-  for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-    cmd.buff[i] = convert_buff_to_byte(&port[i*8], _BV(CMD));
-    data.buff[i] = convert_buff_to_byte(&port[i*8], _BV(DATA));
-  }
-  
-  uint16_t key_combo = 0;
-  // Check first command for device selected
-  if (cmd.device_select == CMD_SEL_CTRL_1 && cmd.command == CMD_READ_SW){
-    // Check ID
-    switch(data.id){
-      case ID_GUNCON_CTRL:
-#if defined(DEBUG)
-        Serial.println("GUNCON found");
-        Serial.print("Switches = 0x");
-        Serial.println(data.switches, HEX);
-#endif
-        key_combo = KEY_COMBO_GUNCON;
-        break;
-      case ID_DIG_CTRL:
-      case ID_ANP_CTRL:
-      case ID_ANS_CTRL:
-#if defined(DEBUG)
-        Serial.println("Controller found");
-        Serial.print("Switches = 0x");
-        Serial.println(data.switches, HEX);
-#endif
-        key_combo = KEY_COMBO_CTRL;
-        break;
-      default:
+  uint8_t i, len, action;
+  struct PS1_Frame *frame;
+
+  while (!(PS1_PIN_IO & _BV(SS))) // if data is currently being sent, wait for it to finish
+    tick();
+  while (PS1_PIN_IO & _BV(SS)) // wait while there's no data incoming
+    tick(); // a reset tick right on the SS edge can cost that transaction, the hold rides it out
+
+  // bytes are in PS1 bit order, the same as wire order for this target
+  len = sample();
+  ps1_capture_start(0, (uint16_t)micros()); // after the bytes, capture can't wait
+  for (i = 0; i < len; i++)
+    ps1_capture_byte(cmd_buf[i], data_buf[i]);
+
+  while ((frame = ps1_capture_peek()) != 0){
+    action = ps1_decode(&pads[frame->pad], &frame->cmd, &frame->data, frame->stamp);
+    ps1_capture_release();
 #if defined(DEBUG)
-        Serial.print("Wrong data or unsupported device: ");
-        Serial.println(data.id, HEX);
+    if (action != PS1_ACT_NONE && reset.state == PS1_RST_IDLE)
+      Serial.println(action == PS1_ACT_SHORT ? "Short Reset" : "Long Reset");
 #endif
-        key_combo = 0;
-        break;
-    }
-
-    // Check switch combo
-    if (key_combo != 0 && 0 == (data.switches ^ key_combo)){
-      // change RESET from input to output, logic low (PORT is already 0)
-      PS1_DIR_IO |= _BV(RESET);
+    ps1_reset_poll(action);
+  }
 #if defined(DEBUG)
-      Serial.println("PlayStation Resetting");
-#endif
-      delay(100); // hold reset for 100ms
-      // change RESET back to input
-      PS1_DIR_IO &= ~_BV(RESET);
-      delay(REBOOT_DELAY); // wait 30 sec before next reset, this is to prevent multiple reset one after the other
-    }
-    
-    clear_buff(data.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-    clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-    clear_buff(port, PORT_BUFF_SIZE); // clear PORT to remove all previous data and not get stuck in a reset loop if the controller is disconnected after a reset
+  static uint16_t stuck_shown;
+  if (stuck != stuck_shown){
+    stuck_shown = stuck;
+    Serial.print("Capture timed out: ");
+    Serial.println(stuck);
   }
+#endif
 }
@@ -1,246 +1,149 @@
 /*
  * Created: 21/08/2019 21:03:29
  * Author : pyroesp
- 
+
  * MCU 328PB : 2xSPI
  *		- 16MHz
- */ 
+ *
+ * Same protocol core as the PIC (../../core, add the ps1_*.c files to the
+ * project and core to the include path), ps1_hal.h has the registers.
+ * SPI1 interrupt: one CMD/DATA byte pair into ps1_capture_byte
+ * PCINT0 (SS0 falling): ps1_capture_start
+ * TIMER0 compare, 1 ms: reset pulse and lockout (ps1_reset_tick)
+ * The main loop decodes the queued frames.
+ */
 
 
 #include <avr/io.h>
-#include <avr/iom328pb.h>
 #include <avr/interrupt.h>
 
 #define  F_CPU 16000000L
-#include <util/delay.h>
-
-#define REBOOT_DELAY 30000 // 30 seconds
-
-#define PS1_PIN_IO PIND // IO pin reg used for SS, CMD, DATA and RESET
-#define PS1_PORT_IO PORTD // IO port reg used for SS, CMD, DATA and RESET
-#define PS1_DIR_IO DDRD // IO dir reg used for SS, CMD, DATA and RESET
-#define RESET 6 // Only IO that outputs a logic 0
-
-/* Controller ID */
-#define ID_DIG_CTRL 0x5A41 // digital
-#define ID_ANP_CTRL 0x5A73 // analog/pad
-#define ID_GUNCON_CTRL 0x5A63 // light gun
-
-/* PlayStation Commands */
-#define CMD_SEL_CTRL_1 0x01 // select controller 1
-#define CMD_SEL_MEMC_1 0x81 // select memory card 1
-#define CMD_READ_SW 0x42 // read switch status from controller
-
-/* PlayStation Buff Size */
-#define PS1_CTRL_BUFF_SIZE 9 // max size of buffer needed for a controller
-
-/* Key Combo */
-#define KEY_COMBO_CTRL 0xFCF6 // select-start-L2-R2 1111 1100 1111 0110
-#define KEY_COMBO_GUNCON 0x9FF7 // A-trigger-B 1001 1111 1111 0111
-
-/* PlayStation Controller Command Union */
-union PS1_Cmd{
-	uint8_t buff[PS1_CTRL_BUFF_SIZE];
-	struct{
-		uint8_t device_select; // 0x01 or 0x81
-		uint8_t command; // 0x42 for read switch
-		uint8_t unused[PS1_CTRL_BUFF_SIZE-2]; // always 0 for controller
-	};
-};
-
-/* PlayStation Controller Data Union */
-union PS1_Ctrl_Data{
-	uint8_t buff[PS1_CTRL_BUFF_SIZE]; // buffer to read data
-	struct{
-		uint8_t unused; // always 0xFF
-		uint16_t id; // 0x5Ayz - y = type; z = # of half word
-		uint16_t switches; // controller switches
-		union{
-			// light gun only (8MHz clock counter since hsync)
-			uint16_t x_pos; // if 0x0001 then error, check y_pos
-			struct{
-				uint8_t adc0; // right joy X
-				uint8_t adc1; // right joy Y
-			};
-		};
-		union{
-			//light gun only (scanlines since vsync)
-			uint16_t y_pos; // if x_pos = 0x0001 && y_pos = 0x000A => not aimed at screen
-			struct{
-				uint8_t adc2; // left joy X
-				uint8_t adc3; // left joy Y
-			};
-		};
-	};
-};
-
-void clear_buff(uint8_t *p, uint8_t s);
-
-volatile union PS1_Cmd cmd;
-volatile union PS1_Ctrl_Data data;
-volatile uint8_t cmd_cnt, data_cnt;
-
-// SPI0 interrupt cmd
-ISR(SPI0_STC_vect){
-	cmd.buff[cmd_cnt] = SPDR0 ^ 0xFF;
-	cmd_cnt++;
-}
 
-// SPI1 interrupt data
-ISR(SPI1_STC_vect){
-	data.buff[data_cnt] = SPDR1 ^ 0xFF;
-	data_cnt++;
-}
+#include "ps1_hal.h"
+#include "ps1_ctrl.h"
+#include "ps1_combo.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_card.h"
 
-/*
-ISR(TIMER1_OVF_vect){
-	PORTB ^= _BV(PORTB0);	
-	TCNT1 = 65495; // OVF at 65536 (41 clock/8 cycles)
-}
-*/
+/* Uncomment the define below to print the resets on the USART, 9600 baud */
+//#define DEBUG
 
+#define REBOOT_DELAY 30000 // ms, lockout after power up and after a reset
+
+#ifdef DEBUG
 #define BAUD 9600
 #define MYUBRR F_CPU/16/BAUD-1
 
-void USART_Init(unsigned int ubrr){   
-	/*Set baud rate */   
-	UBRR0 = ubrr;  
-	/* Enable receiver and transmitter */   
-	UCSR0B = (1<<TXEN0);   
-	/* Set frame format: 8data, 1stop bit */ 
-	UCSR0C = (3<<UCSZ00);
-}
+void USART_Init(unsigned int ubrr);
+void USART_print(const char *data);
+#else
+#define USART_Init(a) ((void)0)
+#define USART_print(a) ((void)0)
+#endif
 
-void USART_Transmit(unsigned char data ){   
-	/* Wait for empty transmit buffer */   
-	while ( !( UCSR0A & (1<<UDRE0)) );   
-	/* Put data into buffer, sends the data */   
-	UDR0 = data;
+// SPI1 interrupt, DATA and the CMD byte clocked in alongside
+ISR(SPI1_STC_vect){
+	ps1_capture_byte(HAL_CMD_READ(), HAL_DATA_READ());
 }
 
-void USART_print(unsigned char *data){
-	int i;
-	for (i = 0; data[i] != 0; i++)
-		USART_Transmit(data[i]);
+// SS0 changed, a falling edge starts a transaction
+ISR(PCINT0_vect){
+	if (HAL_SS_LOW())
+		ps1_capture_start(0, HAL_TIMER_NOW());
 }
 
-void USART_printByte(unsigned char byte){
-	char map[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-	USART_print("0x");
-	USART_Transmit(map[byte >> 4]);
-	USART_Transmit(map[byte & 0xF]);
+// 1 ms tick, reset pulse and lockout
+ISR(TIMER0_COMPA_vect){
+	if (ps1_reset_tick())
+		HAL_RESET_ASSERT(); // output, logic low (PORT is already 0)
+	else
+		HAL_RESET_RELEASE(); // back to input
 }
 
 int main(void){
-	int i;
+	uint8_t action, i;
+	struct PS1_Frame *frame;
+	struct PS1_Port pads[PS1_PADS]; // combo held, per multitap slot
+
 	// PORT REG
 	PS1_DIR_IO = 0;
 	PS1_PORT_IO = 0;
-	
-	// Setup IO
+
+	// Setup IO, the mod only listens: every SPI pin is an input, MISO too
 	DDRE &= ~(_BV(DDRE3) | _BV(DDRE2)); // MOSI1 & SS1 set to inputs
-	DDRC &= ~_BV(DDRC0); // SCK1 set to inputs
-	DDRC |= _BV(DDRC1); // MISO1 set as output
-	DDRB &= ~(_BV(DDRB2) | _BV(DDRB3) | _BV(DDRB5)); // set MOSI0, SCK0, SS0 to input
-	DDRB |= _BV(DDRB4); // set MISO0 to output
-	
-	DDRB |= _BV(PORTB0);
-	
+	DDRC &= ~(_BV(DDRC0) | _BV(DDRC1)); // MISO1 & SCK1 set to inputs
+	DDRB &= ~(_BV(DDRB2) | _BV(DDRB3) | _BV(DDRB4) | _BV(DDRB5)); // SS0, MOSI0, MISO0, SCK0 set to inputs
+
 	USART_Init(MYUBRR);
-	
-	// INTERRUPT REG
-	
-	// Select timer1 normal mode (timer overflow)
-	//TCCR1A = 0;
-	//TCCR1B = 2;
-	//TIMSK1 |= _BV(TOIE1);
-	//TCNT1 = 65495; // OVF at 65536 (41 clock/8 cycles)
-	
-	SPCR0 |= _BV(SPIE); // enable SPI0 interrupt
-	SPCR0 |= _BV(SPE); // enable SPI0
-	SPCR0 |= _BV(DORD); // data order LSB
-	SPCR0 |= _BV(CPOL); // CLK idle when high
-	
-	SPCR1 |= _BV(SPIE1); // enable SPI1 interrupt
-	SPCR1 |= _BV(SPE1); // enable SPI1
-	SPCR1 |= _BV(DORD1); // data order LSB
-	SPCR1 |= _BV(CPOL1); // CLK idle when high
-	
+	USART_print("PlayStation 1 mod\r\n");
+
+	// SPI0 CMD, SPI1 DATA: slave, LSb first, mode 3
+	SPCR0 = _BV(SPE) | _BV(DORD) | _BV(CPOL) | _BV(CPHA); // no interrupt, read in SPI1's
+	SPCR1 = _BV(SPIE1) | _BV(SPE1) | _BV(DORD1) | _BV(CPOL1) | _BV(CPHA1);
+
+	// TIMER1, free running 250kHz time base for transaction timestamps
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11) | _BV(CS10); // 1:64
+
+	// TIMER0, 1 ms tick: 16MHz / 64 / (249 + 1)
+	TCCR0A = _BV(WGM01); // CTC
+	TCCR0B = _BV(CS01) | _BV(CS00); // 1:64
+	OCR0A = 249;
+	TIMSK0 = _BV(OCIE0A);
+
+	// SS0 edge, pin change
+	PCMSK0 = _BV(PCINT2);
+	PCICR = _BV(PCIE0);
+
+	// SETUP variables and arrays
+	ps1_capture_init();
+	for (i = 0; i < PS1_PADS; i++)
+		ps1_port_init(&pads[i]);
+	if (ps1_combo_load(hal_eeprom_read) == COMBO_SRC_EEPROM)
+		USART_print("EEPROM combos\r\n");
+	ps1_reset_init(REBOOT_DELAY); // armed once the bus is up, 30 sec at most
+
 	sei(); // enable global interrupt
-	
-	data_cnt = 0;
-	cmd_cnt = 0;
-	clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE);
-	clear_buff(data.buff, PS1_CTRL_BUFF_SIZE);
-	
-	_delay_ms(REBOOT_DELAY); // wait 30 sec before next reset, this is to prevent multiple reset one after the other
-	
+
 	// MAIN LOOP
-    for(;;){		
-		if (data_cnt >= PS1_CTRL_BUFF_SIZE || cmd_cnt >= PS1_CTRL_BUFF_SIZE){
-			SPCR0 &= ~_BV(SPE); // disable SPI0 
-			SPCR1 &= ~_BV(SPE1); // disable SPI1 
-			
-			USART_print("CMD: ");
-			for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-				USART_printByte(cmd.buff[i]);
-				USART_print(" ");
-			}
-			USART_print("\r\n");
-			
-			USART_print("DATA: ");
-			for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-				USART_printByte(data.buff[i]);
-				USART_print(" ");
-			}
-			USART_print("\r\n");
-			USART_print("-------------------------------\r\n");
-			
-			uint16_t key_combo = 0;
-			// Check first command for device selected
-			if (cmd.device_select == CMD_SEL_CTRL_1 && cmd.command == CMD_READ_SW){
-				// Check ID
-				switch(data.id){
-					case ID_GUNCON_CTRL:
-						key_combo = KEY_COMBO_GUNCON;
-						break;
-					case ID_DIG_CTRL:
-					case ID_ANP_CTRL:
-						key_combo = KEY_COMBO_CTRL;
-						break;
-					default:
-						key_combo = 0;
-						break;
-				}
-		
-				// Check switch combo
-				if (key_combo != 0 && 0 == (data.switches ^ key_combo)){
-					// change RESET from input to output, logic low (PORT is already 0)
-					PS1_DIR_IO |= _BV(RESET);
-					USART_print("Resetting PlayStation\r\n");
-					USART_print("-------------------------------\r\n");
-					_delay_ms(100); // hold reset for 100ms
-					// change RESET back to input
-					PS1_DIR_IO &= ~_BV(RESET);
-					_delay_ms(REBOOT_DELAY); // wait 30 sec before next reset, this is to prevent multiple reset one after the other
-				}
-			}
-
-			clear_buff(data.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-			clear_buff(cmd.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-	
-			data_cnt = 0;
-			cmd_cnt = 0;
-	
-			_delay_ms(50);
-			SPCR0 |= _BV(SPE); // enable SPI0 interrupt
-			SPCR1 |= _BV(SPE1); // enable SPI1 interrupt
+	for(;;){
+		// Decode the oldest complete frame, capture keeps running meanwhile
+		frame = ps1_capture_peek();
+		if (frame){
+			action = ps1_decode(&pads[frame->pad], &frame->cmd, &frame->data, frame->stamp);
+			ps1_capture_release(); // hand the frame back to the ISR
+
+			if (action != PS1_ACT_NONE && reset.state == PS1_RST_IDLE)
+				USART_print(card.idle_ms < CARD_IDLE_MS ? "Reset after save\r\n" :
+					action == PS1_ACT_SHORT ? "Short Reset\r\n" : "Long Reset\r\n");
+			HAL_TICK_MASK(); // the tick takes reset.poll and clears it
+			ps1_reset_poll(action);
+			HAL_TICK_UNMASK();
 		}
-    }
+	}
+}
+
+#ifdef DEBUG
+void USART_Init(unsigned int ubrr){
+	/*Set baud rate */
+	UBRR0 = ubrr;
+	/* Enable receiver and transmitter */
+	UCSR0B = (1<<TXEN0);
+	/* Set frame format: 8data, 1stop bit */
+	UCSR0C = (3<<UCSZ00);
+}
+
+void USART_Transmit(unsigned char data ){
+	/* Wait for empty transmit buffer */
+	while ( !( UCSR0A & (1<<UDRE0)) );
+	/* Put data into buffer, sends the data */
+	UDR0 = data;
 }
 
-void clear_buff(uint8_t *p, uint8_t s){
-	uint8_t i;
-	for (i = 0; i < s; i++)
-		p[i] = 0;
+void USART_print(const char *data){
+	int i;
+	for (i = 0; data[i] != 0; i++)
+		USART_Transmit(data[i]);
 }
+#endif
@@ -0,0 +1,52 @@
+/*
+ * File:   ps1_hal.h
+ * Author: pyroesp
+ *
+ * Register access for the ATmega328PB, kept out of the protocol core.
+ * Include after <avr/io.h>.
+ *
+ * SPI0 gets CMD, SPI1 gets DATA, both slaves on the PS1 clock, LSb first
+ * (DORD), so bytes land in PS1 order (PS1_LSB_FIRST in ps1_target.h).
+ * Mode 3: CLK idles high and the bit is sampled on the rising edge, like
+ * the controller does.
+ */
+
+#ifndef PS1_HAL_H
+#define PS1_HAL_H
+
+#include <avr/eeprom.h>
+
+/* Reset port */
+#define PS1_DIR_IO DDRD // IO dir reg used for RESET
+#define PS1_PORT_IO PORTD // IO port reg used for RESET
+#define PS1_RESET 6 // Only IO that outputs a logic 0
+
+/* RESET is open drain: output low to reset, input to release */
+#define HAL_RESET_ASSERT() (PS1_DIR_IO |= _BV(PS1_RESET))
+#define HAL_RESET_RELEASE() (PS1_DIR_IO &= ~_BV(PS1_RESET))
+
+/* SPI1 receives DATA (controller -> PS1), its interrupt reads both */
+#define HAL_DATA_READ() (SPDR1)
+
+/* SPI0 receives CMD (PS1 -> controller), SPSR0 then SPDR0 clears SPIF0 */
+#define HAL_CMD_READ() ((void)SPSR0, SPDR0)
+
+/* SS0 (PB2, PCINT2) low, SS1 (PE2) is wired to the same SEL */
+#define HAL_SS_LOW() (!(PINB & _BV(PINB2)))
+
+/* TIMER1 runs free at 16MHz / 64 = 250kHz, 4 us per count: shifted up to
+ * the 1MHz time base of the core, it wraps at 65536 us the same way.
+ * Only read from interrupts, which don't nest, so TEMP is safe */
+#define HAL_TIMER_NOW() ((uint16_t)(TCNT1 << 2))
+
+/* TIMER0 1 ms tick, masked while the main loop posts a poll
+ * (ps1_reset_poll), it runs as soon as it's back on */
+#define HAL_TICK_MASK() (TIMSK0 &= ~_BV(OCIE0A))
+#define HAL_TICK_UNMASK() (TIMSK0 |= _BV(OCIE0A))
+
+/* Data EEPROM byte, combo table for ps1_combo_load */
+static inline uint8_t hal_eeprom_read(uint8_t addr){
+    return eeprom_read_byte((const uint8_t *)(uint16_t)addr);
+}
+
+#endif
@@ -7,7 +7,9 @@
  * Created on September 21, 2019, 5:33 PM
  
  Connection:
-    RA2 = SS
+    RA2 = SS (port 1 SEL)
+    RA4 = port 2 SEL (PORT2 only)
+    RA5 = SEL1 AND SEL2 from CLC1, SS of the MSSPs (PORT2 only, leave open)
     RC0 = CLK
     RC1 = DATA
     RC2 = CMD
@@ -26,7 +28,7 @@
 // CONFIG2
 #pragma config MCLRE = ON       // Master Clear Enable bit (MCLR/VPP pin function is MCLR; Weak pull-up enabled)
 #pragma config PWRTE = OFF      // Power-up Timer Enable bit (PWRT disabled)
-#pragma config WDTE = OFF       // Watchdog Timer Enable bits (WDT disabled; SWDTEN is ignored)
+#pragma config WDTE = SWDTEN    // Watchdog Timer Enable bits (WDT controlled by the SWDTEN bit in the WDTCON register)
 #pragma config LPBOREN = OFF    // Low-power BOR enable bit (ULPBOR disabled)
 #pragma config BOREN = OFF      // Brown-out Reset Enable bits (Brown-out Reset disabled)
 #pragma config BORV = LOW       // Brown-out Reset Voltage selection bit (Brown-out voltage (Vbor) set to 2.45V)
@@ -45,156 +47,210 @@
 // #pragma config statements should precede project file includes.
 // Use project enums instead of #define for ON and OFF.
 
-#define _XTAL_FREQ 32000000
+/* Core clock: 32, 16 or 8 MHz. The HFINTOSC PLL runs at 32 MHz and is
+ * divided down at boot (NDIV, CSWEN is on), TMR1 and TMR2 are set up for
+ * the same 1 MHz time base and 1 ms tick whatever the clock.
+ * ps1_busgen -l shows what's left between bytes at each. */
+#define FOSC_MHZ 32
+
+#define _XTAL_FREQ (FOSC_MHZ * 1000000ul)
+
+#if FOSC_MHZ == 32
+#define OSC_NDIV 0 // 1:1
+#define TMR1_CKPS 3 // 8MHz / 8
+#define TMR2_CKPS 3 // 8MHz / 64 / (124 + 1)
+#define TMR2_PR 124
+#elif FOSC_MHZ == 16
+#define OSC_NDIV 1 // 1:2
+#define TMR1_CKPS 2 // 4MHz / 4
+#define TMR2_CKPS 2 // 4MHz / 16 / (249 + 1)
+#define TMR2_PR 249
+#elif FOSC_MHZ == 8
+#define OSC_NDIV 2 // 1:4
+#define TMR1_CKPS 1 // 2MHz / 2
+#define TMR2_CKPS 2 // 2MHz / 16 / (124 + 1)
+#define TMR2_PR 124
+#else
+#error "FOSC_MHZ: 32, 16 or 8"
+#endif
 
 #include <xc.h>
 #include <stdint.h>
 
-#define _BV(b) (1<<(b))
-
-/* Uncomment the define below to have UART TX debugging on RC3 */
+#include "ps1_hal.h"
+#include "ps1_ctrl.h"
+#include "ps1_combo.h"
+#include "ps1_capture.h"
+#include "ps1_reset.h"
+#include "ps1_card.h"
+#include "ps1_trace.h"
+#include "ps1_stats.h"
+#include "ps1_journal.h"
+#include "ps1_guard.h"
+
+/* Uncomment the define below to have UART TX debugging on RC3
+ * 500000 baud, binary records, decode with host/trace_decode.c
+ * With PS1_STATS defined in the project (-DPS1_STATS) as well, any byte
+ * received on RC4 sends back a snapshot of the counters */
 //#define DEBUG
 
+/* Uncomment the define below when SEL of controller port 2 is wired to RA4
+ * Pads on both ports, and behind a multitap on either, can reset then */
+//#define PORT2
+
+/* Uncomment the define below to time transactions in hardware
+ * CCP1 stamps the SS falling edge, TMR3 times SS low and TMR5 counts the
+ * SCK edges in it, both gated by SS. One interrupt per transaction, on SS
+ * going high, hands them to ps1_capture_end. Uses CCP1, TMR3 and TMR5. */
+//#define HW_TIMING
+
+/* Uncomment the define below to keep a journal of the last transactions
+ * and reset decisions in RAM (ps1_journal.h, ~390 bytes, JOURNAL_SIZE).
+ * With DEBUG it's sent on the UART when a reset is decided and when 'J'
+ * is received on RC4. With JOURNAL_NVM as well, the reset decision saves
+ * it to data EEPROM instead (JOURNAL_NVM_ADDR, the last ~150 bytes of
+ * records, ~4 ms a byte), it's still there after a power cycle: read the
+ * EEPROM back with the programmer. host/journal_decode.c prints either. */
+//#define JOURNAL
+//#define JOURNAL_NVM
+
+/* Uncomment the define below to idle the core between transactions
+ * The main loop goes to IDLE when the queue is empty, the MSSP, IOC and
+ * TMR2 interrupts wake it. The bus is quiet ~99% of a frame. */
+//#define LOW_POWER
+
 #ifdef DEBUG
 #define REBOOT_DELAY 2 // s
 #else
 #define REBOOT_DELAY 20 // s
 #endif
 
-#define SHORT_DELAY 500 // ms
-#define LONG_DELAY 2 // s
-
-/* Reset port */
-#define PS1_LAT_IO LATC // IO port reg used for RESET
-#define PS1_TRIS_IO TRISC // IO dir reg used for RESET
-#define PS1_RESET 5 // Only IO that outputs a logic 0
-
-/* Controller ID */
-#define ID_DIG_CTRL 0x5A41 // digital: SCPH-1080 (EU)
-#define ID_ANP_CTRL 0x5A73 // analog/pad: SCPH-110 (EU)
-#define ID_ANS_CTRL 0x5A53 // analog/stick: SCPH-110 (EU)
-#define ID_DS2_CTRL 0x5A79 // dualshock 2
-#define ID_GUNCON_CTRL 0x5A63 // light gun: NPC-103 (EU)
-
-/* PlayStation Commands */
-#define CMD_SEL_CTRL_1 0x01 // select controller 1
-#define CMD_SEL_MEMC_1 0x81 // select memory card 1
-#define CMD_READ_SW 0x42 // read switch status from controller
-
-/* PlayStation Communication Buff Size */
-#define PS1_CTRL_BUFF_SIZE 9 // max size of buffer needed for a controller
+#if defined(DEBUG) && (defined(PS1_STATS) || defined(JOURNAL))
+#define UART_RX
+#endif
 
-/* Key Combo */
-#define KEY_COMBO_CTRL 0xFCF6       // select-start-L2-R2   1111 1100 1111 0110
-#define KEY_COMBO_GUNCON 0x9FF7     // A-trigger-B          1001 1111 1111 0111
-#define KEY_COMBO_XSTATION 0xBCFE   // select-cross-L2-R2   1011 1100 1111 1110
+#ifdef PORT2
+#define SS_LOW() HAL_SEL_LOW() // RA5, CLC1: either port selected
+#else
+#define SS_LOW() HAL_SS_LOW()
+#endif
 
-/*
-Keys : 
-    SELECT, // 0
-    L3,
-    R3,
-    START, // light gun A
-    UP,
-    RIGHT,
-    DOWN,
-    LEFT,
-    L2,
-    R2,
-    L1,
-    R1,
-    TRIANGLE,
-    CIRCLE, // light gun trigger
-    CROSS, // light gun B
-    SQUARE
-*/
-
-
-/* PlayStation Controller Command Union */
-union PS1_Cmd{
-    uint8_t buff[PS1_CTRL_BUFF_SIZE];
-    struct{
-        uint8_t device_select; // 0x01 or 0x81
-        uint8_t command; // 0x42 for read switch
-        uint8_t unused[PS1_CTRL_BUFF_SIZE-2]; // always 0 for controller
-    };
-};
-
-/* PlayStation Controller Data Union */
-union PS1_Ctrl_Data{
-    uint8_t buff[PS1_CTRL_BUFF_SIZE]; // buffer to read data
-    struct{
-        uint8_t unused; // always 0xFF
-        uint16_t id; // 0x5Ayz - y = type; z = # of half word
-        uint16_t switches; // controller switches
-        union{
-            // light gun only (8MHz clock counter since hsync)
-            uint16_t x_pos; // if 0x0001 then error, check y_pos
-            struct{
-                uint8_t adc0; // right joy X
-                uint8_t adc1; // right joy Y
-            };
-        };
-        union{
-            //light gun only (scanlines since vsync)
-            uint16_t y_pos; // if x_pos = 0x0001 && y_pos = 0x000A => not aimed at screen
-            struct{
-                uint8_t adc2; // left joy X
-                uint8_t adc3; // left joy Y
-            };
-        };
-    };
-};
-
-/* Global variables */
-volatile union PS1_Cmd cmd;
-volatile union PS1_Ctrl_Data data;
-volatile uint8_t cmd_cnt, data_cnt;
+#ifdef HW_TIMING
+#define SS_STAMP() HAL_SS_STAMP() // CCP1 capture of the edge
+#else
+#define SS_STAMP() HAL_TIMER_NOW() // TMR1 when the ISR gets to it
+#endif
 
 /* Function prototype */
-void reverse_byte(uint8_t *b);
-void clear_buff(uint8_t *p, uint8_t s);
-void __delay_s(uint8_t s);
-
-void reset_short(void);
-void reset_long(void);
+#ifdef UART_RX
+volatile uint8_t uart_query; // byte received on RC4: 'J' journal, else counters
+#endif
 
 #ifdef DEBUG
 void UART_init(void);
-void UART_sendByte(uint8_t c);
-void UART_print(uint8_t *str);
-void UART_printHex(uint8_t b);
+void UART_print(const char *str);
+void UART_frame(const struct PS1_Frame *f);
 #else
-#define UART_init(a)
-#define UART_sendByte(a) 
-#define UART_print(a) 
-#define UART_printHex(a) 
+#define UART_init(a) ((void)0)
+#define UART_print(a) ((void)0)
+#define UART_frame(a) ((void)0)
+#endif
+
+#ifdef JOURNAL
+uint8_t journal_nvm; // dump going to data EEPROM, else to the UART
+uint8_t journal_addr; // next EEPROM byte
+void journal_save(void);
+void journal_out(void);
 #endif
 
 
 /* Interrupt */
 void __interrupt() _spi_int(void) {    
-    // SPI1 interrupt
-    if (PIR1bits.SSP1IF){
-        if (data_cnt < PS1_CTRL_BUFF_SIZE){
-            data.buff[data_cnt] = SSP1BUF;
-            data_cnt++;
-        }
-        PIR1bits.SSP1IF = 0; // clear SPI1 flag
+    uint8_t c, d, fault;
+#ifdef DEBUG
+    uint8_t b;
+#endif
+#ifdef PS1_STATS
+    uint16_t t0;
+#endif
+    // SPI1 and SPI2 share SS and SCK, so both flags are set on the same
+    // edge: only SPI1 interrupts and the CMD byte is read alongside
+    if (HAL_DATA_READY()){
+#ifdef PS1_STATS
+        t0 = HAL_CYCLES();
+#endif
+        fault = (HAL_SPI_OVERFLOW() ? GUARD_SSPOV : 0) | (HAL_SPI_COLLISION() ? GUARD_WCOL : 0) |
+            (HAL_CMD_READY() ? 0 : GUARD_PAIR);
+        c = HAL_CMD_READ();
+        d = HAL_DATA_READ();
+        if (ps1_guard_spi(fault))
+            ps1_capture_byte(c, d);
+        HAL_DATA_CLEAR(); // clear SPI1 flag
+        HAL_CMD_CLEAR(); // clear SPI2 flag
+        STAT_TIME(isr, t0, HAL_CYCLES());
     }
-    // SPI2 interrupt
-    if (PIR2bits.SSP2IF){
-        if (cmd_cnt < PS1_CTRL_BUFF_SIZE){
-            cmd.buff[cmd_cnt] = SSP2BUF;
-            cmd_cnt++;
-        }
-        PIR2bits.SSP2IF = 0; // clear SPI2 flag
+#ifdef HW_TIMING
+    // SS high, the transaction as the timers saw it, after SPI so its
+    // last byte is in
+    if (HAL_TX_DONE()){
+        HAL_TX_CLEAR(); // clear TMR3 gate flag
+        ps1_capture_end(HAL_TX_WIDTH(), HAL_TX_BITS());
+        HAL_TX_REARM();
     }
+#endif
+    // SS falling edge, after SPI so the last byte of the previous
+    // transaction is in before the byte index goes back to 0
+    if (HAL_SS_EDGE()){
+        HAL_SS_CLEAR(); // clear IOC flag
+        ps1_guard_edge();
+        ps1_capture_start(0, SS_STAMP());
+    }
+#ifdef PORT2
+    if (HAL_SS2_EDGE()){
+        HAL_SS2_CLEAR(); // clear IOC flag
+        ps1_guard_edge();
+        ps1_capture_start(1, SS_STAMP());
+    }
+#endif
+    // 1 ms tick, reset pulse and lockout, SS stuck low
+    if (HAL_TICK_READY()){
+        HAL_TICK_CLEAR(); // clear TMR2 flag
+        if (ps1_reset_tick())
+            HAL_RESET_ASSERT(); // output, logic low (PORT is already 0)
+        else
+            HAL_RESET_RELEASE(); // back to input
+        ps1_guard_tick(SS_LOW());
+    }
+    // The MSSPs are wedged or out of step, restart them, the transaction
+    // is lost
+    if (guard.restart){
+        HAL_SPI_RESTART();
+        ps1_guard_restart();
+    }
+#ifdef DEBUG
+    // UART TX, send the next trace byte or stop until there is one
+    if (HAL_UART_READY()){
+        if (ps1_trace_get(&b))
+            HAL_UART_WRITE(b);
+        else
+            HAL_UART_IDLE();
+    }
+#ifdef UART_RX
+    // UART RX, a query for the journal or the counters
+    if (HAL_UART_RX_READY())
+        uart_query = HAL_UART_READ();
+#endif
+#endif
 }
 
 /* Main */
 void main(void){
-    uint8_t i;
+    uint8_t action, i;
+#ifdef PS1_STATS
+    uint16_t t0;
+#endif
+    struct PS1_Frame *frame;
+    struct PS1_Port pads[PS1_PADS]; // combo held, per port and multitap slot
     
     // SETUP I/O
     ANSELA = 0; // port A is digital IO
@@ -203,16 +259,41 @@ void main(void){
     ANSELC = 0; // port C is digital IO
     
     PS1_LAT_IO &= ~_BV(PS1_RESET); // clear reset output 
-    PS1_TRIS_IO |= _BV(PS1_RESET); // set reset pin to input
+    HAL_RESET_RELEASE(); // set reset pin to input
 
     TRISAbits.TRISA2 = 1; // SS set to input
     TRISCbits.TRISC0 = 1; // SCK set to input
     TRISCbits.TRISC1 = 1; // SDI1 set to input
     TRISCbits.TRISC2 = 1; // SDI2 set to input
     
+    // SETUP clock, divide the 32MHz HFINTOSC PLL down to FOSC_MHZ
+    OSCCON1bits.NDIV = OSC_NDIV; // NOSC stays as RSTOSC, HFINTOSC 2x PLL
+    while (!OSCCON3bits.ORDY); // wait for the switch
+    
     // SETUP SPI1 & SPI2 I/O
+#ifdef PORT2
+    // SETUP CLC1, RA5 = SEL1 AND SEL2: low while either port is selected
+    TRISAbits.TRISA4 = 1; // SEL2 set to input
+    TRISAbits.TRISA5 = 0; // CLC1 output
+    CLCIN0PPSbits.CLCIN0PPS = 0x02; // CLCIN0 = RA2
+    CLCIN1PPSbits.CLCIN1PPS = 0x04; // CLCIN1 = RA4
+    CLC1SEL0bits.LC1D1S = 0; // data 1 = CLCIN0
+    CLC1SEL1bits.LC1D2S = 1; // data 2 = CLCIN1
+    CLC1GLS0 = 0x02; // gate 1 = data 1
+    CLC1GLS1 = 0x08; // gate 2 = data 2
+    CLC1GLS2 = 0; // gates 3 and 4 unused, 0
+    CLC1GLS3 = 0;
+    CLC1POL = 0x0C; // inverted to 1 so they don't hold the AND low
+    CLC1CONbits.LC1MODE = 2; // 4 input AND
+    RA5PPSbits.RA5PPS = 0x04; // CLC1OUT = RA5
+    CLC1CONbits.LC1EN = 1; // enable CLC1
+    
+    SSP1SSPPSbits.SSP1SSPPS = 0x05; // SS1 = RA5
+    SSP2SSPPSbits.SSP2SSPPS = 0x05; // SS2 = RA5
+#else
     SSP1SSPPSbits.SSP1SSPPS = 0x02; // SS1 = RA2 
     SSP2SSPPSbits.SSP2SSPPS = 0x02; // SS2 = RA2 
+#endif
     
     SSP1CLKPPSbits.SSP1CLKPPS = 0x10; // SCK1 = RC0
     SSP2CLKPPSbits.SSP2CLKPPS = 0x10; // SCK2 = RC0
@@ -225,156 +306,201 @@ void main(void){
     SSP1STATbits.CKE = 0; // transmit from idle to active
     SSP1CON1bits.CKP = 1; // clock idle high
     SSP1CON1bits.SSPM = 0x04; // slave mode: clk = sck pin; SS enabled
-    SSP1CON3bits.BOEN = 1; // ignore BF flag
+    SSP1CON3bits.BOEN = 0; // overflow sets SSPOV, see ps1_guard.h
     SSP1CON1bits.SSPEN = 1; // enable SPI1
     
     SSP2STATbits.SMP = 0; // slave mode SPI2
     SSP2STATbits.CKE = 0; // transmit from idle to active
     SSP2CON1bits.CKP = 1; // clock idle = high
     SSP2CON1bits.SSPM = 0x04; // slave mode: clk = sck pin; SS enabled
-    SSP2CON3bits.BOEN = 1; // ignore BF flag
+    SSP2CON3bits.BOEN = 0; // overflow sets SSPOV
     SSP2CON1bits.SSPEN = 1; // enable SPI2
     
     SSP1BUF = 0xFF;
     SSP2BUF = 0xFF;
     
+    // SETUP TMR1, free running 1MHz time base for transaction timestamps
+    T1CONbits.TMR1CS = 0; // Fosc/4
+    T1CONbits.T1CKPS = TMR1_CKPS; // 1MHz
+    T1CONbits.TMR1ON = 1; // start TMR1
+    
+#ifdef HW_TIMING
+#ifdef PORT2
+#define SS_PPS 0x05 // RA5, CLC1: either port selected
+#else
+#define SS_PPS 0x02 // RA2
+#endif
+    // SETUP CCP1, captures TMR1 on every SS falling edge
+    CCP1PPS = SS_PPS;
+    CCPTMRSbits.C1TSEL = 1; // TMR1
+    CCP1CONbits.CCP1MODE = 4; // capture, every falling edge
+    CCP1CONbits.CCP1EN = 1;
+    
+    // SETUP TMR3, 1MHz while SS is low: transaction width
+    T3CONbits.TMR3CS = 0; // Fosc/4
+    T3CONbits.T3CKPS = TMR1_CKPS; // 1MHz, as TMR1
+    T3GPPS = SS_PPS; // T3G = SS
+    T3GCONbits.T3GSS = 0; // gate from the T3G pin
+    T3GCONbits.T3GPOL = 0; // counts while low
+    T3GCONbits.T3GSPM = 1; // single pulse, one transaction at a time
+    T3GCONbits.TMR3GE = 1;
+    T3CONbits.TMR3ON = 1;
+    
+    // SETUP TMR5, SCK rising edges while SS is low: bits in the transaction
+    T5CKIPPS = 0x10; // T5CKI = RC0, SCK
+    T5CONbits.TMR5CS = 2; // T5CKI pin
+    T5CONbits.T5CKPS = 0; // 1:1
+    T5GPPS = SS_PPS; // T5G = SS
+    T5GCONbits.T5GSS = 0;
+    T5GCONbits.T5GPOL = 0;
+    T5GCONbits.T5GSPM = 1;
+    T5GCONbits.TMR5GE = 1;
+    T5CONbits.TMR5ON = 1;
+    HAL_TX_REARM();
+#endif
+    
+    // SETUP TMR2, 1 ms tick
+    T2CONbits.T2CKPS = TMR2_CKPS;
+    T2CONbits.T2OUTPS = 0; // 1:1 postscaler
+    PR2 = TMR2_PR;
+    T2CONbits.TMR2ON = 1; // start TMR2
+    
+#ifdef PS1_STATS
+    // SETUP TMR0, 16 bit free running at Fosc/4, instruction cycle counter
+    T0CON0bits.T016BIT = 1; // 16 bit
+    T0CON1bits.T0CS = 2; // Fosc/4
+    T0CON1bits.T0CKPS = 0; // 1:1 prescaler
+    T0CON0bits.T0EN = 1; // start TMR0
+#endif
+    
+    // SETUP SS edge, interrupt on change
+    IOCANbits.IOCAN2 = 1; // RA2 falling edge
+    IOCAPbits.IOCAP2 = 0; // no rising edge
+#ifdef PORT2
+    IOCANbits.IOCAN4 = 1; // RA4 falling edge, port 2
+    IOCAPbits.IOCAP4 = 0; // no rising edge
+#endif
+    
     // DEBUG
     UART_init();
-    UART_print((uint8_t*)"PlayStation 1 mod:\n\r");
+    UART_print("PlayStation 1 mod");
     
     // SETUP variables and arrays
-    data_cnt = 0;
-    cmd_cnt = 0;
-    
-    clear_buff((uint8_t*)cmd.buff, PS1_CTRL_BUFF_SIZE);
-    clear_buff((uint8_t*)data.buff, PS1_CTRL_BUFF_SIZE);
-    
-    // delay before enabling interrupts
-    __delay_s(REBOOT_DELAY); // wait 20 sec before next reset
+    ps1_capture_init();
+    ps1_guard_init();
+    for (i = 0; i < PS1_PADS; i++)
+        ps1_port_init(&pads[i]);
+    if (ps1_combo_load(hal_eeprom_read) == COMBO_SRC_EEPROM)
+        UART_print("EEPROM combos");
+    ps1_stats_init();
+    ps1_reset_init(REBOOT_DELAY * 1000u); // armed once the bus is up, 20 sec at most
+#ifdef JOURNAL
+    ps1_journal_init();
+    if (HAL_WDT_RESET())
+        ps1_journal_event(J_EV_WATCHDOG);
+#endif
+    if (HAL_WDT_RESET())
+        UART_print("Watchdog reset");
+    HAL_WDT_RESET_CLEAR();
     
     // SETUP INTERRUPTS
     PIR1bits.SSP1IF = 0; // clear SPI1 flag
     PIR2bits.SSP2IF = 0; // clear SPI2 flag
     PIE1bits.SSP1IE = 1; // enable MSSP interrupt (SPI1)
-    PIE2bits.SSP2IE = 1; // enable MSSP interrupt (SPI2)
+    PIE2bits.SSP2IE = 0; // SPI2 is read in the SPI1 interrupt
+    IOCAFbits.IOCAF2 = 0; // clear SS edge flag
+    IOCAFbits.IOCAF4 = 0; // clear port 2 SS edge flag
+    PIE0bits.IOCIE = 1; // enable interrupt on change (SS)
+    PIR1bits.TMR2IF = 0; // clear TMR2 flag
+    PIE1bits.TMR2IE = 1; // enable TMR2 interrupt (tick)
+#ifdef HW_TIMING
+    HAL_TX_CLEAR(); // clear TMR3 gate flag
+    PIE5bits.TMR3GIE = 1; // enable TMR3 gate interrupt (SS high)
+#endif
        
     INTCONbits.PEIE = 1; // peripheral interrupt enable
     INTCONbits.GIE = 1; // global interrupt enable
+    
+    // SETUP watchdog, cleared every main loop pass while the capture works
+    HAL_WDT_START();
        
     // MAIN LOOP
     for(;;){
-        if (data_cnt >= PS1_CTRL_BUFF_SIZE || cmd_cnt >= PS1_CTRL_BUFF_SIZE){
-            INTCONbits.PEIE = 0; // peripheral interrupt disable
-            UART_print((uint8_t*)"\n\rCMD: ");
-            for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-                reverse_byte((uint8_t*)&cmd.buff[i]);
-                UART_printHex((uint8_t)cmd.buff[i]);
-                UART_print((uint8_t*)" ");
-            }
-            UART_print((uint8_t*)"\n\rDATA: ");
-            for (i = 0; i < PS1_CTRL_BUFF_SIZE; i++){
-                reverse_byte((uint8_t*)&data.buff[i]);
-                UART_printHex((uint8_t)data.buff[i]);
-                UART_print((uint8_t*)" ");
-            }
-            UART_print((uint8_t*)"\n\rData done converting");
+        if (ps1_guard_alive())
+            HAL_WDT_CLEAR(); // else restarting the MSSPs didn't help, reboot
+        
+        // Decode the oldest complete frame, capture keeps running meanwhile
+        frame = ps1_capture_peek();
+        if (frame){
+            UART_frame(frame);
+#ifdef JOURNAL
+            ps1_journal_frame(frame);
+#endif
             
-            // Check first command for device selected
-            if (cmd.device_select == CMD_SEL_CTRL_1 && cmd.command == CMD_READ_SW){
-                // Check ID
-                switch(data.id){
-                    case ID_GUNCON_CTRL:
-                        // Check switch combo
-                        switch(data.switches){
-                            case KEY_COMBO_GUNCON:
-                                reset_long();
-                                break;
-                        }
-                        break;
-                    case ID_DIG_CTRL:
-                    case ID_ANS_CTRL:
-                    case ID_ANP_CTRL:
-                    case ID_DS2_CTRL:
-                        // Check switch combo
-                        switch(data.switches){
-                            case KEY_COMBO_CTRL:
-                                reset_short();
-                                break;
-                            case KEY_COMBO_XSTATION:
-                                reset_long();
-                                break;
-                        }
-                        break;
-                }
-            }
-
-            clear_buff((uint8_t*)data.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-            clear_buff((uint8_t*)cmd.buff, PS1_CTRL_BUFF_SIZE); // clear controller stuff
-    
-            data_cnt = 0; // reset counters
-            cmd_cnt = 0; // reset counters
+#ifdef PS1_STATS
+            t0 = HAL_CYCLES();
+#endif
+            // Check frame for a held key combo, the tick does the rest
+            action = ps1_decode(&pads[frame->pad], &frame->cmd, &frame->data, frame->stamp);
+            ps1_capture_release(); // hand the frame back to the ISR
+            ps1_guard_frame();
+            STAT_TIME(decode, t0, HAL_CYCLES());
+#ifdef JOURNAL
+            if (ps1_journal_action(action))
+                journal_save(); // what led up to it
+#endif
             
-            PIR1bits.SSP1IF = 0; // clear SPI1 flag
-            PIR2bits.SSP2IF = 0; // clear SPI2 flag
-            INTCONbits.PEIE = 1; // peripheral interrupt enable
+            if (action != PS1_ACT_NONE && reset.state == PS1_RST_IDLE)
+                UART_print(card.idle_ms < CARD_IDLE_MS ? "Reset after save" :
+                    action == PS1_ACT_SHORT ? "Short Reset" : "Long Reset");
+            HAL_TICK_MASK(); // the tick takes reset.poll and clears it
+            ps1_reset_poll(action);
+            HAL_TICK_UNMASK();
+        }
+#ifdef LOW_POWER
+        else{
+            // Nothing to decode, IDLE until the next interrupt. With GIE off
+            // a frame queued after the peek above still wakes the core (or
+            // turns SLEEP into a NOP), the ISR then runs once GIE is back on.
+            // SLEEP clears the watchdog and running out in IDLE only wakes
+            // the core: once the guard gave up, spin so it resets the chip
+            INTCONbits.GIE = 0;
+            if (!ps1_capture_peek() && ps1_guard_alive())
+                HAL_IDLE();
+            INTCONbits.GIE = 1;
+        }
+#endif
+        
+#ifdef UART_RX
+        if (uart_query){
+#ifdef JOURNAL
+            if (uart_query == 'J'){
+                if (ps1_journal_open(0xFFFF))
+                    journal_nvm = 0;
+            }else
+#endif
+            {
+#ifdef PS1_STATS
+                ps1_trace_stats();
+                HAL_UART_KICK();
+#endif
+            }
+            uart_query = 0;
         }
+#endif
+#ifdef JOURNAL
+        journal_out();
+#endif
     }
     
     for(;;);
 }
 
-/* Reverse byte order 
- * The playstation send data LSb first,
- * but the PIC uses a shift left register
- * so the LSb from the PS1 becomes the MSb of the PIC
-*/
-void reverse_byte(uint8_t *b) {
-   *b = (*b & 0xF0) >> 4 | (*b & 0x0F) << 4;
-   *b = (*b & 0xCC) >> 2 | (*b & 0x33) << 2;
-   *b = (*b & 0xAA) >> 1 | (*b & 0x55) << 1;
-}
-
-/* Clear buffer of size s, aka fill with zero */
-void clear_buff(uint8_t *p, uint8_t s){
-    uint8_t i;
-    for (i = 0; i < s; i++)
-        p[i] = 0;
-}
-
-/* delay in seconds */
-void __delay_s(uint8_t s){
-    for (; s > 0; s--)
-        __delay_ms(1000);
-}
-
-
-void reset_short(void){
-    UART_print((uint8_t*)"\n\rShort Reset successful\n\r");
-    // change RESET pin from input to output, logic low (PORT is already 0)
-    PS1_TRIS_IO &= ~_BV(PS1_RESET);
-    __delay_ms(SHORT_DELAY); // hold reset for 500ms
-    // change RESET back to input
-    PS1_TRIS_IO |= _BV(PS1_RESET);
-    // hold the mcu from resetting too early, just in case
-    __delay_s(REBOOT_DELAY);
-}
-
-void reset_long(void){
-    UART_print((uint8_t*)"\n\rLong Reset successful\n\r");
-    // change RESET pin from input to output, logic low (PORT is already 0)
-    PS1_TRIS_IO &= ~_BV(PS1_RESET);
-    __delay_s(LONG_DELAY); // hold reset for 2s
-    // change RESET back to input
-    PS1_TRIS_IO |= _BV(PS1_RESET);
-    // hold the mcu from resetting too early, just in case
-    __delay_s(REBOOT_DELAY);
-}
-
 #ifdef DEBUG
 /**********************************************************/
 /* UART Debug Functions */
 
-/* Initialize UART with TX on output RC3 */
+/* Initialize UART with TX on output RC3, 500000 baud */
 void UART_init(void){
     // SETUP UART
     ANSELCbits.ANSC3 = 0; // TX set to digital I/O
@@ -382,41 +508,78 @@ void UART_init(void){
     TRISCbits.TRISC3 = 0; // TX set to output
     RC3PPSbits.RC3PPS = 0x14; // TX = RC3
 
-    SP1BRGL = 51; // 9615 baud
-    SP1BRGH = 0; // 9615 baud
+    SP1BRGL = _XTAL_FREQ / 4 / 500000 - 1; // 500000 baud: Fosc / (4 * (n + 1))
+    SP1BRGH = 0; // 500000 baud
     
     TX1STAbits.SYNC = 0; // Asynch mode
     RC1STAbits.SPEN = 1; // Serial Port enable bit
-    TX1STAbits.BRGH = 0; // low speed
-    BAUD1CONbits.BRG16 = 0; // 8 bit baud rate
+    TX1STAbits.BRGH = 1; // high speed
+    BAUD1CONbits.BRG16 = 1; // 16 bit baud rate
     BAUD1CONbits.SCKP = 0; // Idle state for TX high level
     CLKRCONbits.CLKRDIV = 0; // Fosc
     CLKRCONbits.CLKRDC = 2; // 50% duty cyle
     CLKRCONbits.CLKREN = 1; // Enable CLK reference
     
+    ps1_trace_init();
     TX1STAbits.TXEN = 1; // Enable transmitter  
+    
+#ifdef UART_RX
+    // SETUP RX on RC4 for journal and counter queries
+    ANSELCbits.ANSC4 = 0; // RX set to digital I/O
+    TRISCbits.TRISC4 = 1; // RX set to input
+    RXPPSbits.RXPPS = 0x14; // RX = RC4
+    RC1STAbits.CREN = 1; // Enable receiver
+    PIE1bits.RCIE = 1; // enable UART RX interrupt
+#endif
 }
 
-/* Send byte and wait until transfer finished */
-void UART_sendByte(uint8_t c){
-    TX1REG = c;
-    while(!TX1STAbits.TRMT);
+/* Queue a message, the UART interrupt sends it */
+void UART_print(const char *str){
+    ps1_trace_text(str);
+    HAL_UART_KICK();
 }
 
-/* Send string */
-void UART_print(uint8_t *str){
-    uint8_t i;
-    for (i = 0; str[i] != 0 && i < 255; i++)
-        UART_sendByte(str[i]);
+/* Queue a captured frame, the UART interrupt sends it */
+void UART_frame(const struct PS1_Frame *f){
+    ps1_trace_frame(f);
+    HAL_UART_KICK();
 }
+#endif
 
-/* Print hex byte in format 0x%02X */
-void UART_printHex(uint8_t b){
-    uint8_t low_nibble = b & 0x0F;
-    uint8_t high_nibble = (b >> 4) & 0x0F;
-    
-    UART_print((uint8_t*)"0x");
-    UART_sendByte(high_nibble >= 10 ? (high_nibble - 10 + 'A') : high_nibble + '0');
-    UART_sendByte(low_nibble >= 10 ? (low_nibble - 10 + 'A') : low_nibble + '0');
+#ifdef JOURNAL
+/**********************************************************/
+/* Journal dump */
+
+/* A reset was decided: save the journal, as much as JOURNAL_NVM_SIZE holds */
+void journal_save(void){
+#if defined(JOURNAL_NVM)
+    if (ps1_journal_open(JOURNAL_NVM_SIZE)){
+        journal_nvm = 1;
+        journal_addr = JOURNAL_NVM_ADDR;
+    }
+#elif defined(DEBUG)
+    if (ps1_journal_open(0xFFFF))
+        journal_nvm = 0;
+#endif
+}
+
+/* Dump going out: a byte into EEPROM once the last write is done, or a
+ * piece on the trace once there's room for it */
+void journal_out(void){
+    uint8_t b;
+    if (!journal.out)
+        return;
+#ifdef JOURNAL_NVM
+    if (journal_nvm){
+        if (!HAL_EEPROM_BUSY() && ps1_journal_get(&b))
+            hal_eeprom_write(journal_addr++, b);
+        return;
+    }
+#endif
+#ifdef DEBUG
+    if (ps1_trace_journal())
+        HAL_UART_KICK();
+#endif
+    (void)b;
 }
 #endif
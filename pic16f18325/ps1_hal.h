@@ -0,0 +1,163 @@
+/*
+ * File:   ps1_hal.h
+ * Author: pyroesp
+ *
+ * Register access for the PIC16F18325, kept out of the protocol core.
+ * Include after <xc.h>.
+ */
+
+#ifndef PS1_HAL_H
+#define PS1_HAL_H
+
+#define _BV(b) (1<<(b))
+
+/* Reset port */
+#define PS1_LAT_IO LATC // IO port reg used for RESET
+#define PS1_TRIS_IO TRISC // IO dir reg used for RESET
+#define PS1_RESET 5 // Only IO that outputs a logic 0
+
+/* RESET is open drain: output low to reset, input to release */
+#define HAL_RESET_ASSERT() (PS1_TRIS_IO &= ~_BV(PS1_RESET))
+#define HAL_RESET_RELEASE() (PS1_TRIS_IO |= _BV(PS1_RESET))
+
+/* SPI1 receives DATA (controller -> PS1) */
+#define HAL_DATA_READY() (PIR1bits.SSP1IF)
+#define HAL_DATA_READ() (SSP1BUF)
+#define HAL_DATA_CLEAR() (PIR1bits.SSP1IF = 0)
+
+/* SPI2 receives CMD (PS1 -> controller) */
+#define HAL_CMD_READY() (PIR2bits.SSP2IF)
+#define HAL_CMD_READ() (SSP2BUF)
+#define HAL_CMD_CLEAR() (PIR2bits.SSP2IF = 0)
+
+/* SS (RA2) falling edge, interrupt on change */
+#define HAL_SS_EDGE() (IOCAFbits.IOCAF2)
+#define HAL_SS_CLEAR() (IOCAFbits.IOCAF2 = 0)
+
+/* Port 2 SEL (RA4) falling edge, PORT2 */
+#define HAL_SS2_EDGE() (IOCAFbits.IOCAF4)
+#define HAL_SS2_CLEAR() (IOCAFbits.IOCAF4 = 0)
+
+/* TMR1 runs free at 1MHz, read the high byte twice in case the low byte
+ * rolls over in between */
+static inline uint16_t hal_timer_now(void){
+    uint8_t h, l;
+    do {
+        h = TMR1H;
+        l = TMR1L;
+    } while (h != TMR1H);
+    return (uint16_t)h << 8 | l;
+}
+#define HAL_TIMER_NOW() hal_timer_now()
+
+/* HW_TIMING: CCP1 captured TMR1 on the SS falling edge, no ISR latency */
+#define HAL_SS_STAMP() ((uint16_t)CCPR1H << 8 | CCPR1L)
+
+/* HW_TIMING: SS went high. TMR3 (1MHz) and TMR5 (SCK rising edges) are
+ * gated by SS low in single pulse mode, the gate interrupt of TMR3 fires
+ * once both have stopped. Clear and arm them again for the next one. */
+#define HAL_TX_DONE() (PIR5bits.TMR3GIF)
+#define HAL_TX_CLEAR() (PIR5bits.TMR3GIF = 0)
+#define HAL_TX_WIDTH() ((uint16_t)TMR3H << 8 | TMR3L)
+#define HAL_TX_BITS() ((uint16_t)TMR5H << 8 | TMR5L)
+#define HAL_TX_REARM() (TMR3H = 0, TMR3L = 0, TMR5H = 0, TMR5L = 0, \
+    T3GCONbits.T3GGO = 1, T5GCONbits.T5GGO = 1)
+
+/* TMR0 16 bit at Fosc/4, instruction cycle counter for PS1_STATS.
+ * Reading TMR0L latches the high byte into TMR0H, so low byte first */
+static inline uint16_t hal_cycles(void){
+    uint8_t l = TMR0L;
+    return (uint16_t)TMR0H << 8 | l;
+}
+#define HAL_CYCLES() hal_cycles()
+
+/* Data EEPROM byte (0xF000 + addr), combo table for ps1_combo_load */
+static inline uint8_t hal_eeprom_read(uint8_t addr){
+    NVMADRH = 0xF0; // EEPROM at 0xF000
+    NVMADRL = addr;
+    NVMCON1bits.NVMREGS = 1; // EEPROM/config space
+    NVMCON1bits.RD = 1;
+    return NVMDATL;
+}
+
+/* Data EEPROM write, JOURNAL_NVM: starts it and returns, the main loop
+ * waits for HAL_EEPROM_BUSY() to clear before the next one (~4 ms).
+ * Interrupts are off for the unlock sequence only. */
+static inline void hal_eeprom_write(uint8_t addr, uint8_t b){
+    NVMADRH = 0xF0; // EEPROM at 0xF000
+    NVMADRL = addr;
+    NVMDATL = b;
+    NVMCON1bits.NVMREGS = 1; // EEPROM/config space
+    NVMCON1bits.WREN = 1;
+    INTCONbits.GIE = 0;
+    NVMCON2 = 0x55;
+    NVMCON2 = 0xAA;
+    NVMCON1bits.WR = 1;
+    INTCONbits.GIE = 1;
+    NVMCON1bits.WREN = 0;
+}
+#define HAL_EEPROM_BUSY() (NVMCON1bits.WR)
+
+/* MSSP receive overflow, a byte came in before SSPxBUF was read */
+#define HAL_SPI_OVERFLOW() (SSP1CON1bits.SSPOV || SSP2CON1bits.SSPOV)
+
+/* MSSP write collision, SSPxBUF written while a byte was shifting */
+#define HAL_SPI_COLLISION() (SSP1CON1bits.WCOL || SSP2CON1bits.WCOL)
+
+/* Restart both MSSPs: SSPEN off resets the shift registers and the bit
+ * count, the buffers are read to clear BF, SSPOV and WCOL by hand.
+ * Takes a few µs, the bit count starts again on the next clock. */
+static inline void hal_spi_restart(void){
+    SSP1CON1bits.SSPEN = 0;
+    SSP2CON1bits.SSPEN = 0;
+    (void)SSP1BUF;
+    (void)SSP2BUF;
+    SSP1CON1bits.SSPOV = 0;
+    SSP2CON1bits.SSPOV = 0;
+    SSP1CON1bits.WCOL = 0;
+    SSP2CON1bits.WCOL = 0;
+    PIR1bits.SSP1IF = 0;
+    PIR2bits.SSP2IF = 0;
+    SSP1CON1bits.SSPEN = 1;
+    SSP2CON1bits.SSPEN = 1;
+}
+#define HAL_SPI_RESTART() hal_spi_restart()
+
+/* SS of the MSSPs is low: RA2, or RA5 (CLC1, either port) with PORT2 */
+#define HAL_SS_LOW() (!PORTAbits.RA2)
+#define HAL_SEL_LOW() (!PORTAbits.RA5)
+
+/* Watchdog, software enabled (WDTE = SWDTEN), ~64 ms */
+#define HAL_WDT_START() (WDTCONbits.WDTPS = 6, WDTCONbits.SWDTEN = 1) // 1:2048 of 31 kHz LFINTOSC
+#define HAL_WDT_CLEAR() CLRWDT()
+#define HAL_WDT_RESET() (!PCON0bits.nRWDT) // last reset came from the watchdog
+#define HAL_WDT_RESET_CLEAR() (PCON0bits.nRWDT = 1)
+
+/* TMR2 1 ms tick for the reset state machine, masked while the main loop
+ * posts a poll (ps1_reset_poll): the ISR leaves TMR2IF set until then */
+#define HAL_TICK_READY() (PIE1bits.TMR2IE && PIR1bits.TMR2IF)
+#define HAL_TICK_CLEAR() (PIR1bits.TMR2IF = 0)
+#define HAL_TICK_MASK() (PIE1bits.TMR2IE = 0)
+#define HAL_TICK_UNMASK() (PIE1bits.TMR2IE = 1)
+
+/* UART TX (DEBUG trace on RC3), interrupt driven */
+#define HAL_UART_READY() (PIE1bits.TXIE && PIR1bits.TXIF)
+#define HAL_UART_WRITE(b) (TX1REG = (b))
+#define HAL_UART_KICK() (PIE1bits.TXIE = 1) // bytes queued, start sending
+#define HAL_UART_IDLE() (PIE1bits.TXIE = 0) // nothing left to send
+
+/* UART RX (DEBUG queries on RC4) */
+#define HAL_UART_RX_READY() (PIR1bits.RCIF)
+#define HAL_UART_READ() (RC1REG) // clears RCIF
+
+/* IDLE: the CPU stops, Fosc keeps running the MSSP, timers and IOC.
+ * Not SLEEP: that stops HFINTOSC and TMR2, and the PLL takes longer to
+ * start than a byte lasts. Any enabled interrupt wakes the core, with
+ * GIE clear it carries on after SLEEP without going to the ISR. */
+static inline void hal_idle(void){
+    CPUDOZEbits.IDLEN = 1;
+    SLEEP();
+}
+#define HAL_IDLE() hal_idle()
+
+#endif